@@ -0,0 +1,342 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file anastasis-helper-authorization-command.c
+ * @brief long-lived helper that runs a one-shot authorization command
+ * @author Christian Grothoff
+ *
+ * Reference implementation of the helper protocol of the email, SMS
+ * and post authorization plugins (see anastasis_authorization_helper.c),
+ * and adapter for the existing one-shot commands.  Invoked as
+ *
+ *   anastasis-helper-authorization-command COMMAND [ARGUMENT...]
+ *
+ * it runs COMMAND with the given ARGUMENTs followed by the arguments
+ * of each request, feeds it the message of the request on stdin, and
+ * reports its exit status.  This saves the plugins from starting a
+ * process per challenge, but not from starting COMMAND itself; helpers
+ * that handle the requests themselves avoid that as well.
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <sys/wait.h>
+
+/**
+ * Largest request we accept.
+ */
+#define MAX_REQUEST_SIZE (16 * 1024 * 1024)
+
+/**
+ * Largest number of arguments we accept in a request.
+ */
+#define MAX_REQUEST_ARGS 1024
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a request, see `struct RequestHeader`
+ * in anastasis_authorization_helper.c.
+ */
+struct RequestHeader
+{
+  /**
+   * Total size of the request, including this header, in NBO.
+   */
+  uint32_t size;
+
+  /**
+   * Number of 0-terminated arguments following the header, in NBO.
+   */
+  uint32_t argc;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Read exactly @a size bytes from @a fd.
+ *
+ * @param fd file descriptor to read from
+ * @param[out] buf where to write the data
+ * @param size number of bytes to read
+ * @return #GNUNET_OK on success, #GNUNET_NO on end of file
+ *         before the first byte, #GNUNET_SYSERR on errors
+ */
+static enum GNUNET_GenericReturnValue
+read_all (int fd,
+          void *buf,
+          size_t size)
+{
+  size_t off = 0;
+
+  while (off < size)
+  {
+    ssize_t ret;
+
+    ret = read (fd,
+                ((char *) buf) + off,
+                size - off);
+    if ( (-1 == ret) &&
+         (EINTR == errno) )
+      continue;
+    if (0 == ret)
+      return (0 == off) ? GNUNET_NO : GNUNET_SYSERR;
+    if (ret < 0)
+      return GNUNET_SYSERR;
+    off += ret;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Write all @a size bytes of @a buf to @a fd.
+ *
+ * @param fd file descriptor to write to
+ * @param buf data to write
+ * @param size number of bytes to write
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+write_all (int fd,
+           const void *buf,
+           size_t size)
+{
+  size_t off = 0;
+
+  while (off < size)
+  {
+    ssize_t ret;
+
+    ret = write (fd,
+                 ((const char *) buf) + off,
+                 size - off);
+    if ( (-1 == ret) &&
+         (EINTR == errno) )
+      continue;
+    if (ret <= 0)
+      return GNUNET_SYSERR;
+    off += ret;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Run the command for one request.
+ *
+ * @param argv command line, NULL-terminated
+ * @param msg message to pass to the command on stdin
+ * @param msg_size number of bytes in @a msg
+ * @return status to report for the request
+ */
+static uint32_t
+run_command (char *const *argv,
+             const char *msg,
+             size_t msg_size)
+{
+  int p[2];
+  pid_t pid;
+  int status;
+
+  if (0 != pipe (p))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "pipe");
+    return 1;
+  }
+  pid = fork ();
+  if (-1 == pid)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "fork");
+    GNUNET_break (0 == close (p[0]));
+    GNUNET_break (0 == close (p[1]));
+    return 1;
+  }
+  if (0 == pid)
+  {
+    /* our stdout carries the responses, the command
+       must not write to it */
+    if ( (-1 == dup2 (p[0],
+                      STDIN_FILENO)) ||
+         (-1 == dup2 (STDERR_FILENO,
+                      STDOUT_FILENO)) )
+      _exit (1);
+    close (p[0]);
+    close (p[1]);
+    execvp (argv[0],
+            argv);
+    _exit (127);
+  }
+  GNUNET_break (0 == close (p[0]));
+  if (GNUNET_OK !=
+      write_all (p[1],
+                 msg,
+                 msg_size))
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Command `%s' did not read the whole message\n",
+                argv[0]);
+  GNUNET_break (0 == close (p[1]));
+  while (-1 == waitpid (pid,
+                        &status,
+                        0))
+  {
+    if (EINTR == errno)
+      continue;
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "waitpid");
+    return 1;
+  }
+  if (WIFEXITED (status))
+    return (uint32_t) WEXITSTATUS (status);
+  if (WIFSIGNALED (status))
+    return 128 + (uint32_t) WTERMSIG (status);
+  return 1;
+}
+
+
+/**
+ * Handle one request.
+ *
+ * @param cmd_argc number of arguments of the command itself
+ * @param cmd_argv arguments of the command itself
+ * @param req_argc number of arguments in @a req
+ * @param req request after the header
+ * @param req_size number of bytes in @a req
+ * @param[out] result set to the status to report
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the request
+ *         is malformed
+ */
+static enum GNUNET_GenericReturnValue
+handle_request (int cmd_argc,
+                char *const *cmd_argv,
+                uint32_t req_argc,
+                char *req,
+                size_t req_size,
+                uint32_t *result)
+{
+  char **argv;
+  size_t off = 0;
+
+  if ( (req_argc > req_size) ||
+       (req_argc > MAX_REQUEST_ARGS) )
+    return GNUNET_SYSERR;
+  argv = GNUNET_new_array (cmd_argc + req_argc + 1,
+                           char *);
+  for (int i = 0; i<cmd_argc; i++)
+    argv[i] = cmd_argv[i];
+  for (uint32_t i = 0; i<req_argc; i++)
+  {
+    const char *end;
+
+    end = memchr (&req[off],
+                  '\0',
+                  req_size - off);
+    if (NULL == end)
+    {
+      GNUNET_free (argv);
+      return GNUNET_SYSERR;
+    }
+    argv[cmd_argc + i] = &req[off];
+    off = end - req + 1;
+  }
+  argv[cmd_argc + req_argc] = NULL;
+  *result = run_command (argv,
+                         &req[off],
+                         req_size - off);
+  GNUNET_free (argv);
+  return GNUNET_OK;
+}
+
+
+/**
+ * The main function of the helper.
+ *
+ * @param argc number of arguments from the command line
+ * @param argv command line arguments
+ * @return 0 once our stdin was closed, 1 on errors
+ */
+int
+main (int argc,
+      char *const *argv)
+{
+  if (argc < 2)
+  {
+    fprintf (stderr,
+             "Usage: %s COMMAND [ARGUMENT...]\n",
+             argv[0]);
+    return 1;
+  }
+  GNUNET_log_setup ("anastasis-helper-authorization-command",
+                    "WARNING",
+                    NULL);
+  /* failed writes to the command are reported by write() */
+  (void) signal (SIGPIPE,
+                 SIG_IGN);
+  while (1)
+  {
+    struct RequestHeader hdr;
+    enum GNUNET_GenericReturnValue ret;
+    uint32_t size;
+    uint32_t result;
+    char *req;
+
+    ret = read_all (STDIN_FILENO,
+                    &hdr,
+                    sizeof (hdr));
+    if (GNUNET_NO == ret)
+      return 0; /* pool closed our stdin */
+    if (GNUNET_OK != ret)
+      return 1;
+    size = ntohl (hdr.size);
+    if ( (size < sizeof (hdr)) ||
+         (size > MAX_REQUEST_SIZE) )
+    {
+      GNUNET_break_op (0);
+      return 1;
+    }
+    size -= sizeof (hdr);
+    req = GNUNET_malloc (size + 1);
+    if ( (GNUNET_OK !=
+          read_all (STDIN_FILENO,
+                    req,
+                    size)) ||
+         (GNUNET_OK !=
+          handle_request (argc - 1,
+                          &argv[1],
+                          ntohl (hdr.argc),
+                          req,
+                          size,
+                          &result)) )
+    {
+      GNUNET_break_op (0);
+      GNUNET_free (req);
+      return 1;
+    }
+    GNUNET_free (req);
+    result = htonl (result);
+    if (GNUNET_OK !=
+        write_all (STDOUT_FILENO,
+                   &result,
+                   sizeof (result)))
+      return 1;
+  }
+}
+
+
+/* end of anastasis-helper-authorization-command.c */
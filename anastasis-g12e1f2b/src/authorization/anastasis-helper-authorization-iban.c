@@ -40,6 +40,50 @@
  */
 #define RETRY_TIMEOUT GNUNET_TIME_UNIT_MINUTES
 
+/**
+ * How many transfers do we request from the bank at once?  All
+ * transfers of one such page are stored in one transaction.
+ */
+#define BATCH_SIZE 1024
+
+
+/**
+ * Wire transfer received with the current page of the history
+ * and not yet stored in the database.
+ */
+struct PendingTransfer
+{
+  /**
+   * Row of the transfer at the bank.
+   */
+  uint64_t serial_id;
+
+  /**
+   * Subject of the transfer.
+   */
+  char *wire_subject;
+
+  /**
+   * Amount transferred.
+   */
+  struct TALER_Amount amount;
+
+  /**
+   * IBAN of the debited account.
+   */
+  char *debit_iban;
+
+  /**
+   * IBAN of the credited account.
+   */
+  char *credit_iban;
+
+  /**
+   * When was the transfer made?
+   */
+  struct GNUNET_TIME_Absolute execution_date;
+};
+
 /**
  * Authentication data needed to access the account.
  */
@@ -103,6 +147,21 @@ static int test_mode;
  */
 static struct GNUNET_SCHEDULER_Task *task;
 
+/**
+ * Transfers of the current page of the history.
+ */
+static struct PendingTransfer *batch;
+
+/**
+ * Number of valid entries in #batch.
+ */
+static unsigned int batch_len;
+
+/**
+ * Allocated length of #batch.
+ */
+static unsigned int batch_size;
+
 
 #include "iban.c"
 
@@ -144,14 +203,14 @@ payto_get_iban (const char *payto_uri)
 
 /**
  * Notify anastasis-http that we received @a amount
- * from @a sender_account_uri with @a code.
+ * from @a debit_iban with @a code.
  *
- * @param sender_account_uri payto:// URI of the sending account
+ * @param debit_iban IBAN of the sending account
  * @param code numeric code used in the wire transfer subject
  * @param amount the amount that was wired
  */
 static void
-notify (const char *sender_account_uri,
+notify (const char *debit_iban,
         uint64_t code,
         const struct TALER_Amount *amount)
 {
@@ -161,17 +220,14 @@ notify (const char *sender_account_uri,
     .code = GNUNET_htonll (code)
   };
   const char *as;
-  char *iban;
 
-  iban = payto_get_iban (sender_account_uri);
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Generating events for code %llu from %s\n",
               (unsigned long long) code,
-              iban);
-  GNUNET_CRYPTO_hash (iban,
-                      strlen (iban),
+              debit_iban);
+  GNUNET_CRYPTO_hash (debit_iban,
+                      strlen (debit_iban),
                       &ev.debit_iban_hash);
-  GNUNET_free (iban);
   as = TALER_amount2s (amount);
   db_plugin->event_notify (db_plugin->cls,
                            &ev.header,
@@ -180,6 +236,87 @@ notify (const char *sender_account_uri,
 }
 
 
+/**
+ * Forget all transfers in #batch.
+ */
+static void
+clear_batch (void)
+{
+  for (unsigned int i = 0; i<batch_len; i++)
+  {
+    struct PendingTransfer *pt = &batch[i];
+
+    GNUNET_free (pt->wire_subject);
+    GNUNET_free (pt->debit_iban);
+    GNUNET_free (pt->credit_iban);
+  }
+  batch_len = 0;
+}
+
+
+/**
+ * Store all transfers in #batch in one transaction, together with
+ * the notifications for anastasis-httpd, which are thus delivered
+ * once the transaction commits.
+ *
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+store_batch (void)
+{
+  enum GNUNET_DB_QueryStatus qs;
+
+  if (0 == batch_len)
+    return GNUNET_DB_STATUS_SUCCESS_NO_RESULTS;
+  if (GNUNET_OK !=
+      db_plugin->start (db_plugin->cls,
+                        "store wire transfers"))
+  {
+    GNUNET_break (0);
+    return GNUNET_DB_STATUS_HARD_ERROR;
+  }
+  for (unsigned int i = 0; i<batch_len; i++)
+  {
+    const struct PendingTransfer *pt = &batch[i];
+    uint64_t code;
+
+    qs = db_plugin->record_auth_iban_payment (db_plugin->cls,
+                                              pt->serial_id,
+                                              pt->wire_subject,
+                                              &pt->amount,
+                                              pt->debit_iban,
+                                              pt->credit_iban,
+                                              pt->execution_date);
+    if (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS == qs)
+    {
+      /* already existed (!?), should be impossible */
+      GNUNET_break (0);
+      qs = GNUNET_DB_STATUS_HARD_ERROR;
+    }
+    if (qs < 0)
+    {
+      db_plugin->rollback (db_plugin->cls);
+      return qs;
+    }
+    if (GNUNET_OK !=
+        extract_code (pt->wire_subject,
+                      &code))
+      continue;
+    notify (pt->debit_iban,
+            code,
+            &pt->amount);
+  }
+  qs = db_plugin->commit (db_plugin->cls);
+  if (qs < 0)
+    return qs;
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Stored %u wire transfers\n",
+              batch_len);
+  latest_row_off = batch[batch_len - 1].serial_id;
+  return GNUNET_DB_STATUS_SUCCESS_ONE_RESULT;
+}
+
+
 /**
  * We're being aborted with CTRL-C (or SIGTERM). Shut down.
  *
@@ -209,6 +346,10 @@ shutdown_task (void *cls)
     GNUNET_SCHEDULER_cancel (task);
     task = NULL;
   }
+  clear_batch ();
+  GNUNET_array_grow (batch,
+                     batch_size,
+                     0);
   ANASTASIS_DB_plugin_unload (db_plugin);
   db_plugin = NULL;
   ANASTASIS_EUFIN_auth_free (&auth);
@@ -243,10 +384,13 @@ history_cb (void *cls,
             uint64_t serial_id,
             const struct ANASTASIS_EUFIN_CreditDetails *details)
 {
-  enum GNUNET_DB_QueryStatus qs;
+  struct PendingTransfer *pt;
 
   if (NULL == details)
   {
+    enum GNUNET_DB_QueryStatus qs;
+    struct GNUNET_TIME_Relative delay = idle_sleep_interval;
+
     hh = NULL;
     if (TALER_EC_NONE != ec)
     {
@@ -257,23 +401,47 @@ history_cb (void *cls,
     }
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "End of list.\n");
+    qs = store_batch ();
+    clear_batch ();
+    switch (qs)
+    {
+    case GNUNET_DB_STATUS_HARD_ERROR:
+      GNUNET_break (0);
+      global_ret = EXIT_FAILURE;
+      GNUNET_SCHEDULER_shutdown ();
+      return GNUNET_SYSERR;
+    case GNUNET_DB_STATUS_SOFT_ERROR:
+      /* fetch the page again, starting from the last stored row */
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Serialization failure storing wire transfers, retrying\n");
+      delay = GNUNET_TIME_UNIT_ZERO;
+      break;
+    case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
+      break;
+    case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
+      /* there may be more transfers, ask again right away */
+      delay = GNUNET_TIME_UNIT_ZERO;
+      break;
+    }
     GNUNET_assert (NULL == task);
-    if (test_mode)
+    if ( (test_mode) &&
+         (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS == qs) )
     {
       GNUNET_SCHEDULER_shutdown ();
       return GNUNET_OK; /* will be ignored anyway */
     }
-    task = GNUNET_SCHEDULER_add_delayed (idle_sleep_interval,
+    task = GNUNET_SCHEDULER_add_delayed (delay,
                                          &find_transfers,
                                          NULL);
     return GNUNET_OK; /* will be ignored anyway */
   }
-  if (serial_id <= latest_row_off)
+  if ( (serial_id <= latest_row_off) ||
+       ( (0 != batch_len) &&
+         (serial_id <= batch[batch_len - 1].serial_id) ) )
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                "Serial ID %llu not monotonic (got %llu before). Failing!\n",
-                (unsigned long long) serial_id,
-                (unsigned long long) latest_row_off);
+                "Serial ID %llu not monotonic. Failing!\n",
+                (unsigned long long) serial_id);
     GNUNET_SCHEDULER_shutdown ();
     hh = NULL;
     return GNUNET_SYSERR;
@@ -282,52 +450,18 @@ history_cb (void *cls,
               "Adding wire transfer over %s with (hashed) subject `%s'\n",
               TALER_amount2s (&details->amount),
               details->wire_subject);
-  {
-    char *dcanon = payto_get_iban (details->debit_account_uri);
-    char *ccanon = payto_get_iban (details->credit_account_uri);
-
-    qs = db_plugin->record_auth_iban_payment (db_plugin->cls,
-                                              serial_id,
-                                              details->wire_subject,
-                                              &details->amount,
-                                              dcanon,
-                                              ccanon,
-                                              details->execution_date);
-    GNUNET_free (ccanon);
-    GNUNET_free (dcanon);
-  }
-  switch (qs)
-  {
-  case GNUNET_DB_STATUS_HARD_ERROR:
-    GNUNET_break (0);
-    GNUNET_SCHEDULER_shutdown ();
-    hh = NULL;
-    return GNUNET_SYSERR;
-  case GNUNET_DB_STATUS_SOFT_ERROR:
-    GNUNET_break (0);
-    hh = NULL;
-    return GNUNET_SYSERR;
-  case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-    /* already existed (!?), should be impossible */
-    GNUNET_break (0);
-    hh = NULL;
-    return GNUNET_SYSERR;
-  case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-    /* normal case */
-    break;
-  }
-  latest_row_off = serial_id;
-  {
-    uint64_t code;
-
-    if (GNUNET_OK !=
-        extract_code (details->wire_subject,
-                      &code))
-      return GNUNET_OK;
-    notify (details->debit_account_uri,
-            code,
-            &details->amount);
-  }
+  if (batch_len == batch_size)
+    GNUNET_array_grow (batch,
+                       batch_size,
+                       GNUNET_MAX (16,
+                                   batch_size * 2));
+  pt = &batch[batch_len++];
+  pt->serial_id = serial_id;
+  pt->wire_subject = GNUNET_strdup (details->wire_subject);
+  pt->amount = details->amount;
+  pt->debit_iban = payto_get_iban (details->debit_account_uri);
+  pt->credit_iban = payto_get_iban (details->credit_account_uri);
+  pt->execution_date = details->execution_date;
   return GNUNET_OK;
 }
 
@@ -346,7 +480,7 @@ find_transfers (void *cls)
   hh = ANASTASIS_EUFIN_credit_history (ctx,
                                        &auth,
                                        latest_row_off,
-                                       1024,
+                                       BATCH_SIZE,
                                        test_mode
                                        ? GNUNET_TIME_UNIT_ZERO
                                        : LONGPOLL_TIMEOUT,
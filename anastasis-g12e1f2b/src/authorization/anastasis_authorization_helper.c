@@ -0,0 +1,799 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file anastasis_authorization_helper.c
+ * @brief pool of long-lived helper processes for authorization plugins
+ * @author Christian Grothoff
+ *
+ * Each helper reads requests from its stdin and writes one
+ * response per request to its stdout.  A request starts with
+ * a `struct RequestHeader`, followed by the (0-terminated)
+ * arguments that the one-shot command would be given on the
+ * command line, followed by the message the one-shot command
+ * would read from stdin.  The response is a 32-bit status
+ * code in network byte order, with the same meaning as the
+ * exit code of the one-shot command.
+ *
+ * A helper that does not answer a request in time is killed and
+ * restarted, and its request fails.
+ */
+#include "platform.h"
+#include "anastasis_authorization_lib.h"
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a request to a helper.
+ */
+struct RequestHeader
+{
+  /**
+   * Total size of the request, including this header, in NBO.
+   */
+  uint32_t size;
+
+  /**
+   * Number of 0-terminated arguments following the header, in NBO.
+   */
+  uint32_t argc;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * A helper process of a pool.
+ */
+struct Helper
+{
+  /**
+   * Pool this helper belongs to.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+
+  /**
+   * The helper process, NULL if not running.
+   */
+  struct GNUNET_OS_Process *proc;
+
+  /**
+   * Stdin of the helper, we write requests here.
+   */
+  struct GNUNET_DISK_FileHandle *in;
+
+  /**
+   * Stdout of the helper, we read responses from here.
+   */
+  struct GNUNET_DISK_FileHandle *out;
+
+  /**
+   * Task writing the request of @e job.
+   */
+  struct GNUNET_SCHEDULER_Task *write_task;
+
+  /**
+   * Task reading the response for @e job.
+   */
+  struct GNUNET_SCHEDULER_Task *read_task;
+
+  /**
+   * Task killing the helper if it takes too long for @e job.
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
+
+  /**
+   * Job the helper is working on, NULL if idle.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job;
+
+  /**
+   * How much of the request of @e job have we written?
+   */
+  size_t write_off;
+
+  /**
+   * Response being read, in NBO.
+   */
+  uint32_t status;
+
+  /**
+   * How much of @e status have we read?
+   */
+  size_t read_off;
+};
+
+
+/**
+ * Request to be handled by a helper.
+ */
+struct ANASTASIS_AUTHORIZATION_HelperJob
+{
+  /**
+   * Kept in a DLL while waiting for a helper.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *next;
+
+  /**
+   * Kept in a DLL while waiting for a helper.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *prev;
+
+  /**
+   * Pool the job was submitted to.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+
+  /**
+   * Helper working on the job, NULL if queued.
+   */
+  struct Helper *helper;
+
+  /**
+   * The request, starting with a `struct RequestHeader`.
+   */
+  char *req;
+
+  /**
+   * Number of bytes in @e req.
+   */
+  size_t req_size;
+
+  /**
+   * Function to call with the result, NULL if the job was
+   * cancelled while a helper was working on it.
+   */
+  GNUNET_ChildCompletedCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+};
+
+
+/**
+ * Pool of helper processes.
+ */
+struct ANASTASIS_AUTHORIZATION_HelperPool
+{
+  /**
+   * Binary to run as helper.
+   */
+  char *binary;
+
+  /**
+   * Command line of the helper, NULL-terminated, the strings point
+   * into @e argv_buf.
+   */
+  char **argv;
+
+  /**
+   * Buffer with the command line of the helper.
+   */
+  char *argv_buf;
+
+  /**
+   * How long may a helper take for one request?
+   */
+  struct GNUNET_TIME_Relative timeout;
+
+  /**
+   * Array of @e num_helpers helpers.
+   */
+  struct Helper *helpers;
+
+  /**
+   * Head of jobs waiting for a helper.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *queue_head;
+
+  /**
+   * Tail of jobs waiting for a helper.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *queue_tail;
+
+  /**
+   * Task assigning queued jobs to idle helpers.
+   */
+  struct GNUNET_SCHEDULER_Task *dispatch_task;
+
+  /**
+   * Length of @e helpers.
+   */
+  unsigned int num_helpers;
+
+  /**
+   * Number of jobs in the queue.
+   */
+  unsigned int queue_len;
+
+  /**
+   * Maximum number of jobs in the queue.
+   */
+  unsigned int max_queue;
+};
+
+
+/**
+ * Stop helper @a h.  The helper process is killed with SIGKILL,
+ * as waiting for it to exit would otherwise block the event loop
+ * if it ignores (or, being stopped, cannot handle) SIGTERM.
+ *
+ * @param[in,out] h helper to stop
+ */
+static void
+stop_helper (struct Helper *h)
+{
+  if (NULL != h->timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->timeout_task);
+    h->timeout_task = NULL;
+  }
+  if (NULL != h->write_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->write_task);
+    h->write_task = NULL;
+  }
+  if (NULL != h->read_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->read_task);
+    h->read_task = NULL;
+  }
+  if (NULL != h->in)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (h->in));
+    h->in = NULL;
+  }
+  if (NULL != h->out)
+  {
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (h->out));
+    h->out = NULL;
+  }
+  if (NULL != h->proc)
+  {
+    if (0 != GNUNET_OS_process_kill (h->proc,
+                                     SIGKILL))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "kill");
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_OS_process_wait (h->proc));
+    GNUNET_OS_process_destroy (h->proc);
+    h->proc = NULL;
+  }
+}
+
+
+/**
+ * Start helper @a h.
+ *
+ * @param[in,out] h helper to start
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+start_helper (struct Helper *h)
+{
+  struct GNUNET_DISK_PipeHandle *p_in;
+  struct GNUNET_DISK_PipeHandle *p_out;
+
+  p_in = GNUNET_DISK_pipe (GNUNET_DISK_PF_BLOCKING_READ);
+  if (NULL == p_in)
+    return GNUNET_SYSERR;
+  p_out = GNUNET_DISK_pipe (GNUNET_DISK_PF_BLOCKING_WRITE);
+  if (NULL == p_out)
+  {
+    GNUNET_DISK_pipe_close (p_in);
+    return GNUNET_SYSERR;
+  }
+  h->proc = GNUNET_OS_start_process_vap (GNUNET_OS_INHERIT_STD_ERR,
+                                         p_in,
+                                         p_out,
+                                         NULL,
+                                         h->pool->binary,
+                                         h->pool->argv);
+  if (NULL == h->proc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to start helper `%s'\n",
+                h->pool->binary);
+    GNUNET_DISK_pipe_close (p_in);
+    GNUNET_DISK_pipe_close (p_out);
+    return GNUNET_SYSERR;
+  }
+  h->in = GNUNET_DISK_pipe_detach_end (p_in,
+                                       GNUNET_DISK_PIPE_END_WRITE);
+  h->out = GNUNET_DISK_pipe_detach_end (p_out,
+                                        GNUNET_DISK_PIPE_END_READ);
+  GNUNET_assert (NULL != h->in);
+  GNUNET_assert (NULL != h->out);
+  GNUNET_DISK_pipe_close (p_in);
+  GNUNET_DISK_pipe_close (p_out);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Assign queued jobs to idle helpers.
+ *
+ * @param cls a `struct ANASTASIS_AUTHORIZATION_HelperPool`
+ */
+static void
+dispatch (void *cls);
+
+
+/**
+ * Schedule dispatching jobs of @a pool.  Jobs are never dispatched
+ * synchronously, so that callbacks are never invoked from within
+ * #ANASTASIS_authorization_helper_submit().
+ *
+ * @param[in,out] pool pool to dispatch jobs of
+ */
+static void
+schedule_dispatch (struct ANASTASIS_AUTHORIZATION_HelperPool *pool)
+{
+  if (NULL != pool->dispatch_task)
+    return;
+  pool->dispatch_task = GNUNET_SCHEDULER_add_now (&dispatch,
+                                                  pool);
+}
+
+
+/**
+ * Finish the job of helper @a h, and hand the result to the
+ * job's callback (unless the job was cancelled).
+ *
+ * @param[in,out] h helper that is done with its job
+ * @param type how the helper completed the job
+ * @param status status code reported for the job
+ */
+static void
+finish_job (struct Helper *h,
+            enum GNUNET_OS_ProcessStatusType type,
+            unsigned long int status)
+{
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job = h->job;
+
+  if (NULL != h->timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->timeout_task);
+    h->timeout_task = NULL;
+  }
+  h->job = NULL;
+  if (NULL != job->cb)
+    job->cb (job->cb_cls,
+             type,
+             status);
+  GNUNET_free (job->req);
+  GNUNET_free (job);
+  schedule_dispatch (h->pool);
+}
+
+
+/**
+ * Helper @a h failed, stop it and fail its job.  The helper
+ * is restarted when the next job is assigned to it.
+ *
+ * @param[in,out] h helper that failed
+ */
+static void
+helper_failed (struct Helper *h)
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              "Helper `%s' failed, restarting it\n",
+              h->pool->binary);
+  stop_helper (h);
+  finish_job (h,
+              GNUNET_OS_PROCESS_UNKNOWN,
+              0);
+}
+
+
+/**
+ * Helper took too long for its job.  Kill it and fail the job.
+ * The helper is restarted when the next job is assigned to it.
+ *
+ * @param cls a `struct Helper`
+ */
+static void
+helper_timeout (void *cls)
+{
+  struct Helper *h = cls;
+
+  h->timeout_task = NULL;
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              "Helper `%s' did not answer within %s, restarting it\n",
+              h->pool->binary,
+              GNUNET_STRINGS_relative_time_to_string (h->pool->timeout,
+                                                      GNUNET_YES));
+  stop_helper (h);
+  finish_job (h,
+              GNUNET_OS_PROCESS_UNKNOWN,
+              0);
+}
+
+
+/**
+ * Read the response to the job of a helper.
+ *
+ * @param cls a `struct Helper`
+ */
+static void
+read_response (void *cls)
+{
+  struct Helper *h = cls;
+  ssize_t ret;
+
+  h->read_task = NULL;
+  ret = GNUNET_DISK_file_read (h->out,
+                               ((char *) &h->status) + h->read_off,
+                               sizeof (h->status) - h->read_off);
+  if ( (-1 == ret) &&
+       (EAGAIN == errno) )
+  {
+    h->read_task = GNUNET_SCHEDULER_add_read_file (
+      GNUNET_TIME_UNIT_FOREVER_REL,
+      h->out,
+      &read_response,
+      h);
+    return;
+  }
+  if (ret <= 0)
+  {
+    helper_failed (h);
+    return;
+  }
+  h->read_off += ret;
+  if (sizeof (h->status) != h->read_off)
+  {
+    h->read_task = GNUNET_SCHEDULER_add_read_file (
+      GNUNET_TIME_UNIT_FOREVER_REL,
+      h->out,
+      &read_response,
+      h);
+    return;
+  }
+  finish_job (h,
+              GNUNET_OS_PROCESS_EXITED,
+              ntohl (h->status));
+}
+
+
+/**
+ * Write the request of the job of a helper.
+ *
+ * @param cls a `struct Helper`
+ */
+static void
+write_request (void *cls)
+{
+  struct Helper *h = cls;
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job = h->job;
+  ssize_t ret;
+
+  h->write_task = NULL;
+  ret = GNUNET_DISK_file_write (h->in,
+                                job->req + h->write_off,
+                                job->req_size - h->write_off);
+  if ( (-1 == ret) &&
+       (EAGAIN == errno) )
+    ret = 0;
+  else if (ret <= 0)
+  {
+    helper_failed (h);
+    return;
+  }
+  h->write_off += ret;
+  if (job->req_size != h->write_off)
+  {
+    h->write_task = GNUNET_SCHEDULER_add_write_file (
+      GNUNET_TIME_UNIT_FOREVER_REL,
+      h->in,
+      &write_request,
+      h);
+    return;
+  }
+  h->read_off = 0;
+  h->read_task = GNUNET_SCHEDULER_add_read_file (
+    GNUNET_TIME_UNIT_FOREVER_REL,
+    h->out,
+    &read_response,
+    h);
+}
+
+
+static void
+dispatch (void *cls)
+{
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool = cls;
+
+  pool->dispatch_task = NULL;
+  for (unsigned int i = 0; i<pool->num_helpers; i++)
+  {
+    struct Helper *h = &pool->helpers[i];
+    struct ANASTASIS_AUTHORIZATION_HelperJob *job;
+
+    if (NULL == pool->queue_head)
+      return;
+    if (NULL != h->job)
+      continue;
+    job = pool->queue_head;
+    GNUNET_CONTAINER_DLL_remove (pool->queue_head,
+                                 pool->queue_tail,
+                                 job);
+    pool->queue_len--;
+    job->helper = h;
+    h->job = job;
+    if ( (NULL == h->proc) &&
+         (GNUNET_OK != start_helper (h)) )
+    {
+      finish_job (h,
+                  GNUNET_OS_PROCESS_UNKNOWN,
+                  0);
+      continue;
+    }
+    h->write_off = 0;
+    h->timeout_task = GNUNET_SCHEDULER_add_delayed (pool->timeout,
+                                                    &helper_timeout,
+                                                    h);
+    h->write_task = GNUNET_SCHEDULER_add_write_file (
+      GNUNET_TIME_UNIT_FOREVER_REL,
+      h->in,
+      &write_request,
+      h);
+  }
+}
+
+
+struct ANASTASIS_AUTHORIZATION_HelperPool *
+ANASTASIS_authorization_helper_pool_create (const char *command,
+                                            unsigned int num_helpers,
+                                            unsigned int max_queue,
+                                            struct GNUNET_TIME_Relative timeout)
+{
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+  unsigned int argc = 0;
+
+  GNUNET_assert (0 < num_helpers);
+  pool = GNUNET_new (struct ANASTASIS_AUTHORIZATION_HelperPool);
+  pool->argv_buf = GNUNET_strdup (command);
+  pool->argv = GNUNET_new_array (strlen (command) / 2 + 2,
+                                 char *);
+  for (char *tok = strtok (pool->argv_buf,
+                           " \t");
+       NULL != tok;
+       tok = strtok (NULL,
+                     " \t"))
+    pool->argv[argc++] = tok;
+  GNUNET_assert (0 < argc);
+  pool->binary = pool->argv[0];
+  pool->timeout = timeout;
+  pool->num_helpers = num_helpers;
+  pool->max_queue = max_queue;
+  pool->helpers = GNUNET_new_array (num_helpers,
+                                    struct Helper);
+  for (unsigned int i = 0; i<num_helpers; i++)
+    pool->helpers[i].pool = pool;
+  return pool;
+}
+
+
+struct ANASTASIS_AUTHORIZATION_HelperJob *
+ANASTASIS_authorization_helper_submit (
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool,
+  unsigned int argc,
+  const char *args[],
+  const char *msg,
+  GNUNET_ChildCompletedCallback cb,
+  void *cb_cls)
+{
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job;
+  struct RequestHeader hdr;
+  size_t size = sizeof (hdr) + strlen (msg);
+  char *off;
+
+  {
+    unsigned int idle = 0;
+
+    /* queued jobs are assigned to idle helpers first */
+    for (unsigned int i = 0; i<pool->num_helpers; i++)
+      if (NULL == pool->helpers[i].job)
+        idle++;
+    if (pool->queue_len >= pool->max_queue + idle)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Queue of helper `%s' is full\n",
+                  pool->binary);
+      return NULL;
+    }
+  }
+  for (unsigned int i = 0; i<argc; i++)
+    size += strlen (args[i]) + 1;
+  if (size > UINT32_MAX)
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  job = GNUNET_new (struct ANASTASIS_AUTHORIZATION_HelperJob);
+  job->pool = pool;
+  job->cb = cb;
+  job->cb_cls = cb_cls;
+  job->req_size = size;
+  job->req = GNUNET_malloc (size);
+  hdr.size = htonl ((uint32_t) size);
+  hdr.argc = htonl (argc);
+  memcpy (job->req,
+          &hdr,
+          sizeof (hdr));
+  off = job->req + sizeof (hdr);
+  for (unsigned int i = 0; i<argc; i++)
+  {
+    size_t len = strlen (args[i]) + 1;
+
+    memcpy (off,
+            args[i],
+            len);
+    off += len;
+  }
+  memcpy (off,
+          msg,
+          strlen (msg));
+  GNUNET_CONTAINER_DLL_insert_tail (pool->queue_head,
+                                    pool->queue_tail,
+                                    job);
+  pool->queue_len++;
+  schedule_dispatch (pool);
+  return job;
+}
+
+
+void
+ANASTASIS_authorization_helper_cancel (
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job)
+{
+  if (NULL != job->helper)
+  {
+    /* Helper is already working on it, let it finish
+       so that the request stream stays in sync. */
+    job->cb = NULL;
+    return;
+  }
+  GNUNET_CONTAINER_DLL_remove (job->pool->queue_head,
+                               job->pool->queue_tail,
+                               job);
+  job->pool->queue_len--;
+  GNUNET_free (job->req);
+  GNUNET_free (job);
+}
+
+
+struct ANASTASIS_AUTHORIZATION_HelperPool *
+ANASTASIS_authorization_helper_pool_load (
+  const struct GNUNET_CONFIGURATION_Handle *cfg,
+  const char *section)
+{
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+  char *binary;
+  unsigned long long num_helpers;
+  unsigned long long max_queue;
+  struct GNUNET_TIME_Relative timeout;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_string (cfg,
+                                             section,
+                                             "HELPER",
+                                             &binary))
+    return NULL;
+  if (strlen (binary) == strspn (binary,
+                                 " \t"))
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               section,
+                               "HELPER",
+                               "must not be empty");
+    GNUNET_free (binary);
+    return NULL;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             section,
+                                             "HELPER_POOL_SIZE",
+                                             &num_helpers))
+    num_helpers = 4;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             section,
+                                             "HELPER_QUEUE_SIZE",
+                                             &max_queue))
+    max_queue = 256;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           section,
+                                           "HELPER_TIMEOUT",
+                                           &timeout))
+    timeout = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS,
+                                             30);
+  if ( (0 == num_helpers) ||
+       (num_helpers > UINT16_MAX) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               section,
+                               "HELPER_POOL_SIZE",
+                               "must be a small positive number");
+    GNUNET_free (binary);
+    return NULL;
+  }
+  if (max_queue > UINT32_MAX)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               section,
+                               "HELPER_QUEUE_SIZE",
+                               "must be a 32-bit number");
+    GNUNET_free (binary);
+    return NULL;
+  }
+  pool = ANASTASIS_authorization_helper_pool_create (
+    binary,
+    (unsigned int) num_helpers,
+    (unsigned int) max_queue,
+    timeout);
+  GNUNET_free (binary);
+  return pool;
+}
+
+
+void
+ANASTASIS_authorization_helper_pool_destroy (
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool)
+{
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job;
+
+  if (NULL != pool->dispatch_task)
+  {
+    GNUNET_SCHEDULER_cancel (pool->dispatch_task);
+    pool->dispatch_task = NULL;
+  }
+  for (unsigned int i = 0; i<pool->num_helpers; i++)
+  {
+    struct Helper *h = &pool->helpers[i];
+
+    stop_helper (h);
+    if (NULL != (job = h->job))
+    {
+      GNUNET_break (NULL == job->cb);
+      GNUNET_free (job->req);
+      GNUNET_free (job);
+      h->job = NULL;
+    }
+  }
+  while (NULL != (job = pool->queue_head))
+  {
+    GNUNET_break (0);
+    GNUNET_CONTAINER_DLL_remove (pool->queue_head,
+                                 pool->queue_tail,
+                                 job);
+    GNUNET_free (job->req);
+    GNUNET_free (job);
+  }
+  GNUNET_free (pool->helpers);
+  GNUNET_free (pool->argv);
+  GNUNET_free (pool->argv_buf);
+  GNUNET_free (pool);
+}
+
+
+/* end of anastasis_authorization_helper.c */
@@ -544,6 +544,9 @@ iban_process (struct ANASTASIS_AUTHORIZATION_State *as,
                                &bank_event_cb,
                                as);
   }
+  /* Notifications only wake us up; anyone who can NOTIFY on the
+     database could send one, so the transfer must be checked
+     against the database before the challenge is satisfied. */
   after = GNUNET_TIME_absolute_subtract (now,
                                          CODE_VALIDITY_PERIOD);
   (void) GNUNET_TIME_round_abs (&after);
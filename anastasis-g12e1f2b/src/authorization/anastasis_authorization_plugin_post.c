@@ -26,6 +26,7 @@
 #include "anastasis_util_lib.h"
 #include <gnunet/gnunet_db_lib.h>
 #include "anastasis_database_lib.h"
+#include "anastasis_authorization_lib.h"
 
 /**
  * How many retries do we allow per code?
@@ -45,6 +46,12 @@ struct PostContext
    */
   char *auth_command;
 
+  /**
+   * Pool of long-lived helpers to use instead of @e auth_command,
+   * NULL if not configured.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+
   /**
    * Messages of the plugin, read from a resource file.
    */
@@ -103,6 +110,11 @@ struct ANASTASIS_AUTHORIZATION_State
    */
   struct GNUNET_ChildWaitHandle *cwh;
 
+  /**
+   * Request to the helper pool, if we use one.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job;
+
   /**
    * Our client connection, set if suspended.
    */
@@ -336,6 +348,7 @@ post_done_cb (void *cls,
 
   as->child = NULL;
   as->cwh = NULL;
+  as->job = NULL;
   as->pst = type;
   as->exit_code = exit_code;
   MHD_resume_connection (as->connection);
@@ -404,12 +417,56 @@ post_process (struct ANASTASIS_AUTHORIZATION_State *as,
       return ANASTASIS_AUTHORIZATION_RES_FAILED_REPLY_FAILED;
     return ANASTASIS_AUTHORIZATION_RES_FAILED;
   }
+  if ( (NULL == as->msg) &&
+       (NULL != as->ctx->pool) )
+  {
+    /* First time, pass request to helper pool */
+    const char *args[] = {
+      name,
+      street,
+      city,
+      zip,
+      country
+    };
+
+    GNUNET_asprintf (&as->msg,
+                     get_message (as->ctx->messages,
+                                  connection,
+                                  "body"),
+                     (unsigned long long) as->code,
+                     ANASTASIS_CRYPTO_uuid2s (&as->truth_uuid));
+    as->job = ANASTASIS_authorization_helper_submit (as->ctx->pool,
+                                                     5,
+                                                     args,
+                                                     as->msg,
+                                                     &post_done_cb,
+                                                     as);
+    if (NULL == as->job)
+    {
+      mres = TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_SERVICE_UNAVAILABLE,
+                                         TALER_EC_ANASTASIS_POST_HELPER_EXEC_FAILED,
+                                         "busy");
+      if (MHD_YES != mres)
+        return ANASTASIS_AUTHORIZATION_RES_FAILED_REPLY_FAILED;
+      return ANASTASIS_AUTHORIZATION_RES_FAILED;
+    }
+    as->connection = connection;
+    MHD_suspend_connection (connection);
+    return ANASTASIS_AUTHORIZATION_RES_SUSPENDED;
+  }
   if (NULL == as->msg)
   {
     /* First time, start child process and feed pipe */
     struct GNUNET_DISK_PipeHandle *p;
     struct GNUNET_DISK_FileHandle *pipe_stdin;
 
+    GNUNET_asprintf (&as->msg,
+                     get_message (as->ctx->messages,
+                                  connection,
+                                  "body"),
+                     (unsigned long long) as->code,
+                     ANASTASIS_CRYPTO_uuid2s (&as->truth_uuid));
     p = GNUNET_DISK_pipe (GNUNET_DISK_PF_BLOCKING_RW);
     if (NULL == p)
     {
@@ -448,12 +505,6 @@ post_process (struct ANASTASIS_AUTHORIZATION_State *as,
                                               GNUNET_DISK_PIPE_END_WRITE);
     GNUNET_assert (NULL != pipe_stdin);
     GNUNET_DISK_pipe_close (p);
-    GNUNET_asprintf (&as->msg,
-                     get_message (as->ctx->messages,
-                                  connection,
-                                  "body"),
-                     (unsigned long long) as->code,
-                     ANASTASIS_CRYPTO_uuid2s (&as->truth_uuid));
     {
       const char *off = as->msg;
       size_t left = strlen (off);
@@ -490,7 +541,8 @@ post_process (struct ANASTASIS_AUTHORIZATION_State *as,
     MHD_suspend_connection (connection);
     return ANASTASIS_AUTHORIZATION_RES_SUSPENDED;
   }
-  if (NULL != as->cwh)
+  if ( (NULL != as->cwh) ||
+       (NULL != as->job) )
   {
     /* Spurious call, why are we here? */
     GNUNET_break (0);
@@ -572,6 +624,11 @@ post_cleanup (struct ANASTASIS_AUTHORIZATION_State *as)
     GNUNET_wait_child_cancel (as->cwh);
     as->cwh = NULL;
   }
+  if (NULL != as->job)
+  {
+    ANASTASIS_authorization_helper_cancel (as->job);
+    as->job = NULL;
+  }
   if (NULL != as->child)
   {
     (void) GNUNET_OS_process_kill (as->child,
@@ -642,11 +699,14 @@ libanastasis_plugin_authorization_post_init (void *cls)
   plugin->process = &post_process;
   plugin->cleanup = &post_cleanup;
 
-  if (GNUNET_OK !=
-      GNUNET_CONFIGURATION_get_value_string (cfg,
-                                             "authorization-post",
-                                             "COMMAND",
-                                             &ctx->auth_command))
+  ctx->pool = ANASTASIS_authorization_helper_pool_load (cfg,
+                                                        "authorization-post");
+  if ( (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_string (cfg,
+                                               "authorization-post",
+                                               "COMMAND",
+                                               &ctx->auth_command)) &&
+       (NULL == ctx->pool) )
   {
     GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
                                "authorization-post",
@@ -672,6 +732,8 @@ libanastasis_plugin_authorization_post_done (void *cls)
   struct ANASTASIS_AuthorizationPlugin *plugin = cls;
   struct PostContext *ctx = plugin->cls;
 
+  if (NULL != ctx->pool)
+    ANASTASIS_authorization_helper_pool_destroy (ctx->pool);
   GNUNET_free (ctx->auth_command);
   json_decref (ctx->messages);
   GNUNET_free (ctx);
@@ -26,6 +26,7 @@
 #include "anastasis_util_lib.h"
 #include <gnunet/gnunet_db_lib.h>
 #include "anastasis_database_lib.h"
+#include "anastasis_authorization_lib.h"
 
 /**
  * How many retries do we allow per code?
@@ -44,6 +45,12 @@ struct SMS_Context
    */
   char *auth_command;
 
+  /**
+   * Pool of long-lived helpers to use instead of @e auth_command,
+   * NULL if not configured.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+
   /**
    * Regex for phone number validation.
    */
@@ -106,6 +113,11 @@ struct ANASTASIS_AUTHORIZATION_State
    */
   struct GNUNET_ChildWaitHandle *cwh;
 
+  /**
+   * Request to the helper pool, if we use one.
+   */
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job;
+
   /**
    * Our client connection, set if suspended.
    */
@@ -297,6 +309,7 @@ sms_done_cb (void *cls,
 
   as->child = NULL;
   as->cwh = NULL;
+  as->job = NULL;
   as->pst = type;
   as->exit_code = exit_code;
   MHD_resume_connection (as->connection);
@@ -333,12 +346,48 @@ sms_process (struct ANASTASIS_AUTHORIZATION_State *as,
                                       MHD_HTTP_HEADER_ACCEPT_LANGUAGE);
   if (NULL == lang)
     lang = "en";
+  if ( (NULL == as->msg) &&
+       (NULL != as->ctx->pool) )
+  {
+    /* First time, pass request to helper pool */
+    const char *args[] = {
+      as->phone_number
+    };
+
+    GNUNET_asprintf (&as->msg,
+                     "A-%llu\nAnastasis\n: %s",
+                     (unsigned long long) as->code,
+                     ANASTASIS_CRYPTO_uuid2s (&as->truth_uuid));
+    as->job = ANASTASIS_authorization_helper_submit (as->ctx->pool,
+                                                     1,
+                                                     args,
+                                                     as->msg,
+                                                     &sms_done_cb,
+                                                     as);
+    if (NULL == as->job)
+    {
+      mres = TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_SERVICE_UNAVAILABLE,
+                                         TALER_EC_ANASTASIS_SMS_HELPER_EXEC_FAILED,
+                                         "busy");
+      if (MHD_YES != mres)
+        return ANASTASIS_AUTHORIZATION_RES_FAILED_REPLY_FAILED;
+      return ANASTASIS_AUTHORIZATION_RES_FAILED;
+    }
+    as->connection = connection;
+    MHD_suspend_connection (connection);
+    return ANASTASIS_AUTHORIZATION_RES_SUSPENDED;
+  }
   if (NULL == as->msg)
   {
     /* First time, start child process and feed pipe */
     struct GNUNET_DISK_PipeHandle *p;
     struct GNUNET_DISK_FileHandle *pipe_stdin;
 
+    GNUNET_asprintf (&as->msg,
+                     "A-%llu\nAnastasis\n: %s",
+                     (unsigned long long) as->code,
+                     ANASTASIS_CRYPTO_uuid2s (&as->truth_uuid));
     p = GNUNET_DISK_pipe (GNUNET_DISK_PF_BLOCKING_RW);
     if (NULL == p)
     {
@@ -373,10 +422,6 @@ sms_process (struct ANASTASIS_AUTHORIZATION_State *as,
                                               GNUNET_DISK_PIPE_END_WRITE);
     GNUNET_assert (NULL != pipe_stdin);
     GNUNET_DISK_pipe_close (p);
-    GNUNET_asprintf (&as->msg,
-                     "A-%llu\nAnastasis\n: %s",
-                     (unsigned long long) as->code,
-                     ANASTASIS_CRYPTO_uuid2s (&as->truth_uuid));
     {
       const char *off = as->msg;
       size_t left = strlen (off);
@@ -413,7 +458,8 @@ sms_process (struct ANASTASIS_AUTHORIZATION_State *as,
     MHD_suspend_connection (connection);
     return ANASTASIS_AUTHORIZATION_RES_SUSPENDED;
   }
-  if (NULL != as->cwh)
+  if ( (NULL != as->cwh) ||
+       (NULL != as->job) )
   {
     /* Spurious call, why are we here? */
     GNUNET_break (0);
@@ -507,6 +553,11 @@ sms_cleanup (struct ANASTASIS_AUTHORIZATION_State *as)
     GNUNET_wait_child_cancel (as->cwh);
     as->cwh = NULL;
   }
+  if (NULL != as->job)
+  {
+    ANASTASIS_authorization_helper_cancel (as->job);
+    as->job = NULL;
+  }
   if (NULL != as->child)
   {
     (void) GNUNET_OS_process_kill (as->child,
@@ -590,11 +641,14 @@ libanastasis_plugin_authorization_sms_init (void *cls)
   plugin->process = &sms_process;
   plugin->cleanup = &sms_cleanup;
 
-  if (GNUNET_OK !=
-      GNUNET_CONFIGURATION_get_value_string (cfg,
-                                             "authorization-sms",
-                                             "COMMAND",
-                                             &ctx->auth_command))
+  ctx->pool = ANASTASIS_authorization_helper_pool_load (cfg,
+                                                        "authorization-sms");
+  if ( (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_string (cfg,
+                                               "authorization-sms",
+                                               "COMMAND",
+                                               &ctx->auth_command)) &&
+       (NULL == ctx->pool) )
   {
     GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
                                "authorization-sms",
@@ -621,6 +675,8 @@ libanastasis_plugin_authorization_sms_done (void *cls)
   struct ANASTASIS_AuthorizationPlugin *plugin = cls;
   struct SMS_Context *ctx = plugin->cls;
 
+  if (NULL != ctx->pool)
+    ANASTASIS_authorization_helper_pool_destroy (ctx->pool);
   GNUNET_free (ctx->auth_command);
   regfree (&ctx->regex);
   json_decref (ctx->messages);
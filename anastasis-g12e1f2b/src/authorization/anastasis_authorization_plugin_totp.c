@@ -23,7 +23,6 @@
 #include <taler/taler_mhd_lib.h>
 #include <gnunet/gnunet_db_lib.h>
 #include "anastasis_database_lib.h"
-#include <gcrypt.h>
 
 
 /**
@@ -124,80 +123,6 @@ totp_validate (void *cls,
 }
 
 
-/**
- * Compute TOTP code at current time with offset
- * @a time_off for the @a key.
- *
- * @param time_off offset to apply when computing the code
- * @param key input key material
- * @param key_size number of bytes in @a key
- * @return TOTP code at this time
- */
-static uint64_t
-compute_totp (int time_off,
-              const void *key,
-              size_t key_size)
-{
-  struct GNUNET_TIME_Absolute now;
-  time_t t;
-  uint64_t ctr;
-  uint8_t hmac[20]; /* SHA1: 20 bytes */
-
-  now = GNUNET_TIME_absolute_get ();
-  (void) GNUNET_TIME_round_abs (&now);
-  while (time_off < 0)
-  {
-    now = GNUNET_TIME_absolute_subtract (now,
-                                         TOTP_VALIDITY_PERIOD);
-    time_off++;
-  }
-  while (time_off > 0)
-  {
-    now = GNUNET_TIME_absolute_add (now,
-                                    TOTP_VALIDITY_PERIOD);
-    time_off--;
-  }
-  t = now.abs_value_us / GNUNET_TIME_UNIT_SECONDS.rel_value_us;
-  ctr = GNUNET_htonll (t / 30LLU);
-
-  {
-    gcry_md_hd_t md;
-    const unsigned char *mc;
-
-    GNUNET_assert (GPG_ERR_NO_ERROR ==
-                   gcry_md_open (&md,
-                                 GCRY_MD_SHA1,
-                                 GCRY_MD_FLAG_HMAC));
-    gcry_md_setkey (md,
-                    key,
-                    key_size);
-    gcry_md_write (md,
-                   &ctr,
-                   sizeof (ctr));
-    mc = gcry_md_read (md,
-                       GCRY_MD_SHA1);
-    GNUNET_assert (NULL != mc);
-    memcpy (hmac,
-            mc,
-            sizeof (hmac));
-    gcry_md_close (md);
-  }
-
-  {
-    uint32_t code = 0;
-    int offset;
-
-    offset = hmac[sizeof (hmac) - 1] & 0x0f;
-    for (int count = 0; count < 4; count++)
-      code |= hmac[offset + 3 - count] << (8 * count);
-    code &= 0x7fffffff;
-    /* always use 8 digits (maximum) */
-    code = code % 100000000;
-    return code;
-  }
-}
-
-
 /**
  * Begin issuing authentication challenge to user based on @a data.
  *
@@ -223,23 +148,27 @@ totp_start (void *cls,
 {
   const struct ANASTASIS_AuthorizationContext *ac = cls;
   struct ANASTASIS_AUTHORIZATION_State *as;
-  uint64_t want;
-  unsigned int off = 0;
+  struct GNUNET_TIME_Absolute now;
+  uint64_t want[TIME_INTERVAL_RANGE * 2 + 1];
 
   GNUNET_assert (0 == code);
   as = GNUNET_new (struct ANASTASIS_AUTHORIZATION_State);
   as->ac = ac;
   as->truth_uuid = *truth_uuid;
-  for (int i = -TIME_INTERVAL_RANGE;
-       i <= TIME_INTERVAL_RANGE;
-       i++)
-  {
-    want = compute_totp (i,
-                         data,
-                         data_length);
-    ANASTASIS_hash_answer (want,
-                           &as->valid_replies[off++]);
-  }
+  now = GNUNET_TIME_absolute_get ();
+  ANASTASIS_CRYPTO_totp_window (data,
+                                data_length,
+                                GNUNET_TIME_absolute_subtract (
+                                  now,
+                                  GNUNET_TIME_relative_multiply (
+                                    TOTP_VALIDITY_PERIOD,
+                                    TIME_INTERVAL_RANGE)),
+                                TOTP_VALIDITY_PERIOD,
+                                TIME_INTERVAL_RANGE * 2 + 1,
+                                want);
+  for (unsigned int i = 0; i<=TIME_INTERVAL_RANGE * 2; i++)
+    ANASTASIS_hash_answer (want[i],
+                           &as->valid_replies[i]);
   return as;
 }
 
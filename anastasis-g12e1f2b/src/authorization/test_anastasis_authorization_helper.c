@@ -0,0 +1,240 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file test_anastasis_authorization_helper.c
+ * @brief test the pool of authorization helpers with the command adapter
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <signal.h>
+#include <gnunet/gnunet_util_lib.h>
+#include "anastasis_authorization_lib.h"
+
+
+/**
+ * Helper command line; the command adapter running the shell.
+ */
+#define HELPER "./anastasis-helper-authorization-command sh -c"
+
+/**
+ * Global return value, 0 on success.
+ */
+static int global_ret = 1;
+
+/**
+ * The pool under test.
+ */
+static struct ANASTASIS_AUTHORIZATION_HelperPool *pool;
+
+/**
+ * Task failing the test if it takes too long.
+ */
+static struct GNUNET_SCHEDULER_Task *tt;
+
+/**
+ * Which step of the test are we in?
+ */
+static unsigned int step;
+
+/**
+ * Did we manage to put the test into its own process group?
+ */
+static bool own_group;
+
+
+/**
+ * Clean up.
+ *
+ * @param cls NULL
+ */
+static void
+do_shutdown (void *cls)
+{
+  (void) cls;
+  if (NULL != tt)
+  {
+    GNUNET_SCHEDULER_cancel (tt);
+    tt = NULL;
+  }
+  if (NULL != pool)
+  {
+    ANASTASIS_authorization_helper_pool_destroy (pool);
+    pool = NULL;
+  }
+  if (own_group)
+  {
+    void (*old)(int);
+
+    /* killing the helpers orphans the commands they ran */
+    old = signal (SIGTERM,
+                  SIG_IGN);
+    if (0 != kill (0,
+                   SIGTERM))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "kill");
+    (void) signal (SIGTERM,
+                   old);
+  }
+}
+
+
+/**
+ * The test took too long.
+ *
+ * @param cls NULL
+ */
+static void
+do_timeout (void *cls)
+{
+  (void) cls;
+  tt = NULL;
+  GNUNET_break (0);
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Submit the request of the current @e step.
+ */
+static void
+submit (void);
+
+
+/**
+ * Check the result of a request.
+ *
+ * @param cls NULL
+ * @param type how the request completed
+ * @param status status code of the request
+ */
+static void
+done_cb (void *cls,
+         enum GNUNET_OS_ProcessStatusType type,
+         long unsigned int status)
+{
+  (void) cls;
+  switch (step)
+  {
+  case 0:
+    /* the message was passed on stdin, the arguments on the
+       command line: 'sh -c SCRIPT' gets "$0" = "hello" */
+    if ( (GNUNET_OS_PROCESS_EXITED != type) ||
+         (0 != status) )
+    {
+      GNUNET_break (0);
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    break;
+  case 1:
+    if ( (GNUNET_OS_PROCESS_EXITED != type) ||
+         (42 != status) )
+    {
+      GNUNET_break (0);
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    break;
+  case 2:
+    /* the helper hangs and must be killed */
+    if (GNUNET_OS_PROCESS_UNKNOWN != type)
+    {
+      GNUNET_break (0);
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    break;
+  case 3:
+    /* the helper was restarted */
+    if ( (GNUNET_OS_PROCESS_EXITED != type) ||
+         (0 != status) )
+    {
+      GNUNET_break (0);
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    global_ret = 0;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  step++;
+  submit ();
+}
+
+
+static void
+submit (void)
+{
+  static const char *scripts[] = {
+    "test \"`cat`\" = \"message\" && test \"$0\" = \"hello\"",
+    "cat > /dev/null; exit 42",
+    "kill -STOP $PPID; cat > /dev/null",
+    "cat > /dev/null"
+  };
+  const char *args[] = {
+    scripts[step],
+    "hello"
+  };
+
+  GNUNET_assert (NULL !=
+                 ANASTASIS_authorization_helper_submit (pool,
+                                                        2,
+                                                        args,
+                                                        "message",
+                                                        &done_cb,
+                                                        NULL));
+}
+
+
+/**
+ * Run the test.
+ *
+ * @param cls NULL
+ */
+static void
+run (void *cls)
+{
+  (void) cls;
+  GNUNET_SCHEDULER_add_shutdown (&do_shutdown,
+                                 NULL);
+  tt = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+                                     &do_timeout,
+                                     NULL);
+  pool = ANASTASIS_authorization_helper_pool_create (HELPER,
+                                                     1,
+                                                     4,
+                                                     GNUNET_TIME_UNIT_SECONDS);
+  submit ();
+}
+
+
+int
+main (int argc,
+      const char *const argv[])
+{
+  (void) argc;
+  GNUNET_log_setup (argv[0],
+                    "WARNING",
+                    NULL);
+  own_group = (0 == setpgid (0,
+                             0));
+  GNUNET_SCHEDULER_run (&run,
+                        NULL);
+  return global_ret;
+}
+
+
+/* end of test_anastasis_authorization_helper.c */
@@ -29,6 +29,9 @@
 #include "anastasis-httpd_truth.h"
 #include "anastasis-httpd_terms.h"
 #include "anastasis-httpd_config.h"
+#include "anastasis-httpd_gc.h"
+#include "anastasis-httpd_ratelimit.h"
+#include "anastasis-httpd_metrics.h"
 
 
 /**
@@ -36,6 +39,11 @@
  */
 #define UNIX_BACKLOG 500
 
+/**
+ * Environment variable telling worker processes their index.
+ */
+#define WORKER_INDEX_ENV "ANASTASIS_WORKER_INDEX"
+
 /**
  * Upload limit to the service, in megabytes.
  */
@@ -126,11 +134,22 @@ static int global_result;
  */
 static struct MHD_Daemon *mhd;
 
+/**
+ * MHD's epoll file descriptor, NULL if MHD does not use epoll.
+ */
+static struct GNUNET_NETWORK_Handle *mhd_epoll;
+
 /**
  * Connection handle to the our database
  */
 struct ANASTASIS_DatabasePlugin *db;
 
+/**
+ * Threads running slow database operations, NULL to run
+ * them synchronously using #db.
+ */
+struct ANASTASIS_DB_Pool *AH_db_pool;
+
 /**
  * Reschedule context for #AH_ctx.
  */
@@ -172,6 +191,74 @@ static char *apikey;
  */
 static char *keypass;
 
+/**
+ * Command-line arguments we were started with, used to launch
+ * additional worker processes.
+ */
+static char *const *worker_argv;
+
+/**
+ * Number of worker processes to run, including ourselves.
+ */
+static unsigned long long num_workers;
+
+/**
+ * A worker process launched by the main process.
+ */
+struct Worker
+{
+  /**
+   * The worker process, NULL if it is currently not running.
+   */
+  struct GNUNET_OS_Process *proc;
+
+  /**
+   * Handle to wait for the termination of @e proc.
+   */
+  struct GNUNET_ChildWaitHandle *cwh;
+
+  /**
+   * Task to restart the worker after it terminated.
+   */
+  struct GNUNET_SCHEDULER_Task *restart_task;
+
+  /**
+   * How long do we wait before restarting the worker the next time?
+   */
+  struct GNUNET_TIME_Relative backoff;
+
+  /**
+   * When did we last start the worker?
+   */
+  struct GNUNET_TIME_Absolute start_time;
+
+  /**
+   * Index of the worker, passed to it in #WORKER_INDEX_ENV.
+   */
+  unsigned int index;
+};
+
+/**
+ * Worker processes we launched, array of length @e num_workers - 1.
+ */
+static struct Worker *workers;
+
+/**
+ * Listen socket we pass to (re)started worker processes.
+ */
+static int worker_listen_fd = -1;
+
+/**
+ * Task run in worker processes to check if the main
+ * process is still alive.
+ */
+static struct GNUNET_SCHEDULER_Task *parent_task;
+
+/**
+ * Process ID of the main process (in worker processes).
+ */
+static pid_t parent_pid;
+
 
 /**
  * Function that queries MHD's select sets and
@@ -235,6 +322,389 @@ AH_trigger_curl (void)
 }
 
 
+/**
+ * Static request handlers, matched by their exact URL.
+ */
+static struct AH_RequestHandler handlers[] = {
+  /* Landing page, tell humans to go away. */
+  { "/", MHD_HTTP_METHOD_GET, "text/plain",
+    "Hello, I'm Anastasis. This HTTP server is not for humans.\n", 0,
+    &TMH_MHD_handler_static_response, MHD_HTTP_OK },
+  { "/agpl", MHD_HTTP_METHOD_GET, "text/plain",
+    NULL, 0,
+    &TMH_MHD_handler_agpl_redirect, MHD_HTTP_FOUND },
+  { "/terms", MHD_HTTP_METHOD_GET, NULL,
+    NULL, 0,
+    &AH_handler_privacy, MHD_HTTP_OK },
+  { "/privacy", MHD_HTTP_METHOD_GET, NULL,
+    NULL, 0,
+    &AH_handler_terms, MHD_HTTP_OK },
+  { "/config", MHD_HTTP_METHOD_GET, "text/json",
+    NULL, 0,
+    &AH_handler_config, MHD_HTTP_OK },
+  {NULL, NULL, NULL, NULL, 0, 0 }
+};
+
+/**
+ * Handler for unknown URLs.
+ */
+static struct AH_RequestHandler h404 = {
+  "", NULL, "text/html",
+  "<html><title>404: not found</title></html>", 0,
+  &TMH_MHD_handler_static_response, MHD_HTTP_NOT_FOUND
+};
+
+/**
+ * Handler for unsupported methods on known URLs.
+ */
+static struct AH_RequestHandler h405 = {
+  "", NULL, "text/html",
+  "<html><title>405: method not allowed</title></html>", 0,
+  &TMH_MHD_handler_static_response, MHD_HTTP_METHOD_NOT_ALLOWED
+};
+
+
+/**
+ * Handle request with the static handler in @a hc.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data, ignored
+ * @param[in,out] upload_data_size ignored
+ * @return MHD result code
+ */
+static MHD_RESULT
+route_static (struct TM_HandlerContext *hc,
+              struct MHD_Connection *connection,
+              const char *upload_data,
+              size_t *upload_data_size)
+{
+  (void) upload_data;
+  (void) upload_data_size;
+  return hc->rh->handler (hc->rh,
+                          connection);
+}
+
+
+/**
+ * Handle CORS preflight request.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data, ignored
+ * @param[in,out] upload_data_size ignored
+ * @return MHD result code
+ */
+static MHD_RESULT
+route_cors (struct TM_HandlerContext *hc,
+            struct MHD_Connection *connection,
+            const char *upload_data,
+            size_t *upload_data_size)
+{
+  (void) hc;
+  (void) upload_data;
+  (void) upload_data_size;
+  return TALER_MHD_reply_cors_preflight (connection);
+}
+
+
+/**
+ * Handle GET /policy/$ACCOUNT.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data, ignored
+ * @param[in,out] upload_data_size ignored
+ * @return MHD result code
+ */
+static MHD_RESULT
+route_policy_get (struct TM_HandlerContext *hc,
+                  struct MHD_Connection *connection,
+                  const char *upload_data,
+                  size_t *upload_data_size)
+{
+  (void) upload_data;
+  (void) upload_data_size;
+  return AH_policy_get (connection,
+                        &hc->resource.account_pub);
+}
+
+
+/**
+ * Handle POST /policy/$ACCOUNT.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data
+ * @param[in,out] upload_data_size number of bytes (left) in @a upload_data
+ * @return MHD result code
+ */
+static MHD_RESULT
+route_policy_post (struct TM_HandlerContext *hc,
+                   struct MHD_Connection *connection,
+                   const char *upload_data,
+                   size_t *upload_data_size)
+{
+  return AH_handler_policy_post (connection,
+                                 hc,
+                                 &hc->resource.account_pub,
+                                 upload_data,
+                                 upload_data_size);
+}
+
+
+/**
+ * Handle GET /truth/$UUID.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data, ignored
+ * @param[in,out] upload_data_size ignored
+ * @return MHD result code
+ */
+static MHD_RESULT
+route_truth_get (struct TM_HandlerContext *hc,
+                 struct MHD_Connection *connection,
+                 const char *upload_data,
+                 size_t *upload_data_size)
+{
+  (void) upload_data;
+  (void) upload_data_size;
+  return AH_handler_truth_get (connection,
+                               &hc->resource.truth_uuid,
+                               hc);
+}
+
+
+/**
+ * Handle POST /truth/$UUID.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data
+ * @param[in,out] upload_data_size number of bytes (left) in @a upload_data
+ * @return MHD result code
+ */
+static MHD_RESULT
+route_truth_post (struct TM_HandlerContext *hc,
+                  struct MHD_Connection *connection,
+                  const char *upload_data,
+                  size_t *upload_data_size)
+{
+  return AH_handler_truth_post (connection,
+                                hc,
+                                &hc->resource.truth_uuid,
+                                upload_data,
+                                upload_data_size);
+}
+
+
+/**
+ * Route for URLs of the form PREFIX$KEY, where $KEY is the
+ * base32-encoding of the resource the request is about.
+ */
+struct ResourceRoute
+{
+  /**
+   * Prefix of the URL.
+   */
+  const char *prefix;
+
+  /**
+   * Name of the route in metrics.
+   */
+  const char *name;
+
+  /**
+   * Length of @e prefix.
+   */
+  size_t prefix_len;
+
+  /**
+   * Size of the binary $KEY.
+   */
+  size_t key_size;
+
+  /**
+   * What the $KEY is, for error messages.
+   */
+  const char *key_name;
+
+  /**
+   * Handler for GET requests.
+   */
+  TM_RouteHandler get;
+
+  /**
+   * Handler for POST requests.
+   */
+  TM_RouteHandler post;
+};
+
+
+/**
+ * Routes for URLs with a resource.
+ */
+static const struct ResourceRoute resource_routes[] = {
+  { "/policy/", "/policy", sizeof ("/policy/") - 1,
+    sizeof (struct ANASTASIS_CRYPTO_AccountPublicKeyP),
+    "account public key",
+    &route_policy_get, &route_policy_post },
+  { "/truth/", "/truth", sizeof ("/truth/") - 1,
+    sizeof (struct ANASTASIS_CRYPTO_TruthUUIDP),
+    "truth UUID",
+    &route_truth_get, &route_truth_post },
+  { NULL, NULL, 0, 0, NULL, NULL, NULL }
+};
+
+
+/**
+ * Latency histograms of GET (index 0) and POST (index 1) requests
+ * for each of the #resource_routes.
+ */
+static struct ANASTASIS_METRICS_Histogram *
+  resource_metrics[sizeof (resource_routes) / sizeof (resource_routes[0])][2];
+
+/**
+ * Latency histograms of requests for each of the #handlers,
+ * NULL for handlers without a fixed method.
+ */
+static struct ANASTASIS_METRICS_Histogram *
+  handler_metrics[sizeof (handlers) / sizeof (handlers[0])];
+
+
+/**
+ * Lookup the latency histogram of requests for @a route with @a method.
+ *
+ * @param route route of the request, i.e. "/policy"
+ * @param method HTTP method of the request
+ * @return the histogram
+ */
+static struct ANASTASIS_METRICS_Histogram *
+route_metric (const char *route,
+              const char *method)
+{
+  char labels[128];
+
+  GNUNET_snprintf (labels,
+                   sizeof (labels),
+                   "route=\"%s\",method=\"%s\"",
+                   route,
+                   method);
+  return ANASTASIS_METRICS_histogram ("anastasis_request_seconds",
+                                      "Time to handle HTTP requests",
+                                      labels);
+}
+
+
+/**
+ * Resolve the latency histograms of all routes, so that handling
+ * a request only needs to update its histogram.
+ */
+static void
+init_route_metrics (void)
+{
+  for (unsigned int i = 0; NULL != resource_routes[i].prefix; i++)
+  {
+    resource_metrics[i][0] = route_metric (resource_routes[i].name,
+                                           MHD_HTTP_METHOD_GET);
+    resource_metrics[i][1] = route_metric (resource_routes[i].name,
+                                           MHD_HTTP_METHOD_POST);
+  }
+  for (unsigned int i = 0; NULL != handlers[i].url; i++)
+    if (NULL != handlers[i].method)
+      handler_metrics[i] = route_metric (handlers[i].url,
+                                         handlers[i].method);
+}
+
+
+/**
+ * Resolve the route of the request for @a url and @a method,
+ * setting the route in @a hc.
+ *
+ * @param[in,out] hc context of the request
+ * @param url the requested url
+ * @param method the HTTP method used
+ * @return NULL if the route of @a hc was set, otherwise
+ *         the name of the malformed $KEY in @a url
+ */
+static const char *
+resolve_route (struct TM_HandlerContext *hc,
+               const char *url,
+               const char *method)
+{
+  bool path_matched;
+
+  for (unsigned int i = 0; NULL != resource_routes[i].prefix; i++)
+  {
+    const struct ResourceRoute *rr = &resource_routes[i];
+    const char *key;
+
+    if (0 != strncmp (url,
+                      rr->prefix,
+                      rr->prefix_len))
+      continue;
+    key = &url[rr->prefix_len];
+    GNUNET_assert (rr->key_size <= sizeof (hc->resource));
+    if (GNUNET_OK !=
+        GNUNET_STRINGS_string_to_data (key,
+                                       strlen (key),
+                                       &hc->resource,
+                                       rr->key_size))
+      return rr->key_name;
+    if (0 == strcmp (method,
+                     MHD_HTTP_METHOD_GET))
+    {
+      hc->route = rr->get;
+      hc->metric = resource_metrics[i][0];
+    }
+    else if (0 == strcmp (method,
+                          MHD_HTTP_METHOD_POST))
+    {
+      hc->route = rr->post;
+      hc->metric = resource_metrics[i][1];
+    }
+    else if (0 == strcmp (method,
+                          MHD_HTTP_METHOD_OPTIONS))
+      hc->route = &route_cors;
+    else
+    {
+      hc->rh = &h405;
+      hc->route = &route_static;
+    }
+    return NULL;
+  }
+  path_matched = false;
+  for (unsigned int i = 0; NULL != handlers[i].url; i++)
+  {
+    struct AH_RequestHandler *rh = &handlers[i];
+
+    if (0 != strcmp (url,
+                     rh->url))
+      continue;
+    path_matched = true;
+    if (0 == strcasecmp (method,
+                         MHD_HTTP_METHOD_OPTIONS))
+    {
+      hc->route = &route_cors;
+      return NULL;
+    }
+    if ( (NULL == rh->method) ||
+         (0 == strcasecmp (method,
+                           rh->method)) )
+    {
+      hc->rh = rh;
+      hc->route = &route_static;
+      hc->metric = handler_metrics[i];
+      return NULL;
+    }
+  }
+  hc->rh = path_matched ? &h405 : &h404;
+  hc->route = &route_static;
+  return NULL;
+}
+
+
 /**
  * A client has requested the given url using the given method
  * (MHD_HTTP_METHOD_GET, MHD_HTTP_METHOD_PUT,
@@ -285,38 +755,8 @@ url_handler (void *cls,
              size_t *upload_data_size,
              void **con_cls)
 {
-  static struct AH_RequestHandler handlers[] = {
-    /* Landing page, tell humans to go away. */
-    { "/", MHD_HTTP_METHOD_GET, "text/plain",
-      "Hello, I'm Anastasis. This HTTP server is not for humans.\n", 0,
-      &TMH_MHD_handler_static_response, MHD_HTTP_OK },
-    { "/agpl", MHD_HTTP_METHOD_GET, "text/plain",
-      NULL, 0,
-      &TMH_MHD_handler_agpl_redirect, MHD_HTTP_FOUND },
-    { "/terms", MHD_HTTP_METHOD_GET, NULL,
-      NULL, 0,
-      &AH_handler_privacy, MHD_HTTP_OK },
-    { "/privacy", MHD_HTTP_METHOD_GET, NULL,
-      NULL, 0,
-      &AH_handler_terms, MHD_HTTP_OK },
-    { "/config", MHD_HTTP_METHOD_GET, "text/json",
-      NULL, 0,
-      &AH_handler_config, MHD_HTTP_OK },
-    {NULL, NULL, NULL, NULL, 0, 0 }
-  };
-  static struct AH_RequestHandler h404 = {
-    "", NULL, "text/html",
-    "<html><title>404: not found</title></html>", 0,
-    &TMH_MHD_handler_static_response, MHD_HTTP_NOT_FOUND
-  };
-  static struct AH_RequestHandler h405 = {
-    "", NULL, "text/html",
-    "<html><title>405: method not allowed</title></html>", 0,
-    &TMH_MHD_handler_static_response, MHD_HTTP_METHOD_NOT_ALLOWED
-  };
   struct TM_HandlerContext *hc = *con_cls;
   const char *correlation_id = NULL;
-  bool path_matched;
 
   if (NULL == hc)
   {
@@ -338,138 +778,307 @@ url_handler (void *cls,
     *con_cls = hc;
     hc->async_scope_id = aid;
     hc->url = url;
+    hc->start_time = GNUNET_TIME_absolute_get ();
   }
-  if (0 == strcasecmp (method,
-                       MHD_HTTP_METHOD_HEAD))
-    method = MHD_HTTP_METHOD_GET; /* MHD will throw away the body */
-
   GNUNET_SCHEDULER_begin_async_scope (&hc->async_scope_id);
-  if (NULL != correlation_id)
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Handling request for (%s) URL '%s', correlation_id=%s\n",
-                method,
-                url,
-                correlation_id);
-  else
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Handling request (%s) for URL '%s'\n",
-                method,
-                url);
-  if (0 == strncmp (url,
-                    "/policy/",
-                    strlen ("/policy/")))
+  if (NULL == hc->route)
   {
-    const char *account = url + strlen ("/policy/");
-    struct ANASTASIS_CRYPTO_AccountPublicKeyP account_pub;
-
-    if (GNUNET_OK !=
-        GNUNET_STRINGS_string_to_data (
-          account,
-          strlen (account),
-          &account_pub,
-          sizeof (struct ANASTASIS_CRYPTO_AccountPublicKeyP)))
+    const char *malformed;
+
+    if (0 == strcasecmp (method,
+                         MHD_HTTP_METHOD_HEAD))
+      method = MHD_HTTP_METHOD_GET; /* MHD will throw away the body */
+    if (NULL != correlation_id)
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  "Handling request for (%s) URL '%s', correlation_id=%s\n",
+                  method,
+                  url,
+                  correlation_id);
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  "Handling request (%s) for URL '%s'\n",
+                  method,
+                  url);
+    malformed = resolve_route (hc,
+                               url,
+                               method);
+    if (NULL != malformed)
     {
+      GNUNET_break_op (0);
       return TALER_MHD_reply_with_error (connection,
                                          MHD_HTTP_BAD_REQUEST,
                                          TALER_EC_GENERIC_PARAMETER_MALFORMED,
-                                         "account public key");
-    }
-    if (0 == strcmp (method,
-                     MHD_HTTP_METHOD_GET))
-    {
-      return AH_policy_get (connection,
-                            &account_pub);
+                                         malformed);
     }
-    if (0 == strcmp (method,
-                     MHD_HTTP_METHOD_POST))
+  }
+  return hc->route (hc,
+                    connection,
+                    upload_data,
+                    upload_data_size);
+}
+
+
+/**
+ * Terminate all worker processes we launched (if any).
+ */
+static void
+stop_workers (void)
+{
+  if (NULL == workers)
+    return;
+  for (unsigned long long i = 0; i < num_workers - 1; i++)
+  {
+    struct Worker *w = &workers[i];
+
+    if (NULL != w->restart_task)
     {
-      return AH_handler_policy_post (connection,
-                                     hc,
-                                     &account_pub,
-                                     upload_data,
-                                     upload_data_size);
+      GNUNET_SCHEDULER_cancel (w->restart_task);
+      w->restart_task = NULL;
     }
-    if (0 == strcmp (method,
-                     MHD_HTTP_METHOD_OPTIONS))
+    if (NULL != w->cwh)
     {
-      return TALER_MHD_reply_cors_preflight (connection);
+      GNUNET_wait_child_cancel (w->cwh);
+      w->cwh = NULL;
     }
-    return TMH_MHD_handler_static_response (&h405,
-                                            connection);
+    if (NULL == w->proc)
+      continue;
+    if (0 != GNUNET_OS_process_kill (w->proc,
+                                     SIGTERM))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "kill");
   }
-  if (0 == strncmp (url,
-                    "/truth/",
-                    strlen ("/truth/")))
+  for (unsigned long long i = 0; i < num_workers - 1; i++)
   {
-    struct ANASTASIS_CRYPTO_TruthUUIDP tu;
-    const char *pub_key_str;
+    struct Worker *w = &workers[i];
+
+    if (NULL == w->proc)
+      continue;
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_OS_process_wait (w->proc));
+    GNUNET_OS_process_destroy (w->proc);
+    w->proc = NULL;
+  }
+  GNUNET_free (workers);
+  workers = NULL;
+}
+
+
+/**
+ * Launch worker process @a w.
+ *
+ * @param[in,out] w worker to launch
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+start_worker (struct Worker *w);
+
+
+/**
+ * Task that restarts a worker process after it terminated.
+ *
+ * @param cls the `struct Worker *` to restart
+ */
+static void
+restart_worker (void *cls)
+{
+  struct Worker *w = cls;
+
+  w->restart_task = NULL;
+  if (GNUNET_OK != start_worker (w))
+  {
+    w->backoff = GNUNET_TIME_STD_BACKOFF (w->backoff);
+    w->restart_task = GNUNET_SCHEDULER_add_delayed (w->backoff,
+                                                    &restart_worker,
+                                                    w);
+  }
+}
+
 
-    pub_key_str = &url[strlen ("/truth/")];
+/**
+ * Function called when one of our worker processes terminated.
+ * Logs the termination and restarts the worker, with exponential
+ * back-off if it keeps failing right after being started.
+ *
+ * @param cls the `struct Worker *` that terminated
+ * @param type how the process terminated
+ * @param exit_code exit code or signal number
+ */
+static void
+worker_done_cb (void *cls,
+                enum GNUNET_OS_ProcessStatusType type,
+                long unsigned int exit_code)
+{
+  struct Worker *w = cls;
+
+  w->cwh = NULL;
+  GNUNET_OS_process_destroy (w->proc);
+  w->proc = NULL;
+  GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+              "Worker process %u %s with status %lu, restarting it\n",
+              w->index,
+              (GNUNET_OS_PROCESS_SIGNALED == type)
+              ? "was killed by signal"
+              : "exited",
+              exit_code);
+  /* reset the back-off if the worker ran for a while */
+  if (GNUNET_TIME_relative_cmp (GNUNET_TIME_absolute_get_duration (
+                                  w->start_time),
+                                >,
+                                GNUNET_TIME_UNIT_MINUTES))
+    w->backoff = GNUNET_TIME_UNIT_ZERO;
+  else
+    w->backoff = GNUNET_TIME_STD_BACKOFF (w->backoff);
+  w->restart_task = GNUNET_SCHEDULER_add_delayed (w->backoff,
+                                                  &restart_worker,
+                                                  w);
+}
+
+
+static enum GNUNET_GenericReturnValue
+start_worker (struct Worker *w)
+{
+  int lsocks[] = { worker_listen_fd, -1 };
+  char idx[24];
+
+  GNUNET_snprintf (idx,
+                   sizeof (idx),
+                   "%u",
+                   w->index);
+  /* inherited by the worker, see #get_worker_index() */
+  GNUNET_assert (0 == setenv (WORKER_INDEX_ENV,
+                              idx,
+                              1));
+  w->proc = GNUNET_OS_start_process_v (GNUNET_OS_INHERIT_STD_ALL,
+                                       lsocks,
+                                       worker_argv[0],
+                                       worker_argv);
+  (void) unsetenv (WORKER_INDEX_ENV);
+  if (NULL == w->proc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to launch worker process `%s'\n",
+                worker_argv[0]);
+    return GNUNET_SYSERR;
+  }
+  w->start_time = GNUNET_TIME_absolute_get ();
+  w->cwh = GNUNET_wait_child (w->proc,
+                              &worker_done_cb,
+                              w);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Launch the additional worker processes.  Each worker inherits
+ * our listen socket (systemd-style, as file descriptor 3) and
+ * accepts connections on it with its own event loop and its own
+ * database connection.  Workers that terminate are restarted.
+ *
+ * @param listen_fd our listen socket
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+start_workers (int listen_fd)
+{
+  if (num_workers <= 1)
+    return GNUNET_OK;
+  worker_listen_fd = listen_fd;
+  workers = GNUNET_new_array (num_workers - 1,
+                              struct Worker);
+  for (unsigned long long i = 0; i < num_workers - 1; i++)
+  {
+    workers[i].index = (unsigned int) (i + 1);
     if (GNUNET_OK !=
-        GNUNET_STRINGS_string_to_data (
-          pub_key_str,
-          strlen (pub_key_str),
-          &tu,
-          sizeof(tu)))
-    {
-      GNUNET_break_op (0);
-      return TALER_MHD_reply_with_error (connection,
-                                         MHD_HTTP_BAD_REQUEST,
-                                         TALER_EC_GENERIC_PARAMETER_MALFORMED,
-                                         "truth UUID");
-    }
-    if (0 == strcmp (method,
-                     MHD_HTTP_METHOD_GET))
-    {
-      return AH_handler_truth_get (connection,
-                                   &tu,
-                                   hc);
-    }
-    if (0 == strcmp (method,
-                     MHD_HTTP_METHOD_POST))
-    {
-      return AH_handler_truth_post (connection,
-                                    hc,
-                                    &tu,
-                                    upload_data,
-                                    upload_data_size);
-    }
-    if (0 == strcmp (method,
-                     MHD_HTTP_METHOD_OPTIONS))
-    {
-      return TALER_MHD_reply_cors_preflight (connection);
-    }
-    return TMH_MHD_handler_static_response (&h405,
-                                            connection);
+        start_worker (&workers[i]))
+      return GNUNET_SYSERR;
   }
-  path_matched = false;
-  for (unsigned int i = 0; NULL != handlers[i].url; i++)
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Launched %llu additional worker processes\n",
+              num_workers - 1);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Determine the index of this worker process.
+ *
+ * @return 0 for the main process, otherwise the index
+ *         given by our parent
+ */
+static unsigned int
+get_worker_index (void)
+{
+  const char *idx;
+
+  idx = getenv (WORKER_INDEX_ENV);
+  if (NULL == idx)
+    return 0;
+  return (unsigned int) strtoul (idx,
+                                 NULL,
+                                 10);
+}
+
+
+/**
+ * Task run periodically in worker processes that shuts
+ * the worker down if the main process is gone.
+ *
+ * @param cls NULL
+ */
+static void
+check_parent (void *cls)
+{
+  (void) cls;
+  parent_task = NULL;
+  if (getppid () != parent_pid)
   {
-    struct AH_RequestHandler *rh = &handlers[i];
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Main process terminated, shutting down worker\n");
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  parent_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_SECONDS,
+                                              &check_parent,
+                                              NULL);
+}
 
-    if (0 == strcmp (url,
-                     rh->url))
-    {
-      path_matched = true;
-      if (0 == strcasecmp (method,
-                           MHD_HTTP_METHOD_OPTIONS))
-      {
-        return TALER_MHD_reply_cors_preflight (connection);
-      }
-      if ( (NULL == rh->method) ||
-           (0 == strcasecmp (method,
-                             rh->method)) )
-      {
-        return rh->handler (rh,
-                            connection);
-      }
-    }
+
+/**
+ * Check if we were given a listen socket by our parent
+ * (or systemd) via the LISTEN_FDS protocol.
+ *
+ * @return the listen socket, -1 if we were not given one
+ */
+static int
+get_inherited_socket (void)
+{
+  const char *listen_pid;
+  const char *listen_fds;
+  int flags;
+
+  listen_pid = getenv ("LISTEN_PID");
+  listen_fds = getenv ("LISTEN_FDS");
+  if ( (NULL == listen_pid) ||
+       (NULL == listen_fds) ||
+       (getpid () != strtol (listen_pid,
+                             NULL,
+                             10)) ||
+       (1 != strtoul (listen_fds,
+                      NULL,
+                      10)) )
+    return -1;
+  flags = fcntl (3,
+                 F_GETFD);
+  if ( (-1 == flags) ||
+       (0 != fcntl (3,
+                    F_SETFD,
+                    flags | FD_CLOEXEC)) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "fcntl");
+    return -1;
   }
-  if (path_matched)
-    return TMH_MHD_handler_static_response (&h405,
-                                            connection);
-  return TMH_MHD_handler_static_response (&h404,
-                                          connection);
+  return 3;
 }
 
 
@@ -486,6 +1095,17 @@ do_shutdown (void *cls)
   AH_resume_all_bc ();
   AH_truth_shutdown ();
   AH_truth_upload_shutdown ();
+  AH_policy_shutdown ();
+  AH_ratelimit_shutdown ();
+  AH_config_shutdown ();
+  AH_metrics_shutdown ();
+  AH_gc_stop ();
+  stop_workers ();
+  if (NULL != parent_task)
+  {
+    GNUNET_SCHEDULER_cancel (parent_task);
+    parent_task = NULL;
+  }
   if (NULL != mhd_task)
   {
     GNUNET_SCHEDULER_cancel (mhd_task);
@@ -501,11 +1121,22 @@ do_shutdown (void *cls)
     GNUNET_CURL_gnunet_rc_destroy (rc);
     rc = NULL;
   }
+  if (NULL != mhd_epoll)
+  {
+    /* MHD closes the epoll FD itself */
+    GNUNET_NETWORK_socket_free_memory_only_ (mhd_epoll);
+    mhd_epoll = NULL;
+  }
   if (NULL != mhd)
   {
     MHD_stop_daemon (mhd);
     mhd = NULL;
   }
+  if (NULL != AH_db_pool)
+  {
+    ANASTASIS_DB_pool_destroy (AH_db_pool);
+    AH_db_pool = NULL;
+  }
   if (NULL != db)
   {
     ANASTASIS_DB_plugin_unload (db);
@@ -516,6 +1147,9 @@ do_shutdown (void *cls)
     GNUNET_CONTAINER_heap_destroy (AH_to_heap);
     AH_to_heap = NULL;
   }
+  /* the database plugin and its threads are gone, so nothing
+     records observations anymore */
+  ANASTASIS_METRICS_fini ();
 }
 
 
@@ -570,6 +1204,10 @@ handle_mhd_completion_callback (void *cls,
                 toe);
 #endif
   }
+  if (NULL != hc->metric)
+    ANASTASIS_METRICS_observe (hc->metric,
+                               GNUNET_TIME_absolute_get_duration (
+                                 hc->start_time));
   if (NULL != hc->cc)
     hc->cc (hc);
   GNUNET_free (hc);
@@ -579,7 +1217,9 @@ handle_mhd_completion_callback (void *cls,
 
 /**
  * Function that queries MHD's select sets and
- * starts the task waiting for them.
+ * starts the task waiting for them.  If MHD uses
+ * epoll, we only need to wait for its epoll file
+ * descriptor to become readable.
  *
  * @return task handle for the daemon
  */
@@ -597,6 +1237,23 @@ prepare_daemon (void)
   int haveto;
   struct GNUNET_TIME_Relative tv;
 
+  haveto = MHD_get_timeout (mhd, &timeout);
+  if (haveto == MHD_YES)
+    tv = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                        timeout);
+  else
+    tv = GNUNET_TIME_UNIT_FOREVER_REL;
+  if (NULL != mhd_epoll)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Adding run_daemon epoll task\n");
+    return GNUNET_SCHEDULER_add_read_net_with_priority (
+      tv,
+      GNUNET_SCHEDULER_PRIORITY_HIGH,
+      mhd_epoll,
+      &run_daemon,
+      NULL);
+  }
   FD_ZERO (&rs);
   FD_ZERO (&ws);
   FD_ZERO (&es);
@@ -609,12 +1266,6 @@ prepare_daemon (void)
                                 &ws,
                                 &es,
                                 &max));
-  haveto = MHD_get_timeout (mhd, &timeout);
-  if (haveto == MHD_YES)
-    tv = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
-                                        timeout);
-  else
-    tv = GNUNET_TIME_UNIT_FOREVER_REL;
   GNUNET_NETWORK_fdset_copy_native (wrs, &rs, max + 1);
   GNUNET_NETWORK_fdset_copy_native (wws, &ws, max + 1);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -649,6 +1300,9 @@ run (void *cls,
   int fh;
   uint16_t port;
   enum TALER_MHD_GlobalOptions go;
+  bool is_worker;
+  unsigned int worker_index;
+  unsigned int mhd_flags;
 
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Starting anastasis-httpd\n");
@@ -656,6 +1310,8 @@ run (void *cls,
   if (AH_connection_close)
     go |= TALER_MHD_GO_FORCE_CONNECTION_CLOSE;
   AH_load_terms (config);
+  AH_policy_init (config);
+  AH_ratelimit_init (config);
   TALER_MHD_setup (go);
   AH_cfg = config;
   global_result = GNUNET_SYSERR;
@@ -852,6 +1508,21 @@ run (void *cls,
                                       0));
     GNUNET_free (server_salt);
   }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (config,
+                                             "anastasis",
+                                             "WORKERS",
+                                             &num_workers))
+    num_workers = 1;
+  if (0 == num_workers)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "anastasis",
+                               "WORKERS",
+                               "must be positive");
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
 
   /* setup HTTP client event loop */
   AH_ctx = GNUNET_CURL_init (&GNUNET_CURL_gnunet_scheduler_reschedule,
@@ -906,17 +1577,81 @@ run (void *cls,
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
+  {
+    unsigned long long db_threads;
+
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (config,
+                                               "anastasis",
+                                               "DB_THREADS",
+                                               &db_threads))
+      db_threads = 4;
+    if (0 != db_threads)
+    {
+      AH_db_pool = ANASTASIS_DB_pool_create (config,
+                                             (unsigned int) db_threads);
+      if (NULL == AH_db_pool)
+      {
+        GNUNET_SCHEDULER_shutdown ();
+        return;
+      }
+    }
+  }
+  if (GNUNET_OK !=
+      AH_config_init ())
+  {
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
 
-  fh = TALER_MHD_bind (config,
-                       "anastasis",
-                       &port);
-  if ( (0 == port) &&
+  port = 0;
+  /* We may have been given a listen socket by systemd even if
+     we are the main process, so only the index tells us whether
+     we are a worker. */
+  worker_index = get_worker_index ();
+  is_worker = (0 != worker_index);
+  fh = get_inherited_socket ();
+  if ( (is_worker) &&
        (-1 == fh) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Worker process %u did not inherit a listen socket\n",
+                worker_index);
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  if (GNUNET_OK !=
+      AH_metrics_init (config,
+                       worker_index))
   {
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
-  mhd = MHD_start_daemon (MHD_USE_SUSPEND_RESUME | MHD_USE_DUAL_STACK,
+  init_route_metrics ();
+  if (is_worker)
+  {
+    parent_pid = getppid ();
+    parent_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_SECONDS,
+                                                &check_parent,
+                                                NULL);
+  }
+  if (-1 == fh)
+  {
+    fh = TALER_MHD_bind (config,
+                         "anastasis",
+                         &port);
+    if ( (0 == port) &&
+         (-1 == fh) )
+    {
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+  }
+  mhd_flags = MHD_USE_SUSPEND_RESUME | MHD_USE_DUAL_STACK;
+  if (MHD_YES ==
+      MHD_is_feature_supported (MHD_FEATURE_EPOLL))
+    mhd_flags |= MHD_USE_EPOLL;
+  mhd = MHD_start_daemon (mhd_flags,
                           port,
                           NULL, NULL,
                           &url_handler, NULL,
@@ -934,6 +1669,41 @@ run (void *cls,
     GNUNET_SCHEDULER_shutdown ();
     return;
   }
+  if (0 != (mhd_flags & MHD_USE_EPOLL))
+  {
+    const union MHD_DaemonInfo *di;
+
+    di = MHD_get_daemon_info (mhd,
+                              MHD_DAEMON_INFO_EPOLL_FD);
+    if (NULL == di)
+    {
+      GNUNET_break (0);
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    mhd_epoll = GNUNET_NETWORK_socket_box_native (di->epoll_fd);
+  }
+  if (! is_worker)
+  {
+    const union MHD_DaemonInfo *di;
+
+    di = MHD_get_daemon_info (mhd,
+                              MHD_DAEMON_INFO_LISTEN_FD);
+    if ( (NULL == di) ||
+         (GNUNET_OK !=
+          start_workers (di->listen_fd)) )
+    {
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    /* only the main process collects garbage */
+    if (GNUNET_OK !=
+        AH_gc_start (config))
+    {
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+  }
   global_result = GNUNET_OK;
   mhd_task = prepare_daemon ();
 }
@@ -990,6 +1760,7 @@ main (int argc,
      the ANASTASIS defaults to be used! */
   (void) TALER_project_data_default ();
   GNUNET_OS_init (ANASTASIS_project_data_default ());
+  worker_argv = argv;
   res = GNUNET_PROGRAM_run (argc, argv,
                             "anastasis-httpd",
                             "Anastasis HTTP interface",
@@ -103,6 +103,23 @@ typedef void
 (*TM_ContextCleanup)(struct TM_HandlerContext *hc);
 
 
+/**
+ * Signature of a function handling a request after its route
+ * was resolved.
+ *
+ * @param hc context of the request
+ * @param connection the MHD connection to handle
+ * @param upload_data upload data
+ * @param[in,out] upload_data_size number of bytes (left) in @a upload_data
+ * @return MHD result code
+ */
+typedef MHD_RESULT
+(*TM_RouteHandler)(struct TM_HandlerContext *hc,
+                   struct MHD_Connection *connection,
+                   const char *upload_data,
+                   size_t *upload_data_size);
+
+
 /**
  * Each MHD response handler that sets the "connection_cls" to a
  * non-NULL value must use a struct that has this struct as its first
@@ -126,13 +143,46 @@ struct TM_HandlerContext
   /**
    * Which request handler is handling this request?
    */
-  const struct AH_RequestHandler *rh;
+  struct AH_RequestHandler *rh;
+
+  /**
+   * Function handling this request, resolved from URL and method
+   * on the first call for the request.
+   */
+  TM_RouteHandler route;
+
+  /**
+   * Resource the request is about, decoded from the URL once
+   * the @e route is resolved.
+   */
+  union
+  {
+    /**
+     * Account, for requests on ``/policy/``.
+     */
+    struct ANASTASIS_CRYPTO_AccountPublicKeyP account_pub;
+
+    /**
+     * Truth, for requests on ``/truth/``.
+     */
+    struct ANASTASIS_CRYPTO_TruthUUIDP truth_uuid;
+  } resource;
 
   /**
    * URL requested by the client, for logging.
    */
   const char *url;
 
+  /**
+   * Latency histogram of the route, NULL if not recorded.
+   */
+  struct ANASTASIS_METRICS_Histogram *metric;
+
+  /**
+   * When did we start to handle the request?
+   */
+  struct GNUNET_TIME_Absolute start_time;
+
   /**
    * Asynchronous request context id.
    */
@@ -144,6 +194,12 @@ struct TM_HandlerContext
  */
 extern struct ANASTASIS_DatabasePlugin *db;
 
+/**
+ * Threads running slow database operations, NULL to run
+ * them synchronously using #db.
+ */
+extern struct ANASTASIS_DB_Pool *AH_db_pool;
+
 /**
  * Upload limit to the service, in megabytes.
  */
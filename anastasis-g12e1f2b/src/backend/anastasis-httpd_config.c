@@ -74,11 +74,189 @@ add_methods (void *cls,
 }
 
 
-MHD_RESULT
-AH_handler_config (struct AH_RequestHandler *rh,
-                   struct MHD_Connection *connection)
+/**
+ * How long may clients cache the ``/config`` response?  The response
+ * only changes when the service is restarted with a new configuration.
+ */
+#define CONFIG_CACHE_CONTROL "public, max-age=3600"
+
+
+/**
+ * Response to ``/config``, built at startup.
+ */
+static struct MHD_Response *config_resp;
+
+/**
+ * Deflate-compressed variant of #config_resp, NULL if compression
+ * did not reduce the size.
+ */
+static struct MHD_Response *config_resp_deflate;
+
+/**
+ * Empty response with the ETag of #config_resp, used to answer
+ * requests with a matching ``If-None-Match`` header.
+ */
+static struct MHD_Response *config_resp_not_modified;
+
+/**
+ * Empty response with the ETag of #config_resp_deflate, used to
+ * answer requests with a matching ``If-None-Match`` header.
+ */
+static struct MHD_Response *config_resp_deflate_not_modified;
+
+/**
+ * ETag of #config_resp, including the quotes.
+ */
+static char *config_etag;
+
+/**
+ * ETag of #config_resp_deflate, including the quotes.  The encoded
+ * body differs, so it needs an ETag of its own.
+ */
+static char *config_etag_deflate;
+
+
+/**
+ * Add the headers common to all variants of the ``/config``
+ * response to @a resp.
+ *
+ * @param[in,out] resp response to modify
+ * @param etag ETag of the variant
+ */
+static void
+add_config_headers (struct MHD_Response *resp,
+                    const char *etag)
+{
+  TALER_MHD_add_global_headers (resp);
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_ETAG,
+                                         etag));
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_CACHE_CONTROL,
+                                         CONFIG_CACHE_CONTROL));
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_VARY,
+                                         MHD_HTTP_HEADER_ACCEPT_ENCODING));
+}
+
+
+/**
+ * Create a response with @a body of @a body_size bytes.
+ *
+ * @param[in] body response body, freed by the response
+ * @param body_size number of bytes in @a body
+ * @param etag ETag of the response
+ * @return the response
+ */
+static struct MHD_Response *
+make_config_response (void *body,
+                      size_t body_size,
+                      const char *etag)
+{
+  struct MHD_Response *resp;
+
+  resp = MHD_create_response_from_buffer (body_size,
+                                          body,
+                                          MHD_RESPMEM_MUST_FREE);
+  GNUNET_assert (NULL != resp);
+  add_config_headers (resp,
+                      etag);
+  GNUNET_break (MHD_YES ==
+                MHD_add_response_header (resp,
+                                         MHD_HTTP_HEADER_CONTENT_TYPE,
+                                         "application/json"));
+  return resp;
+}
+
+
+/**
+ * Create an empty "304 Not Modified" response for the variant
+ * with @a etag.
+ *
+ * @param etag ETag of the variant
+ * @return the response
+ */
+static struct MHD_Response *
+make_not_modified_response (const char *etag)
+{
+  struct MHD_Response *resp;
+
+  resp = MHD_create_response_from_buffer (0,
+                                          NULL,
+                                          MHD_RESPMEM_PERSISTENT);
+  GNUNET_assert (NULL != resp);
+  add_config_headers (resp,
+                      etag);
+  return resp;
+}
+
+
+/**
+ * Check if an ``If-None-Match`` header matches @a etag.  The header
+ * is either ``*`` or a comma-separated list of quoted entity tags,
+ * each optionally prefixed with ``W/``.  As required for
+ * ``If-None-Match``, weak and strong tags are compared alike.
+ *
+ * @param inm value of the ``If-None-Match`` header
+ * @param etag quoted ETag of the response
+ * @return true if @a inm matches @a etag
+ */
+static bool
+etag_matches (const char *inm,
+              const char *etag)
+{
+  size_t etag_len = strlen (etag);
+  const char *pos = inm;
+
+  while ( (' ' == *pos) ||
+          ('\t' == *pos) )
+    pos++;
+  if ('*' == *pos)
+    return true;
+  while ('\0' != *pos)
+  {
+    const char *end;
+
+    if ( (' ' == *pos) ||
+         ('\t' == *pos) ||
+         (',' == *pos) )
+    {
+      pos++;
+      continue;
+    }
+    if (0 == strncmp (pos,
+                      "W/",
+                      strlen ("W/")))
+      pos += strlen ("W/");
+    if ('"' != *pos)
+      return false; /* malformed */
+    end = strchr (pos + 1,
+                  '"');
+    if (NULL == end)
+      return false; /* malformed */
+    end++;
+    if ( ((size_t) (end - pos) == etag_len) &&
+         (0 == strncmp (pos,
+                        etag,
+                        etag_len)) )
+      return true;
+    pos = end;
+  }
+  return false;
+}
+
+
+enum GNUNET_GenericReturnValue
+AH_config_init (void)
 {
   json_t *method_arr = json_array ();
+  json_t *body;
+  char *json_str;
+  size_t json_len;
+  struct GNUNET_HashCode h;
 
   GNUNET_assert (NULL != method_arr);
   {
@@ -97,9 +275,7 @@ AH_handler_config (struct AH_RequestHandler *rh,
   GNUNET_CONFIGURATION_iterate_sections (AH_cfg,
                                          &add_methods,
                                          method_arr);
-  return TALER_MHD_REPLY_JSON_PACK (
-    connection,
-    MHD_HTTP_OK,
+  body = GNUNET_JSON_PACK (
     GNUNET_JSON_pack_string ("name",
                              "anastasis"),
     GNUNET_JSON_pack_string ("version",
@@ -120,6 +296,121 @@ AH_handler_config (struct AH_RequestHandler *rh,
                             &AH_insurance),
     GNUNET_JSON_pack_data_auto ("server_salt",
                                 &AH_server_salt));
+  json_str = json_dumps (body,
+                         JSON_INDENT (2));
+  json_decref (body);
+  if (NULL == json_str)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  json_len = strlen (json_str);
+  GNUNET_CRYPTO_hash (json_str,
+                      json_len,
+                      &h);
+  {
+    char *hs;
+
+    hs = GNUNET_STRINGS_data_to_string_alloc (&h,
+                                              sizeof (h));
+    GNUNET_asprintf (&config_etag,
+                     "\"%s\"",
+                     hs);
+    GNUNET_asprintf (&config_etag_deflate,
+                     "\"%s-deflate\"",
+                     hs);
+    GNUNET_free (hs);
+  }
+  {
+    void *deflated = GNUNET_memdup (json_str,
+                                    json_len);
+    size_t deflated_len = json_len;
+
+    if (MHD_YES ==
+        TALER_MHD_body_compress (&deflated,
+                                 &deflated_len))
+    {
+      config_resp_deflate = make_config_response (deflated,
+                                                  deflated_len,
+                                                  config_etag_deflate);
+      GNUNET_break (MHD_YES ==
+                    MHD_add_response_header (config_resp_deflate,
+                                             MHD_HTTP_HEADER_CONTENT_ENCODING,
+                                             "deflate"));
+      config_resp_deflate_not_modified
+        = make_not_modified_response (config_etag_deflate);
+    }
+    else
+    {
+      GNUNET_free (deflated);
+    }
+  }
+  config_resp = make_config_response (json_str,
+                                      json_len,
+                                      config_etag);
+  config_resp_not_modified = make_not_modified_response (config_etag);
+  return GNUNET_OK;
+}
+
+
+void
+AH_config_shutdown (void)
+{
+  if (NULL != config_resp)
+  {
+    MHD_destroy_response (config_resp);
+    config_resp = NULL;
+  }
+  if (NULL != config_resp_deflate)
+  {
+    MHD_destroy_response (config_resp_deflate);
+    config_resp_deflate = NULL;
+  }
+  if (NULL != config_resp_not_modified)
+  {
+    MHD_destroy_response (config_resp_not_modified);
+    config_resp_not_modified = NULL;
+  }
+  if (NULL != config_resp_deflate_not_modified)
+  {
+    MHD_destroy_response (config_resp_deflate_not_modified);
+    config_resp_deflate_not_modified = NULL;
+  }
+  GNUNET_free (config_etag);
+  GNUNET_free (config_etag_deflate);
+}
+
+
+MHD_RESULT
+AH_handler_config (struct AH_RequestHandler *rh,
+                   struct MHD_Connection *connection)
+{
+  const char *inm;
+  struct MHD_Response *resp = config_resp;
+  struct MHD_Response *not_modified = config_resp_not_modified;
+  const char *etag = config_etag;
+
+  (void) rh;
+  if ( (NULL != config_resp_deflate) &&
+       (MHD_YES ==
+        TALER_MHD_can_compress (connection)) )
+  {
+    resp = config_resp_deflate;
+    not_modified = config_resp_deflate_not_modified;
+    etag = config_etag_deflate;
+  }
+  inm = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND,
+                                     MHD_HTTP_HEADER_IF_NONE_MATCH);
+  if ( (NULL != inm) &&
+       (etag_matches (inm,
+                      etag)) )
+    return MHD_queue_response (connection,
+                               MHD_HTTP_NOT_MODIFIED,
+                               not_modified);
+  return MHD_queue_response (connection,
+                             MHD_HTTP_OK,
+                             resp);
 }
 
 
@@ -25,6 +25,23 @@
 #include <microhttpd.h>
 #include "anastasis-httpd.h"
 
+/**
+ * Build the response to /config.  Must be called once the
+ * configuration was parsed and the database is available.
+ *
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+AH_config_init (void);
+
+
+/**
+ * Release the response to /config.
+ */
+void
+AH_config_shutdown (void);
+
+
 /**
  * Manages a /config call.
  *
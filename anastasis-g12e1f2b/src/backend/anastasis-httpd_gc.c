@@ -0,0 +1,192 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file backend/anastasis-httpd_gc.c
+ * @brief periodic garbage collection of the database
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "anastasis-httpd_gc.h"
+
+/**
+ * How long after their expiration do we keep backups around?
+ * Same as for `anastasis-dbinit -g`.
+ */
+#define BACKUP_GRACE_PERIOD GNUNET_TIME_relative_multiply ( \
+    GNUNET_TIME_UNIT_MONTHS, 6)
+
+/**
+ * How long do we keep pending payments around?
+ * Same as for `anastasis-dbinit -g`.
+ */
+#define PENDING_PAYMENT_LIFETIME GNUNET_TIME_relative_multiply ( \
+    GNUNET_TIME_UNIT_YEARS, 10)
+
+
+/**
+ * Task running the garbage collection.
+ */
+static struct GNUNET_SCHEDULER_Task *gc_task;
+
+/**
+ * How often do we run garbage collection?
+ */
+static struct GNUNET_TIME_Relative gc_frequency;
+
+/**
+ * Maximum number of rows to delete per table in one step.
+ */
+static unsigned long long gc_batch_size;
+
+
+/**
+ * Start a period of garbage collection.
+ *
+ * @param cls NULL
+ */
+static void
+start_gc (void *cls);
+
+
+/**
+ * Run one step of garbage collection.  If anything was deleted,
+ * immediately schedule the next step at idle priority, otherwise
+ * wait for #gc_frequency.
+ *
+ * @param cls NULL
+ */
+static void
+do_gc (void *cls)
+{
+  struct GNUNET_TIME_Absolute now;
+  enum GNUNET_DB_QueryStatus qs;
+
+  (void) cls;
+  gc_task = NULL;
+  now = GNUNET_TIME_absolute_get ();
+  qs = db->gc_batch (db->cls,
+                     GNUNET_TIME_absolute_subtract (now,
+                                                    BACKUP_GRACE_PERIOD),
+                     GNUNET_TIME_absolute_subtract (now,
+                                                    PENDING_PAYMENT_LIFETIME),
+                     gc_batch_size);
+  if (qs < 0)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Garbage collection failed (%d)\n",
+                (int) qs);
+  }
+  else if (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS != qs)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Garbage collection deleted %d rows\n",
+                (int) qs);
+    gc_task = GNUNET_SCHEDULER_add_with_priority (
+      GNUNET_SCHEDULER_PRIORITY_IDLE,
+      &do_gc,
+      NULL);
+    return;
+  }
+  gc_task = GNUNET_SCHEDULER_add_delayed_with_priority (
+    gc_frequency,
+    GNUNET_SCHEDULER_PRIORITY_IDLE,
+    &start_gc,
+    NULL);
+}
+
+
+/**
+ * Start a period of garbage collection.  Maintains the partitions
+ * of the database once, then deletes expired rows step by step.
+ *
+ * @param cls NULL
+ */
+static void
+start_gc (void *cls)
+{
+  enum GNUNET_DB_QueryStatus qs;
+
+  (void) cls;
+  gc_task = NULL;
+  qs = db->maintain_partitions (
+    db->cls,
+    GNUNET_TIME_absolute_subtract (GNUNET_TIME_absolute_get (),
+                                   BACKUP_GRACE_PERIOD));
+  if (qs < 0)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Partition maintenance failed (%d)\n",
+                (int) qs);
+  else
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Garbage collection dropped %d partitions\n",
+                (int) qs);
+  do_gc (NULL);
+}
+
+
+enum GNUNET_GenericReturnValue
+AH_gc_start (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "anastasis",
+                                           "GC_FREQUENCY",
+                                           &gc_frequency))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "GC_FREQUENCY not set, not running garbage collection\n");
+    return GNUNET_OK;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "anastasis",
+                                             "GC_BATCH_SIZE",
+                                             &gc_batch_size))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                               "anastasis",
+                               "GC_BATCH_SIZE");
+    return GNUNET_SYSERR;
+  }
+  if (0 == gc_batch_size)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "anastasis",
+                               "GC_BATCH_SIZE",
+                               "must be positive");
+    return GNUNET_SYSERR;
+  }
+  gc_task = GNUNET_SCHEDULER_add_delayed_with_priority (
+    gc_frequency,
+    GNUNET_SCHEDULER_PRIORITY_IDLE,
+    &start_gc,
+    NULL);
+  return GNUNET_OK;
+}
+
+
+void
+AH_gc_stop (void)
+{
+  if (NULL != gc_task)
+  {
+    GNUNET_SCHEDULER_cancel (gc_task);
+    gc_task = NULL;
+  }
+}
+
+
+/* end of anastasis-httpd_gc.c */
@@ -0,0 +1,46 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file backend/anastasis-httpd_gc.h
+ * @brief periodic garbage collection of the database
+ * @author Christian Grothoff
+ */
+#ifndef ANASTASIS_HTTPD_GC_H
+#define ANASTASIS_HTTPD_GC_H
+#include "anastasis-httpd.h"
+
+
+/**
+ * Start periodic garbage collection of the database as per
+ * configuration.
+ *
+ * @param cfg configuration to process
+ * @return #GNUNET_OK on success
+ */
+enum GNUNET_GenericReturnValue
+AH_gc_start (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Stop periodic garbage collection.
+ */
+void
+AH_gc_stop (void);
+
+
+#endif
+
+/* end of anastasis-httpd_gc.h */
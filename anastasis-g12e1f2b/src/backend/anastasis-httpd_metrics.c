@@ -0,0 +1,164 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file backend/anastasis-httpd_metrics.c
+ * @brief serve /metrics on the admin port
+ * @author Christian Grothoff
+ *
+ * The admin port is served by a separate MHD daemon with its own
+ * thread and only bound to the loopback interface.  As the handler
+ * runs on that thread, it must not use the scheduler; it only reads
+ * the (thread-safe) histograms.
+ */
+#include "platform.h"
+#include "anastasis-httpd_metrics.h"
+#include "anastasis_util_lib.h"
+
+
+/**
+ * Daemon serving the admin port, NULL if disabled.
+ */
+static struct MHD_Daemon *admin;
+
+
+/**
+ * Handle request on the admin port.
+ *
+ * @param cls NULL
+ * @param connection the connection
+ * @param url the requested url
+ * @param method the HTTP method used
+ * @param version the HTTP version string
+ * @param upload_data the data being uploaded
+ * @param upload_data_size size of @a upload_data
+ * @param con_cls unused
+ * @return MHD result code
+ */
+static MHD_RESULT
+admin_handler (void *cls,
+               struct MHD_Connection *connection,
+               const char *url,
+               const char *method,
+               const char *version,
+               const char *upload_data,
+               size_t *upload_data_size,
+               void **con_cls)
+{
+  struct MHD_Response *resp;
+  unsigned int http_status;
+  MHD_RESULT ret;
+
+  (void) cls;
+  (void) version;
+  (void) upload_data;
+  (void) upload_data_size;
+  (void) con_cls;
+  if ( (0 == strcmp (url,
+                     "/metrics")) &&
+       ( (0 == strcmp (method,
+                       MHD_HTTP_METHOD_GET)) ||
+         (0 == strcmp (method,
+                       MHD_HTTP_METHOD_HEAD)) ) )
+  {
+    char *body;
+
+    body = ANASTASIS_METRICS_dump ();
+    resp = MHD_create_response_from_buffer (strlen (body),
+                                            body,
+                                            MHD_RESPMEM_MUST_FREE);
+    GNUNET_break (MHD_YES ==
+                  MHD_add_response_header (resp,
+                                           MHD_HTTP_HEADER_CONTENT_TYPE,
+                                           "text/plain; version=0.0.4"));
+    http_status = MHD_HTTP_OK;
+  }
+  else
+  {
+    resp = MHD_create_response_from_buffer (0,
+                                            NULL,
+                                            MHD_RESPMEM_PERSISTENT);
+    http_status = MHD_HTTP_NOT_FOUND;
+  }
+  ret = MHD_queue_response (connection,
+                            http_status,
+                            resp);
+  MHD_destroy_response (resp);
+  return ret;
+}
+
+
+enum GNUNET_GenericReturnValue
+AH_metrics_init (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                 unsigned int worker_index)
+{
+  unsigned long long port;
+  struct sockaddr_in sa;
+
+  if ( (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (cfg,
+                                               "anastasis",
+                                               "METRICS_PORT",
+                                               &port)) ||
+       (0 == port) )
+    return GNUNET_OK;
+  port += worker_index;
+  if (port > UINT16_MAX)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "anastasis",
+                               "METRICS_PORT",
+                               "port number too large for all workers");
+    return GNUNET_SYSERR;
+  }
+  memset (&sa,
+          0,
+          sizeof (sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons ((uint16_t) port);
+  sa.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  admin = MHD_start_daemon (MHD_USE_INTERNAL_POLLING_THREAD,
+                            (uint16_t) port,
+                            NULL, NULL,
+                            &admin_handler, NULL,
+                            MHD_OPTION_SOCK_ADDR, &sa,
+                            MHD_OPTION_CONNECTION_TIMEOUT,
+                            (unsigned int) 10 /* 10s */,
+                            MHD_OPTION_END);
+  if (NULL == admin)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to serve metrics on port %llu\n",
+                port);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Serving metrics on 127.0.0.1:%llu\n",
+              port);
+  return GNUNET_OK;
+}
+
+
+void
+AH_metrics_shutdown (void)
+{
+  if (NULL == admin)
+    return;
+  MHD_stop_daemon (admin);
+  admin = NULL;
+}
+
+
+/* end of anastasis-httpd_metrics.c */
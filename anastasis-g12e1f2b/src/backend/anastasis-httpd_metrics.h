@@ -0,0 +1,48 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file backend/anastasis-httpd_metrics.h
+ * @brief serve /metrics on the admin port
+ * @author Christian Grothoff
+ */
+#ifndef ANASTASIS_HTTPD_METRICS_H
+#define ANASTASIS_HTTPD_METRICS_H
+#include "anastasis-httpd.h"
+
+
+/**
+ * Start serving /metrics if an admin port is configured.
+ *
+ * @param cfg configuration to process
+ * @param worker_index index of this worker process, 0 for the
+ *        main process; added to the configured port
+ * @return #GNUNET_OK on success (including if disabled)
+ */
+enum GNUNET_GenericReturnValue
+AH_metrics_init (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                 unsigned int worker_index);
+
+
+/**
+ * Stop serving /metrics.
+ */
+void
+AH_metrics_shutdown (void);
+
+
+#endif
+
+/* end of anastasis-httpd_metrics.h */
@@ -38,17 +38,328 @@
     GNUNET_TIME_UNIT_MINUTES, 30)
 
 
+/**
+ * Entry in the cache of responses for GET /policy requests.  As a
+ * given version of a recovery document never changes, a response
+ * for it can be served again as long as the account exists.
+ */
+struct PolicyCacheEntry
+{
+
+  /**
+   * Kept in LRU DLL, most recently used at the head.
+   */
+  struct PolicyCacheEntry *next;
+
+  /**
+   * Kept in LRU DLL, most recently used at the head.
+   */
+  struct PolicyCacheEntry *prev;
+
+  /**
+   * Response with the recovery document and all headers, we
+   * own one reference to it.
+   */
+  struct MHD_Response *resp;
+
+  /**
+   * Account the recovery document belongs to.
+   */
+  struct ANASTASIS_CRYPTO_AccountPublicKeyP account_pub;
+
+  /**
+   * Number of bytes in the recovery document.
+   */
+  size_t size;
+
+  /**
+   * Version of the recovery document.
+   */
+  uint32_t version;
+
+};
+
+
+/**
+ * Cached responses by account public key (multiple versions per
+ * account are possible).  NULL if caching is disabled.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *policy_cache;
+
+/**
+ * Head of LRU DLL of cache entries.
+ */
+static struct PolicyCacheEntry *lru_head;
+
+/**
+ * Tail of LRU DLL of cache entries.
+ */
+static struct PolicyCacheEntry *lru_tail;
+
+/**
+ * Total number of bytes of recovery documents in the cache.
+ */
+static unsigned long long cache_size;
+
+/**
+ * Maximum number of bytes of recovery documents to cache.
+ */
+static unsigned long long cache_limit;
+
+
+/**
+ * Compute the key for @a account_pub in #policy_cache.
+ *
+ * @param account_pub account to compute key for
+ * @param[out] key set to the key
+ */
+static void
+cache_key (const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+           struct GNUNET_HashCode *key)
+{
+  GNUNET_CRYPTO_hash (account_pub,
+                      sizeof (*account_pub),
+                      key);
+}
+
+
+/**
+ * Remove @a pce from the cache and release its response.
+ *
+ * @param[in] pce entry to free
+ */
+static void
+cache_remove (struct PolicyCacheEntry *pce)
+{
+  struct GNUNET_HashCode key;
+
+  cache_key (&pce->account_pub,
+             &key);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (policy_cache,
+                                                       &key,
+                                                       pce));
+  GNUNET_CONTAINER_DLL_remove (lru_head,
+                               lru_tail,
+                               pce);
+  cache_size -= pce->size;
+  MHD_destroy_response (pce->resp);
+  GNUNET_free (pce);
+}
+
+
+/**
+ * Closure for #find_version_cb().
+ */
+struct FindContext
+{
+  /**
+   * Version we are looking for.
+   */
+  uint32_t version;
+
+  /**
+   * Set to the matching entry, if any.
+   */
+  struct PolicyCacheEntry *pce;
+};
+
+
+/**
+ * Check if @a value is the entry for the version we are looking for.
+ *
+ * @param cls a `struct FindContext`
+ * @param key unused
+ * @param value a `struct PolicyCacheEntry`
+ * @return #GNUNET_NO if we found the entry
+ */
+static enum GNUNET_GenericReturnValue
+find_version_cb (void *cls,
+                 const struct GNUNET_HashCode *key,
+                 void *value)
+{
+  struct FindContext *fc = cls;
+  struct PolicyCacheEntry *pce = value;
+
+  (void) key;
+  if (pce->version != fc->version)
+    return GNUNET_YES;
+  fc->pce = pce;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Lookup cached response for @a version of the recovery document
+ * of @a account_pub.
+ *
+ * @param account_pub account to lookup
+ * @param version version to lookup
+ * @return NULL if not in cache
+ */
+static struct PolicyCacheEntry *
+cache_lookup (const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+              uint32_t version)
+{
+  struct GNUNET_HashCode key;
+  struct FindContext fc = {
+    .version = version
+  };
+
+  if (NULL == policy_cache)
+    return NULL;
+  cache_key (account_pub,
+             &key);
+  GNUNET_CONTAINER_multihashmap_get_multiple (policy_cache,
+                                              &key,
+                                              &find_version_cb,
+                                              &fc);
+  if (NULL != fc.pce)
+  {
+    /* move to front of LRU */
+    GNUNET_CONTAINER_DLL_remove (lru_head,
+                                 lru_tail,
+                                 fc.pce);
+    GNUNET_CONTAINER_DLL_insert (lru_head,
+                                 lru_tail,
+                                 fc.pce);
+  }
+  return fc.pce;
+}
+
+
+/**
+ * Add @a resp for @a version of the recovery document of
+ * @a account_pub to the cache, evicting the least recently
+ * used entries if the cache is full.
+ *
+ * @param account_pub account the document belongs to
+ * @param version version of the document
+ * @param resp response to cache
+ * @param size number of bytes in the document
+ * @return true if the cache took ownership of @a resp
+ */
+static bool
+cache_add (const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+           uint32_t version,
+           struct MHD_Response *resp,
+           size_t size)
+{
+  struct PolicyCacheEntry *pce;
+  struct GNUNET_HashCode key;
+
+  if ( (NULL == policy_cache) ||
+       (size > cache_limit) ||
+       (NULL != cache_lookup (account_pub,
+                              version)) )
+    return false;
+  while (cache_size + size > cache_limit)
+    cache_remove (lru_tail);
+  pce = GNUNET_new (struct PolicyCacheEntry);
+  pce->resp = resp;
+  pce->account_pub = *account_pub;
+  pce->size = size;
+  pce->version = version;
+  cache_key (account_pub,
+             &key);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (
+                   policy_cache,
+                   &key,
+                   pce,
+                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  GNUNET_CONTAINER_DLL_insert (lru_head,
+                               lru_tail,
+                               pce);
+  cache_size += size;
+  return true;
+}
+
+
+/**
+ * Remove @a value from the cache.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value a `struct PolicyCacheEntry`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+remove_cb (void *cls,
+           const struct GNUNET_HashCode *key,
+           void *value)
+{
+  struct PolicyCacheEntry *pce = value;
+
+  (void) cls;
+  (void) key;
+  cache_remove (pce);
+  return GNUNET_YES;
+}
+
+
+void
+AH_policy_cache_invalidate (
+  const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub)
+{
+  struct GNUNET_HashCode key;
+
+  if (NULL == policy_cache)
+    return;
+  cache_key (account_pub,
+             &key);
+  GNUNET_CONTAINER_multihashmap_get_multiple (policy_cache,
+                                              &key,
+                                              &remove_cb,
+                                              NULL);
+}
+
+
+void
+AH_policy_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (cfg,
+                                           "anastasis",
+                                           "POLICY_CACHE_SIZE",
+                                           &cache_limit))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Recovery document cache disabled\n");
+    return;
+  }
+  if (0 == cache_limit)
+    return;
+  policy_cache = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                       GNUNET_NO);
+}
+
+
+void
+AH_policy_shutdown (void)
+{
+  if (NULL == policy_cache)
+    return;
+  while (NULL != lru_head)
+    cache_remove (lru_head);
+  GNUNET_CONTAINER_multihashmap_destroy (policy_cache);
+  policy_cache = NULL;
+}
+
+
 /**
  * Return the current recoverydocument of @a account on @a connection
  * using @a default_http_status on success.
  *
  * @param connection MHD connection to use
  * @param account_pub account to query
+ * @param latest_version latest version of the recovery document
  * @return MHD result code
  */
 static MHD_RESULT
 return_policy (struct MHD_Connection *connection,
-               const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub)
+               const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+               uint32_t latest_version)
 {
   enum GNUNET_DB_QueryStatus qs;
   struct MHD_Response *resp;
@@ -77,6 +388,23 @@ return_policy (struct MHD_Connection *connection,
                                          TALER_EC_GENERIC_PARAMETER_MALFORMED,
                                          "version");
     }
+  }
+  else
+  {
+    version = latest_version;
+  }
+  {
+    struct PolicyCacheEntry *pce;
+
+    pce = cache_lookup (account_pub,
+                        version);
+    if (NULL != pce)
+      return MHD_queue_response (connection,
+                                 MHD_HTTP_OK,
+                                 pce->resp);
+  }
+  if (NULL != version_s)
+  {
     qs = db->get_recovery_document (db->cls,
                                     account_pub,
                                     version,
@@ -156,7 +484,11 @@ return_policy (struct MHD_Connection *connection,
     ret = MHD_queue_response (connection,
                               MHD_HTTP_OK,
                               resp);
-    MHD_destroy_response (resp);
+    if (! cache_add (account_pub,
+                     version,
+                     resp,
+                     res_recovery_data_size))
+      MHD_destroy_response (resp);
     return ret;
   }
 }
@@ -171,12 +503,26 @@ AH_policy_get (struct MHD_Connection *connection,
   MHD_RESULT ret;
   uint32_t version;
   struct GNUNET_TIME_Absolute expiration;
+  const char *inm;
 
-  as = db->lookup_account (db->cls,
-                           account_pub,
-                           &expiration,
-                           &recovery_data_hash,
-                           &version);
+  inm = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND,
+                                     MHD_HTTP_HEADER_IF_NONE_MATCH);
+  /* A stale replica must not tell the client that its (outdated)
+     policy is still current, so conditional requests are answered
+     from the primary database. */
+  if (NULL != inm)
+    as = db->lookup_account (db->cls,
+                             account_pub,
+                             &expiration,
+                             &recovery_data_hash,
+                             &version);
+  else
+    as = db->lookup_account_readonly (db->cls,
+                                      account_pub,
+                                      &expiration,
+                                      &recovery_data_hash,
+                                      &version);
   switch (as)
   {
   case ANASTASIS_DB_ACCOUNT_STATUS_PAYMENT_REQUIRED:
@@ -205,48 +551,42 @@ AH_policy_get (struct MHD_Connection *connection,
     }
     return ret;
   case ANASTASIS_DB_ACCOUNT_STATUS_VALID_HASH_RETURNED:
+    if (NULL != inm)
     {
-      const char *inm;
+      struct GNUNET_HashCode inm_h;
 
-      inm = MHD_lookup_connection_value (connection,
-                                         MHD_HEADER_KIND,
-                                         MHD_HTTP_HEADER_IF_NONE_MATCH);
-      if (NULL != inm)
+      if (GNUNET_OK !=
+          GNUNET_STRINGS_string_to_data (inm,
+                                         strlen (inm),
+                                         &inm_h,
+                                         sizeof (inm_h)))
       {
-        struct GNUNET_HashCode inm_h;
-
-        if (GNUNET_OK !=
-            GNUNET_STRINGS_string_to_data (inm,
-                                           strlen (inm),
-                                           &inm_h,
-                                           sizeof (inm_h)))
-        {
-          GNUNET_break_op (0);
-          return TALER_MHD_reply_with_error (connection,
-                                             MHD_HTTP_BAD_REQUEST,
-                                             TALER_EC_ANASTASIS_POLICY_BAD_IF_NONE_MATCH,
-                                             "Etag must be a base32-encoded SHA-512 hash");
-        }
-        if (0 == GNUNET_memcmp (&inm_h,
-                                &recovery_data_hash))
-        {
-          struct MHD_Response *resp;
-
-          resp = MHD_create_response_from_buffer (0,
-                                                  NULL,
-                                                  MHD_RESPMEM_PERSISTENT);
-          TALER_MHD_add_global_headers (resp);
-          ret = MHD_queue_response (connection,
-                                    MHD_HTTP_NOT_MODIFIED,
-                                    resp);
-          MHD_destroy_response (resp);
-          return ret;
-        }
+        GNUNET_break_op (0);
+        return TALER_MHD_reply_with_error (connection,
+                                           MHD_HTTP_BAD_REQUEST,
+                                           TALER_EC_ANASTASIS_POLICY_BAD_IF_NONE_MATCH,
+                                           "Etag must be a base32-encoded SHA-512 hash");
+      }
+      if (0 == GNUNET_memcmp (&inm_h,
+                              &recovery_data_hash))
+      {
+        struct MHD_Response *resp;
+
+        resp = MHD_create_response_from_buffer (0,
+                                                NULL,
+                                                MHD_RESPMEM_PERSISTENT);
+        TALER_MHD_add_global_headers (resp);
+        ret = MHD_queue_response (connection,
+                                  MHD_HTTP_NOT_MODIFIED,
+                                  resp);
+        MHD_destroy_response (resp);
+        return ret;
       }
     }
     /* We have a result, should fetch and return it! */
     break;
   }
   return return_policy (connection,
-                        account_pub);
+                        account_pub,
+                        version);
 }
@@ -32,6 +32,33 @@ void
 AH_resume_all_bc (void);
 
 
+/**
+ * Initialize the recovery document cache as per configuration.
+ *
+ * @param cfg configuration to process
+ */
+void
+AH_policy_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Release all responses in the recovery document cache.
+ */
+void
+AH_policy_shutdown (void);
+
+
+/**
+ * Drop all cached recovery documents of @a account_pub, to be called
+ * when a new recovery document was stored for the account.
+ *
+ * @param account_pub account that changed
+ */
+void
+AH_policy_cache_invalidate (
+  const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub);
+
+
 /**
  * Handle GET /policy/$ACCOUNT_PUB request.
  *
@@ -37,6 +37,12 @@
 #define CHECK_PAYMENT_GENERIC_TIMEOUT GNUNET_TIME_relative_multiply ( \
     GNUNET_TIME_UNIT_MINUTES, 30)
 
+/**
+ * Uploads larger than this number of bytes are spooled to a
+ * temporary file instead of being buffered in memory.
+ */
+#define MAX_IN_MEMORY_UPLOAD (64 * 1024)
+
 
 /**
  * Context for an upload operation.
@@ -82,9 +88,16 @@ struct PolicyUploadContext
 
   /**
    * Upload, with as many bytes as we have received so far.
+   * NULL if the upload is spooled to @e spool.
    */
   char *upload;
 
+  /**
+   * Temporary file the upload is spooled to if it is too
+   * large to be kept in memory, otherwise NULL.
+   */
+  struct GNUNET_DISK_FileHandle *spool;
+
   /**
    * Used while we are awaiting proposal creation.
    */
@@ -95,6 +108,22 @@ struct PolicyUploadContext
    */
   struct TALER_MERCHANT_OrderMerchantGetHandle *cpo;
 
+  /**
+   * Used while we are storing the upload in the database.
+   */
+  struct ANASTASIS_DB_PoolJob *job;
+
+  /**
+   * Mapping of the spooled upload while we are storing it.
+   */
+  struct GNUNET_DISK_MapHandle *map;
+
+  /**
+   * Upload to store in the database, points to @e upload or
+   * into @e map.
+   */
+  const void *store_data;
+
   /**
    * HTTP response code to use on resume, if non-NULL.
    */
@@ -154,11 +183,27 @@ struct PolicyUploadContext
    */
   unsigned int years_to_pay;
 
+  /**
+   * Policy version returned by the database when storing.
+   */
+  uint32_t version;
+
+  /**
+   * Result of storing the upload, valid if @e stored is set.
+   */
+  enum ANASTASIS_DB_StoreStatus ss;
+
   /**
    * true if client provided a payment secret / order ID?
    */
   bool payment_identifier_provided;
 
+  /**
+   * true if we tried to store the upload and @e ss
+   * is yet to be handled.
+   */
+  bool stored;
+
 };
 
 
@@ -196,6 +241,13 @@ AH_resume_all_bc ()
       TALER_MERCHANT_merchant_order_get_cancel (puc->cpo);
       puc->cpo = NULL;
     }
+    if (NULL != puc->job)
+    {
+      ANASTASIS_DB_pool_cancel (puc->job);
+      puc->job = NULL;
+      puc->ss = ANASTASIS_DB_STORE_STATUS_SOFT_ERROR;
+      puc->stored = true;
+    }
     MHD_resume_connection (puc->con);
   }
 }
@@ -215,15 +267,109 @@ cleanup_ctx (struct TM_HandlerContext *hc)
     TALER_MERCHANT_orders_post_cancel (puc->po);
   if (NULL != puc->cpo)
     TALER_MERCHANT_merchant_order_get_cancel (puc->cpo);
+  if (NULL != puc->job)
+    ANASTASIS_DB_pool_cancel (puc->job);
+  if (NULL != puc->map)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_unmap (puc->map));
   if (NULL != puc->hash_ctx)
     GNUNET_CRYPTO_hash_context_abort (puc->hash_ctx);
   if (NULL != puc->resp)
     MHD_destroy_response (puc->resp);
+  if (NULL != puc->spool)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_file_close (puc->spool));
   GNUNET_free (puc->upload);
   GNUNET_free (puc);
 }
 
 
+/**
+ * Prepare @a puc to receive an upload of @a len bytes.  Small
+ * uploads are buffered in memory, larger ones are spooled to an
+ * (already unlinked) temporary file so that the memory used per
+ * upload does not grow with the size of the recovery document.
+ *
+ * @param[in,out] puc upload context to initialize
+ * @param len number of bytes the client will upload
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+setup_upload_buffer (struct PolicyUploadContext *puc,
+                     size_t len)
+{
+  char *fn;
+
+  puc->upload_size = len;
+  if (len <= MAX_IN_MEMORY_UPLOAD)
+  {
+    puc->upload = GNUNET_malloc_large (len);
+    if (NULL == puc->upload)
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "malloc");
+      return GNUNET_SYSERR;
+    }
+    return GNUNET_OK;
+  }
+  fn = GNUNET_DISK_mktemp ("anastasis-policy-upload");
+  if (NULL == fn)
+    return GNUNET_SYSERR;
+  puc->spool = GNUNET_DISK_file_open (fn,
+                                      GNUNET_DISK_OPEN_READWRITE,
+                                      GNUNET_DISK_PERM_NONE);
+  if (0 != unlink (fn))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "unlink",
+                              fn);
+  GNUNET_free (fn);
+  if (NULL == puc->spool)
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Append @a data to the upload of @a puc.
+ *
+ * @param[in,out] puc upload context to extend
+ * @param data bytes received from the client
+ * @param data_size number of bytes in @a data
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+append_upload (struct PolicyUploadContext *puc,
+               const char *data,
+               size_t data_size)
+{
+  /* check MHD invariant */
+  GNUNET_assert (puc->upload_off + data_size <= puc->upload_size);
+  if (NULL != puc->spool)
+  {
+    if ( (ssize_t) data_size !=
+         GNUNET_DISK_file_write (puc->spool,
+                                 data,
+                                 data_size))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "write");
+      return GNUNET_SYSERR;
+    }
+  }
+  else
+  {
+    memcpy (&puc->upload[puc->upload_off],
+            data,
+            data_size);
+  }
+  puc->upload_off += data_size;
+  GNUNET_CRYPTO_hash_context_read (puc->hash_ctx,
+                                   data,
+                                   data_size);
+  return GNUNET_OK;
+}
+
+
 /**
  * Transmit a payment request for @a order_id on @a connection
  *
@@ -629,6 +775,71 @@ prepare_payment (struct PolicyUploadContext *puc)
 }
 
 
+/**
+ * Store the upload of @a cls in the database.  May run on a
+ * thread of #AH_db_pool, so must not touch anything but @a cls
+ * and must not log; failures are logged once the request resumed.
+ *
+ * @param cls our `struct PolicyUploadContext`
+ * @param plugin database plugin to use
+ */
+static void
+store_work (void *cls,
+            struct ANASTASIS_DatabasePlugin *plugin)
+{
+  struct PolicyUploadContext *puc = cls;
+
+  puc->version = UINT32_MAX;
+  puc->ss = plugin->store_recovery_document (plugin->cls,
+                                             &puc->account,
+                                             &puc->account_sig,
+                                             &puc->new_policy_upload_hash,
+                                             puc->store_data,
+                                             puc->upload_size,
+                                             &puc->payment_identifier,
+                                             &puc->version);
+  puc->stored = true;
+}
+
+
+/**
+ * Release the mapping of the spooled upload, if any.
+ *
+ * @param[in,out] puc upload context to release mapping of
+ */
+static void
+unmap_upload (struct PolicyUploadContext *puc)
+{
+  puc->store_data = NULL;
+  if (NULL == puc->map)
+    return;
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_file_unmap (puc->map));
+  puc->map = NULL;
+}
+
+
+/**
+ * The upload of @a cls was stored by #AH_db_pool, resume
+ * processing the request.
+ *
+ * @param cls our `struct PolicyUploadContext`
+ */
+static void
+store_done (void *cls)
+{
+  struct PolicyUploadContext *puc = cls;
+
+  puc->job = NULL;
+  unmap_upload (puc);
+  GNUNET_CONTAINER_DLL_remove (puc_head,
+                               puc_tail,
+                               puc);
+  MHD_resume_connection (puc->con);
+  AH_trigger_daemon (NULL);
+}
+
+
 MHD_RESULT
 AH_handler_policy_post (
   struct MHD_Connection *connection,
@@ -708,17 +919,15 @@ AH_handler_policy_post (
                                            TALER_EC_SYNC_MALFORMED_CONTENT_LENGTH,
                                            "Content-length value not acceptable");
       }
-      puc->upload = GNUNET_malloc_large (len);
-      if (NULL == puc->upload)
+      if (GNUNET_OK !=
+          setup_upload_buffer (puc,
+                               (size_t) len))
       {
-        GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
-                             "malloc");
         return TALER_MHD_reply_with_error (connection,
                                            MHD_HTTP_PAYLOAD_TOO_LARGE,
                                            TALER_EC_ANASTASIS_POLICY_OUT_OF_MEMORY_ON_CONTENT_LENGTH,
                                            NULL);
       }
-      puc->upload_size = (size_t) len;
     }
     {
       /* Check if header contains Anastasis-Policy-Signature */
@@ -1057,15 +1266,14 @@ AH_handler_policy_post (
   /* handle upload */
   if (0 != *recovery_data_size)
   {
-    /* check MHD invariant */
-    GNUNET_assert (puc->upload_off + *recovery_data_size <= puc->upload_size);
-    memcpy (&puc->upload[puc->upload_off],
-            recovery_data,
-            *recovery_data_size);
-    puc->upload_off += *recovery_data_size;
-    GNUNET_CRYPTO_hash_context_read (puc->hash_ctx,
-                                     recovery_data,
-                                     *recovery_data_size);
+    if (GNUNET_OK !=
+        append_upload (puc,
+                       recovery_data,
+                       *recovery_data_size))
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                         TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
+                                         "failed to spool upload");
     *recovery_data_size = 0;
     return MHD_YES;
   }
@@ -1098,22 +1306,55 @@ AH_handler_policy_post (
   }
 
   /* store backup to database */
+  if (! puc->stored)
   {
-    enum ANASTASIS_DB_StoreStatus ss;
-    uint32_t version = UINT32_MAX;
+    puc->store_data = puc->upload;
+    if (NULL != puc->spool)
+    {
+      /* only map the spooled upload for the duration of the
+         database operation */
+      puc->store_data = GNUNET_DISK_file_map (puc->spool,
+                                              &puc->map,
+                                              GNUNET_DISK_MAP_TYPE_READ,
+                                              puc->upload_size);
+      if (NULL == puc->store_data)
+      {
+        GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                             "mmap");
+        return TALER_MHD_reply_with_error (connection,
+                                           MHD_HTTP_INTERNAL_SERVER_ERROR,
+                                           TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
+                                           "failed to map spooled upload");
+      }
+    }
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Uploading recovery document\n");
+    if (NULL != AH_db_pool)
+    {
+      /* do not block other requests while the database is busy */
+      GNUNET_CONTAINER_DLL_insert (puc_head,
+                                   puc_tail,
+                                   puc);
+      MHD_suspend_connection (connection);
+      puc->job = ANASTASIS_DB_pool_submit (AH_db_pool,
+                                           &store_work,
+                                           &store_done,
+                                           puc);
+      return MHD_YES;
+    }
+    store_work (puc,
+                db);
+    unmap_upload (puc);
+  }
+
+  {
+    enum ANASTASIS_DB_StoreStatus ss = puc->ss;
+    uint32_t version = puc->version;
     char version_s[14];
     char expir_s[32];
 
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Uploading recovery document\n");
-    ss = db->store_recovery_document (db->cls,
-                                      &puc->account,
-                                      &puc->account_sig,
-                                      &puc->new_policy_upload_hash,
-                                      puc->upload,
-                                      puc->upload_size,
-                                      &puc->payment_identifier,
-                                      &version);
+    /* the upload must be stored again if we request payment */
+    puc->stored = false;
     GNUNET_snprintf (version_s,
                      sizeof (version_s),
                      "%u",
@@ -1152,6 +1393,9 @@ AH_handler_policy_post (
       return begin_payment (puc);
     case ANASTASIS_DB_STORE_STATUS_HARD_ERROR:
     case ANASTASIS_DB_STORE_STATUS_SOFT_ERROR:
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Failed to store recovery document (%d)\n",
+                  (int) ss);
       return TALER_MHD_reply_with_error (puc->con,
                                          MHD_HTTP_INTERNAL_SERVER_ERROR,
                                          TALER_EC_GENERIC_DB_FETCH_FAILED,
@@ -1180,6 +1424,7 @@ AH_handler_policy_post (
         return ret;
       }
     case ANASTASIS_DB_STORE_STATUS_SUCCESS:
+      AH_policy_cache_invalidate (&puc->account);
       /* generate main (204) standard success reply */
       {
         struct MHD_Response *resp;
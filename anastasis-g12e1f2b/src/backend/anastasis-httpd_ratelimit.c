@@ -0,0 +1,512 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file backend/anastasis-httpd_ratelimit.c
+ * @brief in-memory rate limiting of challenge answers
+ * @author Christian Grothoff
+ *
+ * Each bucket is a token bucket stored as the single timestamp at
+ * which it will be full again (the "theoretical arrival time" of the
+ * generic cell rate algorithm): an attempt is allowed if that time is
+ * less than #burst times #interval in the future, and moves it
+ * #interval further.  Every (worker) process has its own buckets and
+ * runs single-threaded, so no locking is needed.
+ *
+ * Per-client buckets are disabled by default: behind a reverse proxy
+ * or NAT, many users share one address and would share one bucket.
+ * They should only be enabled together with #client_header if
+ * anastasis-httpd runs behind a proxy.
+ */
+#include "platform.h"
+#include <arpa/inet.h>
+#include "anastasis-httpd_ratelimit.h"
+
+/**
+ * Maximum number of buckets per table.  Once reached, new keys are
+ * not tracked until the sweep removed idle buckets, and the database
+ * alone limits attempts.
+ */
+#define MAX_BUCKETS (1024 * 64)
+
+/**
+ * How often do we remove buckets that are full again?
+ */
+#define SWEEP_FREQUENCY GNUNET_TIME_UNIT_MINUTES
+
+
+/**
+ * Token bucket.
+ */
+struct Bucket
+{
+  /**
+   * Time at which the bucket will be full again.
+   */
+  struct GNUNET_TIME_Absolute full_at;
+};
+
+
+/**
+ * Buckets by truth UUID, NULL if rate limiting is disabled.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *truth_buckets;
+
+/**
+ * Buckets by client address, NULL if per-client rate limiting
+ * is disabled.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *client_buckets;
+
+/**
+ * Task removing idle buckets.
+ */
+static struct GNUNET_SCHEDULER_Task *sweep_task;
+
+/**
+ * Time it takes for one token to be added to a bucket.
+ */
+static struct GNUNET_TIME_Relative interval;
+
+/**
+ * Maximum number of tokens in a bucket of #truth_buckets.
+ */
+static unsigned long long truth_burst;
+
+/**
+ * Maximum number of tokens in a bucket of #client_buckets.
+ */
+static unsigned long long client_burst;
+
+/**
+ * HTTP header set by a trusted reverse proxy to the client address,
+ * i.e. "X-Forwarded-For", NULL to use the address of the peer.
+ */
+static char *client_header;
+
+
+/**
+ * Remove bucket @a value if it is full again.
+ *
+ * @param cls the `struct GNUNET_CONTAINER_MultiHashMap` to sweep
+ * @param key key of the bucket
+ * @param value a `struct Bucket`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+sweep_bucket (void *cls,
+              const struct GNUNET_HashCode *key,
+              void *value)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *map = cls;
+  struct Bucket *b = value;
+
+  if (GNUNET_TIME_absolute_is_future (b->full_at))
+    return GNUNET_OK;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (map,
+                                                       key,
+                                                       b));
+  GNUNET_free (b);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Remove all buckets that are full again.
+ *
+ * @param cls NULL
+ */
+static void
+do_sweep (void *cls)
+{
+  (void) cls;
+  sweep_task = GNUNET_SCHEDULER_add_delayed (SWEEP_FREQUENCY,
+                                             &do_sweep,
+                                             NULL);
+  GNUNET_CONTAINER_multihashmap_iterate (truth_buckets,
+                                         &sweep_bucket,
+                                         truth_buckets);
+  if (NULL != client_buckets)
+    GNUNET_CONTAINER_multihashmap_iterate (client_buckets,
+                                           &sweep_bucket,
+                                           client_buckets);
+}
+
+
+/**
+ * Compute the key identifying a client by its address.  IPv6 clients
+ * are identified by their /64 prefix, as they typically control all
+ * addresses within it.
+ *
+ * @param af address family of @a addr
+ * @param addr a `struct in_addr` or `struct in6_addr`
+ * @param[out] key set to the key of the client
+ */
+static void
+address_key (int af,
+             const void *addr,
+             struct GNUNET_HashCode *key)
+{
+  if (AF_INET == af)
+    GNUNET_CRYPTO_hash (addr,
+                        sizeof (struct in_addr),
+                        key);
+  else
+    GNUNET_CRYPTO_hash (addr,
+                        sizeof (struct in6_addr) / 2,
+                        key);
+}
+
+
+/**
+ * Compute the key identifying the client from the #client_header
+ * of @a connection.  Proxies append the address of their peer to
+ * the header, so only the last entry was set by our trusted proxy;
+ * earlier entries are under the control of the client.
+ *
+ * @param connection connection to identify the client of
+ * @param[out] key set to the key of the client
+ * @return false if the header is missing or malformed
+ */
+static bool
+header_key (struct MHD_Connection *connection,
+            struct GNUNET_HashCode *key)
+{
+  const char *hdr;
+  const char *start;
+  size_t len;
+  char buf[INET6_ADDRSTRLEN];
+  struct in_addr in4;
+  struct in6_addr in6;
+
+  hdr = MHD_lookup_connection_value (connection,
+                                     MHD_HEADER_KIND,
+                                     client_header);
+  if (NULL == hdr)
+    return false;
+  start = strrchr (hdr,
+                   ',');
+  start = (NULL == start) ? hdr : start + 1;
+  start += strspn (start,
+                   " \t");
+  len = strcspn (start,
+                 " \t");
+  if (len >= sizeof (buf))
+    return false;
+  memcpy (buf,
+          start,
+          len);
+  buf[len] = '\0';
+  if (1 == inet_pton (AF_INET,
+                      buf,
+                      &in4))
+  {
+    address_key (AF_INET,
+                 &in4,
+                 key);
+    return true;
+  }
+  if (1 == inet_pton (AF_INET6,
+                      buf,
+                      &in6))
+  {
+    address_key (AF_INET6,
+                 &in6,
+                 key);
+    return true;
+  }
+  return false;
+}
+
+
+/**
+ * Compute the key identifying the client of @a connection, from the
+ * #client_header if configured and present, otherwise from the
+ * address of the peer.
+ *
+ * @param connection connection to identify the client of
+ * @param[out] key set to the key of the client
+ * @return false if the client cannot be identified (i.e. UNIX
+ *         domain socket behind a reverse proxy)
+ */
+static bool
+client_key (struct MHD_Connection *connection,
+            struct GNUNET_HashCode *key)
+{
+  const union MHD_ConnectionInfo *ci;
+  const struct sockaddr *sa;
+
+  if ( (NULL != client_header) &&
+       (header_key (connection,
+                    key)) )
+    return true;
+  ci = MHD_get_connection_info (connection,
+                                MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+  if ( (NULL == ci) ||
+       (NULL == ci->client_addr) )
+    return false;
+  sa = ci->client_addr;
+  switch (sa->sa_family)
+  {
+  case AF_INET:
+    address_key (AF_INET,
+                 &((const struct sockaddr_in *) sa)->sin_addr,
+                 key);
+    return true;
+  case AF_INET6:
+    address_key (AF_INET6,
+                 &((const struct sockaddr_in6 *) sa)->sin6_addr,
+                 key);
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+/**
+ * Lookup the bucket under @a key in @a map, creating a full one
+ * if there is none and the table is not full.
+ *
+ * @param map table to lookup bucket in
+ * @param key key of the bucket
+ * @return NULL if the table is full
+ */
+static struct Bucket *
+get_bucket (struct GNUNET_CONTAINER_MultiHashMap *map,
+            const struct GNUNET_HashCode *key)
+{
+  struct Bucket *b;
+
+  b = GNUNET_CONTAINER_multihashmap_get (map,
+                                         key);
+  if (NULL != b)
+    return b;
+  if (GNUNET_CONTAINER_multihashmap_size (map) >= MAX_BUCKETS)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Rate limiter table full, relying on database\n");
+    return NULL;
+  }
+  b = GNUNET_new (struct Bucket);
+  b->full_at = GNUNET_TIME_UNIT_ZERO_ABS;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (
+                   map,
+                   key,
+                   b,
+                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return b;
+}
+
+
+/**
+ * Check if bucket @a b has a token left at @a now.
+ *
+ * @param b bucket to check, NULL for untracked keys
+ * @param burst maximum number of tokens in @a b
+ * @param now current time
+ * @return true if a token is available
+ */
+static bool
+has_token (const struct Bucket *b,
+           unsigned long long burst,
+           struct GNUNET_TIME_Absolute now)
+{
+  struct GNUNET_TIME_Relative backlog;
+
+  if (NULL == b)
+    return true;
+  backlog = GNUNET_TIME_absolute_get_difference (now,
+                                                 b->full_at);
+  /* each token taken moves full_at one interval further */
+  return GNUNET_TIME_relative_cmp (backlog,
+                                   <=,
+                                   GNUNET_TIME_relative_multiply (
+                                     interval,
+                                     burst - 1));
+}
+
+
+/**
+ * Take a token from bucket @a b at @a now.
+ *
+ * @param[in,out] b bucket to take token from, NULL for untracked keys
+ * @param now current time
+ */
+static void
+take_token (struct Bucket *b,
+            struct GNUNET_TIME_Absolute now)
+{
+  if (NULL == b)
+    return;
+  b->full_at = GNUNET_TIME_absolute_add (GNUNET_TIME_absolute_max (now,
+                                                                   b->full_at),
+                                         interval);
+}
+
+
+void
+AH_ratelimit_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "anastasis",
+                                             "TRUTH_RATE_LIMIT_BURST",
+                                             &truth_burst))
+    truth_burst = 0;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "anastasis",
+                                             "CLIENT_RATE_LIMIT_BURST",
+                                             &client_burst))
+    client_burst = 0;
+  if ( (0 == truth_burst) &&
+       (0 == client_burst) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "In-memory rate limiting of challenge answers disabled\n");
+    return;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "anastasis",
+                                           "TRUTH_RATE_LIMIT_INTERVAL",
+                                           &interval))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_WARNING,
+                               "anastasis",
+                               "TRUTH_RATE_LIMIT_INTERVAL");
+    interval = GNUNET_TIME_UNIT_SECONDS;
+  }
+  if (0 != truth_burst)
+    truth_buckets = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                          GNUNET_NO);
+  if (0 != client_burst)
+  {
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_string (cfg,
+                                               "anastasis",
+                                               "CLIENT_ADDRESS_HEADER",
+                                               &client_header))
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Rate limiting clients by peer address, all clients behind a proxy share one budget\n");
+    client_buckets = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                           GNUNET_NO);
+  }
+  sweep_task = GNUNET_SCHEDULER_add_delayed (SWEEP_FREQUENCY,
+                                             &do_sweep,
+                                             NULL);
+}
+
+
+/**
+ * Free bucket @a value.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value a `struct Bucket`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+free_bucket (void *cls,
+             const struct GNUNET_HashCode *key,
+             void *value)
+{
+  struct Bucket *b = value;
+
+  (void) cls;
+  (void) key;
+  GNUNET_free (b);
+  return GNUNET_OK;
+}
+
+
+void
+AH_ratelimit_shutdown (void)
+{
+  if (NULL != sweep_task)
+  {
+    GNUNET_SCHEDULER_cancel (sweep_task);
+    sweep_task = NULL;
+  }
+  if (NULL != truth_buckets)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (truth_buckets,
+                                           &free_bucket,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (truth_buckets);
+    truth_buckets = NULL;
+  }
+  if (NULL != client_buckets)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (client_buckets,
+                                           &free_bucket,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (client_buckets);
+    client_buckets = NULL;
+  }
+  GNUNET_free (client_header);
+}
+
+
+bool
+AH_ratelimit_check (struct MHD_Connection *connection,
+                    const struct ANASTASIS_CRYPTO_TruthUUIDP *truth_uuid)
+{
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_HashCode key;
+  struct Bucket *tb = NULL;
+  struct Bucket *cb = NULL;
+
+  if ( (NULL == truth_buckets) &&
+       (NULL == client_buckets) )
+    return true;
+  now = GNUNET_TIME_absolute_get ();
+  if (NULL != truth_buckets)
+  {
+    GNUNET_CRYPTO_hash (truth_uuid,
+                        sizeof (*truth_uuid),
+                        &key);
+    tb = get_bucket (truth_buckets,
+                     &key);
+  }
+  if ( (NULL != client_buckets) &&
+       (client_key (connection,
+                    &key)) )
+    cb = get_bucket (client_buckets,
+                     &key);
+  if ( (! has_token (tb,
+                     truth_burst,
+                     now)) ||
+       (! has_token (cb,
+                     client_burst,
+                     now)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Rejecting attempt for truth %s without asking database\n",
+                TALER_B2S (truth_uuid));
+    return false;
+  }
+  take_token (tb,
+              now);
+  take_token (cb,
+              now);
+  return true;
+}
+
+
+/* end of anastasis-httpd_ratelimit.c */
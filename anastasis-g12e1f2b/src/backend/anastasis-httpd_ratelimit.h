@@ -0,0 +1,60 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file backend/anastasis-httpd_ratelimit.h
+ * @brief in-memory rate limiting of challenge answers
+ * @author Christian Grothoff
+ */
+#ifndef ANASTASIS_HTTPD_RATELIMIT_H
+#define ANASTASIS_HTTPD_RATELIMIT_H
+#include "anastasis-httpd.h"
+
+
+/**
+ * Initialize the rate limiter as per configuration.
+ *
+ * @param cfg configuration to process
+ */
+void
+AH_ratelimit_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Release all state of the rate limiter.
+ */
+void
+AH_ratelimit_shutdown (void);
+
+
+/**
+ * Account for an attempt to answer the challenge of @a truth_uuid
+ * from the client of @a connection.  This only protects the database
+ * from brute-force traffic; the retry counters in the database remain
+ * authoritative.
+ *
+ * @param connection connection the attempt was made on
+ * @param truth_uuid truth the attempt is for
+ * @return true if the attempt may proceed, false if either the
+ *         truth or the client exceeded its budget
+ */
+bool
+AH_ratelimit_check (struct MHD_Connection *connection,
+                    const struct ANASTASIS_CRYPTO_TruthUUIDP *truth_uuid);
+
+
+#endif
+
+/* end of anastasis-httpd_ratelimit.h */
@@ -24,9 +24,11 @@
 #include "anastasis-httpd.h"
 #include "anastasis_service.h"
 #include "anastasis-httpd_truth.h"
+#include "anastasis-httpd_ratelimit.h"
 #include <gnunet/gnunet_util_lib.h>
 #include <gnunet/gnunet_rest_lib.h>
 #include "anastasis_authorization_lib.h"
+#include "anastasis_util_lib.h"
 #include <taler/taler_merchant_service.h>
 #include <taler/taler_json_lib.h>
 
@@ -110,6 +112,16 @@ struct GetContext
    */
   struct ANASTASIS_AUTHORIZATION_State *as;
 
+  /**
+   * Time spent in the start function of @e authorization.
+   */
+  struct ANASTASIS_METRICS_Histogram *start_metric;
+
+  /**
+   * Time spent in the process function of @e authorization.
+   */
+  struct ANASTASIS_METRICS_Histogram *process_metric;
+
   /**
    * Used while we are awaiting proposal creation.
    */
@@ -913,6 +925,32 @@ gc_suspended (struct GetContext *gc)
 }
 
 
+/**
+ * Lookup the histogram of the time spent in the @a call function
+ * of the authorization plugin for @a method.
+ *
+ * @param method name of the authorization method
+ * @param call "start" or "process"
+ * @return the histogram
+ */
+static struct ANASTASIS_METRICS_Histogram *
+authorization_metric (const char *method,
+                      const char *call)
+{
+  char labels[128];
+
+  GNUNET_snprintf (labels,
+                   sizeof (labels),
+                   "method=\"%s\",call=\"%s\"",
+                   method,
+                   call);
+  return ANASTASIS_METRICS_histogram (
+    "anastasis_authorization_seconds",
+    "Time spent in authorization plugin calls",
+    labels);
+}
+
+
 /**
  * Run the authorization method-specific 'process' function and continue
  * based on its result with generating an HTTP response.
@@ -926,11 +964,15 @@ run_authorization_process (struct MHD_Connection *connection,
 {
   enum ANASTASIS_AUTHORIZATION_Result ret;
   enum GNUNET_DB_QueryStatus qs;
+  struct GNUNET_TIME_Absolute start;
 
   GNUNET_assert (! gc->suspended);
+  start = GNUNET_TIME_absolute_get ();
   ret = gc->authorization->process (gc->as,
                                     gc->timeout,
                                     connection);
+  ANASTASIS_METRICS_observe (gc->process_metric,
+                             GNUNET_TIME_absolute_get_duration (start));
   switch (ret)
   {
   case ANASTASIS_AUTHORIZATION_RES_SUCCESS:
@@ -1006,21 +1048,12 @@ static enum GNUNET_GenericReturnValue
 rate_limit (struct GetContext *gc)
 {
   enum GNUNET_DB_QueryStatus qs;
-  struct GNUNET_TIME_Absolute rt;
-  uint64_t code;
-  enum ANASTASIS_DB_CodeStatus cs;
-  struct GNUNET_HashCode hc;
-  bool satisfied;
-  uint64_t dummy;
 
-  rt = GNUNET_TIME_UNIT_FOREVER_ABS;
-  qs = db->create_challenge_code (db->cls,
-                                  &gc->truth_uuid,
-                                  MAX_QUESTION_FREQ,
-                                  GNUNET_TIME_UNIT_HOURS,
-                                  INITIAL_RETRY_COUNTER,
-                                  &rt,
-                                  &code);
+  qs = db->rate_limit (db->cls,
+                       &gc->truth_uuid,
+                       MAX_QUESTION_FREQ,
+                       GNUNET_TIME_UNIT_HOURS,
+                       INITIAL_RETRY_COUNTER);
   if (0 > qs)
   {
     GNUNET_break (0 < qs);
@@ -1028,7 +1061,7 @@ rate_limit (struct GetContext *gc)
             TALER_MHD_reply_with_error (gc->connection,
                                         MHD_HTTP_INTERNAL_SERVER_ERROR,
                                         TALER_EC_GENERIC_DB_FETCH_FAILED,
-                                        "create_challenge_code (for rate limiting)"))
+                                        "rate_limit"))
       ? GNUNET_NO
       : GNUNET_SYSERR;
   }
@@ -1042,42 +1075,7 @@ rate_limit (struct GetContext *gc)
       ? GNUNET_NO
       : GNUNET_SYSERR;
   }
-  /* decrement trial counter */
-  ANASTASIS_hash_answer (code + 1,      /* always use wrong answer */
-                         &hc);
-  cs = db->verify_challenge_code (db->cls,
-                                  &gc->truth_uuid,
-                                  &hc,
-                                  &dummy,
-                                  &satisfied);
-  switch (cs)
-  {
-  case ANASTASIS_DB_CODE_STATUS_CHALLENGE_CODE_MISMATCH:
-    /* good, what we wanted */
-    return GNUNET_OK;
-  case ANASTASIS_DB_CODE_STATUS_HARD_ERROR:
-  case ANASTASIS_DB_CODE_STATUS_SOFT_ERROR:
-    GNUNET_break (0);
-    return (MHD_YES ==
-            TALER_MHD_reply_with_error (gc->connection,
-                                        MHD_HTTP_INTERNAL_SERVER_ERROR,
-                                        TALER_EC_GENERIC_DB_FETCH_FAILED,
-                                        "verify_challenge_code"))
-      ? GNUNET_NO
-      : GNUNET_SYSERR;
-  case ANASTASIS_DB_CODE_STATUS_NO_RESULTS:
-    return (MHD_YES ==
-            TALER_MHD_reply_with_error (gc->connection,
-                                        MHD_HTTP_TOO_MANY_REQUESTS,
-                                        TALER_EC_ANASTASIS_TRUTH_RATE_LIMITED,
-                                        NULL))
-      ? GNUNET_NO
-      : GNUNET_SYSERR;
-  case ANASTASIS_DB_CODE_STATUS_VALID_CODE_STORED:
-    /* this should be impossible, we used code+1 */
-    GNUNET_assert (0);
-  }
-  return GNUNET_SYSERR;
+  return GNUNET_OK;
 }
 
 
@@ -1151,10 +1149,12 @@ direct_validation (struct GetContext *gc,
   /* Non-random code, call plugin directly! */
   enum ANASTASIS_AUTHORIZATION_Result aar;
   enum GNUNET_GenericReturnValue res;
+  struct GNUNET_TIME_Absolute start;
 
   res = rate_limit (gc);
   if (GNUNET_OK != res)
     return (GNUNET_NO == res) ? MHD_YES : MHD_NO;
+  start = GNUNET_TIME_absolute_get ();
   gc->as = gc->authorization->start (gc->authorization->cls,
                                      &AH_trigger_daemon,
                                      NULL,
@@ -1162,6 +1162,8 @@ direct_validation (struct GetContext *gc,
                                      0LLU,
                                      decrypted_truth,
                                      decrypted_truth_size);
+  ANASTASIS_METRICS_observe (gc->start_metric,
+                             GNUNET_TIME_absolute_get_duration (start));
   if (NULL == gc->as)
   {
     GNUNET_break (0);
@@ -1170,9 +1172,12 @@ direct_validation (struct GetContext *gc,
                                        TALER_EC_ANASTASIS_TRUTH_AUTHORIZATION_START_FAILED,
                                        NULL);
   }
+  start = GNUNET_TIME_absolute_get ();
   aar = gc->authorization->process (gc->as,
                                     GNUNET_TIME_UNIT_ZERO_ABS,
                                     gc->connection);
+  ANASTASIS_METRICS_observe (gc->process_metric,
+                             GNUNET_TIME_absolute_get_duration (start));
   switch (aar)
   {
   case ANASTASIS_AUTHORIZATION_RES_SUCCESS:
@@ -1298,6 +1303,16 @@ AH_handler_truth_get (
       }
       gc->have_response = (NULL != challenge_response_s);
     }
+    if ( (gc->have_response) &&
+         (! AH_ratelimit_check (connection,
+                                truth_uuid)) )
+    {
+      /* spare the database, the client is brute-forcing */
+      return TALER_MHD_reply_with_error (connection,
+                                         MHD_HTTP_TOO_MANY_REQUESTS,
+                                         TALER_EC_ANASTASIS_TRUTH_RATE_LIMITED,
+                                         NULL);
+    }
 
     {
       const char *long_poll_timeout_ms;
@@ -1418,6 +1433,10 @@ AH_handler_truth_get (
         return ret;
       }
       gc->challenge_cost = gc->authorization->cost;
+      gc->start_metric = authorization_metric (method,
+                                               "start");
+      gc->process_metric = authorization_metric (method,
+                                                 "process");
     }
     else
     {
@@ -1667,13 +1686,19 @@ AH_handler_truth_get (
 
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Beginning authorization process\n");
-  gc->as = gc->authorization->start (gc->authorization->cls,
-                                     &AH_trigger_daemon,
-                                     NULL,
-                                     &gc->truth_uuid,
-                                     gc->code,
-                                     decrypted_truth,
-                                     decrypted_truth_size);
+  {
+    struct GNUNET_TIME_Absolute start = GNUNET_TIME_absolute_get ();
+
+    gc->as = gc->authorization->start (gc->authorization->cls,
+                                       &AH_trigger_daemon,
+                                       NULL,
+                                       &gc->truth_uuid,
+                                       gc->code,
+                                       decrypted_truth,
+                                       decrypted_truth_size);
+    ANASTASIS_METRICS_observe (gc->start_metric,
+                               GNUNET_TIME_absolute_get_duration (start));
+  }
   GNUNET_free (decrypted_truth);
   if (NULL == gc->as)
   {
@@ -21,7 +21,7 @@ function cleanup()
     do
         kill $n 2> /dev/null || true
     done
-    rm -f $TFILE
+    rm -f $TFILE $TFILE.in
     wait
 }
 
@@ -62,4 +62,39 @@ fi
 
 echo " OK"
 
+
+echo -n "Test done authentication with many equal-cost providers ..."
+# 12 providers that differ only in their truth upload fee (so that they
+# are not collapsed as equivalent) with zero usage fees, and 6 questions:
+# every policy map ties, so the search must prune ties to finish quickly.
+jq '.authentication_providers as $ap
+    | .authentication_providers = ([range(12)]
+        | map({ key: "http://localhost:\(9000 + .)/",
+                value: ($ap["http://localhost:8086/"]
+                        + { truth_upload_fee: "TESTKUDOS:0.\(. + 10)" }) })
+        | from_entries)
+    | .authentication_methods = ([range(6)]
+        | map({ type: "question",
+                instructions: "Question \(.)?",
+                challenge: "Answer \(.)" }))' \
+  < resources/04-backup.json \
+  > $TFILE.in
+timeout 60 anastasis-reducer next $TFILE.in $TFILE \
+  || exit_fail "Policy selection did not finish in time"
+rm -f $TFILE.in
+
+STATE=`jq -r -e .backup_state < $TFILE`
+if test "$STATE" != "POLICIES_REVIEWING"
+then
+    exit_fail "Expected new state to be POLICIES_REVIEWING, got $STATE"
+fi
+
+ARRAY_LENGTH=`jq -r -e '.policies | length' < $TFILE`
+if test $ARRAY_LENGTH -lt 3
+then
+    exit_fail "Expected policy array length to be >= 3, got $ARRAY_LENGTH"
+fi
+
+echo " OK"
+
 exit 0
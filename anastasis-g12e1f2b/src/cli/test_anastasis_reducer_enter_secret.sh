@@ -29,7 +29,7 @@ function cleanup()
     do
         kill $n 2> /dev/null || true
     done
-    rm -rf $CONF $WALLET_DB $TFILE $UFILE $TMP_DIR
+    rm -rf $CONF $WALLET_DB $TFILE $UFILE $UFILE.first $TMP_DIR
     wait
 }
 
@@ -422,4 +422,63 @@ jq -r -e .core_secret < $UFILE > /dev/null && exit_fail "'core_secret' was not c
 
 echo " OK"
 
+cp $UFILE $UFILE.first
+
+echo -en $COLOR$BOLD"Test unchanged backup is not uploaded again ..."$NORM$NOCOLOR
+
+$PREFIX anastasis-reducer back $UFILE.first $TFILE
+$PREFIX anastasis-reducer -a \
+  '{"secret": { "value" : "veryhardtoguesssecret", "mime" : "text/plain" } }' \
+  enter_secret $TFILE $UFILE
+$PREFIX anastasis-reducer next $UFILE $TFILE
+
+STATE=`jq -r -e .backup_state < $TFILE`
+if test "$STATE" != "BACKUP_FINISHED"
+then
+    jq -e . $TFILE
+    exit_fail "Expected new state to be 'BACKUP_FINISHED', got '$STATE'"
+fi
+# The versions only stay the same if nothing was uploaded.
+if ! jq -e -n --slurpfile OLD $UFILE.first --slurpfile NEW $TFILE \
+     '$OLD[0].success_details == $NEW[0].success_details' > /dev/null
+then
+    exit_fail "Unchanged backup was uploaded again"
+fi
+
+echo " OK"
+
+echo -en $COLOR$BOLD"Test backup is uploaded again if the provider has another policy ..."$NORM$NOCOLOR
+
+# Pretend the provider at 8086 stores another policy than we uploaded.
+PROVIDER="http://localhost:8086/"
+OLD_VERSION=`jq -r -e --arg P "$PROVIDER" '.success_details[$P].policy_version' < $UFILE.first`
+OTHER_HASH=`jq -r -e --arg P "$PROVIDER" '.success_details[$P].backup_digest' < $UFILE.first`
+jq --arg P "$PROVIDER" --arg H "$OTHER_HASH" \
+   '.success_details[$P].policy_hash = $H' < $UFILE.first > $UFILE
+$PREFIX anastasis-reducer back $UFILE $TFILE
+$PREFIX anastasis-reducer -a \
+  '{"secret": { "value" : "veryhardtoguesssecret", "mime" : "text/plain" } }' \
+  enter_secret $TFILE $UFILE
+$PREFIX anastasis-reducer next $UFILE $TFILE
+
+STATE=`jq -r -e .backup_state < $TFILE`
+if test "$STATE" != "BACKUP_FINISHED"
+then
+    jq -e . $TFILE
+    exit_fail "Expected new state to be 'BACKUP_FINISHED', got '$STATE'"
+fi
+NEW_VERSION=`jq -r -e --arg P "$PROVIDER" '.success_details[$P].policy_version' < $TFILE`
+if test "$NEW_VERSION" -le "$OLD_VERSION"
+then
+    exit_fail "Expected a new policy version at $PROVIDER, got $NEW_VERSION (was $OLD_VERSION)"
+fi
+# Providers that still have our policy are skipped.
+if ! jq -e -n --slurpfile OLD $UFILE.first --slurpfile NEW $TFILE --arg P "$PROVIDER" \
+     '($OLD[0].success_details | del(.[$P])) == ($NEW[0].success_details | del(.[$P]))' > /dev/null
+then
+    exit_fail "Unchanged backups at other providers were uploaded again"
+fi
+
+echo " OK"
+
 exit 0
@@ -22,7 +22,7 @@ function cleanup()
     do
         kill $n 2> /dev/null || true
     done
-    rm -rf $CONF $WALLET_DB $R1FILE $R2FILE $B1FILE $B2FILE $TMP_DIR
+    rm -rf $CONF $WALLET_DB $R1FILE $R2FILE $R3FILE $B1FILE $B2FILE $TMP_DIR
     wait
 }
 
@@ -44,6 +44,7 @@ B1FILE=`mktemp test_reducer_stateB1XXXXXX`
 B2FILE=`mktemp test_reducer_stateB2XXXXXX`
 R1FILE=`mktemp test_reducer_stateR1XXXXXX`
 R2FILE=`mktemp test_reducer_stateR2XXXXXX`
+R3FILE=`mktemp test_reducer_stateR3XXXXXX`
 
 # Install cleanup handler (except for kill -9)
 trap cleanup EXIT
@@ -462,6 +463,9 @@ else
     NAME_UUID=$UUID0
 fi
 
+# keep the state to try answering all challenges at once later
+cp $R2FILE $R3FILE
+
 anastasis-reducer -a \
   "$(jq -n '
     {
@@ -514,4 +518,56 @@ fi
 
 echo " OK"
 
+echo -n "Answering all challenges at once ..."
+anastasis-reducer -a \
+  "$(jq -n '
+    {
+        answers: [
+          { uuid: $NAME_UUID, answer: "Hans" },
+          { uuid: $AGE_UUID, answer: "123" }
+        ]
+    }' \
+    --arg NAME_UUID "$NAME_UUID" \
+    --arg AGE_UUID "$AGE_UUID"
+  )" \
+  solve_challenges < $R3FILE > $R2FILE
+
+STATE=`jq -r -e .recovery_state < $R2FILE`
+if test "$STATE" != "RECOVERY_FINISHED"
+then
+    jq -e . $R2FILE
+    exit_fail "Expected new state to be 'RECOVERY_FINISHED', got '$STATE'"
+fi
+
+SECRET=`jq -r -e .core_secret.value < $R2FILE`
+if test "$SECRET" != "VERYHARDT0GVESSSECRET"
+then
+    jq -e . $R2FILE
+    exit_fail "Expected recovered secret to be 'VERYHARDT0GVESSSECRET', got '$SECRET'"
+fi
+
+echo " OK"
+
+echo -n "Answering all challenges at once with a wrong answer ..."
+anastasis-reducer -a \
+  "$(jq -n '
+    {
+        answers: [
+          { uuid: $NAME_UUID, answer: "Hans" },
+          { uuid: $AGE_UUID, answer: "124" }
+        ]
+    }' \
+    --arg NAME_UUID "$NAME_UUID" \
+    --arg AGE_UUID "$AGE_UUID"
+  )" \
+  solve_challenges < $R3FILE > $R2FILE 2> /dev/null || true
+
+STATE=`jq -r .recovery_state < $R2FILE`
+if test "$STATE" = "RECOVERY_FINISHED"
+then
+    exit_fail "Recovered the secret despite a wrong answer"
+fi
+
+echo " OK"
+
 exit 0
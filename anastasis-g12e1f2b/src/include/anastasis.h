@@ -346,6 +346,71 @@ ANASTASIS_challenge_answer2 (struct ANASTASIS_Challenge *c,
                              void *af_cls);
 
 
+/**
+ * Answer to one of the challenges of a batch, see
+ * #ANASTASIS_challenge_answer_batch().
+ */
+struct ANASTASIS_ChallengeAnswer
+{
+  /**
+   * Challenge to answer.
+   */
+  struct ANASTASIS_Challenge *c;
+
+  /**
+   * Payment made for the challenge, NULL if no payment was yet made.
+   */
+  const struct ANASTASIS_PaymentSecretP *psp;
+
+  /**
+   * Answer to a security question, NULL if the answer is
+   * numeric and given in @e answer_num instead.
+   */
+  const char *answer;
+
+  /**
+   * Numeric answer (TOTP code, TAN), only used if
+   * @e answer is NULL.
+   */
+  uint64_t answer_num;
+
+};
+
+
+/**
+ * Answer multiple challenges at once.  Launches the keyshare lookups
+ * for all @a answers concurrently, so that the latency is bounded by
+ * the slowest provider instead of the sum of all providers.  Useful
+ * for challenges that can be answered without prior interaction with
+ * the provider, like security questions and TOTP.  The (memory-hard)
+ * hashes of the security question answers are computed in parallel
+ * on threads before their lookups start.  @a af is called once for
+ * each challenge.  As soon as the challenges of one policy are all
+ * solved, the core secret is recovered and the remaining lookups are
+ * cancelled.
+ *
+ * All @a answers must be for challenges of the same recovery.
+ *
+ * @param answers_length length of the @a answers array
+ * @param answers challenges to answer
+ * @param timeout how long to wait for payment
+ * @param af reference to the answerfeedback which is passed back to the user
+ * @param af_cls closure for @a af
+ * @return #GNUNET_OK if all challenges were started,
+ *         #GNUNET_NO if a challenge was already solved or being solved,
+ *            or if the answers of another batch are still being hashed,
+ *         #GNUNET_SYSERR on other errors; in both cases
+ *         no challenge was started
+ */
+enum GNUNET_GenericReturnValue
+ANASTASIS_challenge_answer_batch (
+  unsigned int answers_length,
+  const struct ANASTASIS_ChallengeAnswer answers[],
+  struct GNUNET_TIME_Relative timeout,
+  ANASTASIS_AnswerFeedback af,
+  void *af_cls);
+
+
 /**
  * Abort answering challenge.
  *
@@ -504,6 +569,22 @@ typedef void
 struct ANASTASIS_Recovery;
 
 
+/**
+ * Function called to derive the user identifier at a provider, like
+ * #ANASTASIS_CRYPTO_user_identifier_derive().  Allows applications
+ * to cache identifiers, as each derivation is memory-hard.
+ *
+ * @param id_data identity attributes of the user
+ * @param provider_salt salt of the provider
+ * @param[out] id set to the user identifier
+ */
+typedef void
+(*ANASTASIS_UserIdentifierDerive)(
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *provider_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id);
+
+
 /**
  * Starts the recovery process by opening callbacks for the coresecret and a policy callback. A list of
  * providers is checked for policies and passed back to the client.
@@ -513,6 +594,8 @@ struct ANASTASIS_Recovery;
  * @param version defines the version which will be downloaded NULL for latest version
  * @param anastasis_provider_url NULL terminated list of possible provider urls
  * @param provider_salt the server salt
+ * @param uid_derive function to derive user identifiers with,
+ *        NULL for #ANASTASIS_CRYPTO_user_identifier_derive()
  * @param pc opens the policy call back which holds the downloaded version and the policies
  * @param pc_cls closure for callback
  * @param csc core secret callback is opened, with this the core secert is passed to the client after the authentication
@@ -526,6 +609,7 @@ ANASTASIS_recovery_begin (
   unsigned int version,
   const char *anastasis_provider_url,
   const struct ANASTASIS_CRYPTO_ProviderSaltP *provider_salt,
+  ANASTASIS_UserIdentifierDerive uid_derive,
   ANASTASIS_PolicyCallback pc,
   void *pc_cls,
   ANASTASIS_CoreSecretCallback csc,
@@ -549,6 +633,8 @@ ANASTASIS_recovery_serialize (const struct ANASTASIS_Recovery *r);
  *
  * @param ctx context for making HTTP requests
  * @param input result from #ANASTASIS_recovery_serialize()
+ * @param uid_derive function to derive user identifiers with,
+ *        NULL for #ANASTASIS_CRYPTO_user_identifier_derive()
  * @param pc opens the policy call back which holds the downloaded version and the policies
  * @param pc_cls closure for callback
  * @param csc core secret callback is opened, with this the core secert is passed to the client after the authentication
@@ -558,6 +644,7 @@ ANASTASIS_recovery_serialize (const struct ANASTASIS_Recovery *r);
 struct ANASTASIS_Recovery *
 ANASTASIS_recovery_deserialize (struct GNUNET_CURL_Context *ctx,
                                 const json_t *input,
+                                ANASTASIS_UserIdentifierDerive uid_derive,
                                 ANASTASIS_PolicyCallback pc,
                                 void *pc_cls,
                                 ANASTASIS_CoreSecretCallback csc,
@@ -682,6 +769,9 @@ ANASTASIS_truth_upload (
  * @param provider_salt the providers salt
  * @param truth_data contains the truth for this challenge i.e. phone number, email address
  * @param truth_data_size size of the @a truth_data
+ * @param answer_hash hash of the answer if @a type is "question", as
+ *        computed by #ANASTASIS_CRYPTO_secure_answer_hash() with
+ *        @a uuid and @a salt; NULL to compute it
  * @param payment_years_requested for how many years would the client like the service to store the truth?
  * @param pay_timeout how long to wait for payment
  * @param nonce nonce to use for symmetric encryption
@@ -703,6 +793,7 @@ ANASTASIS_truth_upload2 (
   const struct ANASTASIS_CRYPTO_ProviderSaltP *provider_salt,
   const void *truth_data,
   size_t truth_data_size,
+  const struct GNUNET_HashCode *answer_hash,
   uint32_t payment_years_requested,
   struct GNUNET_TIME_Relative pay_timeout,
   const struct ANASTASIS_CRYPTO_NonceP *nonce,
@@ -724,6 +815,9 @@ ANASTASIS_truth_upload2 (
  * @param[in] t truth details, reference is consumed
  * @param truth_data contains the truth for this challenge i.e. phone number, email address
  * @param truth_data_size size of the @a truth_data
+ * @param answer_hash hash of the answer if @a t is a security question,
+ *        as computed by #ANASTASIS_CRYPTO_secure_answer_hash(); NULL
+ *        to compute it
  * @param payment_years_requested for how many years would the client like the service to store the truth?
  * @param pay_timeout how long to wait for payment
  * @param tc opens the truth callback which contains the status of the upload
@@ -735,6 +829,7 @@ ANASTASIS_truth_upload3 (struct GNUNET_CURL_Context *ctx,
                          struct ANASTASIS_Truth *t,
                          const void *truth_data,
                          size_t truth_data_size,
+                         const struct GNUNET_HashCode *answer_hash,
                          uint32_t payment_years_requested,
                          struct GNUNET_TIME_Relative pay_timeout,
                          ANASTASIS_TruthCallback tc,
@@ -852,6 +947,18 @@ struct ANASTASIS_ProviderSuccessStatus
    */
   unsigned long long policy_version;
 
+  /**
+   * Keyed digest of the backup content, to be passed back in
+   * `struct ANASTASIS_ProviderDetails` to skip unchanged backups.
+   */
+  struct GNUNET_HashCode backup_digest;
+
+  /**
+   * Hash of the encrypted policy stored at the provider, to be
+   * passed back in `struct ANASTASIS_ProviderDetails`.
+   */
+  struct GNUNET_HashCode policy_hash;
+
 };
 
 
@@ -962,12 +1069,45 @@ struct ANASTASIS_ProviderDetails
    * salt.
    */
   struct ANASTASIS_CRYPTO_ProviderSaltP provider_salt;
+
+  /**
+   * Digest of the backup stored at the provider as returned in
+   * `struct ANASTASIS_ProviderSuccessStatus`, all zeros if unknown.
+   * If the new backup has the same digest, it is not uploaded again.
+   */
+  struct GNUNET_HashCode backup_digest;
+
+  /**
+   * Version of the policy with @e backup_digest at the provider.
+   */
+  unsigned long long policy_version;
+
+  /**
+   * Expiration of the policy with @e backup_digest at the provider.
+   */
+  struct GNUNET_TIME_Absolute policy_expiration;
+
+  /**
+   * Hash of the encrypted policy with @e backup_digest at the
+   * provider.  The upload is only skipped if this is still the
+   * latest policy at the provider.
+   */
+  struct GNUNET_HashCode policy_hash;
+
+  /**
+   * User identifier at the provider if it was already derived from
+   * the identity attributes and @e provider_salt, NULL to derive it.
+   */
+  const struct ANASTASIS_CRYPTO_UserIdentifierP *user_id;
 };
 
 
 /**
  * Creates a recovery document with the created policies and uploads it to
- * all servers.
+ * all servers.  Providers that already store a backup with the same
+ * content (as per their `backup_digest`) are skipped, if a conditional
+ * GET /policy confirms that their latest policy is still the one with
+ * the given `policy_hash`.
  *
  * @param ctx the CURL context used to connect to the backend
  * @param id_data used to create a account identifier on the escrow provider
@@ -46,5 +46,104 @@ ANASTASIS_authorization_plugin_load (
 void
 ANASTASIS_authorization_plugin_shutdown (void);
 
+
+/**
+ * Pool of long-lived helper processes used by authorization
+ * plugins instead of starting a process per challenge.
+ */
+struct ANASTASIS_AUTHORIZATION_HelperPool;
+
+
+/**
+ * Request submitted to a helper pool.
+ */
+struct ANASTASIS_AUTHORIZATION_HelperJob;
+
+
+/**
+ * Create a pool of helper processes.  Helpers are started
+ * on demand and restarted if they fail.  A helper that takes
+ * longer than @a timeout for a request is killed, and the
+ * request fails.
+ *
+ * @param command command line of the helper to run, the binary
+ *        followed by its arguments, separated by whitespace
+ * @param num_helpers maximum number of helpers to run, must be positive
+ * @param max_queue maximum number of requests to queue if
+ *        all helpers are busy, 0 to reject requests instead
+ * @param timeout how long a helper may take for one request
+ * @return the pool
+ */
+struct ANASTASIS_AUTHORIZATION_HelperPool *
+ANASTASIS_authorization_helper_pool_create (const char *command,
+                                            unsigned int num_helpers,
+                                            unsigned int max_queue,
+                                            struct GNUNET_TIME_Relative timeout);
+
+
+/**
+ * Create a pool of helper processes as configured in @a section
+ * of @a cfg.  The helper command line is given by the "HELPER"
+ * option; "HELPER_POOL_SIZE" and "HELPER_QUEUE_SIZE" limit the
+ * number of helpers and queued requests, and "HELPER_TIMEOUT"
+ * limits the time a helper may take for one request.
+ *
+ * @param cfg configuration to use
+ * @param section configuration section of the plugin
+ * @return NULL if no helper is configured or the configuration
+ *         is invalid
+ */
+struct ANASTASIS_AUTHORIZATION_HelperPool *
+ANASTASIS_authorization_helper_pool_load (
+  const struct GNUNET_CONFIGURATION_Handle *cfg,
+  const char *section);
+
+
+/**
+ * Submit request to a helper of @a pool.  The helper is given
+ * the same arguments and message the one-shot command would get.
+ * @a cb is called with #GNUNET_OS_PROCESS_EXITED and the status
+ * returned by the helper, or #GNUNET_OS_PROCESS_UNKNOWN if the
+ * helper failed.  @a cb is never called from within this function.
+ *
+ * @param pool pool to submit request to
+ * @param argc length of @a args
+ * @param args arguments for the request
+ * @param msg message for the request
+ * @param cb function to call with the result
+ * @param cb_cls closure for @a cb
+ * @return NULL if too many requests are queued already
+ */
+struct ANASTASIS_AUTHORIZATION_HelperJob *
+ANASTASIS_authorization_helper_submit (
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool,
+  unsigned int argc,
+  const char *args[],
+  const char *msg,
+  GNUNET_ChildCompletedCallback cb,
+  void *cb_cls);
+
+
+/**
+ * Cancel request.  The callback will not be called.
+ *
+ * @param[in] job request to cancel
+ */
+void
+ANASTASIS_authorization_helper_cancel (
+  struct ANASTASIS_AUTHORIZATION_HelperJob *job);
+
+
+/**
+ * Stop all helpers of @a pool and free it.  All requests
+ * must have completed or been cancelled.
+ *
+ * @param[in] pool pool to destroy
+ */
+void
+ANASTASIS_authorization_helper_pool_destroy (
+  struct ANASTASIS_AUTHORIZATION_HelperPool *pool);
+
+
 #endif
 /* end of anastasis_authorization_lib.h */
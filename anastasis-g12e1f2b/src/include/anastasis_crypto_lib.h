@@ -289,6 +289,28 @@ ANASTASIS_hash_answer (uint64_t code,
                        struct GNUNET_HashCode *hashed_code);
 
 
+/**
+ * Compute the TOTP codes (RFC 6238 with HMAC-SHA1 and 8 digits) of
+ * @a key for @a num_codes consecutive time steps, starting with the
+ * step that contains @a start.  The HMAC key schedule is derived
+ * only once for all codes.
+ *
+ * @param key shared secret
+ * @param key_size number of bytes in @a key
+ * @param start time within the first step to compute the code for
+ * @param step length of a time step
+ * @param num_codes number of codes to compute
+ * @param[out] codes array of length @a num_codes set to the codes
+ */
+void
+ANASTASIS_CRYPTO_totp_window (const void *key,
+                              size_t key_size,
+                              struct GNUNET_TIME_Absolute start,
+                              struct GNUNET_TIME_Relative step,
+                              unsigned int num_codes,
+                              uint64_t *codes);
+
+
 /**
  * Creates the UserIdentifier, it is used as entropy source for the
  * encryption keys and for the public and private key for signing the
@@ -347,6 +369,98 @@ ANASTASIS_CRYPTO_secure_answer_hash (
   struct GNUNET_HashCode *result);
 
 
+/**
+ * Handle for a batch of user identifier derivations and answer
+ * hashes computed on threads.
+ */
+struct ANASTASIS_CRYPTO_PowBatch;
+
+
+/**
+ * Function called once all results of a batch are available.
+ *
+ * @param cls closure
+ */
+typedef void
+(*ANASTASIS_CRYPTO_PowBatchCallback)(void *cls);
+
+
+/**
+ * Create a batch of memory-hard derivations.  Add derivations with
+ * #ANASTASIS_CRYPTO_pow_batch_add_user_identifier() and
+ * #ANASTASIS_CRYPTO_pow_batch_add_answer_hash(), then start
+ * them with #ANASTASIS_CRYPTO_pow_batch_start().
+ *
+ * @return new batch
+ */
+struct ANASTASIS_CRYPTO_PowBatch *
+ANASTASIS_CRYPTO_pow_batch_create (void);
+
+
+/**
+ * Add the derivation of a user identifier to @a b, see
+ * #ANASTASIS_CRYPTO_user_identifier_derive().
+ *
+ * @param b batch to add to, must not have been started
+ * @param id_data JSON encoded data, which contains the raw user secret
+ * @param server_salt salt from the server (escrow provider)
+ * @param[out] id where to write the identifier once the batch is
+ *             done, must remain valid until then
+ */
+void
+ANASTASIS_CRYPTO_pow_batch_add_user_identifier (
+  struct ANASTASIS_CRYPTO_PowBatch *b,
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id);
+
+
+/**
+ * Add the hashing of an answer to a security question to @a b, see
+ * #ANASTASIS_CRYPTO_secure_answer_hash().
+ *
+ * @param b batch to add to, must not have been started
+ * @param answer human answer to a security question
+ * @param uuid the truth UUID (known to the service)
+ * @param salt random salt value, unknown to the service
+ * @param[out] result where to write the hash once the batch is
+ *             done, must remain valid until then
+ */
+void
+ANASTASIS_CRYPTO_pow_batch_add_answer_hash (
+  struct ANASTASIS_CRYPTO_PowBatch *b,
+  const char *answer,
+  const struct ANASTASIS_CRYPTO_TruthUUIDP *uuid,
+  const struct ANASTASIS_CRYPTO_QuestionSaltP *salt,
+  struct GNUNET_HashCode *result);
+
+
+/**
+ * Start computing all derivations of @a b, in parallel on up to one
+ * thread per CPU.  Must be called from within the scheduler.  The
+ * batch is freed after @a cb was called.
+ *
+ * @param b batch to start
+ * @param cb function to call from the scheduler once all results
+ *        were written
+ * @param cb_cls closure for @a cb
+ */
+void
+ANASTASIS_CRYPTO_pow_batch_start (struct ANASTASIS_CRYPTO_PowBatch *b,
+                                  ANASTASIS_CRYPTO_PowBatchCallback cb,
+                                  void *cb_cls);
+
+
+/**
+ * Cancel batch @a b.  No more results will be written.  Derivations
+ * that are already running finish in the background.
+ *
+ * @param[in] b batch to cancel
+ */
+void
+ANASTASIS_CRYPTO_pow_batch_cancel (struct ANASTASIS_CRYPTO_PowBatch *b);
+
+
 /**
  * Encrypt and signs the recovery document, the recovery
  * document is encrypted with a derivation from the user identifier
@@ -475,6 +589,24 @@ ANASTASIS_CRYPTO_keyshare_create (
   struct ANASTASIS_CRYPTO_KeyShareP *key_share);
 
 
+/**
+ * Compute a digest of the (plaintext) content of a backup that is
+ * keyed with the user identifier at a provider, so that only the user
+ * can tell whether two backups have the same content.
+ *
+ * @param id user identifier at the provider
+ * @param content canonical encoding of the backup content
+ * @param content_size number of bytes in @a content
+ * @param[out] digest set to the keyed digest
+ */
+void
+ANASTASIS_CRYPTO_backup_digest (
+  const struct ANASTASIS_CRYPTO_UserIdentifierP *id,
+  const void *content,
+  size_t content_size,
+  struct GNUNET_HashCode *digest);
+
+
 /**
  * Once per policy a policy key is derived. The policy key consists of
  * multiple key shares which are combined and hashed.
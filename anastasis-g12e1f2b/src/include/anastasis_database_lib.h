@@ -44,6 +44,92 @@ void
 ANASTASIS_DB_plugin_unload (struct ANASTASIS_DatabasePlugin *plugin);
 
 
+/**
+ * Pool of threads with their own database connections.
+ */
+struct ANASTASIS_DB_Pool;
+
+
+/**
+ * Handle for a job submitted to a #ANASTASIS_DB_Pool.
+ */
+struct ANASTASIS_DB_PoolJob;
+
+
+/**
+ * Function run on a thread of the pool.  Must only use @a plugin for
+ * database operations and must not interact with the scheduler.
+ * As the GNUnet logging functions (including #GNUNET_break) are not
+ * thread-safe, it must not log either, but leave its results in the
+ * closure for the #ANASTASIS_DB_PoolDone function to report.
+ *
+ * @param cls closure
+ * @param plugin database plugin owned by the thread
+ */
+typedef void
+(*ANASTASIS_DB_PoolWork)(void *cls,
+                         struct ANASTASIS_DatabasePlugin *plugin);
+
+
+/**
+ * Function called from the scheduler once a job is done.
+ *
+ * @param cls closure
+ */
+typedef void
+(*ANASTASIS_DB_PoolDone)(void *cls);
+
+
+/**
+ * Start @a num_threads threads, each with its own connection to the
+ * database.  Must be called from within the scheduler.
+ *
+ * @param cfg configuration to use
+ * @param num_threads number of threads to start, must not be zero
+ * @return NULL on failure
+ */
+struct ANASTASIS_DB_Pool *
+ANASTASIS_DB_pool_create (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                          unsigned int num_threads);
+
+
+/**
+ * Run @a work on the next idle thread of @a pool and then @a done
+ * from the scheduler.
+ *
+ * @param pool pool to use
+ * @param work function to run on a thread of the pool
+ * @param done function to call once @a work returned
+ * @param cb_cls closure for @a work and @a done
+ * @return handle to cancel the job
+ */
+struct ANASTASIS_DB_PoolJob *
+ANASTASIS_DB_pool_submit (struct ANASTASIS_DB_Pool *pool,
+                          ANASTASIS_DB_PoolWork work,
+                          ANASTASIS_DB_PoolDone done,
+                          void *cb_cls);
+
+
+/**
+ * Cancel @a job.  If its work is already running, waits for it to
+ * return.  The done function of @a job is not called.
+ *
+ * @param[in] job job to cancel
+ */
+void
+ANASTASIS_DB_pool_cancel (struct ANASTASIS_DB_PoolJob *job);
+
+
+/**
+ * Stop all threads of @a pool and close their database connections.
+ * All jobs must have completed or been cancelled.
+ *
+ * @param[in] pool pool to destroy
+ */
+void
+ANASTASIS_DB_pool_destroy (struct ANASTASIS_DB_Pool *pool);
+
+
 #endif  /* ANASTASIS_DB_LIB_H */
 
 /* end of anastasis_database_lib.h */
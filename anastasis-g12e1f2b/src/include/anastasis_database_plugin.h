@@ -226,6 +226,44 @@ struct ANASTASIS_DatabasePlugin
         struct GNUNET_TIME_Absolute expire,
         struct GNUNET_TIME_Absolute expire_pending_payments);
 
+  /**
+   * Function called to perform one step of incremental "garbage
+   * collection" on the database.  Deletes at most @a limit expired
+   * rows from each table, so that each statement only holds its
+   * locks briefly.  Should be called repeatedly until it returns
+   * #GNUNET_DB_STATUS_SUCCESS_NO_RESULTS.
+   *
+   * @param cls closure
+   * @param expire_backups backups of accounts that expired before the
+   *            given time stamp (and IBAN inflows executed before it)
+   *            should be garbage collected
+   * @param expire_pending_payments payments still pending from since before
+   *            this value should be garbage collected
+   * @param limit maximum number of rows to delete per table
+   * @return transaction status, on success the number of rows deleted
+   */
+  enum GNUNET_DB_QueryStatus
+  (*gc_batch)(void *cls,
+              struct GNUNET_TIME_Absolute expire_backups,
+              struct GNUNET_TIME_Absolute expire_pending_payments,
+              uint64_t limit);
+
+  /**
+   * Create the partitions needed for records expiring in the near
+   * future and drop the partitions that only hold expired records.
+   * Briefly locks the partitioned tables, so should be called at
+   * most once per garbage collection period.
+   *
+   * @param cls closure
+   * @param expire_backups IBAN inflows executed before this time
+   *            should be garbage collected
+   * @return transaction status, on success the number of partitions
+   *         dropped
+   */
+  enum GNUNET_DB_QueryStatus
+  (*maintain_partitions)(void *cls,
+                         struct GNUNET_TIME_Absolute expire_backups);
+
   /**
   * Do a pre-flight check that we are not in an uncommitted transaction.
   * If we are, try to commit the previous transaction and output a warning.
@@ -308,6 +346,11 @@ struct ANASTASIS_DatabasePlugin
   /**
    * Notify all that listen on @a es of an event.
    *
+   * Events are sent on one channel per event type, with @a es
+   * prepended to @a extra.  Processes notifying each other, such as
+   * anastasis-helper-authorization-iban and anastasis-httpd, must
+   * thus run the same version of the plugin.
+   *
    * @param cls database context to use
    * @param es specification of the event to generate
    * @param extra additional event data provided
@@ -321,7 +364,8 @@ struct ANASTASIS_DatabasePlugin
 
 
   /**
-   * Store encrypted recovery document.
+   * Store encrypted recovery document.  Does not log failures itself,
+   * so that it may be run on a thread of a #ANASTASIS_DB_Pool.
    *
    * @param cls closure
    * @param account_pub public key of the user's account
@@ -473,6 +517,27 @@ struct ANASTASIS_DatabasePlugin
     uint32_t *version);
 
 
+  /**
+   * Like @e lookup_account, but the result may come from a replica
+   * of the database and thus be slightly stale.  Only to be used by
+   * read-only requests, never to decide about updates.
+   *
+   * @param cls closure
+   * @param account_pub account identifier
+   * @param[out] paid_until until when is the account paid up?
+   * @param[out] recovery_data_hash set to hash of @a recovery document
+   * @param[out] version set to the recovery policy version
+   * @return transaction status
+   */
+  enum ANASTASIS_DB_AccountStatus
+  (*lookup_account_readonly)(
+    void *cls,
+    const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+    struct GNUNET_TIME_Absolute *paid_until,
+    struct GNUNET_HashCode *recovery_data_hash,
+    uint32_t *version);
+
+
   /**
    * Check payment identifier. Used to check if a payment identifier given by
    * the user is valid (existing and paid).
@@ -683,6 +748,30 @@ struct ANASTASIS_DatabasePlugin
     uint64_t *code);
 
 
+  /**
+   * Count an attempt to answer a challenge for which we do not store
+   * real challenge codes (i.e. security questions) against the retry
+   * counter.  Looks up (or creates) the active challenge code entry
+   * for the truth and decrements its retry counter in one step.
+   *
+   * @param cls closure
+   * @param truth_uuid the identifier for the challenge
+   * @param rotation_period how long to count attempts against one entry
+   * @param validity_period for how long is the entry valid
+   * @param retry_counter amount of retries allowed per @a rotation_period
+   * @return transaction status,
+   *        #GNUNET_DB_STATUS_SUCCESS_NO_RESULTS if we are out of valid tries,
+   *        #GNUNET_DB_STATUS_SUCCESS_ONE_RESULT if the attempt was counted
+   */
+  enum GNUNET_DB_QueryStatus
+  (*rate_limit)(
+    void *cls,
+    const struct ANASTASIS_CRYPTO_TruthUUIDP *truth_uuid,
+    struct GNUNET_TIME_Relative rotation_period,
+    struct GNUNET_TIME_Relative validity_period,
+    uint32_t retry_counter);
+
+
   /**
    * Remember in the database that we successfully sent a challenge.
    *
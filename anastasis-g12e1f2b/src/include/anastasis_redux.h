@@ -39,7 +39,9 @@ ANASTASIS_redux_init (struct GNUNET_CURL_Context *ctx);
 
 
 /**
- * Terminate reducer subsystem.
+ * Terminate reducer subsystem.  Also erases the user identifiers
+ * cached while running reducer actions and releases the caches
+ * shared by the requests to the providers.
  */
 void
 ANASTASIS_redux_done (void);
@@ -87,6 +89,10 @@ struct ANASTASIS_ReduxAction;
  * function.  This function can do network access to talk to Anastasis
  * service providers.
  *
+ * The new state shares unmodified members with @a state, so
+ * neither may be modified in place afterwards; use
+ * json_deep_copy() to obtain a state that can be modified.
+ *
  * @param state input state
  * @param action what action to perform
  * @param arguments data for the @a action
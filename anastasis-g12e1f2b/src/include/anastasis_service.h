@@ -247,6 +247,29 @@ ANASTASIS_policy_lookup_version (
   unsigned int version);
 
 
+/**
+ * Does a GET /policy for the latest version, unless that version is
+ * the one with @a known_policy_hash.  In that case, @a cb is called
+ * with #MHD_HTTP_NOT_MODIFIED and no download details.
+ *
+ * @param ctx execution context
+ * @param backend_url base URL of the merchant backend
+ * @param anastasis_pub public key of the user's account
+ * @param known_policy_hash hash of the encrypted policy we know about
+ * @param cb callback which will work the response gotten from the backend
+ * @param cb_cls closure to pass to the callback
+ * @return handle for this operation, NULL upon errors
+ */
+struct ANASTASIS_PolicyLookupOperation *
+ANASTASIS_policy_lookup_if_changed (
+  struct GNUNET_CURL_Context *ctx,
+  const char *backend_url,
+  const struct ANASTASIS_CRYPTO_AccountPublicKeyP *anastasis_pub,
+  const struct GNUNET_HashCode *known_policy_hash,
+  ANASTASIS_PolicyLookupCallback cb,
+  void *cb_cls);
+
+
 /**
  * Cancel a GET /policy request.
  *
@@ -718,4 +741,14 @@ ANASTASIS_truth_store_cancel (
   struct ANASTASIS_TruthStoreOperation *tso);
 
 
+/**
+ * Release the DNS, TLS session and connection caches shared by all
+ * requests of this library.  Must only be called once all requests
+ * have completed or were cancelled; the caches are kept (with a
+ * warning) otherwise.  Later requests create new caches.
+ */
+void
+ANASTASIS_curl_share_cleanup (void);
+
+
 #endif  /* _ANASTASIS_SERVICE_H */
@@ -86,4 +86,55 @@ void
 ANASTASIS_wait_child_cancel (struct ANASTASIS_ChildWaitHandle *cwh);
 
 
+/**
+ * Latency histogram with log-linear buckets, exported in the
+ * Prometheus text format.
+ */
+struct ANASTASIS_METRICS_Histogram;
+
+
+/**
+ * Lookup the histogram of the series @a name with @a labels,
+ * creating it if it does not exist yet.  Thread-safe.
+ *
+ * @param name name of the metric, i.e. "anastasis_request_seconds"
+ * @param help description of the metric
+ * @param labels Prometheus labels of the series without braces,
+ *        i.e. "method=\"GET\"", NULL for none
+ * @return the histogram, valid until ANASTASIS_METRICS_fini()
+ */
+struct ANASTASIS_METRICS_Histogram *
+ANASTASIS_METRICS_histogram (const char *name,
+                             const char *help,
+                             const char *labels);
+
+
+/**
+ * Record an observation of @a duration in @a h.  Lock-free.
+ *
+ * @param[in,out] h histogram to update
+ * @param duration value to record
+ */
+void
+ANASTASIS_METRICS_observe (struct ANASTASIS_METRICS_Histogram *h,
+                           struct GNUNET_TIME_Relative duration);
+
+
+/**
+ * Dump all histograms in the Prometheus text format.  Thread-safe.
+ *
+ * @return 0-terminated dump, to be freed by the caller
+ */
+char *
+ANASTASIS_METRICS_dump (void);
+
+
+/**
+ * Free all histograms.  Must only be called once no thread records
+ * observations anymore, i.e. after the database plugin was unloaded.
+ */
+void
+ANASTASIS_METRICS_fini (void);
+
+
 #endif
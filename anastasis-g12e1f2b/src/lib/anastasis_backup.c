@@ -222,6 +222,7 @@ ANASTASIS_truth_upload3 (struct GNUNET_CURL_Context *ctx,
                          struct ANASTASIS_Truth *t,
                          const void *truth_data,
                          size_t truth_data_size,
+                         const struct GNUNET_HashCode *answer_hash,
                          uint32_t payment_years_requested,
                          struct GNUNET_TIME_Relative pay_timeout,
                          ANASTASIS_TruthCallback tc,
@@ -249,10 +250,13 @@ ANASTASIS_truth_upload3 (struct GNUNET_CURL_Context *ctx,
 
     answer = GNUNET_strndup (truth_data,
                              truth_data_size);
-    ANASTASIS_CRYPTO_secure_answer_hash (answer,
-                                         &t->uuid,
-                                         &t->salt,
-                                         &nt);
+    if (NULL != answer_hash)
+      nt = *answer_hash;
+    else
+      ANASTASIS_CRYPTO_secure_answer_hash (answer,
+                                           &t->uuid,
+                                           &t->salt,
+                                           &nt);
     ANASTASIS_CRYPTO_keyshare_encrypt (&t->key_share,
                                        &tu->id,
                                        answer,
@@ -309,6 +313,7 @@ ANASTASIS_truth_upload2 (
   const struct ANASTASIS_CRYPTO_ProviderSaltP *provider_salt,
   const void *truth_data,
   size_t truth_data_size,
+  const struct GNUNET_HashCode *answer_hash,
   uint32_t payment_years_requested,
   struct GNUNET_TIME_Relative pay_timeout,
   const struct ANASTASIS_CRYPTO_NonceP *nonce,
@@ -341,6 +346,7 @@ ANASTASIS_truth_upload2 (
                                   t,
                                   truth_data,
                                   truth_data_size,
+                                  answer_hash,
                                   payment_years_requested,
                                   pay_timeout,
                                   tc,
@@ -392,6 +398,7 @@ ANASTASIS_truth_upload (
                                   provider_salt,
                                   truth_data,
                                   truth_data_size,
+                                  NULL,
                                   payment_years_requested,
                                   pay_timeout,
                                   &nonce,
@@ -532,6 +539,11 @@ struct PolicyStoreState
    */
   struct GNUNET_HashCode curr_hash;
 
+  /**
+   * Keyed digest of the backup content for this provider.
+   */
+  struct GNUNET_HashCode backup_digest;
+
   /**
    * Payment identifier.
    */
@@ -548,6 +560,12 @@ struct PolicyStoreState
    */
   struct ANASTASIS_PolicyStoreOperation *pso;
 
+  /**
+   * The /policy GET operation checking that the backup at the
+   * provider is still the one with @e curr_hash.
+   */
+  struct ANASTASIS_PolicyLookupOperation *plo;
+
   /**
    * URL of the anastasis backend.
    */
@@ -573,6 +591,12 @@ struct PolicyStoreState
    */
   struct GNUNET_TIME_Absolute policy_expiration;
 
+  /**
+   * True if the provider already has a backup with
+   * @e backup_digest and we thus did not upload anything.
+   */
+  bool unchanged;
+
 };
 
 /**
@@ -604,9 +628,99 @@ struct ANASTASIS_SecretShare
    * Closure for the Result Callback
    */
   unsigned int pss_length;
+
+  /**
+   * Compressed recovery document to encrypt for each provider.
+   */
+  void *recovery_document;
+
+  /**
+   * Number of bytes in @e recovery_document.
+   */
+  size_t recovery_document_size;
+
+  /**
+   * For how many years should we pay for the policies?
+   */
+  uint32_t payment_years_requested;
+
+  /**
+   * How long to wait for payments.
+   */
+  struct GNUNET_TIME_Relative pay_timeout;
 };
 
 
+/**
+ * All uploads are done, report the result of @a ss and clean up.
+ *
+ * @param[in] ss operation to finish
+ */
+static void
+report_result (struct ANASTASIS_SecretShare *ss)
+{
+  struct ANASTASIS_SharePaymentRequest spr[GNUNET_NZL (ss->pss_length)];
+  struct ANASTASIS_ProviderSuccessStatus apss[GNUNET_NZL (ss->pss_length)];
+  unsigned int off = 0;
+  unsigned int voff = 0;
+  struct ANASTASIS_ShareResult sr;
+
+  for (unsigned int i = 0; i<ss->pss_length; i++)
+  {
+    struct PolicyStoreState *pssi = &ss->pss[i];
+
+    if (NULL == pssi->payment_request)
+    {
+      apss[voff].policy_version = pssi->policy_version;
+      apss[voff].provider_url = pssi->anastasis_url;
+      apss[voff].policy_expiration = pssi->policy_expiration;
+      apss[voff].backup_digest = pssi->backup_digest;
+      apss[voff].policy_hash = pssi->curr_hash;
+      voff++;
+    }
+    else
+    {
+      spr[off].payment_request_url = pssi->payment_request;
+      spr[off].provider_url = pssi->anastasis_url;
+      spr[off].payment_secret = pssi->payment_secret;
+      off++;
+    }
+  }
+  if (off > 0)
+  {
+    sr.ss = ANASTASIS_SHARE_STATUS_PAYMENT_REQUIRED;
+    sr.details.payment_required.payment_requests = spr;
+    sr.details.payment_required.payment_requests_length = off;
+  }
+  else
+  {
+    sr.ss = ANASTASIS_SHARE_STATUS_SUCCESS;
+    sr.details.success.pss = apss;
+    sr.details.success.num_providers = voff;
+  }
+  ss->src (ss->src_cls,
+           &sr);
+  ANASTASIS_secret_share_cancel (ss);
+}
+
+
+/**
+ * Report the result of @a ss if all uploads and checks are done.
+ *
+ * @param[in] ss operation to check
+ */
+static void
+check_done (struct ANASTASIS_SecretShare *ss)
+{
+  for (unsigned int i = 0; i<ss->pss_length; i++)
+    if ( (NULL != ss->pss[i].pso) ||
+         (NULL != ss->pss[i].plo) )
+      /* some upload or check is still pending, let's wait for it */
+      return;
+  report_result (ss);
+}
+
+
 /**
  * Callback to process a POST /policy request
  *
@@ -663,53 +777,104 @@ policy_store_cb (void *cls,
     GNUNET_break (0);
     break;
   }
-  for (unsigned int i = 0; i<ss->pss_length; i++)
-    if (NULL != ss->pss[i].pso)
-      /* some upload is still pending, let's wait for it to finish */
-      return;
+  check_done (ss);
+}
+
 
+/**
+ * Encrypt the recovery document of @a pss->ss for the provider of
+ * @a pss and start uploading it.
+ *
+ * @param[in,out] pss upload to start
+ * @return #GNUNET_OK on success
+ */
+static enum GNUNET_GenericReturnValue
+start_upload (struct PolicyStoreState *pss)
+{
+  struct ANASTASIS_SecretShare *ss = pss->ss;
+  void *recovery_data;
+  size_t recovery_data_size;
+  struct ANASTASIS_CRYPTO_AccountPrivateKeyP anastasis_priv;
+
+  pss->unchanged = false;
+  ANASTASIS_CRYPTO_account_private_key_derive (&pss->id,
+                                               &anastasis_priv);
+  ANASTASIS_CRYPTO_recovery_document_encrypt (&pss->id,
+                                              ss->recovery_document,
+                                              ss->recovery_document_size,
+                                              &recovery_data,
+                                              &recovery_data_size);
+  GNUNET_CRYPTO_hash (recovery_data,
+                      recovery_data_size,
+                      &pss->curr_hash);
+  pss->pso = ANASTASIS_policy_store (
+    ss->ctx,
+    pss->anastasis_url,
+    &anastasis_priv,
+    recovery_data,
+    recovery_data_size,
+    ss->payment_years_requested,
+    (! GNUNET_is_zero (&pss->payment_secret))
+    ? &pss->payment_secret
+    : NULL,
+    ss->pay_timeout,
+    &policy_store_cb,
+    pss);
+  GNUNET_free (recovery_data);
+  if (NULL == pss->pso)
   {
-    struct ANASTASIS_SharePaymentRequest spr[GNUNET_NZL (ss->pss_length)];
-    struct ANASTASIS_ProviderSuccessStatus apss[GNUNET_NZL (ss->pss_length)];
-    unsigned int off = 0;
-    unsigned int voff = 0;
-    struct ANASTASIS_ShareResult sr;
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
 
-    for (unsigned int i = 0; i<ss->pss_length; i++)
-    {
-      struct PolicyStoreState *pssi = &ss->pss[i];
 
-      if (NULL == pssi->payment_request)
-      {
-        apss[voff].policy_version = pssi->policy_version;
-        apss[voff].provider_url = pssi->anastasis_url;
-        apss[voff].policy_expiration = pssi->policy_expiration;
-        voff++;
-      }
-      else
-      {
-        spr[off].payment_request_url = pssi->payment_request;
-        spr[off].provider_url = pssi->anastasis_url;
-        spr[off].payment_secret = pssi->payment_secret;
-        off++;
-      }
-    }
-    if (off > 0)
-    {
-      sr.ss = ANASTASIS_SHARE_STATUS_PAYMENT_REQUIRED;
-      sr.details.payment_required.payment_requests = spr;
-      sr.details.payment_required.payment_requests_length = off;
-    }
-    else
-    {
-      sr.ss = ANASTASIS_SHARE_STATUS_SUCCESS;
-      sr.details.success.pss = apss;
-      sr.details.success.num_providers = voff;
-    }
+/**
+ * Callback to process the GET /policy request checking whether the
+ * backup at a provider is unchanged.
+ *
+ * @param cls a `struct PolicyStoreState`
+ * @param http_status HTTP status code for this request
+ * @param dd details of the current policy at the provider, if any
+ */
+static void
+policy_check_cb (void *cls,
+                 unsigned int http_status,
+                 const struct ANASTASIS_DownloadDetails *dd)
+{
+  struct PolicyStoreState *pss = cls;
+  struct ANASTASIS_SecretShare *ss = pss->ss;
+
+  (void) dd;
+  pss->plo = NULL;
+  if (MHD_HTTP_NOT_MODIFIED == http_status)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Backup at `%s' is unchanged, skipping upload\n",
+                pss->anastasis_url);
+    check_done (ss);
+    return;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Backup at `%s' changed (HTTP status %u), uploading again\n",
+              pss->anastasis_url,
+              http_status);
+  if (GNUNET_OK !=
+      start_upload (pss))
+  {
+    struct ANASTASIS_ShareResult sr = {
+      .ss = ANASTASIS_SHARE_STATUS_PROVIDER_FAILED,
+      .details.provider_failure.provider_url = pss->anastasis_url,
+      .details.provider_failure.http_status = 0,
+      .details.provider_failure.ec = TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE
+    };
+
     ss->src (ss->src_cls,
              &sr);
+    ANASTASIS_secret_share_cancel (ss);
+    return;
   }
-  ANASTASIS_secret_share_cancel (ss);
 }
 
 
@@ -732,8 +897,7 @@ ANASTASIS_secret_share (struct GNUNET_CURL_Context *ctx,
   struct ANASTASIS_CoreSecretEncryptionResult *cser;
   json_t *dec_policies;
   json_t *esc_methods;
-  size_t recovery_document_size;
-  char *recovery_document_str;
+  json_t *policy_uuids;
 
   if (0 == pss_length)
   {
@@ -747,19 +911,11 @@ ANASTASIS_secret_share (struct GNUNET_CURL_Context *ctx,
                               struct PolicyStoreState);
   ss->pss_length = pss_length;
   ss->ctx = ctx;
+  ss->payment_years_requested = payment_years_requested;
+  ss->pay_timeout = pay_timeout;
 
-  {
-    struct ANASTASIS_CRYPTO_PolicyKeyP policy_keys[GNUNET_NZL (policies_len)];
-
-    for (unsigned int i = 0; i < policies_len; i++)
-      policy_keys[i] = policies[i]->policy_key;
-    cser = ANASTASIS_CRYPTO_core_secret_encrypt (policy_keys,
-                                                 policies_len,
-                                                 core_secret,
-                                                 core_secret_size);
-  }
-  dec_policies = json_array ();
-  GNUNET_assert (NULL != dec_policies);
+  policy_uuids = json_array ();
+  GNUNET_assert (NULL != policy_uuids);
   for (unsigned int k = 0; k < policies_len; k++)
   {
     const struct ANASTASIS_Policy *policy = policies[k];
@@ -773,17 +929,8 @@ ANASTASIS_secret_share (struct GNUNET_CURL_Context *ctx,
                        GNUNET_JSON_from_data_auto (
                          &policy->truths[b]->uuid)));
     GNUNET_assert (0 ==
-                   json_array_append_new (
-                     dec_policies,
-                     GNUNET_JSON_PACK (
-                       GNUNET_JSON_pack_data_varsize ("master_key",
-                                                      cser->enc_master_keys[k],
-                                                      cser->enc_master_key_sizes
-                                                      [k]),
-                       GNUNET_JSON_pack_array_steal ("uuids",
-                                                     uuids),
-                       GNUNET_JSON_pack_data_auto ("salt",
-                                                   &policy->salt))));
+                   json_array_append_new (policy_uuids,
+                                          uuids));
   }
 
   esc_methods = json_array ();
@@ -835,6 +982,95 @@ ANASTASIS_secret_share (struct GNUNET_CURL_Context *ctx,
     }
   }
 
+  /* Check which providers already have a backup with this content.
+     Policy salts and master keys are fresh for every run, so the
+     digest only covers what determines the recovered secret. */
+  {
+    json_t *content;
+    char *content_str;
+
+    content = GNUNET_JSON_PACK (
+      GNUNET_JSON_pack_allow_null (
+        GNUNET_JSON_pack_string ("secret_name",
+                                 secret_name)),
+      GNUNET_JSON_pack_array_incref ("policies",
+                                     policy_uuids),
+      GNUNET_JSON_pack_array_incref ("escrow_methods",
+                                     esc_methods),
+      GNUNET_JSON_pack_data_varsize ("core_secret",
+                                     core_secret,
+                                     core_secret_size));
+    GNUNET_assert (NULL != content);
+    content_str = json_dumps (content,
+                              JSON_COMPACT | JSON_SORT_KEYS);
+    GNUNET_assert (NULL != content_str);
+    json_decref (content);
+    for (unsigned int l = 0; l < ss->pss_length; l++)
+    {
+      struct PolicyStoreState *pss = &ss->pss[l];
+
+      pss->ss = ss;
+      pss->anastasis_url = GNUNET_strdup (providers[l].provider_url);
+      pss->server_salt = providers[l].provider_salt;
+      pss->payment_secret = providers[l].payment_secret;
+      if (NULL != providers[l].user_id)
+        pss->id = *providers[l].user_id;
+      else
+        ANASTASIS_CRYPTO_user_identifier_derive (id_data,
+                                                 &pss->server_salt,
+                                                 &pss->id);
+      ANASTASIS_CRYPTO_backup_digest (&pss->id,
+                                      content_str,
+                                      strlen (content_str),
+                                      &pss->backup_digest);
+      /* The digest only tells us what we uploaded last time; the
+         provider must confirm that this is still its latest policy. */
+      if ( (0 == GNUNET_memcmp (&pss->backup_digest,
+                                &providers[l].backup_digest)) &&
+           (! GNUNET_is_zero (&providers[l].policy_hash)) )
+      {
+        pss->unchanged = true;
+        pss->curr_hash = providers[l].policy_hash;
+        pss->policy_version = providers[l].policy_version;
+        pss->policy_expiration = providers[l].policy_expiration;
+      }
+    }
+    free (content_str);
+  }
+
+  {
+    struct ANASTASIS_CRYPTO_PolicyKeyP policy_keys[GNUNET_NZL (policies_len)];
+
+    for (unsigned int i = 0; i < policies_len; i++)
+      policy_keys[i] = policies[i]->policy_key;
+    cser = ANASTASIS_CRYPTO_core_secret_encrypt (policy_keys,
+                                                 policies_len,
+                                                 core_secret,
+                                                 core_secret_size);
+  }
+  dec_policies = json_array ();
+  GNUNET_assert (NULL != dec_policies);
+  for (unsigned int k = 0; k < policies_len; k++)
+  {
+    const struct ANASTASIS_Policy *policy = policies[k];
+
+    GNUNET_assert (0 ==
+                   json_array_append_new (
+                     dec_policies,
+                     GNUNET_JSON_PACK (
+                       GNUNET_JSON_pack_data_varsize ("master_key",
+                                                      cser->enc_master_keys[k],
+                                                      cser->enc_master_key_sizes
+                                                      [k]),
+                       GNUNET_JSON_pack_array_incref ("uuids",
+                                                      json_array_get (
+                                                        policy_uuids,
+                                                        k)),
+                       GNUNET_JSON_pack_data_auto ("salt",
+                                                   &policy->salt))));
+  }
+  json_decref (policy_uuids);
+
   {
     json_t *recovery_document;
     size_t rd_size;
@@ -884,57 +1120,37 @@ ANASTASIS_secret_share (struct GNUNET_CURL_Context *ctx,
       return NULL;
     }
     free (rd_str);
-    recovery_document_size = (size_t) (cbuf_size + sizeof (uint32_t));
-    recovery_document_str = (char *) cbuf;
+    ss->recovery_document_size = (size_t) (cbuf_size + sizeof (uint32_t));
+    ss->recovery_document = cbuf;
   }
 
   for (unsigned int l = 0; l < ss->pss_length; l++)
   {
     struct PolicyStoreState *pss = &ss->pss[l];
-    void *recovery_data;
-    size_t recovery_data_size;
-    struct ANASTASIS_CRYPTO_AccountPrivateKeyP anastasis_priv;
-
-    pss->ss = ss;
-    pss->anastasis_url = GNUNET_strdup (providers[l].provider_url);
-    pss->server_salt = providers[l].provider_salt;
-    pss->payment_secret = providers[l].payment_secret;
-    ANASTASIS_CRYPTO_user_identifier_derive (id_data,
-                                             &pss->server_salt,
-                                             &pss->id);
-    ANASTASIS_CRYPTO_account_private_key_derive (&pss->id,
-                                                 &anastasis_priv);
-    ANASTASIS_CRYPTO_recovery_document_encrypt (&pss->id,
-                                                recovery_document_str,
-                                                recovery_document_size,
-                                                &recovery_data,
-                                                &recovery_data_size);
-    GNUNET_CRYPTO_hash (recovery_data,
-                        recovery_data_size,
-                        &pss->curr_hash);
-    pss->pso = ANASTASIS_policy_store (
-      ss->ctx,
-      pss->anastasis_url,
-      &anastasis_priv,
-      recovery_data,
-      recovery_data_size,
-      payment_years_requested,
-      (! GNUNET_is_zero (&pss->payment_secret))
-      ? &pss->payment_secret
-      : NULL,
-      pay_timeout,
-      &policy_store_cb,
-      pss);
-    GNUNET_free (recovery_data);
-    if (NULL == pss->pso)
+
+    if (pss->unchanged)
     {
+      struct ANASTASIS_CRYPTO_AccountPublicKeyP anastasis_pub;
+
+      ANASTASIS_CRYPTO_account_public_key_derive (&pss->id,
+                                                  &anastasis_pub);
+      pss->plo = ANASTASIS_policy_lookup_if_changed (ss->ctx,
+                                                     pss->anastasis_url,
+                                                     &anastasis_pub,
+                                                     &pss->curr_hash,
+                                                     &policy_check_cb,
+                                                     pss);
+      if (NULL != pss->plo)
+        continue;
       GNUNET_break (0);
+    }
+    if (GNUNET_OK !=
+        start_upload (pss))
+    {
       ANASTASIS_secret_share_cancel (ss);
-      GNUNET_free (recovery_document_str);
       return NULL;
     }
   }
-  GNUNET_free (recovery_document_str);
   return ss;
 }
 
@@ -951,9 +1167,15 @@ ANASTASIS_secret_share_cancel (struct ANASTASIS_SecretShare *ss)
       ANASTASIS_policy_store_cancel (pssi->pso);
       pssi->pso = NULL;
     }
+    if (NULL != pssi->plo)
+    {
+      ANASTASIS_policy_lookup_cancel (pssi->plo);
+      pssi->plo = NULL;
+    }
     GNUNET_free (pssi->anastasis_url);
     GNUNET_free (pssi->payment_request);
   }
+  GNUNET_free (ss->recovery_document);
   GNUNET_free (ss->pss);
   GNUNET_free (ss);
 }
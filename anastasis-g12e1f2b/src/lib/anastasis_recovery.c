@@ -103,6 +103,47 @@ struct ANASTASIS_Challenge
    */
   struct ANASTASIS_KeyShareLookupOperation *kslo;
 
+  /**
+   * True while the answer to this challenge is being hashed
+   * as part of a batch, see #ANASTASIS_challenge_answer_batch().
+   */
+  bool batch_pending;
+
+};
+
+
+/**
+ * Answer of a batch whose hash is being computed.
+ */
+struct BatchAnswer
+{
+
+  /**
+   * Challenge to answer, NULL if the challenge was aborted
+   * while we were hashing.
+   */
+  struct ANASTASIS_Challenge *c;
+
+  /**
+   * Answer to the security question.
+   */
+  char *answer;
+
+  /**
+   * Payment secret to use.
+   */
+  struct ANASTASIS_PaymentSecretP ps;
+
+  /**
+   * Hash of @e answer, computed by the batch.
+   */
+  struct GNUNET_HashCode hashed_answer;
+
+  /**
+   * True if @e ps is set.
+   */
+  bool have_ps;
+
 };
 
 
@@ -166,6 +207,11 @@ struct ANASTASIS_Recovery
    */
   json_t *id_data;
 
+  /**
+   * Function to derive user identifiers from @e id_data with.
+   */
+  ANASTASIS_UserIdentifierDerive uid_derive;
+
   /**
    * Callback to send back a recovery document with the policies and the version
    */
@@ -229,6 +275,38 @@ struct ANASTASIS_Recovery
    */
   size_t enc_core_secret_size;
 
+  /**
+   * Batch computing the hashes of answers given to
+   * #ANASTASIS_challenge_answer_batch(), NULL if none is running.
+   */
+  struct ANASTASIS_CRYPTO_PowBatch *pb;
+
+  /**
+   * Answers whose hashes @e pb is computing, array of
+   * length @e batch_length.
+   */
+  struct BatchAnswer *batch;
+
+  /**
+   * Length of the @e batch array.
+   */
+  unsigned int batch_length;
+
+  /**
+   * Timeout to use for the lookups of the @e batch.
+   */
+  struct GNUNET_TIME_Relative batch_timeout;
+
+  /**
+   * Feedback callback for the lookups of the @e batch.
+   */
+  ANASTASIS_AnswerFeedback batch_af;
+
+  /**
+   * Closure for @e batch_af.
+   */
+  void *batch_af_cls;
+
   /**
    * Current offset in the @e solved_challenges array.
    */
@@ -237,6 +315,27 @@ struct ANASTASIS_Recovery
 };
 
 
+/**
+ * Free the @e batch of answers of @a r.
+ *
+ * @param[in,out] r recovery to free the batch of
+ */
+static void
+free_batch (struct ANASTASIS_Recovery *r)
+{
+  for (unsigned int i = 0; i<r->batch_length; i++)
+  {
+    struct BatchAnswer *ba = &r->batch[i];
+
+    if (NULL != ba->c)
+      ba->c->batch_pending = false;
+    GNUNET_free (ba->answer);
+  }
+  GNUNET_free (r->batch);
+  r->batch_length = 0;
+}
+
+
 /**
  * Function called with the results of a #ANASTASIS_keyshare_lookup().
  *
@@ -373,9 +472,9 @@ keyshare_lookup_cb (void *cls,
   }
 
   GNUNET_assert (NULL != dd);
-  ANASTASIS_CRYPTO_user_identifier_derive (recovery->id_data,
-                                           &c->provider_salt,
-                                           &id);
+  recovery->uid_derive (recovery->id_data,
+                        &c->provider_salt,
+                        &id);
   ANASTASIS_CRYPTO_keyshare_decrypt (&dd->details.eks,
                                      &id,
                                      c->answer,
@@ -483,7 +582,8 @@ ANASTASIS_challenge_start (struct ANASTASIS_Challenge *c,
     GNUNET_break (0);
     return GNUNET_NO; /* already solved */
   }
-  if (NULL != c->kslo)
+  if ( (NULL != c->kslo) ||
+       (c->batch_pending) )
   {
     GNUNET_break (0);
     return GNUNET_NO; /* already solving */
@@ -555,9 +655,187 @@ ANASTASIS_challenge_answer2 (struct ANASTASIS_Challenge *c,
 }
 
 
+/**
+ * Function called once the hashes of the security question answers
+ * of a batch were computed.  Starts the keyshare lookups of the batch.
+ *
+ * @param cls a `struct ANASTASIS_Recovery *`
+ */
+static void
+batch_hashed_cb (void *cls)
+{
+  struct ANASTASIS_Recovery *r = cls;
+  struct ANASTASIS_Challenge *failed = NULL;
+  ANASTASIS_AnswerFeedback af = r->batch_af;
+  void *af_cls = r->batch_af_cls;
+
+  r->pb = NULL;
+  for (unsigned int i = 0; i<r->batch_length; i++)
+  {
+    struct BatchAnswer *ba = &r->batch[i];
+    struct ANASTASIS_Challenge *c = ba->c;
+
+    if (NULL == c)
+      continue; /* aborted meanwhile */
+    c->batch_pending = false;
+    ba->c = NULL;
+    GNUNET_free (c->answer);
+    c->answer = ba->answer;
+    ba->answer = NULL;
+    if ( (GNUNET_OK !=
+          ANASTASIS_challenge_start (c,
+                                     ba->have_ps ? &ba->ps : NULL,
+                                     r->batch_timeout,
+                                     &ba->hashed_answer,
+                                     af,
+                                     af_cls)) &&
+         (NULL == failed) )
+      failed = c;
+  }
+  free_batch (r);
+  if (NULL != failed)
+  {
+    /* Only report the first failure: the callback may abort
+       the recovery (and thus the lookups we did start). */
+    struct ANASTASIS_ChallengeStartResponse csr = {
+      .cs = ANASTASIS_CHALLENGE_STATUS_SERVER_FAILURE,
+      .challenge = failed,
+      .details.server_failure.ec = TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE
+    };
+
+    af (af_cls,
+        &csr);
+  }
+}
+
+
+enum GNUNET_GenericReturnValue
+ANASTASIS_challenge_answer_batch (
+  unsigned int answers_length,
+  const struct ANASTASIS_ChallengeAnswer answers[],
+  struct GNUNET_TIME_Relative timeout,
+  ANASTASIS_AnswerFeedback af,
+  void *af_cls)
+{
+  struct ANASTASIS_Recovery *r;
+  unsigned int num_questions = 0;
+
+  if (0 == answers_length)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  r = answers[0].c->recovery;
+  /* Check first, so that we do not have to roll back on
+     the common errors. */
+  for (unsigned int i = 0; i<answers_length; i++)
+  {
+    const struct ANASTASIS_Challenge *c = answers[i].c;
+
+    if (r != c->recovery)
+    {
+      GNUNET_break (0);
+      return GNUNET_SYSERR;
+    }
+    if ( (c->ci.solved) ||
+         (NULL != c->kslo) ||
+         (c->batch_pending) )
+    {
+      GNUNET_break (0);
+      return GNUNET_NO;
+    }
+    for (unsigned int j = 0; j<i; j++)
+      if (c == answers[j].c)
+      {
+        GNUNET_break (0);
+        return GNUNET_NO; /* duplicate */
+      }
+    if (NULL != answers[i].answer)
+      num_questions++;
+  }
+  if ( (num_questions > 0) &&
+       (NULL != r->pb) )
+  {
+    GNUNET_break (0);
+    return GNUNET_NO; /* one batch at a time */
+  }
+  /* Numeric answers are cheap to hash, start their lookups right
+     away.  The lookups only complete once we return to the scheduler,
+     so none of them can finish (and abort the recovery) while we are
+     still starting the others. */
+  for (unsigned int i = 0; i<answers_length; i++)
+  {
+    const struct ANASTASIS_ChallengeAnswer *ca = &answers[i];
+
+    if (NULL != ca->answer)
+      continue;
+    if (GNUNET_OK !=
+        ANASTASIS_challenge_answer2 (ca->c,
+                                     ca->psp,
+                                     timeout,
+                                     ca->answer_num,
+                                     af,
+                                     af_cls))
+    {
+      for (unsigned int j = 0; j<i; j++)
+        if (NULL == answers[j].answer)
+          ANASTASIS_challenge_abort (answers[j].c);
+      return GNUNET_SYSERR;
+    }
+  }
+  if (0 == num_questions)
+    return GNUNET_OK;
+  /* Security question answers are hashed with a memory-hard
+     function, compute all of them in parallel on threads. */
+  r->batch = GNUNET_new_array (num_questions,
+                               struct BatchAnswer);
+  r->batch_timeout = timeout;
+  r->batch_af = af;
+  r->batch_af_cls = af_cls;
+  r->pb = ANASTASIS_CRYPTO_pow_batch_create ();
+  for (unsigned int i = 0; i<answers_length; i++)
+  {
+    const struct ANASTASIS_ChallengeAnswer *ca = &answers[i];
+    struct BatchAnswer *ba;
+
+    if (NULL == ca->answer)
+      continue;
+    ba = &r->batch[r->batch_length++];
+    ba->c = ca->c;
+    ba->c->batch_pending = true;
+    ba->answer = GNUNET_strdup (ca->answer);
+    if (NULL != ca->psp)
+    {
+      ba->ps = *ca->psp;
+      ba->have_ps = true;
+    }
+    ANASTASIS_CRYPTO_pow_batch_add_answer_hash (r->pb,
+                                                ba->answer,
+                                                &ba->c->ci.uuid,
+                                                &ba->c->salt,
+                                                &ba->hashed_answer);
+  }
+  ANASTASIS_CRYPTO_pow_batch_start (r->pb,
+                                    &batch_hashed_cb,
+                                    r);
+  return GNUNET_OK;
+}
+
+
 void
 ANASTASIS_challenge_abort (struct ANASTASIS_Challenge *c)
 {
+  if (c->batch_pending)
+  {
+    struct ANASTASIS_Recovery *r = c->recovery;
+
+    /* still hashing the answer, just skip it when done */
+    for (unsigned int i = 0; i<r->batch_length; i++)
+      if (c == r->batch[i].c)
+        r->batch[i].c = NULL;
+    c->batch_pending = false;
+    return;
+  }
   if (NULL == c->kslo)
   {
     GNUNET_break (0);
@@ -933,6 +1211,7 @@ ANASTASIS_recovery_begin (
   unsigned int version,
   const char *anastasis_provider_url,
   const struct ANASTASIS_CRYPTO_ProviderSaltP *provider_salt,
+  ANASTASIS_UserIdentifierDerive uid_derive,
   ANASTASIS_PolicyCallback pc,
   void *pc_cls,
   ANASTASIS_CoreSecretCallback csc,
@@ -949,9 +1228,12 @@ ANASTASIS_recovery_begin (
   r->ctx = ctx;
   r->id_data = json_incref ((json_t *) id_data);
   r->provider_url = GNUNET_strdup (anastasis_provider_url);
-  ANASTASIS_CRYPTO_user_identifier_derive (id_data,
-                                           provider_salt,
-                                           &r->id);
+  r->uid_derive = (NULL != uid_derive)
+    ? uid_derive
+    : &ANASTASIS_CRYPTO_user_identifier_derive;
+  r->uid_derive (id_data,
+                 provider_salt,
+                 &r->id);
   ANASTASIS_CRYPTO_account_public_key_derive (&r->id,
                                               &pub_key);
   r->ri.version = version;
@@ -1307,6 +1589,7 @@ run_async_pc (void *cls)
 struct ANASTASIS_Recovery *
 ANASTASIS_recovery_deserialize (struct GNUNET_CURL_Context *ctx,
                                 const json_t *input,
+                                ANASTASIS_UserIdentifierDerive uid_derive,
                                 ANASTASIS_PolicyCallback pc,
                                 void *pc_cls,
                                 ANASTASIS_CoreSecretCallback csc,
@@ -1320,6 +1603,9 @@ ANASTASIS_recovery_deserialize (struct GNUNET_CURL_Context *ctx,
   r->pc = pc;
   r->pc_cls = pc_cls;
   r->ctx = ctx;
+  r->uid_derive = (NULL != uid_derive)
+    ? uid_derive
+    : &ANASTASIS_CRYPTO_user_identifier_derive;
   {
     const char *err_json_name;
     unsigned int err_line;
@@ -1445,6 +1731,12 @@ ANASTASIS_recovery_abort (struct ANASTASIS_Recovery *r)
     ANASTASIS_policy_lookup_cancel (r->plo);
     r->plo = NULL;
   }
+  if (NULL != r->pb)
+  {
+    ANASTASIS_CRYPTO_pow_batch_cancel (r->pb);
+    r->pb = NULL;
+  }
+  free_batch (r);
   GNUNET_free (r->solved_challenges);
   for (unsigned int j = 0; j < r->ri.dps_len; j++)
   {
@@ -37,11 +37,20 @@
 /**
  * CPU limiter: do not evaluate more than 16k
  * possible policy combinations to find the "best"
- * policy.
+ * policy.  Only applies if costs are in multiple
+ * currencies, as otherwise find_best_map() can
+ * prune the search and always finds the optimum.
  */
 #define MAX_EVALUATIONS (1024 * 16)
 
 
+/**
+ * True to make find_best_map() evaluate all policy combinations
+ * without pruning, see ANASTASIS_REDUX_policy_search_exhaustive_().
+ */
+static bool exhaustive_search;
+
+
 #define GENERATE_STRING(STRING) #STRING,
 static const char *backup_strings[] = {
   ANASTASIS_BACKUP_STATES (GENERATE_STRING)
@@ -442,8 +451,8 @@ add_authentication (json_t *state,
   {
     json_t *auth_method_arr;
 
-    auth_method_arr = json_object_get (state,
-                                       "authentication_methods");
+    auth_method_arr = ANASTASIS_REDUX_mutable_ (state,
+                                                "authentication_methods");
     if (NULL == auth_method_arr)
     {
       auth_method_arr = json_array ();
@@ -491,8 +500,8 @@ del_authentication (json_t *state,
   json_t *idx;
   json_t *auth_method_arr;
 
-  auth_method_arr = json_object_get (state,
-                                     "authentication_methods");
+  auth_method_arr = ANASTASIS_REDUX_mutable_ (state,
+                                              "authentication_methods");
   if (! json_is_array (auth_method_arr))
   {
     ANASTASIS_redux_fail_ (cb,
@@ -698,13 +707,46 @@ struct PolicyBuilder
    */
   struct PolicyMap *curr_map;
 
+  /**
+   * Challenges of the policy entries selected on the current
+   * path of find_best_map(), array of length @e sel_len.
+   */
+  unsigned int *sel_challenges;
+
+  /**
+   * Providers of the policy entries selected on the current
+   * path of find_best_map(), array of length @e sel_len.
+   */
+  const char **sel_providers;
+
+  /**
+   * Number of policy entries selected on the current path
+   * of find_best_map().
+   */
+  unsigned int sel_len;
+
   /**
    * How many mappings have we evaluated so far?
-   * Used to limit the computation by aborting after
-   * #MAX_EVALUATIONS trials.
    */
   unsigned int evaluations;
 
+  /**
+   * How many partial mappings did we prune?
+   */
+  unsigned int pruned;
+
+  /**
+   * True if we stopped the search after evaluating
+   * #MAX_EVALUATIONS mappings without being able to prune.
+   */
+  bool truncated;
+
+  /**
+   * True if all costs are in the same currency, so that costs
+   * of partial mappings are lower bounds we can prune with.
+   */
+  bool prunable;
+
   /**
    * Overall number of challenges provided by the user.
    */
@@ -1411,6 +1453,42 @@ compare_costs (const struct Costs *my,
 }
 
 
+/**
+ * Check if a (possibly partial) policy map stack with total cost
+ * @a my_cost and @a duplicates is worse than the best one in @a pb.
+ *
+ * Map stacks that tie with the best one are also rejected, so
+ * the first best map stack found wins.  As costs and duplicates
+ * only grow, completions of a tied partial map stack can at best
+ * tie as well, so find_best_map() may prune ties without changing
+ * the result.  This matters when many providers have equal (or
+ * zero) fees.
+ *
+ * @param pb policy builder with the best known map stack
+ * @param my_cost cost of the map stack to check
+ * @param duplicates number of duplicated challenges in the map stack
+ * @return true if the map stack cannot be better than the best one
+ */
+static bool
+worse_than_best (const struct PolicyBuilder *pb,
+                 const struct Costs *my_cost,
+                 unsigned int duplicates)
+{
+  int ccmp;
+
+  if (UINT_MAX == pb->best_duplicates)
+    return false; /* nothing known yet */
+  ccmp = compare_costs (my_cost,
+                        pb->best_cost);
+  if (0 > ccmp)
+    return true; /* not clearly better */
+  if ( (0 == ccmp) &&
+       (duplicates >= pb->best_duplicates) )
+    return true; /* cost-equal, but does not win on duplicates */
+  return false;
+}
+
+
 /**
  * Evaluate the combined policy map stack in the ``curr_map`` of @a pb
  * and compare to the current best cost. If we are better, save the
@@ -1418,98 +1496,19 @@ compare_costs (const struct Costs *my,
  *
  * @param[in,out] pb policy builder we evaluate for
  * @param num_policies length of the ``curr_map`` array
+ * @param my_cost total cost of the ``curr_map``
+ * @param duplicates number of duplicated challenges in the ``curr_map``
  */
 static void
 evaluate_map (struct PolicyBuilder *pb,
-              unsigned int num_policies)
+              unsigned int num_policies,
+              const struct Costs *my_cost,
+              unsigned int duplicates)
 {
-  struct Costs *my_cost = NULL;
-  unsigned int i = 0;
-  unsigned int duplicates = 0;
-  int ccmp;
-
-#if DEBUG
-  fprintf (stderr,
-           "Checking...\n");
-#endif
-  /* calculate cost */
-  for (const struct Policy *p = pb->p_head;
-       NULL != p;
-       p = p->next)
-  {
-    const struct PolicyMap *pm = &pb->curr_map[i++];
-
-#if DEBUG
-    fprintf (stderr,
-             "Evaluating %p (%u): ",
-             p,
-             pm->diversity);
-    for (unsigned int k = 0; k<pb->req_methods; k++)
-    {
-      const struct PolicyEntry *pe = &pm->providers[k];
-
-      fprintf (stderr,
-               "%u->%s ",
-               p->challenges[k],
-               pe->provider_name);
-    }
-    fprintf (stderr, "\n");
-#endif
-    for (unsigned int j = 0; j<pb->req_methods; j++)
-    {
-      const struct PolicyEntry *pe = &pm->providers[j];
-      unsigned int cv = p->challenges[j];
-      bool found = false;
-      unsigned int i2 = 0;
-
-      /* check for duplicates */
-      for (const struct Policy *p2 = pb->p_head;
-           p2 != p;
-           p2 = p2->next)
-      {
-        const struct PolicyMap *pm2 = &pb->curr_map[i2++];
-
-        for (unsigned int j2 = 0; j2<pb->req_methods; j2++)
-        {
-          const struct PolicyEntry *pe2 = &pm2->providers[j2];
-          unsigned int cv2 = p2->challenges[j2];
-
-          if (cv != cv2)
-            continue; /* different challenge */
-          if (0 == strcmp (pe->provider_name,
-                           pe2->provider_name))
-            found = true; /* same challenge&provider! */
-          else
-            duplicates++; /* penalty for same challenge at two providers */
-        }
-      }
-      if (! found)
-      {
-        add_costs (&my_cost,
-                   pe->usage_fee);
-      }
-    }
-  }
-
-  ccmp = -1; /* non-zero if 'best_duplicates' is UINT_MAX */
-  if ( (UINT_MAX != pb->best_duplicates) &&
-       (0 > (ccmp = compare_costs (my_cost,
-                                   pb->best_cost))) )
-  {
-    /* new method not clearly better, do not use it */
-    free_costs (my_cost);
-#if DEBUG
-    fprintf (stderr,
-             "... useless\n");
-#endif
-    return;
-  }
-  if ( (0 == ccmp) &&
-       (duplicates > pb->best_duplicates) )
+  if (worse_than_best (pb,
+                       my_cost,
+                       duplicates))
   {
-    /* new method is cost-equal, but looses on duplicates,
-       do not use it */
-    free_costs (my_cost);
 #if DEBUG
     fprintf (stderr,
              "... useless\n");
@@ -1524,7 +1523,9 @@ evaluate_map (struct PolicyBuilder *pb,
            TALER_amount2s (&my_cost->cost));
 #endif
   free_costs (pb->best_cost);
-  pb->best_cost = my_cost;
+  pb->best_cost = NULL;
+  add_costs (&pb->best_cost,
+             my_cost);
   pb->best_duplicates = duplicates;
   memcpy (pb->best_map,
           pb->curr_map,
@@ -1535,21 +1536,36 @@ evaluate_map (struct PolicyBuilder *pb,
 /**
  * Try all policy maps for @a pos and evaluate the
  * resulting total cost, saving the best result in
- * @a pb.
+ * @a pb.  Costs and duplicates are accumulated along
+ * the way.  As they can only grow, we skip all
+ * completions of a partial map stack that is already
+ * worse than the best one if @a pb is prunable, which yields the
+ * same result as evaluating all completions.  Otherwise, we stop
+ * after evaluating #MAX_EVALUATIONS complete maps.
  *
  * @param[in,out] pb policy builder context
  * @param pos policy we are currently looking at maps for
  * @param off index of @a pos for the policy map
+ * @param cost cost of the policy maps selected for the
+ *        policies before @a pos
+ * @param duplicates number of duplicated challenges in the
+ *        policy maps selected for the policies before @a pos
  */
 static void
 find_best_map (struct PolicyBuilder *pb,
                struct Policy *pos,
-               unsigned int off)
+               unsigned int off,
+               const struct Costs *cost,
+               unsigned int duplicates)
 {
+  unsigned int base = pb->sel_len;
+
   if (NULL == pos)
   {
     evaluate_map (pb,
-                  off);
+                  off,
+                  cost,
+                  duplicates);
     pb->evaluations++;
     return;
   }
@@ -1557,16 +1573,107 @@ find_best_map (struct PolicyBuilder *pb,
        NULL != pm;
        pm = pm->next)
   {
+    struct Costs *my_cost = NULL;
+    unsigned int my_duplicates = duplicates;
+
+    if ( (! pb->prunable) &&
+         (pb->evaluations >= MAX_EVALUATIONS) )
+    {
+      pb->truncated = true;
+      break;
+    }
+    add_costs (&my_cost,
+               cost);
+    for (unsigned int j = 0; j<pb->req_methods; j++)
+    {
+      const struct PolicyEntry *pe = &pm->providers[j];
+      unsigned int cv = pos->challenges[j];
+      bool found = false;
+
+      /* check for duplicates */
+      for (unsigned int k = 0; k<base; k++)
+      {
+        if (cv != pb->sel_challenges[k])
+          continue; /* different challenge */
+        if (0 == strcmp (pe->provider_name,
+                         pb->sel_providers[k]))
+          found = true; /* same challenge&provider! */
+        else
+          my_duplicates++; /* penalty for same challenge at two providers */
+      }
+      if (! found)
+        add_costs (&my_cost,
+                   pe->usage_fee);
+    }
+    if ( (pb->prunable) &&
+         (! exhaustive_search) &&
+         (worse_than_best (pb,
+                           my_cost,
+                           my_duplicates)) )
+    {
+      free_costs (my_cost);
+      pb->pruned++;
+      continue;
+    }
+    for (unsigned int j = 0; j<pb->req_methods; j++)
+    {
+      pb->sel_challenges[base + j] = pos->challenges[j];
+      pb->sel_providers[base + j] = pm->providers[j].provider_name;
+    }
+    pb->sel_len = base + pb->req_methods;
     pb->curr_map[off] = *pm;
     find_best_map (pb,
                    pos->next,
-                   off + 1);
-    if (pb->evaluations >= MAX_EVALUATIONS)
-      break;
+                   off + 1,
+                   my_cost,
+                   my_duplicates);
+    pb->sel_len = base;
+    free_costs (my_cost);
   }
 }
 
 
+void
+ANASTASIS_REDUX_policy_search_exhaustive_ (bool exhaustive)
+{
+  exhaustive_search = exhaustive;
+}
+
+
+/**
+ * Check if all costs of all policy maps in @a pb are
+ * in the same currency.
+ *
+ * @param pb policy builder to check
+ * @return true if only one currency is used
+ */
+static bool
+single_currency (const struct PolicyBuilder *pb)
+{
+  const struct TALER_Amount *currency = NULL;
+
+  for (const struct Policy *p = pb->p_head;
+       NULL != p;
+       p = p->next)
+    for (const struct PolicyMap *pm = p->pm_head;
+         NULL != pm;
+         pm = pm->next)
+      for (unsigned int i = 0; i<pb->req_methods; i++)
+        for (const struct Costs *c = pm->providers[i].usage_fee;
+             NULL != c;
+             c = c->next)
+        {
+          if (NULL == currency)
+            currency = &c->cost;
+          else if (GNUNET_OK !=
+                   TALER_amount_cmp_currency (currency,
+                                              &c->cost))
+            return false;
+        }
+  return true;
+}
+
+
 /**
  * Select cheapest policy combinations and add them to the JSON ``policies``
  * array in @a pb
@@ -1585,18 +1692,30 @@ select_policies (struct PolicyBuilder *pb)
   {
     struct PolicyMap best[cnt];
     struct PolicyMap curr[cnt];
+    unsigned int sel_challenges[cnt * pb->req_methods];
+    const char *sel_providers[cnt * pb->req_methods];
     unsigned int i;
 
     pb->best_map = best;
     pb->curr_map = curr;
+    pb->sel_challenges = sel_challenges;
+    pb->sel_providers = sel_providers;
+    pb->sel_len = 0;
     pb->best_duplicates = UINT_MAX; /* worst */
+    pb->prunable = single_currency (pb);
     find_best_map (pb,
                    pb->p_head,
+                   0,
+                   NULL,
                    0);
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Assessed %u/%u policies\n",
+                "Assessed %u policy combinations, pruned %u (%s)\n",
                 pb->evaluations,
-                (unsigned int) MAX_EVALUATIONS);
+                pb->pruned,
+                ( (pb->prunable) &&
+                  (! pb->truncated) )
+                ? "optimal"
+                : "best effort");
     i = 0;
     for (struct Policy *p = pb->p_head;
          NULL != p;
@@ -1952,8 +2071,8 @@ add_policy (json_t *state,
                            "'policy' not an array");
     return NULL;
   }
-  policies = json_object_get (state,
-                              "policies");
+  policies = ANASTASIS_REDUX_mutable_ (state,
+                                       "policies");
   if (! json_is_array (policies))
   {
     GNUNET_break (0);
@@ -2161,9 +2280,10 @@ add_policy (json_t *state,
           return NULL;
         }
       }
+      /* copy, as serialize_truth() modifies the method in place */
       GNUNET_assert (0 ==
-                     json_array_append (methods,
-                                        method));
+                     json_array_append_new (methods,
+                                            json_deep_copy (method)));
       json_decref (prov_methods);
     } /* end of json_array_foreach (arg_array, index, method) */
   }
@@ -2245,8 +2365,8 @@ update_policy (json_t *state,
     return NULL;
   }
   index = json_integer_value (idx);
-  policy_arr = json_object_get (state,
-                                "policies");
+  policy_arr = ANASTASIS_REDUX_mutable_ (state,
+                                         "policies");
   if (! json_is_array (policy_arr))
   {
     GNUNET_break (0);
@@ -2315,8 +2435,8 @@ del_policy (json_t *state,
     return NULL;
   }
   index = json_integer_value (idx);
-  policy_arr = json_object_get (state,
-                                "policies");
+  policy_arr = ANASTASIS_REDUX_mutable_ (state,
+                                         "policies");
   if (! json_is_array (policy_arr))
   {
     ANASTASIS_redux_fail_ (cb,
@@ -2396,8 +2516,8 @@ del_challenge (json_t *state,
     return NULL;
   }
   index = json_integer_value (pidx);
-  policy_arr = json_object_get (state,
-                                "policies");
+  policy_arr = ANASTASIS_REDUX_mutable_ (state,
+                                         "policies");
   if (! json_is_array (policy_arr))
   {
     ANASTASIS_redux_fail_ (cb,
@@ -2879,6 +2999,81 @@ struct TruthUpload
 };
 
 
+/**
+ * User identifier at a provider, derived in advance.
+ */
+struct ProviderIdentifier
+{
+  /**
+   * URL of the provider.
+   */
+  char *provider_url;
+
+  /**
+   * User identifier at the provider.
+   */
+  struct ANASTASIS_CRYPTO_UserIdentifierP id;
+
+  /**
+   * True if @e id is (being) derived.
+   */
+  bool derived;
+};
+
+
+/**
+ * Answer to a security question, hashed in advance together with
+ * the user identifiers.
+ */
+struct PreparedAnswer
+{
+  /**
+   * URL of the provider the truth is uploaded to.
+   */
+  char *provider_url;
+
+  /**
+   * The answer to hash.
+   */
+  char *answer;
+
+  /**
+   * Index of the authentication method with the question.
+   */
+  uint32_t am_idx;
+
+  /**
+   * Nonce of the truth, unless it exists already.
+   */
+  struct ANASTASIS_CRYPTO_NonceP nonce;
+
+  /**
+   * UUID of the truth.
+   */
+  struct ANASTASIS_CRYPTO_TruthUUIDP uuid;
+
+  /**
+   * Salt for hashing the answer.
+   */
+  struct ANASTASIS_CRYPTO_QuestionSaltP salt;
+
+  /**
+   * Key to encrypt the truth with, unless it exists already.
+   */
+  struct ANASTASIS_CRYPTO_TruthKeyP truth_key;
+
+  /**
+   * Key share of the truth, unless it exists already.
+   */
+  struct ANASTASIS_CRYPTO_KeyShareP key_share;
+
+  /**
+   * Hash of @e answer.
+   */
+  struct GNUNET_HashCode hash;
+};
+
+
 /**
  * Information we keep for an upload() operation.
  */
@@ -2929,6 +3124,36 @@ struct UploadContext
    */
   unsigned int years;
 
+  /**
+   * Until when should the backup be stored?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Derivation of the user identifiers, NULL if not running.
+   */
+  struct ANASTASIS_CRYPTO_PowBatch *pb;
+
+  /**
+   * User identifiers at the providers we upload to.
+   */
+  struct ProviderIdentifier *pids;
+
+  /**
+   * Length of the @e pids array.
+   */
+  unsigned int pids_length;
+
+  /**
+   * Answers to security questions we upload.
+   */
+  struct PreparedAnswer *answers;
+
+  /**
+   * Length of the @e answers array.
+   */
+  unsigned int answers_length;
+
 };
 
 
@@ -2968,11 +3193,83 @@ upload_cancel_cb (void *cls)
     ANASTASIS_secret_share_cancel (uc->ss);
     uc->ss = NULL;
   }
+  if (NULL != uc->pb)
+  {
+    ANASTASIS_CRYPTO_pow_batch_cancel (uc->pb);
+    uc->pb = NULL;
+  }
+  for (unsigned int i = 0; i<uc->pids_length; i++)
+    GNUNET_free (uc->pids[i].provider_url);
+  GNUNET_array_grow (uc->pids,
+                     uc->pids_length,
+                     0);
+  for (unsigned int i = 0; i<uc->answers_length; i++)
+  {
+    GNUNET_free (uc->answers[i].provider_url);
+    GNUNET_free (uc->answers[i].answer);
+  }
+  if (NULL != uc->answers)
+    GNUNET_CRYPTO_zero_keys (uc->answers,
+                             uc->answers_length
+                             * sizeof (struct PreparedAnswer));
+  GNUNET_array_grow (uc->answers,
+                     uc->answers_length,
+                     0);
   json_decref (uc->state);
   GNUNET_free (uc);
 }
 
 
+/**
+ * Find the user identifier derived in advance for @a provider_url.
+ *
+ * @param uc context for the operation
+ * @param provider_url provider to find the identifier for
+ * @return NULL if the identifier was not derived in advance
+ */
+static const struct ANASTASIS_CRYPTO_UserIdentifierP *
+lookup_user_identifier (const struct UploadContext *uc,
+                        const char *provider_url)
+{
+  for (unsigned int i = 0; i<uc->pids_length; i++)
+  {
+    const struct ProviderIdentifier *pid = &uc->pids[i];
+
+    if (0 == strcmp (pid->provider_url,
+                     provider_url))
+      return pid->derived ? &pid->id : NULL;
+  }
+  return NULL;
+}
+
+
+/**
+ * Find the answer to the security question @a am_idx at
+ * @a provider_url that was hashed in advance.
+ *
+ * @param uc context for the operation
+ * @param provider_url provider the truth is uploaded to
+ * @param am_idx index of the authentication method
+ * @return NULL if the answer was not hashed in advance
+ */
+static const struct PreparedAnswer *
+lookup_answer (const struct UploadContext *uc,
+               const char *provider_url,
+               uint32_t am_idx)
+{
+  for (unsigned int i = 0; i<uc->answers_length; i++)
+  {
+    const struct PreparedAnswer *pa = &uc->answers[i];
+
+    if ( (am_idx == pa->am_idx) &&
+         (0 == strcmp (pa->provider_url,
+                       provider_url)) )
+      return pa;
+  }
+  return NULL;
+}
+
+
 /**
  * Take all of the ongoing truth uploads and serialize them into the @a uc
  * state.
@@ -2984,8 +3281,8 @@ serialize_truth (struct UploadContext *uc)
 {
   json_t *policies;
 
-  policies = json_object_get (uc->state,
-                              "policies");
+  policies = ANASTASIS_REDUX_mutable_ (uc->state,
+                                       "policies");
   GNUNET_assert (json_is_array (policies));
   for (struct TruthUpload *tue = uc->tues_head;
        NULL != tue;
@@ -3055,7 +3352,11 @@ secret_share_result_cb (void *cls,
           GNUNET_JSON_pack_uint64 ("policy_version",
                                    pssi->policy_version),
           GNUNET_JSON_pack_time_abs ("policy_expiration",
-                                     pssi->policy_expiration));
+                                     pssi->policy_expiration),
+          GNUNET_JSON_pack_data_auto ("backup_digest",
+                                      &pssi->backup_digest),
+          GNUNET_JSON_pack_data_auto ("policy_hash",
+                                      &pssi->policy_hash));
         GNUNET_assert (NULL != d);
         GNUNET_assert (0 ==
                        json_object_set_new (sa,
@@ -3078,8 +3379,8 @@ secret_share_result_cb (void *cls,
       json_t *ra;
       json_t *providers;
 
-      providers = json_object_get (uc->state,
-                                   "policy_providers");
+      providers = ANASTASIS_REDUX_mutable_ (uc->state,
+                                            "policy_providers");
       set_state (uc->state,
                  ANASTASIS_BACKUP_STATE_POLICIES_PAYING);
       serialize_truth (uc);
@@ -3171,6 +3472,61 @@ secret_share_result_cb (void *cls,
 }
 
 
+/**
+ * Check if the "success_details" of a previous backup in the state
+ * of @a uc show that the provider of @a pd stores a backup that is
+ * valid for long enough.  If so, fill in the details of that backup
+ * so that it is not uploaded again if the content is unchanged and
+ * the provider confirms that the backup is still its latest one.
+ *
+ * @param uc context for the operation
+ * @param[in,out] pd provider details to update
+ */
+static void
+lookup_previous_backup (const struct UploadContext *uc,
+                        struct ANASTASIS_ProviderDetails *pd)
+{
+  const json_t *details;
+  struct GNUNET_HashCode backup_digest;
+  struct GNUNET_HashCode policy_hash;
+  uint64_t policy_version;
+  struct GNUNET_TIME_Absolute policy_expiration;
+  struct GNUNET_JSON_Specification spec[] = {
+    GNUNET_JSON_spec_fixed_auto ("backup_digest",
+                                 &backup_digest),
+    GNUNET_JSON_spec_fixed_auto ("policy_hash",
+                                 &policy_hash),
+    GNUNET_JSON_spec_uint64 ("policy_version",
+                             &policy_version),
+    GNUNET_JSON_spec_absolute_time ("policy_expiration",
+                                    &policy_expiration),
+    GNUNET_JSON_spec_end ()
+  };
+
+  details = json_object_get (json_object_get (uc->state,
+                                              "success_details"),
+                             pd->provider_url);
+  if (NULL == details)
+    return;
+  if (GNUNET_OK !=
+      GNUNET_JSON_parse (details,
+                         spec,
+                         NULL, NULL))
+  {
+    /* backup made by an older version, simply upload again */
+    return;
+  }
+  if (GNUNET_TIME_absolute_cmp (policy_expiration,
+                                <,
+                                uc->expiration))
+    return;
+  pd->backup_digest = backup_digest;
+  pd->policy_hash = policy_hash;
+  pd->policy_version = policy_version;
+  pd->policy_expiration = policy_expiration;
+}
+
+
 /**
  * All truth uploads are done, begin with uploading the policy.
  *
@@ -3449,6 +3805,10 @@ share_secret (struct UploadContext *uc)
         GNUNET_JSON_parse_free (spec);
         return;
       }
+      lookup_previous_backup (uc,
+                              &pds[i]);
+      pds[i].user_id = lookup_user_identifier (uc,
+                                               pds[i].provider_url);
     }
 
     {
@@ -3709,6 +4069,7 @@ add_truth_object (struct UploadContext *uc,
   {
     struct ANASTASIS_CRYPTO_ProviderSaltP salt;
     struct ANASTASIS_CRYPTO_UserIdentifierP id;
+    const struct PreparedAnswer *pa;
     void *truth_data;
     size_t truth_data_size;
     struct GNUNET_JSON_Specification spec[] = {
@@ -3739,6 +4100,7 @@ add_truth_object (struct UploadContext *uc,
     }
     {
       json_t *user_id;
+      const struct ANASTASIS_CRYPTO_UserIdentifierP *pid;
 
       user_id = json_object_get (uc->state,
                                  "identity_attributes");
@@ -3747,15 +4109,24 @@ add_truth_object (struct UploadContext *uc,
         GNUNET_break (0);
         return GNUNET_SYSERR;
       }
-      ANASTASIS_CRYPTO_user_identifier_derive (user_id,
-                                               &salt,
-                                               &id);
+      pid = lookup_user_identifier (uc,
+                                    provider_url);
+      if (NULL != pid)
+        id = *pid;
+      else
+        ANASTASIS_REDUX_user_identifier_derive_ (user_id,
+                                                &salt,
+                                                &id);
     }
+    pa = lookup_answer (uc,
+                        provider_url,
+                        am_idx);
     tue->tu = ANASTASIS_truth_upload3 (ANASTASIS_REDUX_ctx_,
                                        &id,
                                        tue->t,
                                        truth_data,
                                        truth_data_size,
+                                       (NULL != pa) ? &pa->hash : NULL,
                                        uc->years,
                                        uc->timeout,
                                        &truth_upload_cb,
@@ -3897,16 +4268,25 @@ check_truth_upload (struct UploadContext *uc,
       upload_cancel_cb (uc);
       return GNUNET_SYSERR;
     }
-    ANASTASIS_CRYPTO_user_identifier_derive (user_id,
-                                             &provider_salt,
-                                             &id);
+    {
+      const struct ANASTASIS_CRYPTO_UserIdentifierP *pid;
+
+      pid = lookup_user_identifier (uc,
+                                    provider_url);
+      if (NULL != pid)
+        id = *pid;
+      else
+        ANASTASIS_REDUX_user_identifier_derive_ (user_id,
+                                                &provider_salt,
+                                                &id);
+    }
     {
       struct ANASTASIS_CRYPTO_TruthUUIDP uuid;
       struct ANASTASIS_CRYPTO_QuestionSaltP question_salt;
       struct ANASTASIS_CRYPTO_TruthKeyP truth_key;
       struct ANASTASIS_CRYPTO_KeyShareP key_share;
       struct ANASTASIS_CRYPTO_NonceP nonce;
-
+      const struct PreparedAnswer *pa;
       struct GNUNET_JSON_Specification jspec[] = {
         GNUNET_JSON_spec_fixed_auto ("salt",
                                      &question_salt),
@@ -3921,10 +4301,35 @@ check_truth_upload (struct UploadContext *uc,
         GNUNET_JSON_spec_end ()
       };
 
-      if (GNUNET_OK !=
-          GNUNET_JSON_parse (jtruth,
-                             jspec,
-                             NULL, NULL))
+      pa = lookup_answer (uc,
+                          provider_url,
+                          am_idx);
+      if (NULL != pa)
+      {
+        tue->tu = ANASTASIS_truth_upload2 (ANASTASIS_REDUX_ctx_,
+                                           &id,
+                                           provider_url,
+                                           type,
+                                           instructions,
+                                           mime_type,
+                                           &provider_salt,
+                                           truth_data,
+                                           truth_data_size,
+                                           &pa->hash,
+                                           uc->years,
+                                           uc->timeout,
+                                           &pa->nonce,
+                                           &pa->uuid,
+                                           &pa->salt,
+                                           &pa->truth_key,
+                                           &pa->key_share,
+                                           &truth_upload_cb,
+                                           tue);
+      }
+      else if (GNUNET_OK !=
+               GNUNET_JSON_parse (jtruth,
+                                  jspec,
+                                  NULL, NULL))
       {
         tue->tu = ANASTASIS_truth_upload (ANASTASIS_REDUX_ctx_,
                                           &id,
@@ -3951,6 +4356,7 @@ check_truth_upload (struct UploadContext *uc,
                                            &provider_salt,
                                            truth_data,
                                            truth_data_size,
+                                           NULL,
                                            uc->years,
                                            uc->timeout,
                                            &nonce,
@@ -3976,101 +4382,174 @@ check_truth_upload (struct UploadContext *uc,
 
 
 /**
- * Function to upload truths and recovery document policies.
- * Ultimately transitions to failed state (allowing user to go back
- * and change providers/policies), or payment, or finished.
+ * Remember that the user identifier for @a provider_url must be
+ * derived for @a uc.
  *
- * @param state state to operate on
- * @param cb callback (#ANASTASIS_ActionCallback) to call after upload
- * @param cb_cls callback closure
+ * @param[in,out] uc context for the operation
+ * @param provider_url provider to add, NULL to do nothing
  */
-static struct ANASTASIS_ReduxAction *
-upload (json_t *state,
-        ANASTASIS_ActionCallback cb,
-        void *cb_cls)
+static void
+add_provider_identifier (struct UploadContext *uc,
+                         const char *provider_url)
 {
-  struct UploadContext *uc;
-  json_t *auth_methods;
-  json_t *policies;
-  struct GNUNET_TIME_Absolute expiration;
+  struct ProviderIdentifier pid = {
+    .derived = false
+  };
+
+  if (NULL == provider_url)
+    return;
+  for (unsigned int i = 0; i<uc->pids_length; i++)
+    if (0 == strcmp (uc->pids[i].provider_url,
+                     provider_url))
+      return;
+  pid.provider_url = GNUNET_strdup (provider_url);
+  GNUNET_array_append (uc->pids,
+                       uc->pids_length,
+                       pid);
+}
+
+
+/**
+ * Remember that the answer to the security question of @a method
+ * must be hashed for @a uc, if @a method is a security question
+ * that still needs to be uploaded.  New truths get their
+ * parameters here, so that the hash can be computed in advance.
+ *
+ * @param[in,out] uc context for the operation
+ * @param method method of a policy
+ */
+static void
+add_answer (struct UploadContext *uc,
+            const json_t *method)
+{
+  const char *provider_url;
+  uint32_t am_idx;
+  json_t *truth = NULL;
+  const char *type;
+  void *answer;
+  size_t answer_size;
+  json_t *auth_method;
+  struct PreparedAnswer pa = {
+    .answer = NULL
+  };
   struct GNUNET_JSON_Specification spec[] = {
-    GNUNET_JSON_spec_absolute_time ("expiration",
-                                    &expiration),
+    GNUNET_JSON_spec_string ("provider",
+                             &provider_url),
+    GNUNET_JSON_spec_uint32 ("authentication_method",
+                             &am_idx),
+    GNUNET_JSON_spec_mark_optional (
+      GNUNET_JSON_spec_json ("truth",
+                             &truth)),
+    GNUNET_JSON_spec_end ()
+  };
+  struct GNUNET_JSON_Specification aspec[] = {
+    GNUNET_JSON_spec_string ("type",
+                             &type),
+    GNUNET_JSON_spec_varsize ("challenge",
+                              &answer,
+                              &answer_size),
     GNUNET_JSON_spec_end ()
   };
 
+  /* malformed methods are reported by upload_truths() */
   if (GNUNET_OK !=
-      GNUNET_JSON_parse (state,
+      GNUNET_JSON_parse (method,
                          spec,
                          NULL, NULL))
+    return;
+  auth_method = json_array_get (json_object_get (uc->state,
+                                                 "authentication_methods"),
+                                am_idx);
+  if ( (NULL != lookup_answer (uc,
+                               provider_url,
+                               am_idx)) ||
+       (NULL == auth_method) ||
+       (GNUNET_OK !=
+        GNUNET_JSON_parse (auth_method,
+                           aspec,
+                           NULL, NULL)) )
   {
-    ANASTASIS_redux_fail_ (cb,
-                           cb_cls,
-                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
-                           "'expiration' missing");
-    return NULL;
-  }
-  auth_methods = json_object_get (state,
-                                  "authentication_methods");
-  if ( (! json_is_array (auth_methods)) ||
-       (0 == json_array_size (auth_methods)) )
-  {
-    ANASTASIS_redux_fail_ (cb,
-                           cb_cls,
-                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
-                           "'authentication_methods' must be non-empty array");
-    return NULL;
+    GNUNET_JSON_parse_free (spec);
+    return;
   }
-  policies = json_object_get (state,
-                              "policies");
-  if ( (! json_is_array (policies)) ||
-       (0 == json_array_size (policies)) )
+  if (0 != strcmp ("question",
+                   type))
   {
-    ANASTASIS_redux_fail_ (cb,
-                           cb_cls,
-                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
-                           "'policies' must be non-empty array");
-    return NULL;
+    GNUNET_JSON_parse_free (aspec);
+    GNUNET_JSON_parse_free (spec);
+    return;
   }
-
-  uc = GNUNET_new (struct UploadContext);
-  uc->ra.cleanup = &upload_cancel_cb;
-  uc->ra.cleanup_cls = uc;
-  uc->cb = cb;
-  uc->cb_cls = cb_cls;
-  uc->state = json_incref (state);
-  uc->years = expiration_to_years (expiration);
-
+  if (NULL != truth)
   {
-    json_t *args;
-    struct GNUNET_JSON_Specification pspec[] = {
+    uint32_t status = UINT32_MAX;
+    struct GNUNET_JSON_Specification tspec[] = {
       GNUNET_JSON_spec_mark_optional (
-        GNUNET_JSON_spec_relative_time ("timeout",
-                                        &uc->timeout)),
+        GNUNET_JSON_spec_uint32 ("upload_status",
+                                 &status)),
+      GNUNET_JSON_spec_fixed_auto ("uuid",
+                                   &pa.uuid),
+      GNUNET_JSON_spec_fixed_auto ("salt",
+                                   &pa.salt),
       GNUNET_JSON_spec_end ()
     };
 
-    args = json_object_get (uc->state,
-                            "pay_arguments");
-    if ( (NULL != args) &&
-         (GNUNET_OK !=
-          GNUNET_JSON_parse (args,
-                             pspec,
-                             NULL, NULL)) )
+    if ( (GNUNET_OK !=
+          GNUNET_JSON_parse (truth,
+                             tspec,
+                             NULL, NULL)) ||
+         (ANASTASIS_US_SUCCESS == status) )
     {
-      json_dumpf (args,
-                  stderr,
-                  JSON_INDENT (2));
-      GNUNET_break (0);
-      ANASTASIS_redux_fail_ (cb,
-                             cb_cls,
-                             TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID,
-                             "'timeout' must be valid delay");
-
-      return NULL;
+      GNUNET_JSON_parse_free (aspec);
+      GNUNET_JSON_parse_free (spec);
+      return;
     }
   }
+  else
+  {
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_NONCE,
+                                &pa.nonce,
+                                sizeof (pa.nonce));
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_NONCE,
+                                &pa.salt,
+                                sizeof (pa.salt));
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_NONCE,
+                                &pa.uuid,
+                                sizeof (pa.uuid));
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_STRONG,
+                                &pa.truth_key,
+                                sizeof (pa.truth_key));
+    ANASTASIS_CRYPTO_keyshare_create (&pa.key_share);
+  }
+  pa.provider_url = GNUNET_strdup (provider_url);
+  pa.answer = GNUNET_strndup (answer,
+                              answer_size);
+  pa.am_idx = am_idx;
+  GNUNET_array_append (uc->answers,
+                       uc->answers_length,
+                       pa);
+  GNUNET_CRYPTO_zero_keys (&pa,
+                           sizeof (pa));
+  GNUNET_JSON_parse_free (aspec);
+  GNUNET_JSON_parse_free (spec);
+}
+
 
+/**
+ * Upload the truths of all policies, then share the secret.
+ *
+ * @param[in] uc context for the operation
+ * @return NULL if the operation failed (and the callback was called)
+ */
+static struct ANASTASIS_ReduxAction *
+upload_truths (struct UploadContext *uc)
+{
+  json_t *auth_methods;
+  json_t *policies;
+
+  auth_methods = json_object_get (uc->state,
+                                  "authentication_methods");
+  policies = json_object_get (uc->state,
+                              "policies");
   {
     json_t *policy;
     size_t pindex;
@@ -4086,8 +4565,8 @@ upload (json_t *state,
       if ( (! json_is_array (methods)) ||
            (0 == json_array_size (policies)) )
       {
-        ANASTASIS_redux_fail_ (cb,
-                               cb_cls,
+        ANASTASIS_redux_fail_ (uc->cb,
+                               uc->cb_cls,
                                TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
                                "'policies' must be non-empty array");
         upload_cancel_cb (uc);
@@ -4114,8 +4593,8 @@ upload (json_t *state,
                                spec,
                                NULL, NULL))
         {
-          ANASTASIS_redux_fail_ (cb,
-                                 cb_cls,
+          ANASTASIS_redux_fail_ (uc->cb,
+                                 uc->cb_cls,
                                  TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
                                  "'method' data malformed");
           upload_cancel_cb (uc);
@@ -4132,8 +4611,8 @@ upload (json_t *state,
                                 am_idx);
           if (NULL == amj)
           {
-            ANASTASIS_redux_fail_ (cb,
-                                   cb_cls,
+            ANASTASIS_redux_fail_ (uc->cb,
+                                   uc->cb_cls,
                                    TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
                                    "'authentication_method' refers to invalid authorization index malformed");
             upload_cancel_cb (uc);
@@ -4152,8 +4631,8 @@ upload (json_t *state,
             if (GNUNET_SYSERR == ret)
             {
               GNUNET_JSON_parse_free (spec);
-              ANASTASIS_redux_fail_ (cb,
-                                     cb_cls,
+              ANASTASIS_redux_fail_ (uc->cb,
+                                     uc->cb_cls,
                                      TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
                                      NULL);
               return NULL;
@@ -4175,8 +4654,8 @@ upload (json_t *state,
             if (GNUNET_SYSERR == ret)
             {
               GNUNET_JSON_parse_free (spec);
-              ANASTASIS_redux_fail_ (cb,
-                                     cb_cls,
+              ANASTASIS_redux_fail_ (uc->cb,
+                                     uc->cb_cls,
                                      TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
                                      NULL);
               return NULL;
@@ -4196,6 +4675,237 @@ upload (json_t *state,
 }
 
 
+/**
+ * All user identifiers were derived and all answers hashed,
+ * continue with the upload.
+ *
+ * @param cls a `struct UploadContext`
+ */
+static void
+user_identifiers_derived (void *cls)
+{
+  struct UploadContext *uc = cls;
+  json_t *user_id;
+
+  uc->pb = NULL;
+  user_id = json_object_get (uc->state,
+                             "identity_attributes");
+  for (unsigned int i = 0; i<uc->pids_length; i++)
+  {
+    const struct ProviderIdentifier *pid = &uc->pids[i];
+    struct ANASTASIS_CRYPTO_ProviderSaltP salt;
+
+    if ( (! pid->derived) ||
+         (GNUNET_OK !=
+          lookup_salt (uc->state,
+                       pid->provider_url,
+                       &salt)) )
+      continue;
+    ANASTASIS_REDUX_remember_user_identifier_ (user_id,
+                                               &salt,
+                                               &pid->id);
+  }
+  (void) upload_truths (uc);
+}
+
+
+/**
+ * Start deriving the user identifiers for all providers and hashing
+ * the answers to security questions in the state of @a uc on threads,
+ * as each derivation is memory-hard and takes a while.  Sets @e pb if
+ * derivations were started.
+ *
+ * @param[in,out] uc context for the operation
+ */
+static void
+derive_user_identifiers (struct UploadContext *uc)
+{
+  json_t *user_id;
+  json_t *policy;
+  json_t *provider;
+  size_t index;
+
+  user_id = json_object_get (uc->state,
+                             "identity_attributes");
+  if (! json_is_object (user_id))
+    return; /* upload_truths() will complain */
+  json_array_foreach (json_object_get (uc->state,
+                                       "policies"),
+                      index,
+                      policy)
+  {
+    json_t *method;
+    size_t mindex;
+
+    json_array_foreach (json_object_get (policy,
+                                         "methods"),
+                        mindex,
+                        method)
+    {
+      add_provider_identifier (uc,
+                               json_string_value (
+                                 json_object_get (method,
+                                                  "provider")));
+      add_answer (uc,
+                  method);
+    }
+  }
+  json_array_foreach (json_object_get (uc->state,
+                                       "policy_providers"),
+                      index,
+                      provider)
+  {
+    add_provider_identifier (uc,
+                             json_string_value (
+                               json_object_get (provider,
+                                                "provider_url")));
+  }
+  /* no more changes to the array, so we may hand out pointers */
+  for (unsigned int i = 0; i<uc->pids_length; i++)
+  {
+    struct ProviderIdentifier *pid = &uc->pids[i];
+    struct ANASTASIS_CRYPTO_ProviderSaltP salt;
+
+    if (GNUNET_OK !=
+        lookup_salt (uc->state,
+                     pid->provider_url,
+                     &salt))
+      continue;
+    pid->derived = true;
+    if (ANASTASIS_REDUX_lookup_user_identifier_ (user_id,
+                                                 &salt,
+                                                 &pid->id))
+      continue;
+    if (NULL == uc->pb)
+      uc->pb = ANASTASIS_CRYPTO_pow_batch_create ();
+    ANASTASIS_CRYPTO_pow_batch_add_user_identifier (uc->pb,
+                                                    user_id,
+                                                    &salt,
+                                                    &pid->id);
+  }
+  for (unsigned int i = 0; i<uc->answers_length; i++)
+  {
+    struct PreparedAnswer *pa = &uc->answers[i];
+
+    if (NULL == uc->pb)
+      uc->pb = ANASTASIS_CRYPTO_pow_batch_create ();
+    ANASTASIS_CRYPTO_pow_batch_add_answer_hash (uc->pb,
+                                                pa->answer,
+                                                &pa->uuid,
+                                                &pa->salt,
+                                                &pa->hash);
+  }
+  if (NULL != uc->pb)
+    ANASTASIS_CRYPTO_pow_batch_start (uc->pb,
+                                      &user_identifiers_derived,
+                                      uc);
+}
+
+
+/**
+ * Function to upload truths and recovery document policies.
+ * Ultimately transitions to failed state (allowing user to go back
+ * and change providers/policies), or payment, or finished.
+ *
+ * @param state state to operate on
+ * @param cb callback (#ANASTASIS_ActionCallback) to call after upload
+ * @param cb_cls callback closure
+ */
+static struct ANASTASIS_ReduxAction *
+upload (json_t *state,
+        ANASTASIS_ActionCallback cb,
+        void *cb_cls)
+{
+  struct UploadContext *uc;
+  json_t *auth_methods;
+  json_t *policies;
+  struct GNUNET_TIME_Absolute expiration;
+  struct GNUNET_JSON_Specification spec[] = {
+    GNUNET_JSON_spec_absolute_time ("expiration",
+                                    &expiration),
+    GNUNET_JSON_spec_end ()
+  };
+
+  if (GNUNET_OK !=
+      GNUNET_JSON_parse (state,
+                         spec,
+                         NULL, NULL))
+  {
+    ANASTASIS_redux_fail_ (cb,
+                           cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
+                           "'expiration' missing");
+    return NULL;
+  }
+  auth_methods = json_object_get (state,
+                                  "authentication_methods");
+  if ( (! json_is_array (auth_methods)) ||
+       (0 == json_array_size (auth_methods)) )
+  {
+    ANASTASIS_redux_fail_ (cb,
+                           cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
+                           "'authentication_methods' must be non-empty array");
+    return NULL;
+  }
+  policies = json_object_get (state,
+                              "policies");
+  if ( (! json_is_array (policies)) ||
+       (0 == json_array_size (policies)) )
+  {
+    ANASTASIS_redux_fail_ (cb,
+                           cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
+                           "'policies' must be non-empty array");
+    return NULL;
+  }
+
+  uc = GNUNET_new (struct UploadContext);
+  uc->ra.cleanup = &upload_cancel_cb;
+  uc->ra.cleanup_cls = uc;
+  uc->cb = cb;
+  uc->cb_cls = cb_cls;
+  uc->state = json_incref (state);
+  uc->years = expiration_to_years (expiration);
+  uc->expiration = expiration;
+
+  {
+    json_t *args;
+    struct GNUNET_JSON_Specification pspec[] = {
+      GNUNET_JSON_spec_mark_optional (
+        GNUNET_JSON_spec_relative_time ("timeout",
+                                        &uc->timeout)),
+      GNUNET_JSON_spec_end ()
+    };
+
+    args = json_object_get (uc->state,
+                            "pay_arguments");
+    if ( (NULL != args) &&
+         (GNUNET_OK !=
+          GNUNET_JSON_parse (args,
+                             pspec,
+                             NULL, NULL)) )
+    {
+      json_dumpf (args,
+                  stderr,
+                  JSON_INDENT (2));
+      GNUNET_break (0);
+      ANASTASIS_redux_fail_ (cb,
+                             cb_cls,
+                             TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID,
+                             "'timeout' must be valid delay");
+
+      return NULL;
+    }
+  }
+
+  derive_user_identifiers (uc);
+  if (NULL != uc->pb)
+    return &uc->ra;
+  return upload_truths (uc);
+}
+
+
 /**
  * Test if the core secret @a secret_size is small enough to be stored
  * at all providers, which have a minimum upload limit of @a min_limit_in_mb.
@@ -4992,8 +5702,8 @@ providers_complete (struct BackupStartState *bss)
   struct BackupStartStateProviderEntry *pe;
   json_t *tlist;
 
-  tlist = json_object_get (bss->state,
-                           "authentication_providers");
+  tlist = ANASTASIS_REDUX_mutable_ (bss->state,
+                                    "authentication_providers");
   if (NULL == tlist)
   {
     tlist = json_object ();
@@ -214,6 +214,12 @@ struct SelectChallengeContext
    */
   struct ANASTASIS_PaymentSecretP ps;
 
+  /**
+   * Number of challenges answered by a "solve_challenges"
+   * batch that were not yet solved.
+   */
+  unsigned int pending;
+
   /**
    * Application asked us to only poll for existing
    * asynchronous challenges, and not to being a
@@ -397,9 +403,10 @@ report_solved (void *cls)
 /**
  * Find challenge of @a uuid in @a state under "recovery_information".
  *
- * @param state the state to search
+ * @param[in,out] state the state to search
  * @param uuid the UUID to search for
- * @return NULL on error, otherwise challenge entry; RC is NOT incremented
+ * @return NULL on error, otherwise challenge entry that may be
+ *         modified; RC is NOT incremented
  */
 static json_t *
 find_challenge_in_ri (json_t *state,
@@ -416,8 +423,8 @@ find_challenge_in_ri (json_t *state,
   json_t *challenge;
   size_t index;
 
-  ri = json_object_get (state,
-                        "recovery_information");
+  ri = ANASTASIS_REDUX_mutable_ (state,
+                                 "recovery_information");
   if (NULL == ri)
   {
     GNUNET_break (0);
@@ -454,16 +461,17 @@ find_challenge_in_ri (json_t *state,
 /**
  * Find challenge of @a uuid in @a state under "cs".
  *
- * @param state the state to search
+ * @param[in,out] state the state to search
  * @param uuid the UUID to search for
- * @return NULL on error, otherwise challenge entry; RC is NOT incremented
+ * @return NULL on error, otherwise challenge entry that may be
+ *         modified; RC is NOT incremented
  */
 static json_t *
 find_challenge_in_cs (json_t *state,
                       const struct ANASTASIS_CRYPTO_TruthUUIDP *uuid)
 {
-  json_t *rd = json_object_get (state,
-                                "recovery_document");
+  json_t *rd = ANASTASIS_REDUX_mutable_ (state,
+                                         "recovery_document");
   json_t *cs = json_object_get (rd,
                                 "cs");
   json_t *c;
@@ -521,8 +529,8 @@ answer_feedback_cb (
                                        sizeof (uuid));
   GNUNET_assert (NULL != end);
   *end = '\0';
-  feedback = json_object_get (sctx->state,
-                              "challenge_feedback");
+  feedback = ANASTASIS_REDUX_mutable_ (sctx->state,
+                                       "challenge_feedback");
   if (NULL == feedback)
   {
     feedback = json_object ();
@@ -564,6 +572,12 @@ answer_feedback_cb (
                                           uuid,
                                           solved));
     }
+    if (sctx->pending > 1)
+    {
+      /* wait for the other challenges of the batch */
+      sctx->pending--;
+      return;
+    }
     /* Delay reporting challenge success, as we MAY still
        also see a secret recovery success (and we can only
        call the callback once) */
@@ -1408,6 +1422,7 @@ solve_challenge (json_t *state,
   sctx->args = json_incref ((json_t*) arguments);
   sctx->r = ANASTASIS_recovery_deserialize (ANASTASIS_REDUX_ctx_,
                                             rd,
+                                            &ANASTASIS_REDUX_user_identifier_derive_,
                                             &solve_challenge_cb,
                                             sctx,
                                             &core_secret_cb,
@@ -1430,6 +1445,286 @@ solve_challenge (json_t *state,
 }
 
 
+/**
+ * Callback which passes back the recovery document and its possible
+ * policies.  We answer all challenges given in the "answers" of the
+ * "solve_challenges" action at once.
+ *
+ * @param cls a `struct SelectChallengeContext *`
+ * @param ri recovery information struct which contains the policies
+ */
+static void
+solve_challenges_cb (void *cls,
+                     const struct ANASTASIS_RecoveryInformation *ri)
+{
+  struct SelectChallengeContext *sctx = cls;
+  struct GNUNET_TIME_Relative timeout = GNUNET_TIME_UNIT_ZERO;
+  json_t *answers;
+  struct GNUNET_JSON_Specification tspec[] = {
+    GNUNET_JSON_spec_mark_optional (
+      GNUNET_JSON_spec_relative_time ("timeout",
+                                      &timeout)),
+    GNUNET_JSON_spec_json ("answers",
+                           &answers),
+    GNUNET_JSON_spec_end ()
+  };
+  size_t answers_length;
+
+  if (NULL == ri)
+  {
+    GNUNET_break_op (0);
+    ANASTASIS_redux_fail_ (sctx->cb,
+                           sctx->cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
+                           "recovery information could not be deserialized");
+    sctx_free (sctx);
+    return;
+  }
+  if (GNUNET_OK !=
+      GNUNET_JSON_parse (sctx->args,
+                         tspec,
+                         NULL, NULL))
+  {
+    GNUNET_break_op (0);
+    ANASTASIS_redux_fail_ (sctx->cb,
+                           sctx->cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID,
+                           "'answers' or 'timeout' malformed");
+    sctx_free (sctx);
+    return;
+  }
+  answers_length = json_array_size (answers);
+  if ( (! json_is_array (answers)) ||
+       (0 == answers_length) ||
+       (answers_length > ri->cs_len) )
+  {
+    GNUNET_break_op (0);
+    GNUNET_JSON_parse_free (tspec);
+    ANASTASIS_redux_fail_ (sctx->cb,
+                           sctx->cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID,
+                           "'answers' must be a non-empty array");
+    sctx_free (sctx);
+    return;
+  }
+  {
+    struct ANASTASIS_ChallengeAnswer cas[answers_length];
+    struct ANASTASIS_PaymentSecretP ps[answers_length];
+    size_t off;
+    json_t *ja;
+    const char *error = NULL;
+    enum GNUNET_GenericReturnValue ret;
+
+    memset (cas,
+            0,
+            sizeof (cas));
+    json_array_foreach (answers, off, ja)
+    {
+      struct ANASTASIS_CRYPTO_TruthUUIDP uuid;
+      struct GNUNET_JSON_Specification uspec[] = {
+        GNUNET_JSON_spec_fixed_auto ("uuid",
+                                     &uuid),
+        GNUNET_JSON_spec_end ()
+      };
+      struct GNUNET_JSON_Specification pspec[] = {
+        GNUNET_JSON_spec_fixed_auto ("payment_secret",
+                                     &ps[off]),
+        GNUNET_JSON_spec_end ()
+      };
+      struct ANASTASIS_Challenge *ci = NULL;
+      const struct ANASTASIS_ChallengeDetails *cd = NULL;
+      json_t *c;
+      json_t *challenge;
+
+      if (GNUNET_OK !=
+          GNUNET_JSON_parse (ja,
+                             uspec,
+                             NULL, NULL))
+      {
+        error = "'uuid' missing in answer";
+        break;
+      }
+      for (unsigned int i = 0; i<ri->cs_len; i++)
+      {
+        cd = ANASTASIS_challenge_get_details (ri->cs[i]);
+        if (0 ==
+            GNUNET_memcmp (&uuid,
+                           &cd->uuid))
+        {
+          ci = ri->cs[i];
+          break;
+        }
+      }
+      if (NULL == ci)
+      {
+        error = "'uuid' not in list of challenges";
+        break;
+      }
+      if (cd->solved)
+      {
+        error = "Selected challenge already solved";
+        break;
+      }
+      c = find_challenge_in_cs (sctx->state,
+                                &cd->uuid);
+      challenge = find_challenge_in_ri (sctx->state,
+                                        &cd->uuid);
+      if ( (NULL == c) ||
+           (NULL == challenge) )
+      {
+        GNUNET_break (0);
+        error = "challenge not found";
+        break;
+      }
+      cas[off].c = ci;
+      if ( (NULL !=
+            json_object_get (challenge,
+                             "payment_secret")) &&
+           (GNUNET_OK ==
+            GNUNET_JSON_parse (challenge,
+                               pspec,
+                               NULL, NULL)) )
+        cas[off].psp = &ps[off];
+      if (0 == strcmp ("question",
+                       cd->type))
+      {
+        /* security question, answer must be a string */
+        json_t *janswer = json_object_get (ja,
+                                           "answer");
+
+        cas[off].answer = json_string_value (janswer);
+        if (NULL == cas[off].answer)
+        {
+          error = "'answer' missing";
+          break;
+        }
+        /* persist answer, in case payment is required */
+        GNUNET_assert (0 ==
+                       json_object_set (c,
+                                        "answer",
+                                        janswer));
+      }
+      else
+      {
+        json_t *pin = json_object_get (ja,
+                                       "pin");
+
+        if (! json_is_integer (pin))
+        {
+          error = "'pin' missing";
+          break;
+        }
+        cas[off].answer_num = json_integer_value (pin);
+        /* persist answer, in case async processing
+           happens via poll */
+        GNUNET_assert (0 ==
+                       json_object_set (c,
+                                        "answer-pin",
+                                        pin));
+      }
+    }
+    if (NULL != error)
+    {
+      GNUNET_break_op (0);
+      GNUNET_JSON_parse_free (tspec);
+      ANASTASIS_redux_fail_ (sctx->cb,
+                             sctx->cb_cls,
+                             TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID,
+                             error);
+      sctx_free (sctx);
+      return;
+    }
+    sctx->pending = answers_length;
+    ret = ANASTASIS_challenge_answer_batch (answers_length,
+                                            cas,
+                                            timeout,
+                                            &answer_feedback_cb,
+                                            sctx);
+    GNUNET_JSON_parse_free (tspec);
+    if (GNUNET_OK != ret)
+    {
+      ANASTASIS_redux_fail_ (sctx->cb,
+                             sctx->cb_cls,
+                             (GNUNET_NO == ret)
+                             ? TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID
+                             : TALER_EC_GENERIC_INTERNAL_INVARIANT_FAILURE,
+                             "Failed to begin answering challenges");
+      sctx_free (sctx);
+      return;
+    }
+  }
+  /* await answer feedback */
+}
+
+
+/**
+ * The user answered several challenges at once, for example
+ * all security questions.  Answer all of them concurrently.
+ *
+ * @param[in] state we are in
+ * @param arguments our arguments with the "answers"
+ * @param cb functiont o call with the new state
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation
+ */
+static struct ANASTASIS_ReduxAction *
+solve_challenges (json_t *state,
+                  const json_t *arguments,
+                  ANASTASIS_ActionCallback cb,
+                  void *cb_cls)
+{
+  struct SelectChallengeContext *sctx;
+  json_t *rd;
+
+  if (NULL == arguments)
+  {
+    ANASTASIS_redux_fail_ (cb,
+                           cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_INPUT_INVALID,
+                           "arguments missing");
+    return NULL;
+  }
+  rd = json_object_get (state,
+                        "recovery_document");
+  if (NULL == rd)
+  {
+    GNUNET_break_op (0);
+    ANASTASIS_redux_fail_ (cb,
+                           cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
+                           "solve_challenges");
+    return NULL;
+  }
+  sctx = GNUNET_new (struct SelectChallengeContext);
+  sctx->cb = cb;
+  sctx->cb_cls = cb_cls;
+  sctx->state = json_incref (state);
+  sctx->args = json_incref ((json_t*) arguments);
+  sctx->r = ANASTASIS_recovery_deserialize (ANASTASIS_REDUX_ctx_,
+                                            rd,
+                                            &ANASTASIS_REDUX_user_identifier_derive_,
+                                            &solve_challenges_cb,
+                                            sctx,
+                                            &core_secret_cb,
+                                            sctx);
+  if (NULL == sctx->r)
+  {
+    json_decref (sctx->state);
+    json_decref (sctx->args);
+    GNUNET_free (sctx);
+    GNUNET_break_op (0);
+    ANASTASIS_redux_fail_ (cb,
+                           cb_cls,
+                           TALER_EC_ANASTASIS_REDUCER_STATE_INVALID,
+                           "'recovery_document' invalid");
+    return NULL;
+  }
+  sctx->ra.cleanup = &sctx_free;
+  sctx->ra.cleanup_cls = sctx;
+  return &sctx->ra;
+}
+
+
 /**
  * The user asked for us to poll on pending
  * asynchronous challenges to see if they have
@@ -1469,6 +1764,7 @@ poll_challenges (json_t *state,
   sctx->args = json_incref ((json_t*) arguments);
   sctx->r = ANASTASIS_recovery_deserialize (ANASTASIS_REDUX_ctx_,
                                             rd,
+                                            &ANASTASIS_REDUX_user_identifier_derive_,
                                             &solve_challenge_cb,
                                             sctx,
                                             &core_secret_cb,
@@ -1573,6 +1869,7 @@ pay_challenge (json_t *state,
   sctx->args = json_incref ((json_t*) arguments);
   sctx->r = ANASTASIS_recovery_deserialize (ANASTASIS_REDUX_ctx_,
                                             rd,
+                                            &ANASTASIS_REDUX_user_identifier_derive_,
                                             &pay_challenge_cb,
                                             sctx,
                                             &core_secret_cb,
@@ -1858,6 +2155,7 @@ select_challenge (json_t *state,
   sctx->args = json_incref ((json_t*) arguments);
   sctx->r = ANASTASIS_recovery_deserialize (ANASTASIS_REDUX_ctx_,
                                             rd,
+                                            &ANASTASIS_REDUX_user_identifier_derive_,
                                             &select_challenge_cb,
                                             sctx,
                                             &core_secret_cb,
@@ -2078,6 +2376,11 @@ ANASTASIS_recovery_action_ (json_t *state,
       "poll",
       &poll_challenges
     },
+    {
+      ANASTASIS_RECOVERY_STATE_CHALLENGE_SELECTING,
+      "solve_challenges",
+      &solve_challenges
+    },
     {
       ANASTASIS_RECOVERY_STATE_CHALLENGE_SELECTING,
       "back",
@@ -2689,6 +2992,7 @@ launch_recovery (struct RecoverSecretState *rss,
                                            : 0,
                                            pd->backend_url,
                                            &pd->salt,
+                                           &ANASTASIS_REDUX_user_identifier_derive_,
                                            &policy_lookup_cb,
                                            pd,
                                            &core_early_secret_cb,
@@ -2720,8 +3024,8 @@ providers_complete (struct RecoverSecretState *rss)
   struct RecoveryStartStateProviderEntry *pe;
   json_t *tlist;
 
-  tlist = json_object_get (rss->state,
-                           "authentication_providers");
+  tlist = ANASTASIS_REDUX_mutable_ (rss->state,
+                                    "authentication_providers");
   if (NULL == tlist)
   {
     tlist = json_object ();
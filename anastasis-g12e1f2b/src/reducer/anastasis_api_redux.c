@@ -36,6 +36,11 @@
  */
 #define CONFIG_GENERIC_TIMEOUT GNUNET_TIME_UNIT_MINUTES
 
+/**
+ * Number of user identifiers kept in the cache.
+ */
+#define USER_ID_CACHE_SIZE 32
+
 
 #define GENERATE_STRING(STRING) #STRING,
 static const char *generic_strings[] = {
@@ -88,6 +93,28 @@ struct ConfigReduxWaiting
 };
 
 
+/**
+ * User identifier in the cache.
+ */
+struct UserIdentifierCacheEntry
+{
+  /**
+   * Hash over the provider salt and the identity attributes.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * The derived identifier.
+   */
+  struct ANASTASIS_CRYPTO_UserIdentifierP id;
+
+  /**
+   * True if the entry is in use.
+   */
+  bool used;
+};
+
+
 /**
  * Anastasis authorization method configuration
  */
@@ -240,6 +267,17 @@ static json_t *provider_list;
  */
 static char *external_reducer_binary;
 
+/**
+ * Recently derived user identifiers, replaced round-robin.  Only
+ * used from the scheduler, so no locking is needed.
+ */
+static struct UserIdentifierCacheEntry user_id_cache[USER_ID_CACHE_SIZE];
+
+/**
+ * Index of the entry of #user_id_cache to replace next.
+ */
+static unsigned int user_id_cache_next;
+
 
 const char *
 ANASTASIS_REDUX_probe_external_reducer (void)
@@ -386,6 +424,10 @@ ANASTASIS_redux_done ()
                                  cr);
     free_config_request (cr);
   }
+  GNUNET_CRYPTO_zero_keys (user_id_cache,
+                           sizeof (user_id_cache));
+  user_id_cache_next = 0;
+  ANASTASIS_curl_share_cleanup ();
   ANASTASIS_REDUX_ctx_ = NULL;
   if (NULL != redux_countries)
   {
@@ -405,6 +447,125 @@ ANASTASIS_redux_done ()
 }
 
 
+/**
+ * Compute the key of the user identifier derived from @a id_data
+ * for the provider with @a server_salt in #user_id_cache.
+ *
+ * @param id_data identity attributes of the user
+ * @param server_salt salt of the provider
+ * @param[out] key set to the key
+ */
+static void
+user_id_cache_key (const json_t *id_data,
+                   const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+                   struct GNUNET_HashCode *key)
+{
+  struct GNUNET_HashContext *hctx;
+  char *json_enc;
+
+  json_enc = json_dumps (id_data,
+                         JSON_COMPACT | JSON_SORT_KEYS);
+  GNUNET_assert (NULL != json_enc);
+  hctx = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hctx,
+                                   server_salt,
+                                   sizeof (*server_salt));
+  GNUNET_CRYPTO_hash_context_read (hctx,
+                                   json_enc,
+                                   strlen (json_enc));
+  GNUNET_CRYPTO_hash_context_finish (hctx,
+                                     key);
+  GNUNET_CRYPTO_zero_keys (json_enc,
+                           strlen (json_enc));
+  free (json_enc);
+}
+
+
+/**
+ * Find the entry of #user_id_cache with @a key.
+ *
+ * @param key key to find
+ * @return NULL if not found
+ */
+static struct UserIdentifierCacheEntry *
+user_id_cache_find (const struct GNUNET_HashCode *key)
+{
+  for (unsigned int i = 0; i<USER_ID_CACHE_SIZE; i++)
+  {
+    struct UserIdentifierCacheEntry *e = &user_id_cache[i];
+
+    if ( (e->used) &&
+         (0 == GNUNET_memcmp (&e->key,
+                              key)) )
+      return e;
+  }
+  return NULL;
+}
+
+
+bool
+ANASTASIS_REDUX_lookup_user_identifier_ (
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id)
+{
+  struct GNUNET_HashCode key;
+  const struct UserIdentifierCacheEntry *e;
+
+  user_id_cache_key (id_data,
+                     server_salt,
+                     &key);
+  e = user_id_cache_find (&key);
+  if (NULL == e)
+    return false;
+  *id = e->id;
+  return true;
+}
+
+
+void
+ANASTASIS_REDUX_remember_user_identifier_ (
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  const struct ANASTASIS_CRYPTO_UserIdentifierP *id)
+{
+  struct GNUNET_HashCode key;
+  struct UserIdentifierCacheEntry *e;
+
+  user_id_cache_key (id_data,
+                     server_salt,
+                     &key);
+  e = user_id_cache_find (&key);
+  if (NULL == e)
+  {
+    e = &user_id_cache[user_id_cache_next];
+    user_id_cache_next = (user_id_cache_next + 1) % USER_ID_CACHE_SIZE;
+  }
+  e->key = key;
+  e->id = *id;
+  e->used = true;
+}
+
+
+void
+ANASTASIS_REDUX_user_identifier_derive_ (
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id)
+{
+  if (ANASTASIS_REDUX_lookup_user_identifier_ (id_data,
+                                               server_salt,
+                                               id))
+    return;
+  ANASTASIS_CRYPTO_user_identifier_derive (id_data,
+                                           server_salt,
+                                           id);
+  ANASTASIS_REDUX_remember_user_identifier_ (id_data,
+                                             server_salt,
+                                             id);
+}
+
+
 const json_t *
 ANASTASIS_redux_countries_init_ (void)
 {
@@ -491,8 +652,8 @@ notify_waiting (struct ConfigRequest *cr)
                                           "authentication_providers",
                                           provider_list = json_object ()));
     }
-    provider_list = json_object_get (w->state,
-                                     "authentication_providers");
+    provider_list = ANASTASIS_REDUX_mutable_ (w->state,
+                                              "authentication_providers");
     GNUNET_assert (NULL != provider_list);
 
     if (TALER_EC_NONE != cr->ec)
@@ -1408,8 +1569,8 @@ ANASTASIS_add_provider_ (json_t *state,
                            "arguments missing");
     return true; /* cb was invoked */
   }
-  tlist = json_object_get (state,
-                           "authentication_providers");
+  tlist = ANASTASIS_REDUX_mutable_ (state,
+                                    "authentication_providers");
   if (NULL == tlist)
   {
     tlist = json_object ();
@@ -1843,7 +2004,9 @@ ANASTASIS_redux_action (const json_t *state,
     json_t *new_state;
     struct ANASTASIS_ReduxAction *ret;
 
-    new_state = json_deep_copy (state);
+    /* Only copy the top-level object; members are shared with
+       @a state until modified, see ANASTASIS_REDUX_mutable_() */
+    new_state = json_copy ((json_t *) state);
     GNUNET_assert (NULL != new_state);
     if (gs != ANASTASIS_GENERIC_STATE_INVALID)
     {
@@ -1884,6 +2047,29 @@ ANASTASIS_redux_action (const json_t *state,
 }
 
 
+json_t *
+ANASTASIS_REDUX_mutable_ (json_t *state,
+                          const char *field)
+{
+  json_t *member;
+  json_t *copy;
+
+  member = json_object_get (state,
+                            field);
+  if (NULL == member)
+    return NULL;
+  if (1 == member->refcount)
+    return member; /* not shared, modify in place */
+  copy = json_deep_copy (member);
+  GNUNET_assert (NULL != copy);
+  GNUNET_assert (0 ==
+                 json_object_set_new (state,
+                                      field,
+                                      copy));
+  return copy;
+}
+
+
 void
 ANASTASIS_redux_action_cancel (struct ANASTASIS_ReduxAction *ra)
 {
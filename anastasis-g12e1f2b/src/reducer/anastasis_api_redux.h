@@ -182,6 +182,81 @@ ANASTASIS_redux_fail_ (ANASTASIS_ActionCallback cb,
                        const char *detail);
 
 
+/**
+ * Get member @a field of @a state for modification.  States
+ * share unmodified members with the state they were derived
+ * from, so nested values must only be modified in place after
+ * obtaining the member via this function.  If the member is
+ * shared, it is replaced in @a state by a private copy.
+ *
+ * @param[in,out] state state to get member from
+ * @param field name of the member
+ * @return member that may be modified, NULL if @a field is not in @a state
+ */
+json_t *
+ANASTASIS_REDUX_mutable_ (json_t *state,
+                          const char *field);
+
+
+/**
+ * Lookup the user identifier derived from @a id_data for the
+ * provider with @a server_salt in the cache of the reducer.
+ *
+ * @param id_data identity attributes of the user
+ * @param server_salt salt of the provider
+ * @param[out] id set to the identifier if it was found
+ * @return true if the identifier was found
+ */
+bool
+ANASTASIS_REDUX_lookup_user_identifier_ (
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id);
+
+
+/**
+ * Remember the user identifier @a id derived from @a id_data for
+ * the provider with @a server_salt, so that later actions need not
+ * derive it again.  The cache is erased by ANASTASIS_redux_done().
+ *
+ * @param id_data identity attributes of the user
+ * @param server_salt salt of the provider
+ * @param id the derived identifier
+ */
+void
+ANASTASIS_REDUX_remember_user_identifier_ (
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  const struct ANASTASIS_CRYPTO_UserIdentifierP *id);
+
+
+/**
+ * Derive the user identifier like
+ * ANASTASIS_CRYPTO_user_identifier_derive(), but take it from the
+ * cache of the reducer if it was derived before.
+ *
+ * @param id_data identity attributes of the user
+ * @param server_salt salt of the provider
+ * @param[out] id set to the identifier
+ */
+void
+ANASTASIS_REDUX_user_identifier_derive_ (
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id);
+
+
+/**
+ * Make the policy selection of the backup reducer evaluate all
+ * policy combinations instead of pruning the search.  Only used to
+ * check in tests that pruning does not change the result.
+ *
+ * @param exhaustive true to disable pruning
+ */
+void
+ANASTASIS_REDUX_policy_search_exhaustive_ (bool exhaustive);
+
+
 /**
  * DispatchHandler/Callback function which is called for a
  * "add_provider" action.  Adds another Anastasis provider
@@ -0,0 +1,243 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 3, or
+  (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Anastasis; see the file COPYING.  If not, see
+  <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * @file reducer/test_anastasis_redux_policies.c
+ * @brief test that pruning the policy search does not change its result
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <gnunet/gnunet_json_lib.h>
+#include "anastasis_redux.h"
+#include "anastasis_api_redux.h"
+
+
+/**
+ * Number of providers to offer.
+ */
+#define NUM_PROVIDERS 3
+
+
+/**
+ * Callback storing the new state of a (synchronous) action.
+ *
+ * @param cls a `json_t **` to store the new state in
+ * @param error error code, #TALER_EC_NONE on success
+ * @param new_state the new state
+ */
+static void
+action_cb (void *cls,
+           enum TALER_ErrorCode error,
+           json_t *new_state)
+{
+  json_t **result = cls;
+
+  GNUNET_break (TALER_EC_NONE == error);
+  if (TALER_EC_NONE != error)
+    return;
+  *result = json_incref (new_state);
+}
+
+
+/**
+ * Build a state with @a num_questions security questions and
+ * #NUM_PROVIDERS providers with random fees.  Fees are drawn from a
+ * small range, so that many policy maps tie.
+ *
+ * @param num_questions number of security questions to add
+ * @return the state
+ */
+static json_t *
+make_state (unsigned int num_questions)
+{
+  json_t *providers;
+  json_t *methods;
+
+  providers = json_object ();
+  GNUNET_assert (NULL != providers);
+  for (unsigned int i = 0; i<NUM_PROVIDERS; i++)
+  {
+    struct ANASTASIS_CRYPTO_ProviderSaltP salt;
+    char url[64];
+    char usage_fee[32];
+    char upload_fee[32];
+
+    GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                                &salt,
+                                sizeof (salt));
+    GNUNET_snprintf (url,
+                     sizeof (url),
+                     "http://localhost:%u/",
+                     9000 + i);
+    GNUNET_snprintf (usage_fee,
+                     sizeof (usage_fee),
+                     "TESTKUDOS:%u",
+                     GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                               2));
+    /* distinct upload fees, so providers are never equivalent */
+    GNUNET_snprintf (upload_fee,
+                     sizeof (upload_fee),
+                     "TESTKUDOS:0.%u",
+                     i + 10);
+    GNUNET_assert (
+      0 ==
+      json_object_set_new (
+        providers,
+        url,
+        json_pack ("{s:[{s:s, s:s}], s:s, s:I, s:I, s:o}",
+                   "methods",
+                   "type", "question",
+                   "usage_fee", usage_fee,
+                   "truth_upload_fee", upload_fee,
+                   "storage_limit_in_megabytes", (json_int_t) 1,
+                   "http_status", (json_int_t) MHD_HTTP_OK,
+                   "salt", GNUNET_JSON_from_data_auto (&salt))));
+  }
+  methods = json_array ();
+  GNUNET_assert (NULL != methods);
+  for (unsigned int i = 0; i<num_questions; i++)
+  {
+    char question[32];
+    char answer[32];
+
+    GNUNET_snprintf (question,
+                     sizeof (question),
+                     "Question %u?",
+                     i);
+    GNUNET_snprintf (answer,
+                     sizeof (answer),
+                     "Answer %u",
+                     i);
+    GNUNET_assert (
+      0 ==
+      json_array_append_new (
+        methods,
+        GNUNET_JSON_PACK (
+          GNUNET_JSON_pack_string ("type",
+                                   "question"),
+          GNUNET_JSON_pack_string ("instructions",
+                                   question),
+          GNUNET_JSON_pack_data_varsize ("challenge",
+                                         answer,
+                                         strlen (answer)))));
+  }
+  return GNUNET_JSON_PACK (
+    GNUNET_JSON_pack_string ("backup_state",
+                             "AUTHENTICATIONS_EDITING"),
+    GNUNET_JSON_pack_object_steal ("authentication_providers",
+                                   providers),
+    GNUNET_JSON_pack_array_steal ("authentication_methods",
+                                  methods));
+}
+
+
+/**
+ * Select policies for @a state.
+ *
+ * @param state state to select policies for
+ * @param exhaustive true to evaluate all policy combinations
+ * @return the policies, NULL on failure
+ */
+static json_t *
+select_policies (const json_t *state,
+                 bool exhaustive)
+{
+  json_t *result = NULL;
+  json_t *policies;
+
+  ANASTASIS_REDUX_policy_search_exhaustive_ (exhaustive);
+  GNUNET_assert (NULL ==
+                 ANASTASIS_redux_action (state,
+                                         "next",
+                                         NULL,
+                                         &action_cb,
+                                         &result));
+  ANASTASIS_REDUX_policy_search_exhaustive_ (false);
+  if (NULL == result)
+    return NULL;
+  policies = json_incref (json_object_get (result,
+                                           "policies"));
+  json_decref (result);
+  return policies;
+}
+
+
+/**
+ * Check that the pruned policy search finds the same policies as
+ * the exhaustive one for @a rounds random states.
+ *
+ * @param num_questions number of security questions
+ * @param rounds number of states to try
+ * @return 0 on success
+ */
+static int
+test_pruning (unsigned int num_questions,
+              unsigned int rounds)
+{
+  for (unsigned int i = 0; i<rounds; i++)
+  {
+    json_t *state;
+    json_t *pruned;
+    json_t *exhaustive;
+    bool equal;
+
+    state = make_state (num_questions);
+    pruned = select_policies (state,
+                              false);
+    exhaustive = select_policies (state,
+                                  true);
+    equal = ( (NULL != pruned) &&
+              (0 < json_array_size (pruned)) &&
+              (json_equal (pruned,
+                           exhaustive)) );
+    if (! equal)
+    {
+      GNUNET_break (0);
+      json_dumpf (state,
+                  stderr,
+                  JSON_INDENT (2));
+    }
+    json_decref (state);
+    json_decref (pruned);
+    json_decref (exhaustive);
+    if (! equal)
+      return 1;
+  }
+  return 0;
+}
+
+
+int
+main (int argc,
+      const char *const argv[])
+{
+  (void) argc;
+  GNUNET_log_setup (argv[0], "WARNING", NULL);
+  if (0 != test_pruning (3,
+                         16))
+    return 1;
+  if (0 != test_pruning (4,
+                         2))
+    return 1;
+  return 0;
+}
+
+
+/* end of test_anastasis_redux_policies.c */
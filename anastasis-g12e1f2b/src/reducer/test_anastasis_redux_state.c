@@ -0,0 +1,418 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 3, or
+  (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Anastasis; see the file COPYING.  If not, see
+  <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * @file reducer/test_anastasis_redux_state.c
+ * @brief test that reducer actions leave their input state unchanged
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <gnunet/gnunet_json_lib.h>
+#include "anastasis_redux.h"
+
+
+/**
+ * Callback storing the new state of a (synchronous) action.
+ *
+ * @param cls a `json_t **` to store the new state in
+ * @param error error code, #TALER_EC_NONE on success
+ * @param new_state the new state
+ */
+static void
+action_cb (void *cls,
+           enum TALER_ErrorCode error,
+           json_t *new_state)
+{
+  json_t **result = cls;
+
+  GNUNET_break (TALER_EC_NONE == error);
+  if (TALER_EC_NONE != error)
+    return;
+  *result = json_incref (new_state);
+}
+
+
+/**
+ * Run synchronous @a action on @a state.
+ *
+ * @param state input state
+ * @param action action to run
+ * @param arguments arguments for @a action
+ * @return the new state, NULL on failure
+ */
+static json_t *
+run_action (const json_t *state,
+            const char *action,
+            const json_t *arguments)
+{
+  json_t *result = NULL;
+
+  GNUNET_assert (NULL ==
+                 ANASTASIS_redux_action (state,
+                                         action,
+                                         arguments,
+                                         &action_cb,
+                                         &result));
+  return result;
+}
+
+
+/**
+ * Run synchronous @a action on @a state and check that @a state is
+ * unchanged afterwards.
+ *
+ * @param state input state
+ * @param action action to run
+ * @param arguments arguments for @a action
+ * @return the new state, NULL on failure or if @a state changed
+ */
+static json_t *
+run_unchanged (const json_t *state,
+               const char *action,
+               const json_t *arguments)
+{
+  json_t *copy;
+  json_t *result;
+
+  copy = json_deep_copy (state);
+  GNUNET_assert (NULL != copy);
+  result = run_action (state,
+                       action,
+                       arguments);
+  if (! json_equal ((json_t *) state,
+                    copy))
+  {
+    GNUNET_break (0);
+    json_decref (result);
+    result = NULL;
+  }
+  json_decref (copy);
+  return result;
+}
+
+
+/**
+ * Build an "authentication_method" argument for a security question.
+ *
+ * @param question the question
+ * @param answer the answer
+ * @return the argument
+ */
+static json_t *
+make_question (const char *question,
+               const char *answer)
+{
+  return GNUNET_JSON_PACK (
+    GNUNET_JSON_pack_object_steal (
+      "authentication_method",
+      GNUNET_JSON_PACK (
+        GNUNET_JSON_pack_string ("type",
+                                 "question"),
+        GNUNET_JSON_pack_string ("instructions",
+                                 question),
+        GNUNET_JSON_pack_data_varsize ("challenge",
+                                       answer,
+                                       strlen (answer)))));
+}
+
+
+/**
+ * Check that actions on a state leave all earlier states unchanged,
+ * even though the new states share members with them.
+ *
+ * @return 0 on success
+ */
+static int
+test_states_unchanged (void)
+{
+  json_t *s0;
+  json_t *s0_copy;
+  json_t *s1;
+  json_t *s1_copy;
+  json_t *s2;
+  json_t *args;
+
+  s0 = json_pack ("{s:s, s:{s:{s:[{s:s, s:s}], s:I, s:I}}, s:[]}",
+                  "backup_state", "AUTHENTICATIONS_EDITING",
+                  "authentication_providers",
+                  "http://localhost:8086/",
+                  "methods",
+                  "type", "question",
+                  "usage_fee", "TESTKUDOS:0",
+                  "storage_limit_in_megabytes", (json_int_t) 1,
+                  "http_status", (json_int_t) MHD_HTTP_OK,
+                  "authentication_methods");
+  GNUNET_assert (NULL != s0);
+  s0_copy = json_deep_copy (s0);
+
+  args = make_question ("What is your name?",
+                        "Hans");
+  s1 = run_action (s0,
+                   "add_authentication",
+                   args);
+  json_decref (args);
+  if ( (NULL == s1) ||
+       (1 != json_array_size (json_object_get (s1,
+                                               "authentication_methods"))) )
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  if (! json_equal (s0,
+                    s0_copy))
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  s1_copy = json_deep_copy (s1);
+
+  /* drop our reference to the first state, so that members
+     of the second state are only shared with the third */
+  json_decref (s0);
+  args = make_question ("Where do you live?",
+                        "Mars");
+  s2 = run_action (s1,
+                   "add_authentication",
+                   args);
+  json_decref (args);
+  if ( (NULL == s2) ||
+       (2 != json_array_size (json_object_get (s2,
+                                               "authentication_methods"))) )
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  if (! json_equal (s1,
+                    s1_copy))
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  json_decref (s1);
+
+  args = json_pack ("{s:I}",
+                    "authentication_method",
+                    (json_int_t) 0);
+  s1 = run_action (s2,
+                   "delete_authentication",
+                   args);
+  json_decref (args);
+  if ( (NULL == s1) ||
+       (1 != json_array_size (json_object_get (s1,
+                                               "authentication_methods"))) ||
+       (2 != json_array_size (json_object_get (s2,
+                                               "authentication_methods"))) )
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  json_decref (s0_copy);
+  json_decref (s1_copy);
+  json_decref (s1);
+  json_decref (s2);
+  return 0;
+}
+
+
+/**
+ * Return the number of methods of policy @a i in @a state.
+ *
+ * @param state state with policies
+ * @param i index of the policy
+ * @return number of methods
+ */
+static size_t
+policy_size (const json_t *state,
+             size_t i)
+{
+  return json_array_size (
+    json_object_get (json_array_get (json_object_get (state,
+                                                      "policies"),
+                                     i),
+                     "methods"));
+}
+
+
+/**
+ * Check that the actions editing policies and the secret leave
+ * their input state unchanged.
+ *
+ * @return 0 on success
+ */
+static int
+test_policy_actions_unchanged (void)
+{
+  json_t *s0;
+  json_t *s1;
+  json_t *s2;
+  json_t *args;
+  int ret = 1;
+
+  s0 = json_pack ("{s:s, s:{s:{s:[{s:s, s:s}], s:I, s:I}},"
+                  " s:[{s:s}, {s:s}],"
+                  " s:[{s:[{s:I, s:s}, {s:I, s:s}]}]}",
+                  "backup_state", "POLICIES_REVIEWING",
+                  "authentication_providers",
+                  "http://localhost:8086/",
+                  "methods",
+                  "type", "question",
+                  "usage_fee", "TESTKUDOS:0",
+                  "storage_limit_in_megabytes", (json_int_t) 1,
+                  "http_status", (json_int_t) MHD_HTTP_OK,
+                  "authentication_methods",
+                  "type", "question",
+                  "type", "question",
+                  "policies",
+                  "methods",
+                  "authentication_method", (json_int_t) 0,
+                  "provider", "http://localhost:8086/",
+                  "authentication_method", (json_int_t) 1,
+                  "provider", "http://localhost:8086/");
+  GNUNET_assert (NULL != s0);
+
+  args = json_pack ("{s:[{s:I, s:s}]}",
+                    "policy",
+                    "authentication_method", (json_int_t) 1,
+                    "provider", "http://localhost:8086/");
+  s1 = run_unchanged (s0,
+                      "add_policy",
+                      args);
+  json_decref (args);
+  if ( (NULL == s1) ||
+       (2 != json_array_size (json_object_get (s1,
+                                               "policies"))) )
+  {
+    GNUNET_break (0);
+    goto cleanup;
+  }
+
+  args = json_pack ("{s:I, s:[{s:I, s:s}]}",
+                    "policy_index", (json_int_t) 0,
+                    "policy",
+                    "authentication_method", (json_int_t) 0,
+                    "provider", "http://localhost:8086/");
+  s2 = run_unchanged (s1,
+                      "update_policy",
+                      args);
+  json_decref (args);
+  if ( (NULL == s2) ||
+       (1 != policy_size (s2,
+                          0)) )
+  {
+    GNUNET_break (0);
+    json_decref (s2);
+    goto cleanup;
+  }
+  json_decref (s2);
+
+  args = json_pack ("{s:I, s:I}",
+                    "policy_index", (json_int_t) 0,
+                    "challenge_index", (json_int_t) 1);
+  s2 = run_unchanged (s1,
+                      "delete_challenge",
+                      args);
+  json_decref (args);
+  if ( (NULL == s2) ||
+       (1 != policy_size (s2,
+                          0)) ||
+       (2 != policy_size (s1,
+                          0)) )
+  {
+    GNUNET_break (0);
+    json_decref (s2);
+    goto cleanup;
+  }
+  json_decref (s2);
+
+  args = json_pack ("{s:I}",
+                    "policy_index", (json_int_t) 0);
+  s2 = run_unchanged (s1,
+                      "delete_policy",
+                      args);
+  json_decref (args);
+  if ( (NULL == s2) ||
+       (1 != json_array_size (json_object_get (s2,
+                                               "policies"))) )
+  {
+    GNUNET_break (0);
+    json_decref (s2);
+    goto cleanup;
+  }
+  json_decref (s2);
+
+  /* actions of the secret editing state */
+  GNUNET_assert (0 ==
+                 json_object_set_new (s1,
+                                      "backup_state",
+                                      json_string ("SECRET_EDITING")));
+  GNUNET_assert (0 ==
+                 json_object_set_new (s1,
+                                      "core_secret",
+                                      json_pack ("{s:s}",
+                                                 "text",
+                                                 "secret")));
+  args = json_pack ("{s:s}",
+                    "name",
+                    "my secret");
+  s2 = run_unchanged (s1,
+                      "enter_secret_name",
+                      args);
+  json_decref (args);
+  if (NULL == s2)
+  {
+    GNUNET_break (0);
+    goto cleanup;
+  }
+  json_decref (s2);
+  s2 = run_unchanged (s1,
+                      "clear_secret",
+                      NULL);
+  if ( (NULL == s2) ||
+       (NULL != json_object_get (s2,
+                                 "core_secret")) )
+  {
+    GNUNET_break (0);
+    json_decref (s2);
+    goto cleanup;
+  }
+  json_decref (s2);
+  ret = 0;
+cleanup:
+  json_decref (s0);
+  json_decref (s1);
+  return ret;
+}
+
+
+int
+main (int argc,
+      const char *const argv[])
+{
+  (void) argc;
+  GNUNET_log_setup (argv[0], "WARNING", NULL);
+  if (0 != test_states_unchanged ())
+    return 1;
+  if (0 != test_policy_actions_unchanged ())
+    return 1;
+  return 0;
+}
+
+
+/* end of test_anastasis_redux_state.c */
@@ -0,0 +1,265 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as
+  published by the Free Software Foundation; either version 3, or
+  (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public
+  License along with Anastasis; see the file COPYING.  If not, see
+  <http://www.gnu.org/licenses/>
+*/
+
+/**
+ * @file reducer/test_anastasis_redux_user_id.c
+ * @brief test that recoveries take user identifiers from the cache
+ *        of the reducer, and that the cache is wiped at the end
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <gnunet/gnunet_json_lib.h>
+#include <gnunet/gnunet_curl_lib.h>
+#include "anastasis.h"
+#include "anastasis_redux.h"
+#include "anastasis_api_redux.h"
+
+
+/**
+ * Provider to (pretend to) recover from, never contacted.
+ */
+#define PROVIDER_URL "http://localhost:8086/"
+
+
+/**
+ * Global return value, 0 on success.
+ */
+static int global_ret = 1;
+
+/**
+ * Number of user identifiers the recovery asked for.
+ */
+static unsigned int derivations;
+
+/**
+ * Number of user identifiers that were found in the cache.
+ */
+static unsigned int hits;
+
+
+/**
+ * Derive a user identifier like the reducer does, counting how
+ * often the identifier was already in the cache.
+ *
+ * @param id_data identity attributes of the user
+ * @param provider_salt salt of the provider
+ * @param[out] id set to the user identifier
+ */
+static void
+counting_derive (const json_t *id_data,
+                 const struct ANASTASIS_CRYPTO_ProviderSaltP *provider_salt,
+                 struct ANASTASIS_CRYPTO_UserIdentifierP *id)
+{
+  struct ANASTASIS_CRYPTO_UserIdentifierP cached;
+
+  derivations++;
+  if (ANASTASIS_REDUX_lookup_user_identifier_ (id_data,
+                                               provider_salt,
+                                               &cached))
+    hits++;
+  ANASTASIS_REDUX_user_identifier_derive_ (id_data,
+                                           provider_salt,
+                                           id);
+}
+
+
+/**
+ * Policy callback, never called as the recovery is aborted.
+ *
+ * @param cls NULL
+ * @param ri recovery information
+ */
+static void
+policy_cb (void *cls,
+           const struct ANASTASIS_RecoveryInformation *ri)
+{
+  (void) cls;
+  (void) ri;
+  GNUNET_break (0);
+}
+
+
+/**
+ * Core secret callback, never called as the recovery is aborted.
+ *
+ * @param cls NULL
+ * @param rc status of the recovery
+ * @param secret the secret
+ * @param secret_size number of bytes in @a secret
+ */
+static void
+core_secret_cb (void *cls,
+                enum ANASTASIS_RecoveryStatus rc,
+                const void *secret,
+                size_t secret_size)
+{
+  (void) cls;
+  (void) rc;
+  (void) secret;
+  (void) secret_size;
+  GNUNET_break (0);
+}
+
+
+/**
+ * Begin a recovery for @a id_data at a provider with @a salt, and
+ * abort it right away: the user identifier is derived when the
+ * recovery begins.
+ *
+ * @param ctx CURL context to use
+ * @param id_data identity attributes of the user
+ * @param salt salt of the provider
+ * @return true on success
+ */
+static bool
+begin_recovery (struct GNUNET_CURL_Context *ctx,
+                const json_t *id_data,
+                const struct ANASTASIS_CRYPTO_ProviderSaltP *salt)
+{
+  struct ANASTASIS_Recovery *r;
+
+  r = ANASTASIS_recovery_begin (ctx,
+                                id_data,
+                                0,
+                                PROVIDER_URL,
+                                salt,
+                                &counting_derive,
+                                &policy_cb,
+                                NULL,
+                                &core_secret_cb,
+                                NULL);
+  if (NULL == r)
+    return false;
+  ANASTASIS_recovery_abort (r);
+  return true;
+}
+
+
+/**
+ * Run the test.
+ *
+ * @param id_data identity attributes of the user
+ * @param ctx CURL context to use
+ * @return 0 on success
+ */
+static int
+test_cache (struct GNUNET_CURL_Context *ctx,
+            const json_t *id_data)
+{
+  struct ANASTASIS_CRYPTO_ProviderSaltP salt;
+  struct ANASTASIS_CRYPTO_UserIdentifierP id;
+  struct ANASTASIS_CRYPTO_UserIdentifierP expected;
+
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              &salt,
+                              sizeof (salt));
+  if (! begin_recovery (ctx,
+                        id_data,
+                        &salt))
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  /* the second recovery must not derive the identifier again */
+  if (! begin_recovery (ctx,
+                        id_data,
+                        &salt))
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  if ( (2 != derivations) ||
+       (1 != hits) )
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  ANASTASIS_CRYPTO_user_identifier_derive (id_data,
+                                           &salt,
+                                           &expected);
+  if ( (! ANASTASIS_REDUX_lookup_user_identifier_ (id_data,
+                                                   &salt,
+                                                   &id)) ||
+       (0 != GNUNET_memcmp (&expected,
+                            &id)) )
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  ANASTASIS_redux_done ();
+  if (ANASTASIS_REDUX_lookup_user_identifier_ (id_data,
+                                               &salt,
+                                               &id))
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * Main function of the test, run by the scheduler.
+ *
+ * @param cls NULL
+ */
+static void
+run (void *cls)
+{
+  struct GNUNET_CURL_RescheduleContext *rc;
+  struct GNUNET_CURL_Context *ctx;
+  json_t *id_data;
+
+  (void) cls;
+  ctx = GNUNET_CURL_init (&GNUNET_CURL_gnunet_scheduler_reschedule,
+                          &rc);
+  GNUNET_assert (NULL != ctx);
+  rc = GNUNET_CURL_gnunet_rc_create (ctx);
+  ANASTASIS_redux_init (ctx);
+  id_data = GNUNET_JSON_PACK (
+    GNUNET_JSON_pack_string ("full_name",
+                             "Max Musterman"),
+    GNUNET_JSON_pack_string ("birthdate",
+                             "2000-01-01"));
+  global_ret = test_cache (ctx,
+                           id_data);
+  if (0 != global_ret)
+    ANASTASIS_redux_done ();
+  json_decref (id_data);
+  GNUNET_CURL_fini (ctx);
+  GNUNET_CURL_gnunet_rc_destroy (rc);
+}
+
+
+int
+main (int argc,
+      const char *const argv[])
+{
+  (void) argc;
+  GNUNET_log_setup (argv[0],
+                    "WARNING",
+                    NULL);
+  GNUNET_SCHEDULER_run (&run,
+                        NULL);
+  return global_ret;
+}
+
+
+/* end of test_anastasis_redux_user_id.c */
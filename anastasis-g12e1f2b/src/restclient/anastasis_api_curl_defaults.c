@@ -20,16 +20,140 @@
  * @author Florian Dold
  */
 #include "platform.h"
+#include <pthread.h>
+#include "anastasis_service.h"
 #include "anastasis_api_curl_defaults.h"
 
+
+/**
+ * Caches shared by all our easy handles, so that requests to the
+ * same providers reuse DNS lookups, TLS sessions and connections.
+ * Applications may run requests from several threads, each with its
+ * own GNUNET_CURL_Context, so access to the caches is locked.
+ */
+static CURLSH *share;
+
+/**
+ * Protects #share.
+ */
+static pthread_mutex_t share_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Locks for the data shared via #share, by `curl_lock_data`.
+ */
+static pthread_mutex_t data_locks[CURL_LOCK_DATA_LAST];
+
+
+/**
+ * Lock shared data for curl.
+ *
+ * @param handle easy handle accessing the data
+ * @param data which data to lock
+ * @param access type of access, ignored
+ * @param cls NULL
+ */
+static void
+lock_cb (CURL *handle,
+         curl_lock_data data,
+         curl_lock_access access,
+         void *cls)
+{
+  (void) handle;
+  (void) access;
+  (void) cls;
+  GNUNET_assert (0 ==
+                 pthread_mutex_lock (&data_locks[data]));
+}
+
+
+/**
+ * Unlock shared data for curl.
+ *
+ * @param handle easy handle accessing the data
+ * @param data which data to unlock
+ * @param cls NULL
+ */
+static void
+unlock_cb (CURL *handle,
+           curl_lock_data data,
+           void *cls)
+{
+  (void) handle;
+  (void) cls;
+  GNUNET_assert (0 ==
+                 pthread_mutex_unlock (&data_locks[data]));
+}
+
+
+/**
+ * Get the share handle, creating it if necessary.
+ * Must be called with #share_lock held.
+ *
+ * @return NULL on error
+ */
+static CURLSH *
+get_share (void)
+{
+  static bool have_locks;
+
+  if (NULL != share)
+    return share;
+  if (! have_locks)
+  {
+    for (unsigned int i = 0; i<CURL_LOCK_DATA_LAST; i++)
+      GNUNET_assert (0 ==
+                     pthread_mutex_init (&data_locks[i],
+                                         NULL));
+    have_locks = true;
+  }
+  share = curl_share_init ();
+  if (NULL == share)
+    return NULL;
+  GNUNET_break (CURLSHE_OK ==
+                curl_share_setopt (share,
+                                   CURLSHOPT_LOCKFUNC,
+                                   &lock_cb));
+  GNUNET_break (CURLSHE_OK ==
+                curl_share_setopt (share,
+                                   CURLSHOPT_UNLOCKFUNC,
+                                   &unlock_cb));
+  GNUNET_break (CURLSHE_OK ==
+                curl_share_setopt (share,
+                                   CURLSHOPT_SHARE,
+                                   CURL_LOCK_DATA_DNS));
+  GNUNET_break (CURLSHE_OK ==
+                curl_share_setopt (share,
+                                   CURLSHOPT_SHARE,
+                                   CURL_LOCK_DATA_SSL_SESSION));
+#if LIBCURL_VERSION_NUM >= 0x073900
+  GNUNET_break (CURLSHE_OK ==
+                curl_share_setopt (share,
+                                   CURLSHOPT_SHARE,
+                                   CURL_LOCK_DATA_CONNECT));
+#endif
+  return share;
+}
+
+
 CURL *
 ANASTASIS_curl_easy_get_ (const char *url)
 {
   CURL *eh;
+  CURLSH *sh;
 
   eh = curl_easy_init ();
   if (NULL == eh)
     return NULL;
+  GNUNET_assert (0 ==
+                 pthread_mutex_lock (&share_lock));
+  sh = get_share ();
+  if (NULL != sh)
+    GNUNET_assert (CURLE_OK ==
+                   curl_easy_setopt (eh,
+                                     CURLOPT_SHARE,
+                                     sh));
+  GNUNET_assert (0 ==
+                 pthread_mutex_unlock (&share_lock));
   GNUNET_assert (CURLE_OK ==
                  curl_easy_setopt (eh,
                                    CURLOPT_URL,
@@ -42,5 +166,41 @@ ANASTASIS_curl_easy_get_ (const char *url)
                  curl_easy_setopt (eh,
                                    CURLOPT_TCP_FASTOPEN,
                                    1L));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_TCP_KEEPALIVE,
+                                   1L));
+  /* Multiplex requests to the same provider over one
+     connection where the provider supports HTTP/2 */
+  GNUNET_break (CURLE_OK ==
+                curl_easy_setopt (eh,
+                                  CURLOPT_HTTP_VERSION,
+                                  (long) CURL_HTTP_VERSION_2TLS));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_PIPEWAIT,
+                                   1L));
   return eh;
 }
+
+
+void
+ANASTASIS_curl_share_cleanup (void)
+{
+  GNUNET_assert (0 ==
+                 pthread_mutex_lock (&share_lock));
+  if (NULL != share)
+  {
+    if (CURLSHE_OK ==
+        curl_share_cleanup (share))
+      share = NULL;
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Requests still running, keeping shared curl caches\n");
+  }
+  GNUNET_assert (0 ==
+                 pthread_mutex_unlock (&share_lock));
+}
+
+
+/* end of anastasis_api_curl_defaults.c */
@@ -28,7 +28,8 @@
 
 /**
  * Get a curl handle with the right defaults
- * for the exchange lib.  In the future, we might manage a pool of connections here.
+ * for the exchange lib.  All handles share DNS, TLS session
+ * and connection caches, and use HTTP/2 where available.
  *
  * @param url URL to query
  */
@@ -150,6 +150,12 @@ handle_policy_lookup_finished (void *cls,
       ANASTASIS_policy_lookup_cancel (plo);
       return;
     }
+  case MHD_HTTP_NO_CONTENT:
+    /* Account exists, but has no policy */
+    break;
+  case MHD_HTTP_NOT_MODIFIED:
+    /* Policy matches the If-None-Match header, nothing to verify */
+    break;
   case MHD_HTTP_BAD_REQUEST:
     /* This should never happen, either us or the anastasis server is buggy
        (or API version conflict); just pass JSON reply to the application */
@@ -354,3 +360,67 @@ ANASTASIS_policy_lookup_version (
                                       plo);
   return plo;
 }
+
+
+struct ANASTASIS_PolicyLookupOperation *
+ANASTASIS_policy_lookup_if_changed (
+  struct GNUNET_CURL_Context *ctx,
+  const char *backend_url,
+  const struct ANASTASIS_CRYPTO_AccountPublicKeyP *anastasis_pub,
+  const struct GNUNET_HashCode *known_policy_hash,
+  ANASTASIS_PolicyLookupCallback cb,
+  void *cb_cls)
+{
+  struct ANASTASIS_PolicyLookupOperation *plo;
+  CURL *eh;
+  char *acc_pub_str;
+  char *path;
+  struct curl_slist *job_headers;
+
+  GNUNET_assert (NULL != cb);
+  plo = GNUNET_new (struct ANASTASIS_PolicyLookupOperation);
+  plo->account_pub = *anastasis_pub;
+  acc_pub_str = GNUNET_STRINGS_data_to_string_alloc (anastasis_pub,
+                                                     sizeof (*anastasis_pub));
+  GNUNET_asprintf (&path,
+                   "policy/%s",
+                   acc_pub_str);
+  GNUNET_free (acc_pub_str);
+  plo->url = TALER_url_join (backend_url,
+                             path,
+                             NULL);
+  GNUNET_free (path);
+  {
+    char *etag;
+    char *hdr;
+
+    etag = GNUNET_STRINGS_data_to_string_alloc (known_policy_hash,
+                                                sizeof (*known_policy_hash));
+    GNUNET_asprintf (&hdr,
+                     "%s: %s",
+                     MHD_HTTP_HEADER_IF_NONE_MATCH,
+                     etag);
+    GNUNET_free (etag);
+    job_headers = curl_slist_append (NULL,
+                                     hdr);
+    GNUNET_free (hdr);
+  }
+  eh = ANASTASIS_curl_easy_get_ (plo->url);
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_HEADERFUNCTION,
+                                   &handle_header));
+  GNUNET_assert (CURLE_OK ==
+                 curl_easy_setopt (eh,
+                                   CURLOPT_HEADERDATA,
+                                   plo));
+  plo->cb = cb;
+  plo->cb_cls = cb_cls;
+  plo->job = GNUNET_CURL_job_add_raw (ctx,
+                                      eh,
+                                      job_headers,
+                                      &handle_policy_lookup_finished,
+                                      plo);
+  curl_slist_free_all (job_headers);
+  return plo;
+}
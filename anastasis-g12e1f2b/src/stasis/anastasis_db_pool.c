@@ -0,0 +1,446 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file stasis/anastasis_db_pool.c
+ * @brief run database operations on threads with their own connections
+ * @author Christian Grothoff
+ *
+ * Every thread loads its own instance of the database plugin, so the
+ * plugin itself needs no locking.  Finished jobs are queued and the
+ * scheduler is woken up by writing to a pipe.
+ *
+ * The GNUnet logging functions are not thread-safe, so everything
+ * that logs (connecting the plugins, reporting leftover jobs) runs on
+ * the scheduler thread.  The threads themselves only use assertions
+ * on their locks, which abort the process anyway.
+ */
+#include "platform.h"
+#include "anastasis_database_lib.h"
+#include <pthread.h>
+
+
+/**
+ * Job submitted to the pool.
+ */
+struct ANASTASIS_DB_PoolJob
+{
+  /**
+   * Kept in a DLL of pending or of finished jobs.
+   */
+  struct ANASTASIS_DB_PoolJob *next;
+
+  /**
+   * Kept in a DLL of pending or of finished jobs.
+   */
+  struct ANASTASIS_DB_PoolJob *prev;
+
+  /**
+   * Pool the job was submitted to.
+   */
+  struct ANASTASIS_DB_Pool *pool;
+
+  /**
+   * Function to run on a thread.
+   */
+  ANASTASIS_DB_PoolWork work;
+
+  /**
+   * Function to call from the scheduler.
+   */
+  ANASTASIS_DB_PoolDone done;
+
+  /**
+   * Closure for @e work and @e done.
+   */
+  void *cb_cls;
+
+  /**
+   * True while @e work is running on a thread.
+   */
+  bool running;
+
+  /**
+   * True once @e work returned, the job is then in the
+   * DLL of finished jobs.
+   */
+  bool finished;
+};
+
+
+/**
+ * Thread of the pool.
+ */
+struct Worker
+{
+  /**
+   * The thread.
+   */
+  pthread_t thread;
+
+  /**
+   * Database plugin used only by this thread.
+   */
+  struct ANASTASIS_DatabasePlugin *plugin;
+
+  /**
+   * Pool the worker belongs to.
+   */
+  struct ANASTASIS_DB_Pool *pool;
+
+  /**
+   * True if @e thread was started.
+   */
+  bool started;
+};
+
+
+/**
+ * Pool of threads with their own database connections.
+ */
+struct ANASTASIS_DB_Pool
+{
+  /**
+   * Array of @e num_workers workers.
+   */
+  struct Worker *workers;
+
+  /**
+   * Head of jobs waiting for a thread.
+   */
+  struct ANASTASIS_DB_PoolJob *pending_head;
+
+  /**
+   * Tail of jobs waiting for a thread.
+   */
+  struct ANASTASIS_DB_PoolJob *pending_tail;
+
+  /**
+   * Head of jobs waiting for their done function to be called.
+   */
+  struct ANASTASIS_DB_PoolJob *finished_head;
+
+  /**
+   * Tail of jobs waiting for their done function to be called.
+   */
+  struct ANASTASIS_DB_PoolJob *finished_tail;
+
+  /**
+   * Pipe used to wake up the scheduler when jobs finished.
+   */
+  struct GNUNET_DISK_PipeHandle *notify;
+
+  /**
+   * Task reading from @e notify.
+   */
+  struct GNUNET_SCHEDULER_Task *notify_task;
+
+  /**
+   * Protects the DLLs, the job flags and @e stopping.
+   */
+  pthread_mutex_t lock;
+
+  /**
+   * Signalled when jobs are submitted or the pool is stopping.
+   */
+  pthread_cond_t work_cond;
+
+  /**
+   * Signalled when jobs finished.
+   */
+  pthread_cond_t finished_cond;
+
+  /**
+   * Length of the @e workers array.
+   */
+  unsigned int num_workers;
+
+  /**
+   * True once the threads are asked to terminate.
+   */
+  bool stopping;
+};
+
+
+/**
+ * Main function of the threads of the pool.
+ *
+ * @param cls a `struct Worker`
+ * @return NULL
+ */
+static void *
+worker_main (void *cls)
+{
+  struct Worker *w = cls;
+  struct ANASTASIS_DB_Pool *pool = w->pool;
+  static const char c = '!';
+
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  while (1)
+  {
+    struct ANASTASIS_DB_PoolJob *job;
+
+    while ( (! pool->stopping) &&
+            (NULL == pool->pending_head) )
+      GNUNET_assert (0 == pthread_cond_wait (&pool->work_cond,
+                                             &pool->lock));
+    if (pool->stopping)
+      break;
+    job = pool->pending_head;
+    GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                 pool->pending_tail,
+                                 job);
+    job->running = true;
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+    job->work (job->cb_cls,
+               w->plugin);
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    job->running = false;
+    job->finished = true;
+    GNUNET_CONTAINER_DLL_insert_tail (pool->finished_head,
+                                      pool->finished_tail,
+                                      job);
+    GNUNET_assert (0 == pthread_cond_broadcast (&pool->finished_cond));
+    /* the pipe is non-blocking; if it is full, the scheduler
+       has not yet drained the previous notifications anyway */
+    (void) GNUNET_DISK_file_write (
+      GNUNET_DISK_pipe_handle (pool->notify,
+                               GNUNET_DISK_PIPE_END_WRITE),
+      &c,
+      sizeof (c));
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  return NULL;
+}
+
+
+/**
+ * Drain the notification pipe and call the done functions of all
+ * finished jobs.
+ *
+ * @param cls a `struct ANASTASIS_DB_Pool`
+ */
+static void
+run_finished (void *cls)
+{
+  struct ANASTASIS_DB_Pool *pool = cls;
+  const struct GNUNET_DISK_FileHandle *fh;
+  char buf[64];
+
+  fh = GNUNET_DISK_pipe_handle (pool->notify,
+                                GNUNET_DISK_PIPE_END_READ);
+  pool->notify_task = GNUNET_SCHEDULER_add_read_file (
+    GNUNET_TIME_UNIT_FOREVER_REL,
+    fh,
+    &run_finished,
+    pool);
+  while (0 < GNUNET_DISK_file_read (fh,
+                                    buf,
+                                    sizeof (buf)))
+    ;
+  while (1)
+  {
+    struct ANASTASIS_DB_PoolJob *job;
+
+    /* take one job at a time, so that done functions may
+       cancel other finished jobs */
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    job = pool->finished_head;
+    if (NULL != job)
+      GNUNET_CONTAINER_DLL_remove (pool->finished_head,
+                                   pool->finished_tail,
+                                   job);
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+    if (NULL == job)
+      break;
+    job->done (job->cb_cls);
+    GNUNET_free (job);
+  }
+}
+
+
+struct ANASTASIS_DB_Pool *
+ANASTASIS_DB_pool_create (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                          unsigned int num_threads)
+{
+  struct ANASTASIS_DB_Pool *pool;
+
+  GNUNET_assert (0 < num_threads);
+  pool = GNUNET_new (struct ANASTASIS_DB_Pool);
+  GNUNET_assert (0 == pthread_mutex_init (&pool->lock,
+                                          NULL));
+  GNUNET_assert (0 == pthread_cond_init (&pool->work_cond,
+                                         NULL));
+  GNUNET_assert (0 == pthread_cond_init (&pool->finished_cond,
+                                         NULL));
+  pool->notify = GNUNET_DISK_pipe (GNUNET_DISK_PF_NONE);
+  if (NULL == pool->notify)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "pipe");
+    ANASTASIS_DB_pool_destroy (pool);
+    return NULL;
+  }
+  pool->num_workers = num_threads;
+  pool->workers = GNUNET_new_array (num_threads,
+                                    struct Worker);
+  for (unsigned int i = 0; i<num_threads; i++)
+  {
+    struct Worker *w = &pool->workers[i];
+
+    w->pool = pool;
+    w->plugin = ANASTASIS_DB_plugin_load (cfg);
+    if (NULL == w->plugin)
+    {
+      ANASTASIS_DB_pool_destroy (pool);
+      return NULL;
+    }
+    if (GNUNET_OK !=
+        w->plugin->connect (w->plugin->cls))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Failed to connect database thread %u\n",
+                  i);
+      ANASTASIS_DB_pool_destroy (pool);
+      return NULL;
+    }
+  }
+  for (unsigned int i = 0; i<num_threads; i++)
+  {
+    struct Worker *w = &pool->workers[i];
+    int ret;
+
+    ret = pthread_create (&w->thread,
+                          NULL,
+                          &worker_main,
+                          w);
+    if (0 != ret)
+    {
+      errno = ret;
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                           "pthread_create");
+      ANASTASIS_DB_pool_destroy (pool);
+      return NULL;
+    }
+    w->started = true;
+  }
+  pool->notify_task = GNUNET_SCHEDULER_add_read_file (
+    GNUNET_TIME_UNIT_FOREVER_REL,
+    GNUNET_DISK_pipe_handle (pool->notify,
+                             GNUNET_DISK_PIPE_END_READ),
+    &run_finished,
+    pool);
+  return pool;
+}
+
+
+struct ANASTASIS_DB_PoolJob *
+ANASTASIS_DB_pool_submit (struct ANASTASIS_DB_Pool *pool,
+                          ANASTASIS_DB_PoolWork work,
+                          ANASTASIS_DB_PoolDone done,
+                          void *cb_cls)
+{
+  struct ANASTASIS_DB_PoolJob *job;
+
+  job = GNUNET_new (struct ANASTASIS_DB_PoolJob);
+  job->pool = pool;
+  job->work = work;
+  job->done = done;
+  job->cb_cls = cb_cls;
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  GNUNET_CONTAINER_DLL_insert_tail (pool->pending_head,
+                                    pool->pending_tail,
+                                    job);
+  GNUNET_assert (0 == pthread_cond_signal (&pool->work_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  return job;
+}
+
+
+void
+ANASTASIS_DB_pool_cancel (struct ANASTASIS_DB_PoolJob *job)
+{
+  struct ANASTASIS_DB_Pool *pool = job->pool;
+
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  while (job->running)
+    GNUNET_assert (0 == pthread_cond_wait (&pool->finished_cond,
+                                           &pool->lock));
+  if (job->finished)
+    GNUNET_CONTAINER_DLL_remove (pool->finished_head,
+                                 pool->finished_tail,
+                                 job);
+  else
+    GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                 pool->pending_tail,
+                                 job);
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  GNUNET_free (job);
+}
+
+
+void
+ANASTASIS_DB_pool_destroy (struct ANASTASIS_DB_Pool *pool)
+{
+  GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+  pool->stopping = true;
+  GNUNET_assert (0 == pthread_cond_broadcast (&pool->work_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  for (unsigned int i = 0; i<pool->num_workers; i++)
+  {
+    struct Worker *w = &pool->workers[i];
+
+    if (w->started)
+      GNUNET_assert (0 == pthread_join (w->thread,
+                                        NULL));
+    if (NULL != w->plugin)
+      ANASTASIS_DB_plugin_unload (w->plugin);
+  }
+  GNUNET_free (pool->workers);
+  for (struct ANASTASIS_DB_PoolJob *job = pool->pending_head;
+       NULL != job;
+       job = pool->pending_head)
+  {
+    GNUNET_break (0);
+    GNUNET_CONTAINER_DLL_remove (pool->pending_head,
+                                 pool->pending_tail,
+                                 job);
+    GNUNET_free (job);
+  }
+  for (struct ANASTASIS_DB_PoolJob *job = pool->finished_head;
+       NULL != job;
+       job = pool->finished_head)
+  {
+    GNUNET_break (0);
+    GNUNET_CONTAINER_DLL_remove (pool->finished_head,
+                                 pool->finished_tail,
+                                 job);
+    GNUNET_free (job);
+  }
+  if (NULL != pool->notify_task)
+  {
+    GNUNET_SCHEDULER_cancel (pool->notify_task);
+    pool->notify_task = NULL;
+  }
+  if (NULL != pool->notify)
+    GNUNET_DISK_pipe_close (pool->notify);
+  GNUNET_assert (0 == pthread_cond_destroy (&pool->finished_cond));
+  GNUNET_assert (0 == pthread_cond_destroy (&pool->work_cond));
+  GNUNET_assert (0 == pthread_mutex_destroy (&pool->lock));
+  GNUNET_free (pool);
+}
+
+
+/* end of anastasis_db_pool.c */
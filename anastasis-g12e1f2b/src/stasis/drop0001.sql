@@ -22,6 +22,33 @@ BEGIN;
 -- Unlike the other SQL files, it SHOULD be updated to reflect the
 -- latest requirements for dropping tables.
 
+-- Drops for 0005.sql
+DROP INDEX IF EXISTS anastasis_auth_iban_in_serial_index;
+
+-- Unregister patch (0005.sql)
+SELECT _v.unregister_patch('stasis-0005');
+
+-- Drops for 0004.sql
+DROP FUNCTION IF EXISTS anastasis_maintain_partitions;
+DROP FUNCTION IF EXISTS anastasis_drop_weekly_partitions;
+DROP FUNCTION IF EXISTS anastasis_create_weekly_partitions;
+
+-- Unregister patch (0004.sql)
+SELECT _v.unregister_patch('stasis-0004');
+
+-- Drops for 0003.sql
+DROP FUNCTION IF EXISTS anastasis_do_rate_limit;
+
+-- Unregister patch (0003.sql)
+SELECT _v.unregister_patch('stasis-0003');
+
+-- Drops for 0002.sql
+DROP FUNCTION IF EXISTS anastasis_do_store_recovery_document;
+DROP FUNCTION IF EXISTS anastasis_do_create_challenge_code;
+
+-- Unregister patch (0002.sql)
+SELECT _v.unregister_patch('stasis-0002');
+
 -- Drops for 0001.sql
 DROP TABLE IF EXISTS anastasis_truth CASCADE;
 DROP TABLE IF EXISTS anastasis_user CASCADE;
@@ -23,6 +23,7 @@
 #include "platform.h"
 #include "anastasis_database_plugin.h"
 #include "anastasis_database_lib.h"
+#include "anastasis_util_lib.h"
 #include <taler/taler_pq_lib.h>
 
 /**
@@ -44,6 +45,110 @@
  */
 #define NONCE_MAX_VALUE (1LLU << 52)
 
+/**
+ * How often do we check the replication lag of the replica?
+ */
+#define REPLICA_CHECK_FREQUENCY GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * For how far into the future do we create the weekly partitions of
+ * challenge codes and IBAN inflows?  Rows beyond end up in the
+ * default partition.
+ */
+#define PARTITION_HORIZON GNUNET_TIME_relative_multiply ( \
+    GNUNET_TIME_UNIT_WEEKS, 4)
+
+
+/**
+ * Closure of the plugin.
+ */
+struct PostgresClosure;
+
+
+/**
+ * Subscription to all events of one type.  We LISTEN on a single
+ * channel per event type and dispatch the notifications to the
+ * waiters ourselves, so the number of LISTENs does not grow with the
+ * number of waiters.
+ */
+struct EventType
+{
+  /**
+   * Kept in DLL.
+   */
+  struct EventType *next;
+
+  /**
+   * Kept in DLL.
+   */
+  struct EventType *prev;
+
+  /**
+   * Plugin we belong to.
+   */
+  struct PostgresClosure *pg;
+
+  /**
+   * Handle of the LISTEN for this type.
+   */
+  struct GNUNET_DB_EventHandler *eh;
+
+  /**
+   * Event type, in network byte order.
+   */
+  uint16_t type;
+};
+
+
+/**
+ * Waiter for events matching one event specification.  Handed out
+ * to the application as a `struct GNUNET_DB_EventHandler`.
+ */
+struct EventWaiter
+{
+  /**
+   * Plugin we belong to.
+   */
+  struct PostgresClosure *pg;
+
+  /**
+   * Hash of the event specification, key in the waiter map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Task to signal the timeout, NULL if none is pending.
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
+
+  /**
+   * Function to call on events.
+   */
+  GNUNET_DB_EventCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+};
+
+
+/**
+ * Latency histogram of a prepared statement.
+ */
+struct StatementHistogram
+{
+  /**
+   * Name of the prepared statement.
+   */
+  const char *statement;
+
+  /**
+   * Histogram of the execution times of @e statement.
+   */
+  struct ANASTASIS_METRICS_Histogram *histogram;
+};
+
 
 /**
  * Type of the "cls" argument given to each of the functions in
@@ -57,6 +162,33 @@ struct PostgresClosure
    */
   struct GNUNET_PQ_Context *conn;
 
+  /**
+   * Connection to a read-only replica for the GET paths, NULL if
+   * none is configured (or it could not be reached).
+   */
+  struct GNUNET_PQ_Context *replica;
+
+  /**
+   * Connection string of the replica, NULL if none is configured.
+   */
+  char *replica_config;
+
+  /**
+   * Maximum replication lag at which we still read from the replica.
+   */
+  struct GNUNET_TIME_Relative max_replica_lag;
+
+  /**
+   * When may we next check the replication lag (or retry the replica
+   * after it failed)?
+   */
+  struct GNUNET_TIME_Absolute replica_next_check;
+
+  /**
+   * Was the replica usable at the last check?
+   */
+  bool replica_usable;
+
   /**
    * Underlying configuration.
    */
@@ -72,6 +204,31 @@ struct PostgresClosure
    */
   char *currency;
 
+  /**
+   * Head of event types we are listening for.
+   */
+  struct EventType *et_head;
+
+  /**
+   * Tail of event types we are listening for.
+   */
+  struct EventType *et_tail;
+
+  /**
+   * Map from hashes of event specifications to `struct EventWaiter`s.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *waiters;
+
+  /**
+   * Histograms of our prepared statements, sorted by statement name.
+   */
+  struct StatementHistogram *histograms;
+
+  /**
+   * Length of the @e histograms array.
+   */
+  unsigned int histograms_len;
+
   /**
    * Prepared statements have been initialized.
    */
@@ -79,6 +236,93 @@ struct PostgresClosure
 };
 
 
+/**
+ * Compare two `struct StatementHistogram` by statement name.
+ *
+ * @param a first `struct StatementHistogram`
+ * @param b second `struct StatementHistogram`
+ * @return result of strcmp() on the statement names
+ */
+static int
+cmp_statement_histogram (const void *a,
+                         const void *b)
+{
+  const struct StatementHistogram *sa = a;
+  const struct StatementHistogram *sb = b;
+
+  return strcmp (sa->statement,
+                 sb->statement);
+}
+
+
+/**
+ * Lookup the histogram of @a statement.
+ *
+ * @param pg the plugin-specific state
+ * @param statement name of the prepared statement
+ * @return NULL if @a statement was never prepared
+ */
+static struct ANASTASIS_METRICS_Histogram *
+lookup_histogram (const struct PostgresClosure *pg,
+                  const char *statement)
+{
+  struct StatementHistogram key = {
+    .statement = statement
+  };
+  const struct StatementHistogram *sh;
+
+  if (0 == pg->histograms_len)
+    return NULL;
+  sh = bsearch (&key,
+                pg->histograms,
+                pg->histograms_len,
+                sizeof (struct StatementHistogram),
+                &cmp_statement_histogram);
+  if (NULL == sh)
+    return NULL;
+  return sh->histogram;
+}
+
+
+/**
+ * Resolve the histograms of the prepared statements @a ps, so that
+ * executing them only needs to update the histogram.
+ *
+ * @param[in,out] pg the plugin-specific state
+ * @param ps statements to be prepared
+ */
+static void
+register_statements (struct PostgresClosure *pg,
+                     const struct GNUNET_PQ_PreparedStatement *ps)
+{
+  for (unsigned int i = 0; NULL != ps[i].name; i++)
+  {
+    char labels[128];
+    struct StatementHistogram sh;
+
+    if (NULL != lookup_histogram (pg,
+                                  ps[i].name))
+      continue;
+    GNUNET_snprintf (labels,
+                     sizeof (labels),
+                     "statement=\"%s\"",
+                     ps[i].name);
+    sh.statement = ps[i].name;
+    sh.histogram = ANASTASIS_METRICS_histogram (
+      "anastasis_db_statement_seconds",
+      "Execution time of prepared statements",
+      labels);
+    GNUNET_array_append (pg->histograms,
+                         pg->histograms_len,
+                         sh);
+    qsort (pg->histograms,
+           pg->histograms_len,
+           sizeof (struct StatementHistogram),
+           &cmp_statement_histogram);
+  }
+}
+
+
 /**
  * Drop anastasis tables
  *
@@ -127,6 +371,82 @@ postgres_create_tables (void *cls)
 }
 
 
+/**
+ * Prepare the read-only statements used by the GET paths on @a conn,
+ * which is either the primary or the replica.
+ *
+ * @param[in,out] pg the plugin-specific state
+ * @param conn connection to prepare statements on
+ * @return #GNUNET_OK upon success; #GNUNET_SYSERR upon failure
+ */
+static enum GNUNET_GenericReturnValue
+prepare_read_statements (struct PostgresClosure *pg,
+                         struct GNUNET_PQ_Context *conn)
+{
+  struct GNUNET_PQ_PreparedStatement ps[] = {
+    GNUNET_PQ_make_prepare ("truth_select",
+                            "SELECT "
+                            " method_name"
+                            ",encrypted_truth"
+                            ",truth_mime"
+                            " FROM anastasis_truth"
+                            " WHERE truth_uuid =$1;",
+                            1),
+    GNUNET_PQ_make_prepare ("latest_recoverydocument_select",
+                            "SELECT "
+                            " version"
+                            ",account_sig"
+                            ",recovery_data_hash"
+                            ",recovery_data"
+                            " FROM anastasis_recoverydocument"
+                            " WHERE user_id =$1 "
+                            " ORDER BY version DESC"
+                            " LIMIT 1;",
+                            1),
+    GNUNET_PQ_make_prepare ("latest_recovery_version_select",
+                            "SELECT"
+                            " version"
+                            ",recovery_data_hash"
+                            ",expiration_date"
+                            " FROM anastasis_recoverydocument"
+                            " JOIN anastasis_user USING (user_id)"
+                            " WHERE user_id=$1"
+                            " ORDER BY version DESC"
+                            " LIMIT 1;",
+                            1),
+    GNUNET_PQ_make_prepare ("recoverydocument_select",
+                            "SELECT "
+                            " account_sig"
+                            ",recovery_data_hash"
+                            ",recovery_data"
+                            " FROM anastasis_recoverydocument"
+                            " WHERE user_id=$1"
+                            " AND version=$2;",
+                            2),
+    GNUNET_PQ_make_prepare ("key_share_select",
+                            "SELECT "
+                            "key_share_data "
+                            "FROM "
+                            "anastasis_truth "
+                            "WHERE truth_uuid =$1;",
+                            1),
+    /* like "user_select", but without locking */
+    GNUNET_PQ_make_prepare ("user_expiration_select",
+                            "SELECT"
+                            " expiration_date"
+                            " FROM anastasis_user"
+                            " WHERE user_id=$1;",
+                            1),
+    GNUNET_PQ_PREPARED_STATEMENT_END
+  };
+
+  register_statements (pg,
+                       ps);
+  return GNUNET_PQ_prepare_statements (conn,
+                                       ps);
+}
+
+
 /**
  * Establish connection to the database.
  *
@@ -336,87 +656,27 @@ prepare_statements (void *cls)
                             7),
 
 
-    GNUNET_PQ_make_prepare ("recovery_document_insert",
-                            "INSERT INTO anastasis_recoverydocument "
-                            "(user_id"
-                            ",version"
-                            ",account_sig"
-                            ",recovery_data_hash"
-                            ",recovery_data"
-                            ") VALUES "
-                            "($1, $2, $3, $4, $5);",
+    GNUNET_PQ_make_prepare ("do_store_recovery_document",
+                            "SELECT"
+                            " out_status AS status"
+                            ",out_version AS version"
+                            " FROM anastasis_do_store_recovery_document"
+                            " ($1, $2, $3, $4, $5);",
                             5),
-    GNUNET_PQ_make_prepare ("truth_select",
-                            "SELECT "
-                            " method_name"
-                            ",encrypted_truth"
-                            ",truth_mime"
-                            " FROM anastasis_truth"
-                            " WHERE truth_uuid =$1;",
-                            1),
-    GNUNET_PQ_make_prepare ("latest_recoverydocument_select",
-                            "SELECT "
-                            " version"
-                            ",account_sig"
-                            ",recovery_data_hash"
-                            ",recovery_data"
-                            " FROM anastasis_recoverydocument"
-                            " WHERE user_id =$1 "
-                            " ORDER BY version DESC"
-                            " LIMIT 1;",
-                            1),
-    GNUNET_PQ_make_prepare ("latest_recovery_version_select",
+    GNUNET_PQ_make_prepare ("do_create_challenge_code",
                             "SELECT"
-                            " version"
-                            ",recovery_data_hash"
-                            ",expiration_date"
-                            " FROM anastasis_recoverydocument"
-                            " JOIN anastasis_user USING (user_id)"
-                            " WHERE user_id=$1"
-                            " ORDER BY version DESC"
-                            " LIMIT 1;",
-                            1),
-    GNUNET_PQ_make_prepare ("recoverydocument_select",
-                            "SELECT "
-                            " account_sig"
-                            ",recovery_data_hash"
-                            ",recovery_data"
-                            " FROM anastasis_recoverydocument"
-                            " WHERE user_id=$1"
-                            " AND version=$2;",
-                            2),
-    GNUNET_PQ_make_prepare ("postcounter_select",
+                            " out_code AS code"
+                            ",out_retry_counter AS retry_counter"
+                            ",out_retransmission_date AS retransmission_date"
+                            " FROM anastasis_do_create_challenge_code"
+                            " ($1, $2, $3, $4, $5, $6);",
+                            6),
+    GNUNET_PQ_make_prepare ("do_rate_limit",
                             "SELECT"
-                            " post_counter"
-                            " FROM anastasis_recdoc_payment"
-                            " WHERE user_id=$1"
-                            "  AND payment_identifier=$2;",
-                            2),
-    GNUNET_PQ_make_prepare ("postcounter_update",
-                            "UPDATE "
-                            "anastasis_recdoc_payment "
-                            "SET "
-                            "post_counter=$1 "
-                            "WHERE user_id =$2 "
-                            "AND payment_identifier=$3;",
-                            3),
-    GNUNET_PQ_make_prepare ("key_share_select",
-                            "SELECT "
-                            "key_share_data "
-                            "FROM "
-                            "anastasis_truth "
-                            "WHERE truth_uuid =$1;",
-                            1),
-    GNUNET_PQ_make_prepare ("challengecode_insert",
-                            "INSERT INTO anastasis_challengecode "
-                            "(truth_uuid"
-                            ",code"
-                            ",creation_date"
-                            ",expiration_date"
-                            ",retry_counter"
-                            ") VALUES "
-                            "($1, $2, $3, $4, $5);",
-                            5),
+                            " out_limited AS limited"
+                            " FROM anastasis_do_rate_limit"
+                            " ($1, $2, $3, $4, $5, $6);",
+                            6),
     GNUNET_PQ_make_prepare ("challengecode_select",
                             "SELECT "
                             " code"
@@ -447,21 +707,9 @@ prepare_statements (void *cls)
                             "   AND creation_date >= $3"
                             " LIMIT 1;",
                             3),
-    GNUNET_PQ_make_prepare ("challengecode_select_meta",
-                            "SELECT "
-                            " code"
-                            ",retry_counter"
-                            ",retransmission_date"
-                            " FROM anastasis_challengecode"
-                            " WHERE truth_uuid=$1"
-                            "   AND expiration_date > $2"
-                            "   AND creation_date > $3"
-                            " ORDER BY creation_date DESC"
-                            " LIMIT 1;",
-                            2),
-    GNUNET_PQ_make_prepare ("challengecode_update_retry",
-                            "UPDATE anastasis_challengecode"
-                            " SET retry_counter=retry_counter - 1"
+    GNUNET_PQ_make_prepare ("challengecode_update_retry",
+                            "UPDATE anastasis_challengecode"
+                            " SET retry_counter=retry_counter - 1"
                             " WHERE truth_uuid=$1"
                             "   AND code=$2"
                             "   AND retry_counter != 0;",
@@ -499,22 +747,214 @@ prepare_statements (void *cls)
                             "WHERE "
                             "expiration_date < $1;",
                             1),
+    GNUNET_PQ_make_prepare ("maintain_partitions",
+                            "SELECT"
+                            " out_dropped AS dropped"
+                            " FROM anastasis_maintain_partitions"
+                            " ($1, $2, $3);",
+                            3),
+    /* weekly partitions are dropped as a whole, only the
+       default partition is collected row by row */
+    /* ctid is only unique within a partition, so rows of the
+       partitioned table are identified by (tableoid, ctid) */
+    GNUNET_PQ_make_prepare ("gc_challengecodes_batch",
+                            "DELETE FROM anastasis_challengecode"
+                            " WHERE (tableoid, ctid) IN"
+                            " (SELECT tableoid, ctid"
+                            "   FROM anastasis_challengecode"
+                            "  WHERE expiration_date < $1"
+                            "  LIMIT $2);",
+                            2),
+    GNUNET_PQ_make_prepare ("gc_recdoc_pending_payments_batch",
+                            "DELETE FROM anastasis_recdoc_payment"
+                            " WHERE ctid IN"
+                            " (SELECT ctid"
+                            "   FROM anastasis_recdoc_payment"
+                            "  WHERE paid=FALSE"
+                            "    AND creation_date < $1"
+                            "  LIMIT $2);",
+                            2),
+    GNUNET_PQ_make_prepare ("gc_challenge_pending_payments_batch",
+                            "DELETE FROM anastasis_challenge_payment"
+                            " WHERE ctid IN"
+                            " (SELECT ctid"
+                            "   FROM anastasis_challenge_payment"
+                            "  WHERE (paid=FALSE OR refunded=TRUE)"
+                            "    AND creation_date < $1"
+                            "  LIMIT $2);",
+                            2),
+    GNUNET_PQ_make_prepare ("gc_recoverydocuments_batch",
+                            "DELETE FROM anastasis_recoverydocument"
+                            " WHERE ctid IN"
+                            " (SELECT rd.ctid"
+                            "   FROM anastasis_recoverydocument rd"
+                            "   JOIN anastasis_user u USING (user_id)"
+                            "  WHERE u.expiration_date < $1"
+                            "  LIMIT $2);",
+                            2),
+    GNUNET_PQ_make_prepare ("gc_recdoc_payments_batch",
+                            "DELETE FROM anastasis_recdoc_payment"
+                            " WHERE ctid IN"
+                            " (SELECT p.ctid"
+                            "   FROM anastasis_recdoc_payment p"
+                            "   JOIN anastasis_user u USING (user_id)"
+                            "  WHERE u.expiration_date < $1"
+                            "  LIMIT $2);",
+                            2),
+    GNUNET_PQ_make_prepare ("gc_accounts_batch",
+                            "DELETE FROM anastasis_user"
+                            " WHERE ctid IN"
+                            " (SELECT u.ctid"
+                            "   FROM anastasis_user u"
+                            "  WHERE u.expiration_date < $1"
+                            "    AND NOT EXISTS"
+                            "     (SELECT 1"
+                            "        FROM anastasis_recoverydocument rd"
+                            "       WHERE rd.user_id=u.user_id)"
+                            "    AND NOT EXISTS"
+                            "     (SELECT 1"
+                            "        FROM anastasis_recdoc_payment p"
+                            "       WHERE p.user_id=u.user_id)"
+                            "  LIMIT $2);",
+                            2),
     GNUNET_PQ_PREPARED_STATEMENT_END
   };
 
   {
     enum GNUNET_GenericReturnValue ret;
 
+    register_statements (pg,
+                         ps);
     ret = GNUNET_PQ_prepare_statements (pg->conn,
                                         ps);
     if (GNUNET_OK != ret)
       return ret;
+    ret = prepare_read_statements (pg,
+                                   pg->conn);
+    if (GNUNET_OK != ret)
+      return ret;
     pg->init = true;
     return GNUNET_OK;
   }
 }
 
 
+/**
+ * Record how long the execution of @a statement took.
+ *
+ * @param pg the plugin-specific state
+ * @param statement name of the prepared statement
+ * @param start time the execution started
+ */
+static void
+observe_statement (const struct PostgresClosure *pg,
+                   const char *statement,
+                   struct GNUNET_TIME_Absolute start)
+{
+  struct ANASTASIS_METRICS_Histogram *h;
+
+  h = lookup_histogram (pg,
+                        statement);
+  if (NULL == h)
+    return;
+  ANASTASIS_METRICS_observe (h,
+                             GNUNET_TIME_absolute_get_duration (start));
+}
+
+
+/**
+ * Timed version of #GNUNET_PQ_eval_prepared_non_select().
+ *
+ * @param pg the plugin-specific state
+ * @param conn database connection
+ * @param statement name of the prepared statement
+ * @param params parameters for the statement
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+eval_non_select (const struct PostgresClosure *pg,
+                 struct GNUNET_PQ_Context *conn,
+                 const char *statement,
+                 const struct GNUNET_PQ_QueryParam *params)
+{
+  struct GNUNET_TIME_Absolute start = GNUNET_TIME_absolute_get ();
+  enum GNUNET_DB_QueryStatus qs;
+
+  qs = GNUNET_PQ_eval_prepared_non_select (conn,
+                                           statement,
+                                           params);
+  observe_statement (pg,
+                     statement,
+                     start);
+  return qs;
+}
+
+
+/**
+ * Timed version of #GNUNET_PQ_eval_prepared_singleton_select().
+ *
+ * @param pg the plugin-specific state
+ * @param conn database connection
+ * @param statement name of the prepared statement
+ * @param params parameters for the statement
+ * @param[in,out] rs result specification
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+eval_singleton_select (const struct PostgresClosure *pg,
+                       struct GNUNET_PQ_Context *conn,
+                       const char *statement,
+                       const struct GNUNET_PQ_QueryParam *params,
+                       struct GNUNET_PQ_ResultSpec *rs)
+{
+  struct GNUNET_TIME_Absolute start = GNUNET_TIME_absolute_get ();
+  enum GNUNET_DB_QueryStatus qs;
+
+  qs = GNUNET_PQ_eval_prepared_singleton_select (conn,
+                                                 statement,
+                                                 params,
+                                                 rs);
+  observe_statement (pg,
+                     statement,
+                     start);
+  return qs;
+}
+
+
+/**
+ * Timed version of #GNUNET_PQ_eval_prepared_multi_select().
+ *
+ * @param pg the plugin-specific state
+ * @param conn database connection
+ * @param statement name of the prepared statement
+ * @param params parameters for the statement
+ * @param rh function to call with the results
+ * @param rh_cls closure for @a rh
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+eval_multi_select (const struct PostgresClosure *pg,
+                   struct GNUNET_PQ_Context *conn,
+                   const char *statement,
+                   const struct GNUNET_PQ_QueryParam *params,
+                   GNUNET_PQ_PostgresResultHandler rh,
+                   void *rh_cls)
+{
+  struct GNUNET_TIME_Absolute start = GNUNET_TIME_absolute_get ();
+  enum GNUNET_DB_QueryStatus qs;
+
+  qs = GNUNET_PQ_eval_prepared_multi_select (conn,
+                                             statement,
+                                             params,
+                                             rh,
+                                             rh_cls);
+  observe_statement (pg,
+                     statement,
+                     start);
+  return qs;
+}
+
+
 /**
  * Check that the database connection is still up.
  *
@@ -529,6 +969,159 @@ check_connection (void *cls)
 }
 
 
+/**
+ * Connect to the read-only replica.  Failures are not fatal, we then
+ * simply read from the primary.
+ *
+ * @param pg the plugin-specific state
+ */
+static void
+connect_replica (struct PostgresClosure *pg)
+{
+  struct GNUNET_PQ_PreparedStatement ps[] = {
+    /* A replica that replayed all WAL it received is only current
+       if it is still receiving WAL; otherwise (or if we may not see
+       the receiver status) we consider it to be lagging forever. */
+    GNUNET_PQ_make_prepare ("replica_lag",
+                            "SELECT COALESCE("
+                            " CASE"
+                            " WHEN NOT pg_is_in_recovery()"
+                            " THEN 0"
+                            " WHEN NOT EXISTS (SELECT 1"
+                            "   FROM pg_stat_wal_receiver"
+                            "   WHERE status='streaming')"
+                            " THEN NULL"
+                            " WHEN pg_last_wal_receive_lsn()"
+                            "      = pg_last_wal_replay_lsn()"
+                            " THEN 0"
+                            " ELSE (EXTRACT(EPOCH FROM clock_timestamp()"
+                            "        - pg_last_xact_replay_timestamp())"
+                            "       * 1000000)::INT8"
+                            " END, 9223372036854775807) AS lag;",
+                            0),
+    GNUNET_PQ_PREPARED_STATEMENT_END
+  };
+
+  register_statements (pg,
+                       ps);
+  pg->replica = GNUNET_PQ_connect (pg->replica_config,
+                                   NULL,
+                                   NULL,
+                                   ps);
+  if (NULL == pg->replica)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to connect to replica, reading from primary\n");
+    return;
+  }
+  if (GNUNET_OK !=
+      prepare_read_statements (pg,
+                               pg->replica))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to prepare statements on replica, reading from primary\n");
+    GNUNET_PQ_disconnect (pg->replica);
+    pg->replica = NULL;
+  }
+}
+
+
+/**
+ * Determine the connection to use for a read-only query that may
+ * return slightly stale data.  That is the replica, unless none is
+ * configured, we are in a transaction, or the replica is lagging too
+ * much or failed recently.
+ *
+ * @param pg the plugin-specific state
+ * @return connection to use
+ */
+static struct GNUNET_PQ_Context *
+read_connection (struct PostgresClosure *pg)
+{
+  struct GNUNET_TIME_Relative lag;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_relative_time ("lag",
+                                         &lag),
+    GNUNET_PQ_result_spec_end
+  };
+  enum GNUNET_DB_QueryStatus qs;
+
+  if ( (NULL == pg->replica) ||
+       (NULL != pg->transaction_name) )
+    return pg->conn;
+  if (GNUNET_TIME_absolute_is_future (pg->replica_next_check))
+    return pg->replica_usable ? pg->replica : pg->conn;
+  pg->replica_next_check
+    = GNUNET_TIME_relative_to_absolute (REPLICA_CHECK_FREQUENCY);
+  GNUNET_PQ_reconnect_if_down (pg->replica);
+  qs = eval_singleton_select (pg,
+                              pg->replica,
+                              "replica_lag",
+                              params,
+                              rs);
+  pg->replica_usable
+    = (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT == qs) &&
+      (GNUNET_TIME_relative_cmp (lag,
+                                 <=,
+                                 pg->max_replica_lag));
+  if (! pg->replica_usable)
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Replica unavailable or lagging, reading from primary\n");
+  return pg->replica_usable ? pg->replica : pg->conn;
+}
+
+
+/**
+ * Run read-only prepared @a statement returning at most one row,
+ * preferably on the replica.  If the replica fails or does not find
+ * the row (which may be due to replication lag), the statement is
+ * run on the primary.
+ *
+ * @param pg the plugin-specific state
+ * @param statement name of the statement to run
+ * @param params parameters for the statement
+ * @param[in,out] rs result specification
+ * @return transaction status
+ */
+static enum GNUNET_DB_QueryStatus
+read_singleton_select (struct PostgresClosure *pg,
+                       const char *statement,
+                       const struct GNUNET_PQ_QueryParam *params,
+                       struct GNUNET_PQ_ResultSpec *rs)
+{
+  struct GNUNET_PQ_Context *conn = read_connection (pg);
+
+  if (conn != pg->conn)
+  {
+    enum GNUNET_DB_QueryStatus qs;
+
+    qs = eval_singleton_select (pg,
+                                conn,
+                                statement,
+                                params,
+                                rs);
+    if (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT == qs)
+      return qs;
+    if (qs < 0)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "Statement `%s' failed on replica, using primary\n",
+                  statement);
+      pg->replica_usable = false;
+    }
+  }
+  check_connection (pg);
+  return eval_singleton_select (pg,
+                                pg->conn,
+                                statement,
+                                params,
+                                rs);
+}
+
+
 /**
  * Connect to the database if the connection does not exist yet.
  *
@@ -571,6 +1164,8 @@ internal_setup (struct PostgresClosure *pg,
     if (NULL == db_conn)
       return GNUNET_SYSERR;
     pg->conn = db_conn;
+    if (NULL != pg->replica_config)
+      connect_replica (pg);
   }
   if (NULL == pg->transaction_name)
     GNUNET_PQ_reconnect_if_down (pg->conn);
@@ -704,14 +1299,123 @@ commit_transaction (void *cls)
     GNUNET_PQ_query_param_end
   };
 
-  qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                           "do_commit",
-                                           no_params);
+  qs = eval_non_select (pg,
+                        pg->conn,
+                        "do_commit",
+                        no_params);
   pg->transaction_name = NULL;
   return qs;
 }
 
 
+/**
+ * Payload of a notification that is dispatched to the waiters.
+ */
+struct EventDispatchContext
+{
+  /**
+   * Additional event data.
+   */
+  const void *extra;
+
+  /**
+   * Number of bytes in @e extra.
+   */
+  size_t extra_size;
+};
+
+
+/**
+ * Pass a notification to waiter @a value.
+ *
+ * @param cls a `struct EventDispatchContext`
+ * @param key hash of the event specification
+ * @param value a `struct EventWaiter`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static enum GNUNET_GenericReturnValue
+dispatch_event (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  const struct EventDispatchContext *edc = cls;
+  struct EventWaiter *w = value;
+
+  (void) key;
+  w->cb (w->cb_cls,
+         edc->extra,
+         edc->extra_size);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Called on notifications for an event type.  The payload starts
+ * with the event specification the notification is for, followed
+ * by the additional event data.
+ *
+ * @param cls a `struct EventType`
+ * @param extra payload of the notification
+ * @param extra_size number of bytes in @a extra
+ */
+static void
+event_type_cb (void *cls,
+               const void *extra,
+               size_t extra_size)
+{
+  struct EventType *et = cls;
+  struct GNUNET_DB_EventHeaderP es;
+  struct GNUNET_HashCode key;
+  struct EventDispatchContext edc;
+  uint16_t es_size;
+
+  if (NULL == extra)
+    return; /* we never time out */
+  if (extra_size < sizeof (es))
+  {
+    GNUNET_break (0);
+    return;
+  }
+  memcpy (&es,
+          extra,
+          sizeof (es));
+  es_size = ntohs (es.size);
+  if ( (es_size < sizeof (es)) ||
+       (es_size > extra_size) ||
+       (es.type != et->type) )
+  {
+    GNUNET_break (0);
+    return;
+  }
+  GNUNET_CRYPTO_hash (extra,
+                      es_size,
+                      &key);
+  edc.extra = (const char *) extra + es_size;
+  edc.extra_size = extra_size - es_size;
+  GNUNET_CONTAINER_multihashmap_get_multiple (et->pg->waiters,
+                                              &key,
+                                              &dispatch_event,
+                                              &edc);
+}
+
+
+/**
+ * Signal to a waiter that its timeout expired.
+ *
+ * @param cls a `struct EventWaiter`
+ */
+static void
+waiter_timeout (void *cls)
+{
+  struct EventWaiter *w = cls;
+
+  w->timeout_task = NULL;
+  w->cb (w->cb_cls,
+         NULL,
+         0);
+}
+
+
 /**
  * Register callback to be invoked on events of type @a es.
  *
@@ -731,12 +1435,55 @@ postgres_event_listen (void *cls,
                        void *cb_cls)
 {
   struct PostgresClosure *pg = cls;
+  struct EventType *et;
+  struct EventWaiter *w;
+
+  for (et = pg->et_head; NULL != et; et = et->next)
+    if (et->type == es->type)
+      break;
+  if (NULL == et)
+  {
+    struct GNUNET_DB_EventHeaderP th = {
+      .size = htons (sizeof (th)),
+      .type = es->type
+    };
 
-  return GNUNET_PQ_event_listen (pg->conn,
-                                 es,
-                                 timeout,
-                                 cb,
-                                 cb_cls);
+    et = GNUNET_new (struct EventType);
+    et->pg = pg;
+    et->type = es->type;
+    et->eh = GNUNET_PQ_event_listen (pg->conn,
+                                     &th,
+                                     GNUNET_TIME_UNIT_FOREVER_REL,
+                                     &event_type_cb,
+                                     et);
+    if (NULL == et->eh)
+    {
+      GNUNET_break (0);
+      GNUNET_free (et);
+      return NULL;
+    }
+    GNUNET_CONTAINER_DLL_insert (pg->et_head,
+                                 pg->et_tail,
+                                 et);
+  }
+  w = GNUNET_new (struct EventWaiter);
+  w->pg = pg;
+  w->cb = cb;
+  w->cb_cls = cb_cls;
+  GNUNET_CRYPTO_hash (es,
+                      ntohs (es->size),
+                      &w->key);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (
+                   pg->waiters,
+                   &w->key,
+                   w,
+                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  if (! GNUNET_TIME_relative_is_forever (timeout))
+    w->timeout_task = GNUNET_SCHEDULER_add_delayed (timeout,
+                                                    &waiter_timeout,
+                                                    w);
+  return (struct GNUNET_DB_EventHandler *) w;
 }
 
 
@@ -748,12 +1495,22 @@ postgres_event_listen (void *cls,
 static void
 postgres_event_listen_cancel (struct GNUNET_DB_EventHandler *eh)
 {
-  GNUNET_PQ_event_listen_cancel (eh);
+  struct EventWaiter *w = (struct EventWaiter *) eh;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (w->pg->waiters,
+                                                       &w->key,
+                                                       w));
+  if (NULL != w->timeout_task)
+    GNUNET_SCHEDULER_cancel (w->timeout_task);
+  GNUNET_free (w);
 }
 
 
 /**
- * Notify all that listen on @a es of an event.
+ * Notify all that listen on @a es of an event.  The notification is
+ * sent on the channel of the event type, with @a es prepended to
+ * @a extra so that the listeners can dispatch it.
  *
  * @param cls database context to use
  * @param es specification of the event to generate
@@ -767,11 +1524,26 @@ postgres_event_notify (void *cls,
                        size_t extra_size)
 {
   struct PostgresClosure *pg = cls;
-
-  return GNUNET_PQ_event_notify (pg->conn,
-                                 es,
-                                 extra,
-                                 extra_size);
+  struct GNUNET_DB_EventHeaderP th = {
+    .size = htons (sizeof (th)),
+    .type = es->type
+  };
+  size_t es_size = ntohs (es->size);
+  char *payload;
+
+  payload = GNUNET_malloc (es_size + extra_size);
+  memcpy (payload,
+          es,
+          es_size);
+  if (0 != extra_size)
+    memcpy (&payload[es_size],
+            extra,
+            extra_size);
+  GNUNET_PQ_event_notify (pg->conn,
+                          &th,
+                          payload,
+                          es_size + extra_size);
+  GNUNET_free (payload);
 }
 
 
@@ -807,14 +1579,143 @@ postgres_gc (void *cls,
   check_connection (pg);
   GNUNET_break (GNUNET_OK ==
                 postgres_preflight (pg));
-  qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                           "gc_accounts",
-                                           params);
+  qs = eval_non_select (pg,
+                        pg->conn,
+                        "gc_accounts",
+                        params);
   if (qs < 0)
     return qs;
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "gc_recdoc_pending_payments",
-                                             params2);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "gc_recdoc_pending_payments",
+                          params2);
+}
+
+
+/**
+ * Create the weekly partitions of challenge codes and IBAN inflows
+ * needed for the next #PARTITION_HORIZON and drop the expired ones.
+ * Creating and detaching partitions briefly locks the whole table,
+ * so this should only be done once per garbage collection period.
+ *
+ * @param cls closure
+ * @param expire_backups IBAN inflows executed before this time
+ *            should be garbage collected
+ * @return transaction status, on success the number of partitions
+ *         dropped
+ */
+static enum GNUNET_DB_QueryStatus
+postgres_maintain_partitions (void *cls,
+                              struct GNUNET_TIME_Absolute expire_backups)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_TIME_Absolute now = GNUNET_TIME_absolute_get ();
+  struct GNUNET_TIME_Relative horizon = PARTITION_HORIZON;
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_absolute_time (&now),
+    GNUNET_PQ_query_param_absolute_time (&expire_backups),
+    GNUNET_PQ_query_param_relative_time (&horizon),
+    GNUNET_PQ_query_param_end
+  };
+  uint32_t dropped;
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_uint32 ("dropped",
+                                  &dropped),
+    GNUNET_PQ_result_spec_end
+  };
+  enum GNUNET_DB_QueryStatus qs;
+
+  check_connection (pg);
+  GNUNET_break (GNUNET_OK ==
+                postgres_preflight (pg));
+  qs = eval_singleton_select (pg,
+                              pg->conn,
+                              "maintain_partitions",
+                              params,
+                              rs);
+  if (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT != qs)
+    return qs;
+  if (dropped > INT32_MAX)
+    dropped = INT32_MAX;
+  return (enum GNUNET_DB_QueryStatus) dropped;
+}
+
+
+/**
+ * Function called to perform one step of incremental "garbage
+ * collection" on the database.  Deletes at most @a limit expired
+ * rows from the default partition of challenge codes and from each
+ * other table, so that each statement only holds its locks briefly.
+ * Should be called repeatedly until it returns
+ * #GNUNET_DB_STATUS_SUCCESS_NO_RESULTS.
+ *
+ * @param cls closure
+ * @param expire_backups backups of accounts that expired before the
+ *            given time stamp (and IBAN inflows executed before it)
+ *            should be garbage collected
+ * @param expire_pending_payments payments still pending from since before
+ *            this value should be garbage collected
+ * @param limit maximum number of rows to delete per table
+ * @return transaction status, on success the number of rows deleted
+ */
+static enum GNUNET_DB_QueryStatus
+postgres_gc_batch (void *cls,
+                   struct GNUNET_TIME_Absolute expire_backups,
+                   struct GNUNET_TIME_Absolute expire_pending_payments,
+                   uint64_t limit)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_TIME_Absolute now = GNUNET_TIME_absolute_get ();
+  struct GNUNET_PQ_QueryParam params_now[] = {
+    GNUNET_PQ_query_param_absolute_time (&now),
+    GNUNET_PQ_query_param_uint64 (&limit),
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_QueryParam params_backups[] = {
+    GNUNET_PQ_query_param_absolute_time (&expire_backups),
+    GNUNET_PQ_query_param_uint64 (&limit),
+    GNUNET_PQ_query_param_end
+  };
+  struct GNUNET_PQ_QueryParam params_payments[] = {
+    GNUNET_PQ_query_param_absolute_time (&expire_pending_payments),
+    GNUNET_PQ_query_param_uint64 (&limit),
+    GNUNET_PQ_query_param_end
+  };
+  struct
+  {
+    const char *statement;
+    const struct GNUNET_PQ_QueryParam *params;
+  } steps[] = {
+    { "gc_challengecodes_batch", params_now },
+    { "gc_recdoc_pending_payments_batch", params_payments },
+    { "gc_challenge_pending_payments_batch", params_payments },
+    /* recovery documents and payments reference the account,
+       so they must go before the account itself */
+    { "gc_recoverydocuments_batch", params_backups },
+    { "gc_recdoc_payments_batch", params_backups },
+    { "gc_accounts_batch", params_backups },
+    { NULL, NULL }
+  };
+  unsigned long long total = 0;
+
+  check_connection (pg);
+  GNUNET_break (GNUNET_OK ==
+                postgres_preflight (pg));
+  for (unsigned int i = 0; NULL != steps[i].statement; i++)
+  {
+    enum GNUNET_DB_QueryStatus qs;
+
+    qs = eval_non_select (pg,
+                          pg->conn,
+                          steps[i].statement,
+                          steps[i].params);
+    if (qs < 0)
+      return qs;
+    total += (unsigned long long) qs;
+  }
+  if (total > INT32_MAX)
+    total = INT32_MAX;
+  return (enum GNUNET_DB_QueryStatus) total;
 }
 
 
@@ -844,213 +1745,70 @@ postgres_store_recovery_document (
   uint32_t *version)
 {
   struct PostgresClosure *pg = cls;
-  enum GNUNET_DB_QueryStatus qs;
-
-  check_connection (pg);
-  GNUNET_break (GNUNET_OK ==
-                postgres_preflight (pg));
-  for (unsigned int retry = 0; retry<MAX_RETRIES; retry++)
-  {
-    if (GNUNET_OK !=
-        begin_transaction (pg,
-                           "store_recovery_document"))
-    {
-      GNUNET_break (0);
-      return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-    }
-    /* get the current version and hash of the latest recovery document
-       for this account */
-    {
-      struct GNUNET_HashCode dh;
-      struct GNUNET_PQ_QueryParam params[] = {
-        GNUNET_PQ_query_param_auto_from_type (account_pub),
-        GNUNET_PQ_query_param_end
-      };
-      struct GNUNET_PQ_ResultSpec rs[] = {
-        GNUNET_PQ_result_spec_uint32 ("version",
-                                      version),
-        GNUNET_PQ_result_spec_auto_from_type ("recovery_data_hash",
-                                              &dh),
-        GNUNET_PQ_result_spec_end
-      };
-
-      qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                     "latest_recovery_version_select",
-                                                     params,
-                                                     rs);
-      switch (qs)
-      {
-      case GNUNET_DB_STATUS_HARD_ERROR:
-        GNUNET_break (0);
-        rollback (pg);
-        return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-      case GNUNET_DB_STATUS_SOFT_ERROR:
-        goto retry;
-      case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-        *version = 1;
-        break;
-      case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-        /* had an existing recovery_data, is it identical? */
-        if (0 == GNUNET_memcmp (&dh,
-                                recovery_data_hash))
-        {
-          /* Yes. Previous identical recovery data exists */
-          rollback (pg);
-          return ANASTASIS_DB_STORE_STATUS_NO_RESULTS;
-        }
-        (*version)++;
-        break;
-      default:
-        GNUNET_break (0);
-        rollback (pg);
-        return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-      }
-    }
-
-    /* First, check if account exists */
-    {
-      struct GNUNET_PQ_QueryParam params[] = {
-        GNUNET_PQ_query_param_auto_from_type (account_pub),
-        GNUNET_PQ_query_param_end
-      };
-      struct GNUNET_PQ_ResultSpec rs[] = {
-        GNUNET_PQ_result_spec_end
-      };
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (account_pub),
+    GNUNET_PQ_query_param_auto_from_type (account_sig),
+    GNUNET_PQ_query_param_auto_from_type (recovery_data_hash),
+    GNUNET_PQ_query_param_fixed_size (recovery_data,
+                                      recovery_data_size),
+    GNUNET_PQ_query_param_auto_from_type (payment_secret),
+    GNUNET_PQ_query_param_end
+  };
+  uint32_t status;
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_uint32 ("status",
+                                  &status),
+    GNUNET_PQ_result_spec_uint32 ("version",
+                                  version),
+    GNUNET_PQ_result_spec_end
+  };
 
-      qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                     "user_select",
-                                                     params,
-                                                     rs);
-    }
+  /* May run on a thread of a #ANASTASIS_DB_Pool, so failures are
+     only reported to the caller, which logs them on the scheduler
+     thread. */
+  check_connection (pg);
+  if (GNUNET_SYSERR ==
+      postgres_preflight (pg))
+    return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
+  /* The stored procedure runs as a single statement (and thus
+     transaction), so this only costs one round-trip. */
+  for (unsigned int retry = 0; retry<MAX_RETRIES; retry++)
+  {
+    enum GNUNET_DB_QueryStatus qs;
+
+    qs = eval_singleton_select (pg,
+                                pg->conn,
+                                "do_store_recovery_document",
+                                params,
+                                rs);
     switch (qs)
     {
     case GNUNET_DB_STATUS_HARD_ERROR:
-      rollback (pg);
       return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
     case GNUNET_DB_STATUS_SOFT_ERROR:
-      goto retry;
+      continue;
     case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-      rollback (pg);
-      return ANASTASIS_DB_STORE_STATUS_PAYMENT_REQUIRED;
+      return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
     case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-      /* handle interesting case below */
       break;
     }
-
-    {
-      uint32_t postcounter;
-
-      /* lookup if the user has enough uploads left and decrement */
-      {
-        struct GNUNET_PQ_QueryParam params[] = {
-          GNUNET_PQ_query_param_auto_from_type (account_pub),
-          GNUNET_PQ_query_param_auto_from_type (payment_secret),
-          GNUNET_PQ_query_param_end
-        };
-        struct GNUNET_PQ_ResultSpec rs[] = {
-          GNUNET_PQ_result_spec_uint32 ("post_counter",
-                                        &postcounter),
-          GNUNET_PQ_result_spec_end
-        };
-
-        qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                       "postcounter_select",
-                                                       params,
-                                                       rs);
-        switch (qs)
-        {
-        case GNUNET_DB_STATUS_HARD_ERROR:
-          rollback (pg);
-          return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-        case GNUNET_DB_STATUS_SOFT_ERROR:
-          goto retry;
-        case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-          rollback (pg);
-          return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-        case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-          break;
-        }
-      }
-
-      if (0 == postcounter)
-      {
-        rollback (pg);
-        return ANASTASIS_DB_STORE_STATUS_STORE_LIMIT_EXCEEDED;
-      }
-      /* Decrement the postcounter by one */
-      postcounter--;
-
-      /* Update the postcounter in the Database */
-      {
-        struct GNUNET_PQ_QueryParam params[] = {
-          GNUNET_PQ_query_param_uint32 (&postcounter),
-          GNUNET_PQ_query_param_auto_from_type (account_pub),
-          GNUNET_PQ_query_param_auto_from_type (payment_secret),
-          GNUNET_PQ_query_param_end
-        };
-
-        qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                                 "postcounter_update",
-                                                 params);
-        switch (qs)
-        {
-        case GNUNET_DB_STATUS_HARD_ERROR:
-          GNUNET_break (0);
-          rollback (pg);
-          return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-        case GNUNET_DB_STATUS_SOFT_ERROR:
-          goto retry;
-        case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-          GNUNET_break (0);
-          rollback (pg);
-          return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-        case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-          break;
-        default:
-          GNUNET_break (0);
-          rollback (pg);
-          return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-        }
-      }
-    }
-
-    /* finally, actually insert the recovery document */
+    switch (status)
     {
-      struct GNUNET_PQ_QueryParam params[] = {
-        GNUNET_PQ_query_param_auto_from_type (account_pub),
-        GNUNET_PQ_query_param_uint32 (version),
-        GNUNET_PQ_query_param_auto_from_type (account_sig),
-        GNUNET_PQ_query_param_auto_from_type (recovery_data_hash),
-        GNUNET_PQ_query_param_fixed_size (recovery_data,
-                                          recovery_data_size),
-        GNUNET_PQ_query_param_end
-      };
-
-      qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                               "recovery_document_insert",
-                                               params);
-      switch (qs)
-      {
-      case GNUNET_DB_STATUS_HARD_ERROR:
-        rollback (pg);
-        return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-      case GNUNET_DB_STATUS_SOFT_ERROR:
-        goto retry;
-      case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-        GNUNET_break (0);
-        rollback (pg);
-        return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-      case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-        qs = commit_transaction (pg);
-        if (GNUNET_DB_STATUS_SOFT_ERROR == qs)
-          goto retry;
-        if (qs < 0)
-          return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
-        return ANASTASIS_DB_STORE_STATUS_SUCCESS;
-      }
+    case 0:
+      return ANASTASIS_DB_STORE_STATUS_SUCCESS;
+    case 1:
+      /* Previous identical recovery data exists */
+      return ANASTASIS_DB_STORE_STATUS_NO_RESULTS;
+    case 2:
+      return ANASTASIS_DB_STORE_STATUS_PAYMENT_REQUIRED;
+    case 3:
+      return ANASTASIS_DB_STORE_STATUS_STORE_LIMIT_EXCEEDED;
+    case 4:
+      /* payment unknown */
+      return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
+    default:
+      return ANASTASIS_DB_STORE_STATUS_HARD_ERROR;
     }
-retry:
-    rollback (pg);
   }
   return ANASTASIS_DB_STORE_STATUS_SOFT_ERROR;
 }
@@ -1094,9 +1852,10 @@ postgres_increment_lifetime (
         GNUNET_PQ_query_param_auto_from_type (account_pub),
         GNUNET_PQ_query_param_end
       };
-      qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                               "recdoc_payment_done",
-                                               params);
+      qs = eval_non_select (pg,
+                            pg->conn,
+                            "recdoc_payment_done",
+                            params);
       switch (qs)
       {
       case GNUNET_DB_STATUS_HARD_ERROR:
@@ -1127,10 +1886,11 @@ postgres_increment_lifetime (
         GNUNET_PQ_result_spec_end
       };
 
-      qs2 = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                      "user_select",
-                                                      params,
-                                                      rs);
+      qs2 = eval_singleton_select (pg,
+                                   pg->conn,
+                                   "user_select",
+                                   params,
+                                   rs);
       switch (qs2)
       {
       case GNUNET_DB_STATUS_HARD_ERROR:
@@ -1159,9 +1919,10 @@ postgres_increment_lifetime (
           GNUNET_break (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us !=
                         expiration.abs_value_us);
           *paid_until = expiration;
-          qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                                   "user_insert",
-                                                   params);
+          qs = eval_non_select (pg,
+                                pg->conn,
+                                "user_insert",
+                                params);
         }
         break;
       case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
@@ -1190,9 +1951,10 @@ postgres_increment_lifetime (
           GNUNET_break (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us !=
                         expiration.abs_value_us);
           *paid_until = expiration;
-          qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                                   "user_update",
-                                                   params);
+          qs = eval_non_select (pg,
+                                pg->conn,
+                                "user_update",
+                                params);
         }
         break;
       }
@@ -1266,9 +2028,10 @@ postgres_update_lifetime (
         GNUNET_PQ_query_param_auto_from_type (account_pub),
         GNUNET_PQ_query_param_end
       };
-      qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                               "recdoc_payment_done",
-                                               params);
+      qs = eval_non_select (pg,
+                            pg->conn,
+                            "recdoc_payment_done",
+                            params);
       if (GNUNET_DB_STATUS_SOFT_ERROR == qs)
         goto retry;
       if (0 >= qs)
@@ -1295,10 +2058,11 @@ postgres_update_lifetime (
         GNUNET_PQ_result_spec_end
       };
 
-      qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                     "user_select",
-                                                     params,
-                                                     rs);
+      qs = eval_singleton_select (pg,
+                                  pg->conn,
+                                  "user_select",
+                                  params,
+                                  rs);
       switch (qs)
       {
       case GNUNET_DB_STATUS_HARD_ERROR:
@@ -1317,9 +2081,10 @@ postgres_update_lifetime (
 
           GNUNET_break (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us !=
                         eol.abs_value_us);
-          qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                                   "user_insert",
-                                                   params);
+          qs = eval_non_select (pg,
+                                pg->conn,
+                                "user_insert",
+                                params);
           GNUNET_log (GNUNET_ERROR_TYPE_INFO,
                       "Created new account %s with expiration %s\n",
                       TALER_B2S (account_pub),
@@ -1339,9 +2104,10 @@ postgres_update_lifetime (
                                                  eol);
           GNUNET_break (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us !=
                         expiration.abs_value_us);
-          qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                                   "user_update",
-                                                   params);
+          qs = eval_non_select (pg,
+                                pg->conn,
+                                "user_update",
+                                params);
           GNUNET_log (GNUNET_ERROR_TYPE_INFO,
                       "Updated account %s to new expiration %s\n",
                       TALER_B2S (account_pub),
@@ -1428,10 +2194,11 @@ postgres_record_recdoc_payment (
       GNUNET_PQ_result_spec_end
     };
 
-    qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "user_select",
-                                                   params,
-                                                   rs);
+    qs = eval_singleton_select (pg,
+                                pg->conn,
+                                "user_select",
+                                params,
+                                rs);
   }
   switch (qs)
   {
@@ -1451,9 +2218,10 @@ postgres_record_recdoc_payment (
         GNUNET_PQ_query_param_end
       };
 
-      qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                               "user_insert",
-                                               params);
+      qs = eval_non_select (pg,
+                            pg->conn,
+                            "user_insert",
+                            params);
       switch (qs)
       {
       case GNUNET_DB_STATUS_HARD_ERROR:
@@ -1480,9 +2248,10 @@ postgres_record_recdoc_payment (
     break;
   }
 
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "recdoc_payment_insert",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "recdoc_payment_insert",
+                          params);
 }
 
 
@@ -1512,9 +2281,10 @@ postgres_record_truth_upload_payment (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "truth_payment_insert",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "truth_payment_insert",
+                          params);
 }
 
 
@@ -1546,10 +2316,11 @@ postgres_check_truth_upload_paid (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "truth_payment_select",
-                                                   params,
-                                                   rs);
+  return eval_singleton_select (pg,
+                                pg->conn,
+                                "truth_payment_select",
+                                params,
+                                rs);
 }
 
 
@@ -1580,9 +2351,10 @@ postgres_record_challenge_payment (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "challenge_payment_insert",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "challenge_payment_insert",
+                          params);
 }
 
 
@@ -1608,9 +2380,10 @@ postgres_record_challenge_refund (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "challenge_refund_update",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "challenge_refund_update",
+                          params);
 }
 
 
@@ -1648,9 +2421,10 @@ postgres_record_auth_iban_payment (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "store_auth_iban_payment_details",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "store_auth_iban_payment_details",
+                          params);
 }
 
 
@@ -1771,11 +2545,12 @@ postgres_test_auth_iban_payment (
   enum GNUNET_DB_QueryStatus qs;
 
   check_connection (pg);
-  qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
-                                             "test_auth_iban_payment",
-                                             params,
-                                             &test_auth_cb,
-                                             &tic);
+  qs = eval_multi_select (pg,
+                          pg->conn,
+                          "test_auth_iban_payment",
+                          params,
+                          &test_auth_cb,
+                          &tic);
   if (qs < 0)
     return qs;
   return tic.qs;
@@ -1812,10 +2587,11 @@ postgres_get_last_auth_iban_payment_row (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "get_last_auth_iban_payment",
-                                                   params,
-                                                   rs);
+  return eval_singleton_select (pg,
+                                pg->conn,
+                                "get_last_auth_iban_payment",
+                                params,
+                                rs);
 }
 
 
@@ -1851,10 +2627,11 @@ postgres_check_challenge_payment (
   };
 
   check_connection (pg);
-  qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                 "challenge_payment_select",
-                                                 params,
-                                                 rs);
+  qs = eval_singleton_select (pg,
+                              pg->conn,
+                              "challenge_payment_select",
+                              params,
+                              rs);
   *paid = (0 != paid8);
   return qs;
 }
@@ -1894,10 +2671,11 @@ postgres_check_payment_identifier (
   enum GNUNET_DB_QueryStatus qs;
 
   check_connection (pg);
-  qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                 "recdoc_payment_select",
-                                                 params,
-                                                 rs);
+  qs = eval_singleton_select (pg,
+                              pg->conn,
+                              "recdoc_payment_select",
+                              params,
+                              rs);
 
   if (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT == qs)
   {
@@ -1953,9 +2731,10 @@ postgres_store_truth (
                                          truth_expiration);
   GNUNET_TIME_round_abs (&expiration);
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "truth_insert",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "truth_insert",
+                          params);
 }
 
 
@@ -1995,11 +2774,10 @@ postgres_get_escrow_challenge (
     GNUNET_PQ_result_spec_end
   };
 
-  check_connection (pg);
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "truth_select",
-                                                   params,
-                                                   rs);
+  return read_singleton_select (pg,
+                                "truth_select",
+                                params,
+                                rs);
 }
 
 
@@ -2028,11 +2806,10 @@ postgres_get_key_share (
     GNUNET_PQ_result_spec_end
   };
 
-  check_connection (pg);
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "key_share_select",
-                                                   params,
-                                                   rs);
+  return read_singleton_select (pg,
+                                "key_share_select",
+                                params,
+                                rs);
 }
 
 
@@ -2040,22 +2817,24 @@ postgres_get_key_share (
  * Check if an account exists, and if so, return the
  * current @a recovery_document_hash.
  *
- * @param cls closure
+ * @param pg the plugin-specific state
+ * @param use_replica true if the result may come from the replica
+ *        (and thus be slightly stale)
  * @param account_pub account identifier
  * @param[out] paid_until until when is the account paid up?
  * @param[out] recovery_data_hash set to hash of @a recovery document
  * @param[out] version set to the recovery policy version
  * @return transaction status
  */
-enum ANASTASIS_DB_AccountStatus
-postgres_lookup_account (
-  void *cls,
+static enum ANASTASIS_DB_AccountStatus
+lookup_account (
+  struct PostgresClosure *pg,
+  bool use_replica,
   const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
   struct GNUNET_TIME_Absolute *paid_until,
   struct GNUNET_HashCode *recovery_data_hash,
   uint32_t *version)
 {
-  struct PostgresClosure *pg = cls;
   struct GNUNET_PQ_QueryParam params[] = {
     GNUNET_PQ_query_param_auto_from_type (account_pub),
     GNUNET_PQ_query_param_end
@@ -2076,10 +2855,16 @@ postgres_lookup_account (
       GNUNET_PQ_result_spec_end
     };
 
-    qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "latest_recovery_version_select",
-                                                   params,
-                                                   rs);
+    qs = use_replica
+      ? read_singleton_select (pg,
+                               "latest_recovery_version_select",
+                               params,
+                               rs)
+      : eval_singleton_select (pg,
+                               pg->conn,
+                               "latest_recovery_version_select",
+                               params,
+                               rs);
   }
   switch (qs)
   {
@@ -2102,10 +2887,16 @@ postgres_lookup_account (
       GNUNET_PQ_result_spec_end
     };
 
-    qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "user_select",
-                                                   params,
-                                                   rs);
+    qs = use_replica
+      ? read_singleton_select (pg,
+                               "user_expiration_select",
+                               params,
+                               rs)
+      : eval_singleton_select (pg,
+                               pg->conn,
+                               "user_select",
+                               params,
+                               rs);
   }
   switch (qs)
   {
@@ -2131,6 +2922,67 @@ postgres_lookup_account (
 }
 
 
+/**
+ * Check if an account exists, and if so, return the
+ * current @a recovery_document_hash.  Always asks the primary,
+ * as the result is used to decide about updates.
+ *
+ * @param cls closure
+ * @param account_pub account identifier
+ * @param[out] paid_until until when is the account paid up?
+ * @param[out] recovery_data_hash set to hash of @a recovery document
+ * @param[out] version set to the recovery policy version
+ * @return transaction status
+ */
+static enum ANASTASIS_DB_AccountStatus
+postgres_lookup_account (
+  void *cls,
+  const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+  struct GNUNET_TIME_Absolute *paid_until,
+  struct GNUNET_HashCode *recovery_data_hash,
+  uint32_t *version)
+{
+  struct PostgresClosure *pg = cls;
+
+  return lookup_account (pg,
+                         false,
+                         account_pub,
+                         paid_until,
+                         recovery_data_hash,
+                         version);
+}
+
+
+/**
+ * Like #postgres_lookup_account(), but preferably asks the replica,
+ * so the result may be slightly stale.
+ *
+ * @param cls closure
+ * @param account_pub account identifier
+ * @param[out] paid_until until when is the account paid up?
+ * @param[out] recovery_data_hash set to hash of @a recovery document
+ * @param[out] version set to the recovery policy version
+ * @return transaction status
+ */
+static enum ANASTASIS_DB_AccountStatus
+postgres_lookup_account_readonly (
+  void *cls,
+  const struct ANASTASIS_CRYPTO_AccountPublicKeyP *account_pub,
+  struct GNUNET_TIME_Absolute *paid_until,
+  struct GNUNET_HashCode *recovery_data_hash,
+  uint32_t *version)
+{
+  struct PostgresClosure *pg = cls;
+
+  return lookup_account (pg,
+                         true,
+                         account_pub,
+                         paid_until,
+                         recovery_data_hash,
+                         version);
+}
+
+
 /**
  * Fetch latest recovery document for user.
  *
@@ -2174,10 +3026,10 @@ postgres_get_latest_recovery_document (
   check_connection (pg);
   GNUNET_break (GNUNET_OK ==
                 postgres_preflight (pg));
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "latest_recoverydocument_select",
-                                                   params,
-                                                   rs);
+  return read_singleton_select (pg,
+                                "latest_recoverydocument_select",
+                                params,
+                                rs);
 }
 
 
@@ -2220,11 +3072,10 @@ postgres_get_recovery_document (
     GNUNET_PQ_result_spec_end
   };
 
-  check_connection (pg);
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "recoverydocument_select",
-                                                   params,
-                                                   rs);
+  return read_singleton_select (pg,
+                                "recoverydocument_select",
+                                params,
+                                rs);
 }
 
 
@@ -2332,9 +3183,10 @@ check_valid_code (void *cls,
         };
         enum GNUNET_DB_QueryStatus qs;
 
-        qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                                 "challengecode_update_retry",
-                                                 params);
+        qs = eval_non_select (pg,
+                              pg->conn,
+                              "challengecode_update_retry",
+                              params);
         if (qs <= 0)
         {
           GNUNET_break (0);
@@ -2383,11 +3235,12 @@ postgres_verify_challenge_code (
   *satisfied = false;
   check_connection (pg);
   GNUNET_TIME_round_abs (&now);
-  qs = GNUNET_PQ_eval_prepared_multi_select (pg->conn,
-                                             "challengecode_select",
-                                             params,
-                                             &check_valid_code,
-                                             &cvc);
+  qs = eval_multi_select (pg,
+                          pg->conn,
+                          "challengecode_select",
+                          params,
+                          &check_valid_code,
+                          &cvc);
   if ( (qs < 0) ||
        (cvc.db_failure) )
     return ANASTASIS_DB_CODE_STATUS_HARD_ERROR;
@@ -2425,9 +3278,10 @@ postgres_mark_challenge_code_satisfied (
     GNUNET_PQ_query_param_end
   };
 
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "challengecode_set_satisfied",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "challengecode_set_satisfied",
+                          params);
 }
 
 
@@ -2460,10 +3314,11 @@ postgres_test_challenge_code_satisfied (
     GNUNET_PQ_result_spec_end
   };
 
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "challengecode_test_satisfied",
-                                                   params,
-                                                   rs);
+  return eval_singleton_select (pg,
+                                pg->conn,
+                                "challengecode_test_satisfied",
+                                params,
+                                rs);
 }
 
 
@@ -2497,10 +3352,11 @@ postgres_lookup_challenge_payment (
     GNUNET_PQ_result_spec_end
   };
 
-  return GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                   "challenge_pending_payment_select",
-                                                   params,
-                                                   rs);
+  return eval_singleton_select (pg,
+                                pg->conn,
+                                "challenge_pending_payment_select",
+                                params,
+                                rs);
 }
 
 
@@ -2526,9 +3382,10 @@ postgres_update_challenge_payment (
   };
 
   check_connection (pg);
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "challenge_payment_done",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "challenge_payment_done",
+                          params);
 }
 
 
@@ -2559,7 +3416,6 @@ postgres_create_challenge_code (
   uint64_t *code)
 {
   struct PostgresClosure *pg = cls;
-  enum GNUNET_DB_QueryStatus qs;
   struct GNUNET_TIME_Absolute now = GNUNET_TIME_absolute_get ();
   struct GNUNET_TIME_Absolute expiration_date;
   struct GNUNET_TIME_Absolute ex_rot;
@@ -2572,108 +3428,144 @@ postgres_create_challenge_code (
                                           rotation_period);
   for (unsigned int retries = 0; retries<MAX_RETRIES; retries++)
   {
-    if (GNUNET_OK !=
-        begin_transaction (pg,
-                           "create_challenge_code"))
+    uint64_t fresh_code;
+    uint32_t old_retry_counter;
+    struct GNUNET_PQ_QueryParam params[] = {
+      GNUNET_PQ_query_param_auto_from_type (truth_uuid),
+      GNUNET_PQ_query_param_uint64 (&fresh_code),
+      TALER_PQ_query_param_absolute_time (&now),
+      TALER_PQ_query_param_absolute_time (&ex_rot),
+      TALER_PQ_query_param_absolute_time (&expiration_date),
+      GNUNET_PQ_query_param_uint32 (&retry_counter),
+      GNUNET_PQ_query_param_end
+    };
+    struct GNUNET_PQ_ResultSpec rs[] = {
+      GNUNET_PQ_result_spec_uint64 ("code",
+                                    code),
+      GNUNET_PQ_result_spec_uint32 ("retry_counter",
+                                    &old_retry_counter),
+      GNUNET_PQ_result_spec_absolute_time ("retransmission_date",
+                                           retransmission_date),
+      GNUNET_PQ_result_spec_end
+    };
+    enum GNUNET_DB_QueryStatus qs;
+
+    /* Used by the stored procedure only if there is no
+       active challenge code yet. */
+    fresh_code = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                           NONCE_MAX_VALUE);
+    qs = eval_singleton_select (pg,
+                                pg->conn,
+                                "do_create_challenge_code",
+                                params,
+                                rs);
+    switch (qs)
     {
+    case GNUNET_DB_STATUS_HARD_ERROR:
+      GNUNET_break (0);
+      return qs;
+    case GNUNET_DB_STATUS_SOFT_ERROR:
+      continue;
+    case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
       GNUNET_break (0);
       return GNUNET_DB_STATUS_HARD_ERROR;
+    case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
+      break;
     }
-
+    if (0 == old_retry_counter)
     {
-      uint32_t old_retry_counter;
-      struct GNUNET_PQ_QueryParam params[] = {
-        GNUNET_PQ_query_param_auto_from_type (truth_uuid),
-        TALER_PQ_query_param_absolute_time (&now),
-        TALER_PQ_query_param_absolute_time (&ex_rot),
-        GNUNET_PQ_query_param_end
-      };
-      struct GNUNET_PQ_ResultSpec rs[] = {
-        GNUNET_PQ_result_spec_uint64 ("code",
-                                      code),
-        GNUNET_PQ_result_spec_uint32 ("retry_counter",
-                                      &old_retry_counter),
-        GNUNET_PQ_result_spec_absolute_time ("retransmission_date",
-                                             retransmission_date),
-        GNUNET_PQ_result_spec_end
-      };
-      enum GNUNET_DB_QueryStatus qs;
-
-      qs = GNUNET_PQ_eval_prepared_singleton_select (pg->conn,
-                                                     "challengecode_select_meta",
-                                                     params,
-                                                     rs);
-      switch (qs)
-      {
-      case GNUNET_DB_STATUS_HARD_ERROR:
-        GNUNET_break (0);
-        rollback (pg);
-        return qs;
-      case GNUNET_DB_STATUS_SOFT_ERROR:
-        goto retry;
-      case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-        GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                    "No active challenge found, creating a fresh one\n");
-        break;
-      case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-        if (0 == old_retry_counter)
-        {
-          rollback (pg);
-          GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                      "Active challenge %llu has zero tries left, refusing to create another one\n",
-                      (unsigned long long) code);
-          return GNUNET_DB_STATUS_SUCCESS_NO_RESULTS;
-        }
-        rollback (pg);
-        GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                    "Active challenge has %u tries left, returning old challenge\n",
-                    (unsigned int) old_retry_counter);
-        return qs;
-      }
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  "Active challenge %llu has zero tries left, refusing to create another one\n",
+                  (unsigned long long) *code);
+      return GNUNET_DB_STATUS_SUCCESS_NO_RESULTS;
     }
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Challenge has %u tries left\n",
+                (unsigned int) old_retry_counter);
+    return GNUNET_DB_STATUS_SUCCESS_ONE_RESULT;
+  }
+  return GNUNET_DB_STATUS_SOFT_ERROR;
+}
 
-    *code = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_NONCE,
-                                      NONCE_MAX_VALUE);
-    *retransmission_date = GNUNET_TIME_UNIT_ZERO_ABS;
-    {
-      struct GNUNET_PQ_QueryParam params[] = {
-        GNUNET_PQ_query_param_auto_from_type (truth_uuid),
-        GNUNET_PQ_query_param_uint64 (code),
-        TALER_PQ_query_param_absolute_time (&now),
-        TALER_PQ_query_param_absolute_time (&expiration_date),
-        GNUNET_PQ_query_param_uint32 (&retry_counter),
-        GNUNET_PQ_query_param_end
-      };
 
-      qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                               "challengecode_insert",
-                                               params);
-      switch (qs)
-      {
-      case GNUNET_DB_STATUS_HARD_ERROR:
-        rollback (pg);
-        return GNUNET_DB_STATUS_HARD_ERROR;
-      case GNUNET_DB_STATUS_SOFT_ERROR:
-        goto retry;
-      case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
-        GNUNET_break (0);
-        rollback (pg);
-        return GNUNET_DB_STATUS_HARD_ERROR;
-      case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
-        GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                    "Created fresh challenge with %u tries left\n",
-                    (unsigned int) retry_counter);
-        break;
-      }
-    }
-    qs = commit_transaction (pg);
-    if (GNUNET_DB_STATUS_SOFT_ERROR == qs)
-      goto retry;
-    if (qs < 0)
+/**
+ * Count an attempt to answer a challenge for which we do not store
+ * real challenge codes against the retry counter.  Looks up (or
+ * creates) the active challenge code entry for the truth and
+ * decrements its retry counter in one statement.
+ *
+ * @param cls closure
+ * @param truth_uuid the identifier for the challenge
+ * @param rotation_period how long to count attempts against one entry
+ * @param validity_period for how long is the entry valid
+ * @param retry_counter amount of retries allowed per @a rotation_period
+ * @return transaction status,
+ *        #GNUNET_DB_STATUS_SUCCESS_NO_RESULTS if we are out of valid tries,
+ *        #GNUNET_DB_STATUS_SUCCESS_ONE_RESULT if the attempt was counted
+ */
+static enum GNUNET_DB_QueryStatus
+postgres_rate_limit (
+  void *cls,
+  const struct ANASTASIS_CRYPTO_TruthUUIDP *truth_uuid,
+  struct GNUNET_TIME_Relative rotation_period,
+  struct GNUNET_TIME_Relative validity_period,
+  uint32_t retry_counter)
+{
+  struct PostgresClosure *pg = cls;
+  struct GNUNET_TIME_Absolute now = GNUNET_TIME_absolute_get ();
+  struct GNUNET_TIME_Absolute expiration_date;
+  struct GNUNET_TIME_Absolute ex_rot;
+  /* Never checked, but the column must be filled; a random value
+     ensures it cannot be guessed either. */
+  uint64_t code = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                            NONCE_MAX_VALUE);
+  struct GNUNET_PQ_QueryParam params[] = {
+    GNUNET_PQ_query_param_auto_from_type (truth_uuid),
+    GNUNET_PQ_query_param_uint64 (&code),
+    TALER_PQ_query_param_absolute_time (&now),
+    TALER_PQ_query_param_absolute_time (&ex_rot),
+    TALER_PQ_query_param_absolute_time (&expiration_date),
+    GNUNET_PQ_query_param_uint32 (&retry_counter),
+    GNUNET_PQ_query_param_end
+  };
+  uint8_t limited;
+  struct GNUNET_PQ_ResultSpec rs[] = {
+    GNUNET_PQ_result_spec_auto_from_type ("limited",
+                                          &limited),
+    GNUNET_PQ_result_spec_end
+  };
+
+  check_connection (pg);
+  GNUNET_TIME_round_abs (&now);
+  expiration_date = GNUNET_TIME_absolute_add (now,
+                                              validity_period);
+  ex_rot = GNUNET_TIME_absolute_subtract (now,
+                                          rotation_period);
+  for (unsigned int retries = 0; retries<MAX_RETRIES; retries++)
+  {
+    enum GNUNET_DB_QueryStatus qs;
+
+    qs = eval_singleton_select (pg,
+                                pg->conn,
+                                "do_rate_limit",
+                                params,
+                                rs);
+    switch (qs)
+    {
+    case GNUNET_DB_STATUS_HARD_ERROR:
+      GNUNET_break (0);
       return qs;
+    case GNUNET_DB_STATUS_SOFT_ERROR:
+      continue;
+    case GNUNET_DB_STATUS_SUCCESS_NO_RESULTS:
+      GNUNET_break (0);
+      return GNUNET_DB_STATUS_HARD_ERROR;
+    case GNUNET_DB_STATUS_SUCCESS_ONE_RESULT:
+      break;
+    }
+    if (0 != limited)
+      return GNUNET_DB_STATUS_SUCCESS_NO_RESULTS;
     return GNUNET_DB_STATUS_SUCCESS_ONE_RESULT;
-retry:
-    rollback (pg);
   }
   return GNUNET_DB_STATUS_SOFT_ERROR;
 }
@@ -2709,9 +3601,10 @@ postgres_mark_challenge_sent (
 
     now = GNUNET_TIME_absolute_get ();
     GNUNET_TIME_round_abs (&now);
-    qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "challengecode_mark_sent",
-                                             params);
+    qs = eval_non_select (pg,
+                          pg->conn,
+                          "challengecode_mark_sent",
+                          params);
     if (qs <= 0)
       return qs;
   }
@@ -2722,9 +3615,10 @@ postgres_mark_challenge_sent (
       GNUNET_PQ_query_param_end
     };
 
-    qs = GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "challengepayment_dec_counter",
-                                             params);
+    qs = eval_non_select (pg,
+                          pg->conn,
+                          "challengepayment_dec_counter",
+                          params);
     if (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS == qs)
       return GNUNET_DB_STATUS_SUCCESS_ONE_RESULT; /* probably was free */
     return qs;
@@ -2750,9 +3644,10 @@ postgres_challenge_gc (void *cls)
   check_connection (pg);
   GNUNET_break (GNUNET_OK ==
                 postgres_preflight (pg));
-  return GNUNET_PQ_eval_prepared_non_select (pg->conn,
-                                             "gc_challengecodes",
-                                             params);
+  return eval_non_select (pg,
+                          pg->conn,
+                          "gc_challengecodes",
+                          params);
 }
 
 
@@ -2784,6 +3679,21 @@ libanastasis_plugin_db_postgres_init (void *cls)
     GNUNET_free (pg);
     return NULL;
   }
+  if (GNUNET_OK ==
+      GNUNET_CONFIGURATION_get_value_string (cfg,
+                                             "stasis-postgres",
+                                             "REPLICA_CONFIG",
+                                             &pg->replica_config))
+  {
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_time (cfg,
+                                             "stasis-postgres",
+                                             "MAX_REPLICA_LAG",
+                                             &pg->max_replica_lag))
+      pg->max_replica_lag = GNUNET_TIME_UNIT_SECONDS;
+  }
+  pg->waiters = GNUNET_CONTAINER_multihashmap_create (16,
+                                                      GNUNET_NO);
   plugin = GNUNET_new (struct ANASTASIS_DatabasePlugin);
   plugin->cls = pg;
   /* FIXME: Should this be the same? */
@@ -2791,6 +3701,8 @@ libanastasis_plugin_db_postgres_init (void *cls)
   plugin->create_tables = &postgres_create_tables;
   plugin->drop_tables = &postgres_drop_tables;
   plugin->gc = &postgres_gc;
+  plugin->gc_batch = &postgres_gc_batch;
+  plugin->maintain_partitions = &postgres_maintain_partitions;
   plugin->preflight = &postgres_preflight;
   plugin->rollback = &rollback;
   plugin->commit = &commit_transaction;
@@ -2805,6 +3717,7 @@ libanastasis_plugin_db_postgres_init (void *cls)
   plugin->get_latest_recovery_document = &postgres_get_latest_recovery_document;
   plugin->get_recovery_document = &postgres_get_recovery_document;
   plugin->lookup_account = &postgres_lookup_account;
+  plugin->lookup_account_readonly = &postgres_lookup_account_readonly;
   plugin->check_payment_identifier = &postgres_check_payment_identifier;
   plugin->increment_lifetime = &postgres_increment_lifetime;
   plugin->update_lifetime = &postgres_update_lifetime;
@@ -2816,6 +3729,7 @@ libanastasis_plugin_db_postgres_init (void *cls)
   plugin->test_challenge_code_satisfied =
     &postgres_test_challenge_code_satisfied;
   plugin->create_challenge_code = &postgres_create_challenge_code;
+  plugin->rate_limit = &postgres_rate_limit;
   plugin->mark_challenge_sent = &postgres_mark_challenge_sent;
   plugin->challenge_gc = &postgres_challenge_gc;
   plugin->record_truth_upload_payment = &postgres_record_truth_upload_payment;
@@ -2844,8 +3758,26 @@ libanastasis_plugin_db_postgres_done (void *cls)
 {
   struct ANASTASIS_DatabasePlugin *plugin = cls;
   struct PostgresClosure *pg = plugin->cls;
+  struct EventType *et;
 
+  while (NULL != (et = pg->et_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pg->et_head,
+                                 pg->et_tail,
+                                 et);
+    GNUNET_PQ_event_listen_cancel (et->eh);
+    GNUNET_free (et);
+  }
+  GNUNET_break (0 ==
+                GNUNET_CONTAINER_multihashmap_size (pg->waiters));
+  GNUNET_CONTAINER_multihashmap_destroy (pg->waiters);
   GNUNET_PQ_disconnect (pg->conn);
+  if (NULL != pg->replica)
+    GNUNET_PQ_disconnect (pg->replica);
+  GNUNET_array_grow (pg->histograms,
+                     pg->histograms_len,
+                     0);
+  GNUNET_free (pg->replica_config);
   GNUNET_free (pg->currency);
   GNUNET_free (pg);
   GNUNET_free (plugin);
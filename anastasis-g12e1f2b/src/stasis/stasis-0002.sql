@@ -0,0 +1,168 @@
+--
+-- This file is part of Anastasis
+-- Copyright (C) 2021 Anastasis SARL SA
+--
+-- ANASTASIS is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- ANASTASIS is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- ANASTASIS; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('stasis-0002', NULL, NULL);
+
+
+CREATE OR REPLACE FUNCTION anastasis_do_store_recovery_document (
+  IN in_user_id BYTEA,
+  IN in_account_sig BYTEA,
+  IN in_recovery_data_hash BYTEA,
+  IN in_recovery_data BYTEA,
+  IN in_payment_identifier BYTEA,
+  OUT out_status INT4,
+  OUT out_version INT4)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  my_hash BYTEA;
+BEGIN
+  out_version=0;
+  -- Lock the account, serializing uploads for the same account.
+  PERFORM FROM anastasis_user
+    WHERE user_id=in_user_id
+    FOR UPDATE;
+  IF NOT FOUND
+  THEN
+    -- Account unknown
+    out_status=2;
+    RETURN;
+  END IF;
+
+  SELECT version
+        ,recovery_data_hash
+    INTO out_version
+        ,my_hash
+    FROM anastasis_recoverydocument
+    WHERE user_id=in_user_id
+    ORDER BY version DESC
+    LIMIT 1;
+  IF FOUND
+  THEN
+    IF my_hash=in_recovery_data_hash
+    THEN
+      -- Identical to the latest version, nothing to do
+      out_status=1;
+      RETURN;
+    END IF;
+    out_version=out_version+1;
+  ELSE
+    out_version=1;
+  END IF;
+
+  UPDATE anastasis_recdoc_payment
+    SET post_counter=post_counter-1
+    WHERE user_id=in_user_id
+      AND payment_identifier=in_payment_identifier
+      AND post_counter > 0;
+  IF NOT FOUND
+  THEN
+    PERFORM FROM anastasis_recdoc_payment
+      WHERE user_id=in_user_id
+        AND payment_identifier=in_payment_identifier;
+    IF FOUND
+    THEN
+      -- Upload limit of the payment exhausted
+      out_status=3;
+    ELSE
+      -- Payment unknown
+      out_status=4;
+    END IF;
+    RETURN;
+  END IF;
+
+  INSERT INTO anastasis_recoverydocument
+    (user_id
+    ,version
+    ,account_sig
+    ,recovery_data_hash
+    ,recovery_data
+    ) VALUES
+    (in_user_id
+    ,out_version
+    ,in_account_sig
+    ,in_recovery_data_hash
+    ,in_recovery_data);
+  out_status=0;
+END $$;
+
+COMMENT ON FUNCTION anastasis_do_store_recovery_document(BYTEA, BYTEA, BYTEA, BYTEA, BYTEA)
+  IS 'Stores a new version of the recovery document of an account, charging the upload to the given payment. Status is 0 on success, 1 if the document is identical to the latest version, 2 if the account is unknown, 3 if the payment has no uploads left and 4 if the payment is unknown';
+
+
+CREATE OR REPLACE FUNCTION anastasis_do_create_challenge_code (
+  IN in_truth_uuid BYTEA,
+  IN in_code INT8,
+  IN in_now INT8,
+  IN in_rotation_start INT8,
+  IN in_expiration_date INT8,
+  IN in_retry_counter INT4,
+  OUT out_code INT8,
+  OUT out_retry_counter INT4,
+  OUT out_retransmission_date INT8)
+LANGUAGE plpgsql
+AS $$
+BEGIN
+  -- Lock the truth, serializing challenge creation for it.
+  PERFORM FROM anastasis_truth
+    WHERE truth_uuid=in_truth_uuid
+    FOR NO KEY UPDATE;
+
+  SELECT code
+        ,retry_counter
+        ,retransmission_date
+    INTO out_code
+        ,out_retry_counter
+        ,out_retransmission_date
+    FROM anastasis_challengecode
+    WHERE truth_uuid=in_truth_uuid
+      AND expiration_date > in_now
+      AND creation_date > in_rotation_start
+    ORDER BY creation_date DESC
+    LIMIT 1;
+  IF FOUND
+  THEN
+    -- Return active challenge
+    RETURN;
+  END IF;
+
+  INSERT INTO anastasis_challengecode
+    (truth_uuid
+    ,code
+    ,creation_date
+    ,expiration_date
+    ,retry_counter
+    ) VALUES
+    (in_truth_uuid
+    ,in_code
+    ,in_now
+    ,in_expiration_date
+    ,in_retry_counter);
+  out_code=in_code;
+  out_retry_counter=in_retry_counter;
+  out_retransmission_date=0;
+END $$;
+
+COMMENT ON FUNCTION anastasis_do_create_challenge_code(BYTEA, INT8, INT8, INT8, INT8, INT4)
+  IS 'Returns the active challenge code of a truth, creating one with the given code if there is none';
+
+
+-- Complete transaction
+COMMIT;
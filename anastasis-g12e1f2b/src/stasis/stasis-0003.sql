@@ -0,0 +1,91 @@
+--
+-- This file is part of Anastasis
+-- Copyright (C) 2021 Anastasis SARL SA
+--
+-- ANASTASIS is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- ANASTASIS is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- ANASTASIS; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('stasis-0003', NULL, NULL);
+
+
+
+CREATE OR REPLACE FUNCTION anastasis_do_rate_limit (
+  IN in_truth_uuid BYTEA,
+  IN in_code INT8,
+  IN in_now INT8,
+  IN in_rotation_start INT8,
+  IN in_expiration_date INT8,
+  IN in_retry_counter INT4,
+  OUT out_limited BOOLEAN)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  my_creation_date INT8;
+  my_retry_counter INT4;
+BEGIN
+  -- Lock the truth, serializing attempts for it.
+  PERFORM FROM anastasis_truth
+    WHERE truth_uuid=in_truth_uuid
+    FOR NO KEY UPDATE;
+
+  SELECT creation_date
+        ,retry_counter
+    INTO my_creation_date
+        ,my_retry_counter
+    FROM anastasis_challengecode
+    WHERE truth_uuid=in_truth_uuid
+      AND expiration_date > in_now
+      AND creation_date > in_rotation_start
+    ORDER BY creation_date DESC
+    LIMIT 1;
+  IF NOT FOUND
+  THEN
+    -- Start a new period, already counting this attempt.
+    INSERT INTO anastasis_challengecode
+      (truth_uuid
+      ,code
+      ,creation_date
+      ,expiration_date
+      ,retry_counter
+      ) VALUES
+      (in_truth_uuid
+      ,in_code
+      ,in_now
+      ,in_expiration_date
+      ,in_retry_counter - 1);
+    out_limited=FALSE;
+    RETURN;
+  END IF;
+
+  IF 0 = my_retry_counter
+  THEN
+    out_limited=TRUE;
+    RETURN;
+  END IF;
+
+  UPDATE anastasis_challengecode
+    SET retry_counter=retry_counter - 1
+    WHERE truth_uuid=in_truth_uuid
+      AND creation_date=my_creation_date;
+  out_limited=FALSE;
+END $$;
+
+COMMENT ON FUNCTION anastasis_do_rate_limit(BYTEA, INT8, INT8, INT8, INT8, INT4)
+  IS 'Counts an attempt against the active challenge code of a truth (creating one if needed) and returns whether the attempt must be rejected because the retry counter is exhausted';
+
+
+-- Complete transaction
+COMMIT;
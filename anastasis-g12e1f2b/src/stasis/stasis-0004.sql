@@ -0,0 +1,270 @@
+--
+-- This file is part of Anastasis
+-- Copyright (C) 2021 Anastasis SARL SA
+--
+-- ANASTASIS is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- ANASTASIS is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- ANASTASIS; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('stasis-0004', NULL, NULL);
+
+
+
+-- Challenge codes and IBAN inflows are partitioned by week of
+-- their expiration/execution date, so that garbage collection
+-- can drop whole partitions instead of deleting rows.  Rows for
+-- which no weekly partition exists go to the DEFAULT partition,
+-- which is garbage collected row by row.
+
+ALTER TABLE anastasis_challengecode
+  RENAME TO anastasis_challengecode_old;
+
+CREATE TABLE anastasis_challengecode
+  (truth_uuid BYTEA CHECK(LENGTH(truth_uuid)=32) NOT NULL,
+   code INT8 NOT NULL,
+   creation_date INT8 NOT NULL,
+   expiration_date INT8 NOT NULL,
+   retransmission_date INT8 NOT NULL DEFAULT 0,
+   retry_counter INT4 NOT NULL,
+   satisfied BOOLEAN NOT NULL DEFAULT FALSE)
+  PARTITION BY RANGE (expiration_date);
+COMMENT ON TABLE anastasis_challengecode
+  IS 'Stores a code which is checked for the authentication by SMS, E-Mail.., partitioned by week of the expiration date';
+COMMENT ON COLUMN anastasis_challengecode.truth_uuid
+  IS 'Link to the corresponding challenge which is solved';
+COMMENT ON COLUMN anastasis_challengecode.code
+  IS 'The pin code which is sent to the user and verified';
+COMMENT ON COLUMN anastasis_challengecode.creation_date
+  IS 'Creation date of the code';
+COMMENT ON COLUMN anastasis_challengecode.retransmission_date
+  IS 'When did we last transmit the challenge to the user';
+COMMENT ON COLUMN anastasis_challengecode.expiration_date
+  IS 'When will the code expire';
+COMMENT ON COLUMN anastasis_challengecode.retry_counter
+  IS 'How many tries are left for this code must be > 0';
+COMMENT ON COLUMN anastasis_challengecode.satisfied
+  IS 'Has this challenge been satisfied by the user, used if it is not enough for the user to know the code (like for video identification or SEPA authentication). For SMS/E-mail/Post verification, this field being FALSE does not imply that the user did not meet the challenge.';
+
+CREATE TABLE anastasis_challengecode_default
+  PARTITION OF anastasis_challengecode DEFAULT;
+
+INSERT INTO anastasis_challengecode
+  SELECT truth_uuid
+        ,code
+        ,creation_date
+        ,expiration_date
+        ,retransmission_date
+        ,retry_counter
+        ,satisfied
+    FROM anastasis_challengecode_old;
+DROP TABLE anastasis_challengecode_old;
+
+CREATE INDEX anastasis_challengecode_uuid_index
+  ON anastasis_challengecode
+  (truth_uuid,expiration_date);
+COMMENT ON INDEX anastasis_challengecode_uuid_index
+  IS 'for challenge lookup';
+
+CREATE INDEX anastasis_challengecode_expiration_index
+  ON anastasis_challengecode
+  (expiration_date);
+COMMENT ON INDEX anastasis_challengecode_expiration_index
+  IS 'for garbage collection of the default partition';
+
+
+ALTER TABLE anastasis_auth_iban_in
+  RENAME TO anastasis_auth_iban_in_old;
+
+-- Unique constraints must include the partition key, so the
+-- serial ID is only unique by virtue of its sequence.
+CREATE TABLE anastasis_auth_iban_in
+  (auth_in_serial_id BIGSERIAL
+  ,wire_reference INT8 NOT NULL
+  ,wire_subject TEXT NOT NULL
+  ,credit_val INT8 NOT NULL
+  ,credit_frac INT4 NOT NULL
+  ,debit_account_details TEXT NOT NULL
+  ,credit_account_details TEXT NOT NULL
+  ,execution_date INT8 NOT NULL
+  ,PRIMARY KEY (wire_reference, execution_date)
+  )
+  PARTITION BY RANGE (execution_date);
+COMMENT ON TABLE anastasis_auth_iban_in
+  IS 'list of IBAN wire transfers for authentication using the IBAN plugin, partitioned by week of the execution date';
+COMMENT ON COLUMN anastasis_auth_iban_in.wire_reference
+  IS 'Unique number identifying the wire transfer in LibEuFin/Nexus';
+COMMENT ON COLUMN anastasis_auth_iban_in.wire_subject
+  IS 'For authentication, this contains the code, but also additional text';
+COMMENT ON COLUMN anastasis_auth_iban_in.execution_date
+  IS 'Used both for garbage collection and to see if the transfer happened on time';
+COMMENT ON COLUMN anastasis_auth_iban_in.credit_account_details
+  IS 'Identifies the bank account of the Anastasis provider, which could change over time';
+COMMENT ON COLUMN anastasis_auth_iban_in.debit_account_details
+  IS 'Identifies the bank account of the customer, which must match what was given in the truth';
+
+CREATE TABLE anastasis_auth_iban_in_default
+  PARTITION OF anastasis_auth_iban_in DEFAULT;
+
+INSERT INTO anastasis_auth_iban_in
+  (auth_in_serial_id
+  ,wire_reference
+  ,wire_subject
+  ,credit_val
+  ,credit_frac
+  ,debit_account_details
+  ,credit_account_details
+  ,execution_date)
+  SELECT auth_in_serial_id
+        ,wire_reference
+        ,wire_subject
+        ,credit_val
+        ,credit_frac
+        ,debit_account_details
+        ,credit_account_details
+        ,execution_date
+    FROM anastasis_auth_iban_in_old;
+DROP TABLE anastasis_auth_iban_in_old;
+-- Continue numbering where the old table left off.
+SELECT setval(pg_get_serial_sequence('anastasis_auth_iban_in',
+                                     'auth_in_serial_id'),
+              COALESCE(MAX(auth_in_serial_id), 0) + 1,
+              FALSE)
+  FROM anastasis_auth_iban_in;
+
+CREATE INDEX anastasis_auth_iban_in_lookup_index
+  ON anastasis_auth_iban_in
+  (debit_account_details
+  ,execution_date
+  );
+
+
+CREATE OR REPLACE FUNCTION anastasis_create_weekly_partitions (
+  IN in_table TEXT,
+  IN in_column TEXT,
+  IN in_start INT8,
+  IN in_end INT8,
+  OUT out_created INT4)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  week CONSTANT INT8 = 604800000000;
+  my_week INT8;
+  my_name TEXT;
+  my_busy BOOLEAN;
+BEGIN
+  out_created=0;
+  FOR my_week IN (in_start / week) .. (in_end / week)
+  LOOP
+    my_name = in_table || '_w' || my_week;
+    CONTINUE WHEN to_regclass(my_name) IS NOT NULL;
+    -- A partition cannot be created if the default partition
+    -- already has rows in its range; those weeks stay in the
+    -- default partition.
+    EXECUTE format('SELECT EXISTS (SELECT 1 FROM %I WHERE %I >= $1 AND %I < $2)',
+                   in_table || '_default',
+                   in_column,
+                   in_column)
+      INTO my_busy
+      USING my_week * week, (my_week + 1) * week;
+    CONTINUE WHEN my_busy;
+    EXECUTE format('CREATE TABLE %I PARTITION OF %I FOR VALUES FROM (%s) TO (%s)',
+                   my_name,
+                   in_table,
+                   my_week * week,
+                   (my_week + 1) * week);
+    out_created=out_created + 1;
+  END LOOP;
+END $$;
+
+COMMENT ON FUNCTION anastasis_create_weekly_partitions(TEXT, TEXT, INT8, INT8)
+  IS 'Creates the missing weekly partitions of a table covering the given time range';
+
+
+CREATE OR REPLACE FUNCTION anastasis_drop_weekly_partitions (
+  IN in_table TEXT,
+  IN in_cutoff INT8,
+  OUT out_dropped INT4)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  week CONSTANT INT8 = 604800000000;
+  my_name TEXT;
+BEGIN
+  out_dropped=0;
+  FOR my_name IN
+    SELECT c.relname
+      FROM pg_inherits i
+      JOIN pg_class c
+        ON (c.oid = i.inhrelid)
+     WHERE i.inhparent = in_table::regclass
+       AND c.relname ~ ('^' || in_table || '_w[0-9]+$')
+  LOOP
+    CONTINUE WHEN (substring(my_name from '_w([0-9]+)$')::INT8 + 1) * week
+                  > in_cutoff;
+    EXECUTE format('ALTER TABLE %I DETACH PARTITION %I',
+                   in_table,
+                   my_name);
+    EXECUTE format('DROP TABLE %I',
+                   my_name);
+    out_dropped=out_dropped + 1;
+  END LOOP;
+END $$;
+
+COMMENT ON FUNCTION anastasis_drop_weekly_partitions(TEXT, INT8)
+  IS 'Drops the weekly partitions of a table that only cover times before the cutoff';
+
+
+CREATE OR REPLACE FUNCTION anastasis_maintain_partitions (
+  IN in_now INT8,
+  IN in_iban_cutoff INT8,
+  IN in_horizon INT8,
+  OUT out_dropped INT4)
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  my_last INT8;
+BEGIN
+  PERFORM anastasis_create_weekly_partitions ('anastasis_challengecode',
+                                              'expiration_date',
+                                              in_now,
+                                              in_now + in_horizon);
+  PERFORM anastasis_create_weekly_partitions ('anastasis_auth_iban_in',
+                                              'execution_date',
+                                              in_now,
+                                              in_now + in_horizon);
+  out_dropped = anastasis_drop_weekly_partitions ('anastasis_challengecode',
+                                                  in_now);
+  -- The latest inflow of each credit account tells the IBAN helper
+  -- where to resume, so never drop it.
+  SELECT MIN(last)
+    INTO my_last
+    FROM (SELECT MAX(execution_date) AS last
+            FROM anastasis_auth_iban_in
+           GROUP BY credit_account_details) AS latest;
+  IF my_last IS NOT NULL
+  THEN
+    out_dropped = out_dropped
+      + anastasis_drop_weekly_partitions ('anastasis_auth_iban_in',
+                                          LEAST (in_iban_cutoff,
+                                                 my_last));
+  END IF;
+END $$;
+
+COMMENT ON FUNCTION anastasis_maintain_partitions(INT8, INT8, INT8)
+  IS 'Creates the partitions needed until the given horizon and drops partitions of expired challenge codes and of IBAN inflows executed before the cutoff';
+
+
+-- Complete transaction
+COMMIT;
@@ -0,0 +1,52 @@
+--
+-- This file is part of Anastasis
+-- Copyright (C) 2021 Anastasis SARL SA
+--
+-- ANASTASIS is free software; you can redistribute it and/or modify it under the
+-- terms of the GNU General Public License as published by the Free Software
+-- Foundation; either version 3, or (at your option) any later version.
+--
+-- ANASTASIS is distributed in the hope that it will be useful, but WITHOUT ANY
+-- WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+-- A PARTICULAR PURPOSE.  See the GNU General Public License for more details.
+--
+-- You should have received a copy of the GNU General Public License along with
+-- ANASTASIS; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+--
+
+-- Everything in one big transaction
+BEGIN;
+
+-- Check patch versioning is in place.
+SELECT _v.register_patch('stasis-0005', NULL, NULL);
+
+
+-- Unique indices of a partitioned table must include the partition
+-- key.  The execution date of a wire transfer never changes, so
+-- the serial ID and the wire reference stay unique by themselves.
+CREATE UNIQUE INDEX anastasis_auth_iban_in_serial_index
+  ON anastasis_auth_iban_in
+  (auth_in_serial_id
+  ,execution_date
+  );
+COMMENT ON INDEX anastasis_auth_iban_in_serial_index
+  IS 'keeps the serial ID unique';
+
+
+-- Create the weekly partitions for the next four weeks right away,
+-- so that new rows do not go to the default partitions until the
+-- first garbage collection run.
+SELECT anastasis_create_weekly_partitions
+  ('anastasis_challengecode'
+  ,'expiration_date'
+  ,(EXTRACT(EPOCH FROM CURRENT_TIMESTAMP) * 1000000)::INT8
+  ,(EXTRACT(EPOCH FROM CURRENT_TIMESTAMP + INTERVAL '4 weeks') * 1000000)::INT8);
+SELECT anastasis_create_weekly_partitions
+  ('anastasis_auth_iban_in'
+  ,'execution_date'
+  ,(EXTRACT(EPOCH FROM CURRENT_TIMESTAMP) * 1000000)::INT8
+  ,(EXTRACT(EPOCH FROM CURRENT_TIMESTAMP + INTERVAL '4 weeks') * 1000000)::INT8);
+
+
+-- Complete transaction
+COMMIT;
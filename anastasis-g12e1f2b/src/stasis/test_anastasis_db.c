@@ -15,7 +15,7 @@
 */
 /**
  * @file anastasis/test_anastasis_db.c
- * @brief testcase for anastasis postgres db plugin
+ * @brief testcase for anastasis postgres db plugin and database thread pool
  * @author Marcello Stanisci
  * @author Christian Grothoff
  */
@@ -23,6 +23,7 @@
 #include "anastasis_database_lib.h"
 #include "anastasis_util_lib.h"
 #include <gnunet/gnunet_signatures.h>
+#include <pthread.h>
 
 
 #define FAILIF(cond)                            \
@@ -46,6 +47,269 @@ static int result;
  */
 static struct ANASTASIS_DatabasePlugin *plugin;
 
+/**
+ * Job submitted to the pool by the pool test.
+ */
+struct PoolTestJob
+{
+  /**
+   * Handle of the job, NULL once cancelled or done.
+   */
+  struct ANASTASIS_DB_PoolJob *job;
+
+  /**
+   * True if the work must wait for #pool_release.
+   */
+  bool gated;
+
+  /**
+   * Set once the work started.
+   */
+  bool started;
+
+  /**
+   * Set once the work is about to return.
+   */
+  bool ran;
+
+  /**
+   * Set if the plugin of the thread was usable.
+   */
+  bool ok;
+
+  /**
+   * Set once the done function was called.
+   */
+  bool done;
+};
+
+/**
+ * Pool under test.
+ */
+static struct ANASTASIS_DB_Pool *pool;
+
+/**
+ * Jobs of the pool test: one cancelled while running, one cancelled
+ * while pending, one cancelled after finishing and one completed.
+ */
+static struct PoolTestJob pool_jobs[4];
+
+/**
+ * Set to let gated jobs proceed.
+ */
+static bool pool_release;
+
+/**
+ * Protects the flags of #pool_jobs and #pool_release.
+ */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when flags of #pool_jobs or #pool_release change.
+ */
+static pthread_cond_t pool_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Task failing the pool test if it takes too long.
+ */
+static struct GNUNET_SCHEDULER_Task *pool_tt;
+
+
+/**
+ * Set @a flag and wake up waiters.
+ *
+ * @param[out] flag flag to set
+ */
+static void
+pool_set (bool *flag)
+{
+  GNUNET_assert (0 == pthread_mutex_lock (&pool_lock));
+  *flag = true;
+  GNUNET_assert (0 == pthread_cond_broadcast (&pool_cond));
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool_lock));
+}
+
+
+/**
+ * Wait until @a flag is set.
+ *
+ * @param flag flag to wait for
+ */
+static void
+pool_wait (const bool *flag)
+{
+  GNUNET_assert (0 == pthread_mutex_lock (&pool_lock));
+  while (! *flag)
+    GNUNET_assert (0 == pthread_cond_wait (&pool_cond,
+                                           &pool_lock));
+  GNUNET_assert (0 == pthread_mutex_unlock (&pool_lock));
+}
+
+
+/**
+ * Work of the jobs of the pool test, run on a thread of the pool.
+ *
+ * @param cls a `struct PoolTestJob`
+ * @param wplugin plugin of the thread
+ */
+static void
+pool_work (void *cls,
+           struct ANASTASIS_DatabasePlugin *wplugin)
+{
+  struct PoolTestJob *tj = cls;
+
+  pool_set (&tj->started);
+  if (tj->gated)
+  {
+    struct timespec req = {
+      .tv_nsec = 50 * 1000 * 1000
+    };
+
+    pool_wait (&pool_release);
+    /* keep running while the job is cancelled */
+    nanosleep (&req,
+               NULL);
+  }
+  tj->ok = (GNUNET_OK ==
+            wplugin->preflight (wplugin->cls));
+  pool_set (&tj->ran);
+}
+
+
+/**
+ * Done function of the jobs of the pool test.
+ *
+ * @param cls a `struct PoolTestJob`
+ */
+static void
+pool_done (void *cls);
+
+
+/**
+ * Check the outcome of the pool test, destroy the pool and the
+ * database.
+ *
+ * @param cls NULL
+ */
+static void
+finish_pool_test (void *cls)
+{
+  (void) cls;
+  if (NULL != pool_tt)
+  {
+    GNUNET_SCHEDULER_cancel (pool_tt);
+    pool_tt = NULL;
+  }
+  for (unsigned int i = 0; i<4; i++)
+    if (NULL != pool_jobs[i].job)
+    {
+      ANASTASIS_DB_pool_cancel (pool_jobs[i].job);
+      pool_jobs[i].job = NULL;
+    }
+  ANASTASIS_DB_pool_destroy (pool);
+  pool = NULL;
+  /* cancelled while running: waited for, but not done */
+  if ( (! pool_jobs[0].ran) ||
+       (pool_jobs[0].done) )
+    GNUNET_break (0);
+  /* cancelled while pending: never run */
+  else if ( (pool_jobs[1].started) ||
+            (pool_jobs[1].done) )
+    GNUNET_break (0);
+  /* cancelled after finishing: not done */
+  else if ( (! pool_jobs[2].ran) ||
+            (pool_jobs[2].done) )
+    GNUNET_break (0);
+  else if ( (! pool_jobs[3].ok) ||
+            (! pool_jobs[3].done) )
+    GNUNET_break (0);
+  else
+    result = 0;
+  GNUNET_break (GNUNET_OK ==
+                plugin->drop_tables (plugin->cls));
+  ANASTASIS_DB_plugin_unload (plugin);
+  plugin = NULL;
+}
+
+
+static void
+pool_done (void *cls)
+{
+  struct PoolTestJob *tj = cls;
+
+  tj->job = NULL;
+  tj->done = true;
+  GNUNET_SCHEDULER_add_now (&finish_pool_test,
+                            NULL);
+}
+
+
+/**
+ * The pool test took too long.
+ *
+ * @param cls NULL
+ */
+static void
+pool_timeout (void *cls)
+{
+  (void) cls;
+  pool_tt = NULL;
+  GNUNET_break (0);
+  finish_pool_test (NULL);
+}
+
+
+/**
+ * Submit job @a i of the pool test.
+ *
+ * @param i index into #pool_jobs
+ */
+static void
+pool_submit (unsigned int i)
+{
+  pool_jobs[i].job = ANASTASIS_DB_pool_submit (pool,
+                                               &pool_work,
+                                               &pool_done,
+                                               &pool_jobs[i]);
+}
+
+
+/**
+ * Test submitting, cancelling and completing jobs on a pool with a
+ * single thread.  Finishes from the scheduler.
+ *
+ * @param cfg configuration to use
+ * @return #GNUNET_OK if the test was started
+ */
+static enum GNUNET_GenericReturnValue
+start_pool_test (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  pool = ANASTASIS_DB_pool_create (cfg,
+                                   1);
+  if (NULL == pool)
+    return GNUNET_SYSERR;
+  pool_tt = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+                                          &pool_timeout,
+                                          NULL);
+  pool_jobs[0].gated = true;
+  pool_submit (0);
+  pool_submit (1);
+  /* job 1 cannot start before job 0 returned */
+  pool_wait (&pool_jobs[0].started);
+  ANASTASIS_DB_pool_cancel (pool_jobs[1].job);
+  pool_jobs[1].job = NULL;
+  pool_set (&pool_release);
+  ANASTASIS_DB_pool_cancel (pool_jobs[0].job);
+  pool_jobs[0].job = NULL;
+  /* the done function is queued, but must not be called */
+  pool_submit (2);
+  pool_wait (&pool_jobs[2].ran);
+  ANASTASIS_DB_pool_cancel (pool_jobs[2].job);
+  pool_jobs[2].job = NULL;
+  pool_submit (3);
+  return GNUNET_OK;
+}
+
 
 /**
  * Main function that will be run by the scheduler.
@@ -204,6 +468,12 @@ run (void *cls)
                                     &exp,
                                     &r,
                                     &vrs));
+    FAILIF (ANASTASIS_DB_ACCOUNT_STATUS_VALID_HASH_RETURNED !=
+            plugin->lookup_account_readonly (plugin->cls,
+                                             &accountPubP,
+                                             &exp,
+                                             &r,
+                                             &vrs));
   }
   FAILIF (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT !=
           plugin->get_key_share (plugin->cls,
@@ -288,8 +558,39 @@ run (void *cls)
                                            &r_code,
                                            &sat));
   }
-  if (-1 == result)
-    result = 0;
+  /* two tries left on the active code after the mismatch above */
+  FAILIF (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT !=
+          plugin->rate_limit (plugin->cls,
+                              &truth_uuid,
+                              GNUNET_TIME_UNIT_HOURS,
+                              GNUNET_TIME_UNIT_DAYS,
+                              3));
+  FAILIF (GNUNET_DB_STATUS_SUCCESS_ONE_RESULT !=
+          plugin->rate_limit (plugin->cls,
+                              &truth_uuid,
+                              GNUNET_TIME_UNIT_HOURS,
+                              GNUNET_TIME_UNIT_DAYS,
+                              3));
+  FAILIF (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS !=
+          plugin->rate_limit (plugin->cls,
+                              &truth_uuid,
+                              GNUNET_TIME_UNIT_HOURS,
+                              GNUNET_TIME_UNIT_DAYS,
+                              3));
+  /* partitions were created by the schema, none expired yet */
+  FAILIF (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS !=
+          plugin->maintain_partitions (plugin->cls,
+                                       GNUNET_TIME_UNIT_ZERO_ABS));
+  /* nothing expired yet, so incremental GC must not delete anything */
+  FAILIF (GNUNET_DB_STATUS_SUCCESS_NO_RESULTS !=
+          plugin->gc_batch (plugin->cls,
+                            GNUNET_TIME_UNIT_ZERO_ABS,
+                            GNUNET_TIME_UNIT_ZERO_ABS,
+                            16));
+  if (GNUNET_OK ==
+      start_pool_test (cfg))
+    return; /* drops the tables when done */
+  GNUNET_break (0);
 
 drop:
   GNUNET_break (GNUNET_OK ==
@@ -237,6 +237,7 @@ recover_secret_run (void *cls,
                                             rss->version,
                                             rss->anastasis_url,
                                             salt,
+                                            NULL,
                                             &policy_lookup_cb,
                                             rss,
                                             &core_secret_cb,
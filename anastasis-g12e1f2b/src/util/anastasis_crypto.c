@@ -44,6 +44,148 @@ ANASTASIS_hash_answer (uint64_t code,
 }
 
 
+/**
+ * Size of a SHA-1 input block in bytes.
+ */
+#define SHA1_BLOCK_SIZE 64
+
+/**
+ * Size of a SHA-1 digest in bytes.
+ */
+#define SHA1_DIGEST_SIZE 20
+
+
+/**
+ * Start a SHA-1 computation on the HMAC block of @a key padded
+ * with @a pad.
+ *
+ * @param key HMAC key, at most #SHA1_BLOCK_SIZE bytes
+ * @param key_size number of bytes in @a key
+ * @param pad 0x36 for the inner, 0x5c for the outer hash
+ * @return SHA-1 handle that has consumed the padded key block
+ */
+static gcry_md_hd_t
+hmac_sha1_pad (const uint8_t *key,
+               size_t key_size,
+               uint8_t pad)
+{
+  gcry_md_hd_t md;
+  uint8_t block[SHA1_BLOCK_SIZE];
+
+  memset (block,
+          pad,
+          sizeof (block));
+  for (size_t i = 0; i<key_size; i++)
+    block[i] ^= key[i];
+  GNUNET_assert (GPG_ERR_NO_ERROR ==
+                 gcry_md_open (&md,
+                               GCRY_MD_SHA1,
+                               0));
+  gcry_md_write (md,
+                 block,
+                 sizeof (block));
+  GNUNET_CRYPTO_zero_keys (block,
+                           sizeof (block));
+  return md;
+}
+
+
+/**
+ * Finish the SHA-1 computation of a copy of @a md after
+ * feeding it @a data.
+ *
+ * @param md SHA-1 handle to copy, left unchanged
+ * @param data data to hash
+ * @param data_size number of bytes in @a data
+ * @param[out] digest set to the resulting digest
+ */
+static void
+sha1_finish_copy (gcry_md_hd_t md,
+                  const void *data,
+                  size_t data_size,
+                  uint8_t digest[SHA1_DIGEST_SIZE])
+{
+  gcry_md_hd_t copy;
+  const unsigned char *mc;
+
+  GNUNET_assert (GPG_ERR_NO_ERROR ==
+                 gcry_md_copy (&copy,
+                               md));
+  gcry_md_write (copy,
+                 data,
+                 data_size);
+  mc = gcry_md_read (copy,
+                     GCRY_MD_SHA1);
+  GNUNET_assert (NULL != mc);
+  memcpy (digest,
+          mc,
+          SHA1_DIGEST_SIZE);
+  gcry_md_close (copy);
+}
+
+
+void
+ANASTASIS_CRYPTO_totp_window (const void *key,
+                              size_t key_size,
+                              struct GNUNET_TIME_Absolute start,
+                              struct GNUNET_TIME_Relative step,
+                              unsigned int num_codes,
+                              uint64_t *codes)
+{
+  uint8_t hkey[SHA1_DIGEST_SIZE];
+  gcry_md_hd_t inner;
+  gcry_md_hd_t outer;
+  uint64_t t;
+
+  if (key_size > SHA1_BLOCK_SIZE)
+  {
+    /* HMAC uses the hash of long keys */
+    gcry_md_hash_buffer (GCRY_MD_SHA1,
+                         hkey,
+                         key,
+                         key_size);
+    key = hkey;
+    key_size = sizeof (hkey);
+  }
+  /* The padded key blocks are hashed once here; each code then
+     only costs one compression for the counter and one for the
+     inner digest. */
+  inner = hmac_sha1_pad (key,
+                         key_size,
+                         0x36);
+  outer = hmac_sha1_pad (key,
+                         key_size,
+                         0x5c);
+  GNUNET_CRYPTO_zero_keys (hkey,
+                           sizeof (hkey));
+  t = start.abs_value_us / step.rel_value_us;
+  for (unsigned int i = 0; i<num_codes; i++)
+  {
+    uint64_t ctr = GNUNET_htonll (t + i);
+    uint8_t hmac[SHA1_DIGEST_SIZE];
+    uint32_t code = 0;
+    unsigned int offset;
+
+    sha1_finish_copy (inner,
+                      &ctr,
+                      sizeof (ctr),
+                      hmac);
+    sha1_finish_copy (outer,
+                      hmac,
+                      sizeof (hmac),
+                      hmac);
+    offset = hmac[sizeof (hmac) - 1] & 0x0f;
+    for (int count = 0; count < 4; count++)
+      code |= ((uint32_t) hmac[offset + 3 - count]) << (8 * count);
+    code &= 0x7fffffff;
+    /* always use 8 digits (maximum) */
+    codes[i] = code % 100000000;
+  }
+  gcry_md_close (inner);
+  gcry_md_close (outer);
+}
+
+
 void
 ANASTASIS_CRYPTO_secure_answer_hash (
   const char *answer,
@@ -426,6 +568,32 @@ ANASTASIS_CRYPTO_keyshare_create (
 }
 
 
+void
+ANASTASIS_CRYPTO_backup_digest (
+  const struct ANASTASIS_CRYPTO_UserIdentifierP *id,
+  const void *content,
+  size_t content_size,
+  struct GNUNET_HashCode *digest)
+{
+  struct GNUNET_CRYPTO_AuthKey key;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CRYPTO_kdf (&key,
+                                    sizeof (key),
+                                    /* salt / XTS */
+                                    "anastasis-backup-digest",
+                                    strlen ("anastasis-backup-digest"),
+                                    /* ikm */
+                                    id,
+                                    sizeof (*id),
+                                    NULL, 0));
+  GNUNET_CRYPTO_hmac (&key,
+                      content,
+                      content_size,
+                      digest);
+}
+
+
 void
 ANASTASIS_CRYPTO_policy_key_derive (
   const struct ANASTASIS_CRYPTO_KeyShareP *key_shares,
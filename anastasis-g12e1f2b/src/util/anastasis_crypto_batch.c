@@ -0,0 +1,449 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file util/anastasis_crypto_batch.c
+ * @brief compute memory-hard derivations in parallel on threads
+ * @author Christian Grothoff
+ *
+ * Each batch starts its own detached threads, which take jobs until
+ * none are left.  The last thread to finish wakes up the scheduler by
+ * writing to a pipe, or frees the batch if it was cancelled.  Results
+ * are only copied to the caller's memory from the scheduler, so a
+ * cancelled batch never writes to memory the caller may have freed.
+ */
+#include "platform.h"
+#include "anastasis_crypto_lib.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <pthread.h>
+
+
+/**
+ * Derivation to compute.
+ */
+struct PowJob
+{
+  /**
+   * Is this a user identifier (or an answer hash)?
+   */
+  bool user_identifier;
+
+  /**
+   * Details depending on @e user_identifier.
+   */
+  union
+  {
+
+    /**
+     * Derivation of a user identifier.
+     */
+    struct
+    {
+      /**
+       * Private copy of the identity attributes.
+       */
+      json_t *id_data;
+
+      /**
+       * Salt of the provider.
+       */
+      struct ANASTASIS_CRYPTO_ProviderSaltP server_salt;
+
+      /**
+       * Result computed by the thread.
+       */
+      struct ANASTASIS_CRYPTO_UserIdentifierP id;
+
+      /**
+       * Where to write @e id.
+       */
+      struct ANASTASIS_CRYPTO_UserIdentifierP *out;
+    } uid;
+
+    /**
+     * Hash of an answer to a security question.
+     */
+    struct
+    {
+      /**
+       * Copy of the answer.
+       */
+      char *answer;
+
+      /**
+       * UUID of the truth.
+       */
+      struct ANASTASIS_CRYPTO_TruthUUIDP uuid;
+
+      /**
+       * Salt of the question.
+       */
+      struct ANASTASIS_CRYPTO_QuestionSaltP salt;
+
+      /**
+       * Result computed by the thread.
+       */
+      struct GNUNET_HashCode result;
+
+      /**
+       * Where to write @e result.
+       */
+      struct GNUNET_HashCode *out;
+    } answer;
+
+  } details;
+};
+
+
+/**
+ * Batch of derivations.
+ */
+struct ANASTASIS_CRYPTO_PowBatch
+{
+  /**
+   * Array of @e jobs_length jobs.
+   */
+  struct PowJob *jobs;
+
+  /**
+   * Pipe used to wake up the scheduler once all jobs are done.
+   */
+  struct GNUNET_DISK_PipeHandle *notify;
+
+  /**
+   * Task reading from @e notify.
+   */
+  struct GNUNET_SCHEDULER_Task *notify_task;
+
+  /**
+   * Function to call once all jobs are done.
+   */
+  ANASTASIS_CRYPTO_PowBatchCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+
+  /**
+   * Protects @e next_job, @e active and @e cancelled.
+   */
+  pthread_mutex_t lock;
+
+  /**
+   * Length of the @e jobs array.
+   */
+  unsigned int jobs_length;
+
+  /**
+   * Index of the next job to take.
+   */
+  unsigned int next_job;
+
+  /**
+   * Number of threads still working on the batch, plus one while
+   * #ANASTASIS_CRYPTO_pow_batch_start() is starting them.
+   */
+  unsigned int active;
+
+  /**
+   * True if the batch was cancelled.
+   */
+  bool cancelled;
+};
+
+
+/**
+ * Free @a b and all of its jobs.
+ *
+ * @param[in] b batch to free
+ */
+static void
+free_batch (struct ANASTASIS_CRYPTO_PowBatch *b)
+{
+  for (unsigned int i = 0; i<b->jobs_length; i++)
+  {
+    struct PowJob *job = &b->jobs[i];
+
+    if (job->user_identifier)
+    {
+      json_decref (job->details.uid.id_data);
+      GNUNET_CRYPTO_zero_keys (&job->details.uid.id,
+                               sizeof (job->details.uid.id));
+    }
+    else
+    {
+      GNUNET_CRYPTO_zero_keys (job->details.answer.answer,
+                               strlen (job->details.answer.answer));
+      GNUNET_free (job->details.answer.answer);
+    }
+  }
+  GNUNET_array_grow (b->jobs,
+                     b->jobs_length,
+                     0);
+  if (NULL != b->notify)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_DISK_pipe_close (b->notify));
+  GNUNET_assert (0 == pthread_mutex_destroy (&b->lock));
+  GNUNET_free (b);
+}
+
+
+/**
+ * Take jobs of @a b until none are left.
+ *
+ * @param b batch to work on
+ */
+static void
+run_jobs (struct ANASTASIS_CRYPTO_PowBatch *b)
+{
+  GNUNET_assert (0 == pthread_mutex_lock (&b->lock));
+  while ( (! b->cancelled) &&
+          (b->next_job < b->jobs_length) )
+  {
+    struct PowJob *job = &b->jobs[b->next_job++];
+
+    GNUNET_assert (0 == pthread_mutex_unlock (&b->lock));
+    if (job->user_identifier)
+      ANASTASIS_CRYPTO_user_identifier_derive (job->details.uid.id_data,
+                                               &job->details.uid.server_salt,
+                                               &job->details.uid.id);
+    else
+      ANASTASIS_CRYPTO_secure_answer_hash (job->details.answer.answer,
+                                           &job->details.answer.uuid,
+                                           &job->details.answer.salt,
+                                           &job->details.answer.result);
+    GNUNET_assert (0 == pthread_mutex_lock (&b->lock));
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&b->lock));
+}
+
+
+/**
+ * Stop working on @a b.  The last one to stop either wakes up the
+ * scheduler or, if @a b was cancelled, frees it.
+ *
+ * @param b batch to stop working on
+ */
+static void
+release_batch (struct ANASTASIS_CRYPTO_PowBatch *b)
+{
+  static const char c = '!';
+  bool last;
+  bool cancelled;
+
+  GNUNET_assert (0 == pthread_mutex_lock (&b->lock));
+  last = (0 == --b->active);
+  cancelled = b->cancelled;
+  if (last && (! cancelled))
+  {
+    /* write while holding the lock, so that a concurrent cancel
+       cannot free the batch before we are done with it */
+    GNUNET_break (sizeof (c) ==
+                  GNUNET_DISK_file_write (
+                    GNUNET_DISK_pipe_handle (b->notify,
+                                             GNUNET_DISK_PIPE_END_WRITE),
+                    &c,
+                    sizeof (c)));
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&b->lock));
+  if (last && cancelled)
+    free_batch (b);
+}
+
+
+/**
+ * Main function of the threads of a batch.
+ *
+ * @param cls a `struct ANASTASIS_CRYPTO_PowBatch`
+ * @return NULL
+ */
+static void *
+batch_thread (void *cls)
+{
+  struct ANASTASIS_CRYPTO_PowBatch *b = cls;
+
+  run_jobs (b);
+  release_batch (b);
+  return NULL;
+}
+
+
+/**
+ * Copy the results of the finished batch to the caller and
+ * notify it.
+ *
+ * @param cls a `struct ANASTASIS_CRYPTO_PowBatch`
+ */
+static void
+batch_done (void *cls)
+{
+  struct ANASTASIS_CRYPTO_PowBatch *b = cls;
+
+  b->notify_task = NULL;
+  for (unsigned int i = 0; i<b->jobs_length; i++)
+  {
+    struct PowJob *job = &b->jobs[i];
+
+    if (job->user_identifier)
+      *job->details.uid.out = job->details.uid.id;
+    else
+      *job->details.answer.out = job->details.answer.result;
+  }
+  b->cb (b->cb_cls);
+  free_batch (b);
+}
+
+
+struct ANASTASIS_CRYPTO_PowBatch *
+ANASTASIS_CRYPTO_pow_batch_create (void)
+{
+  struct ANASTASIS_CRYPTO_PowBatch *b;
+
+  b = GNUNET_new (struct ANASTASIS_CRYPTO_PowBatch);
+  GNUNET_assert (0 == pthread_mutex_init (&b->lock,
+                                          NULL));
+  return b;
+}
+
+
+void
+ANASTASIS_CRYPTO_pow_batch_add_user_identifier (
+  struct ANASTASIS_CRYPTO_PowBatch *b,
+  const json_t *id_data,
+  const struct ANASTASIS_CRYPTO_ProviderSaltP *server_salt,
+  struct ANASTASIS_CRYPTO_UserIdentifierP *id)
+{
+  struct PowJob job = {
+    .user_identifier = true,
+    .details.uid.server_salt = *server_salt,
+    .details.uid.out = id
+  };
+
+  GNUNET_assert (0 == b->active);
+  /* the thread must not share reference counts with the caller */
+  job.details.uid.id_data = json_deep_copy (id_data);
+  GNUNET_assert (NULL != job.details.uid.id_data);
+  GNUNET_array_append (b->jobs,
+                       b->jobs_length,
+                       job);
+}
+
+
+void
+ANASTASIS_CRYPTO_pow_batch_add_answer_hash (
+  struct ANASTASIS_CRYPTO_PowBatch *b,
+  const char *answer,
+  const struct ANASTASIS_CRYPTO_TruthUUIDP *uuid,
+  const struct ANASTASIS_CRYPTO_QuestionSaltP *salt,
+  struct GNUNET_HashCode *result)
+{
+  struct PowJob job = {
+    .user_identifier = false,
+    .details.answer.answer = GNUNET_strdup (answer),
+    .details.answer.uuid = *uuid,
+    .details.answer.salt = *salt,
+    .details.answer.out = result
+  };
+
+  GNUNET_assert (0 == b->active);
+  GNUNET_array_append (b->jobs,
+                       b->jobs_length,
+                       job);
+}
+
+
+void
+ANASTASIS_CRYPTO_pow_batch_start (struct ANASTASIS_CRYPTO_PowBatch *b,
+                                  ANASTASIS_CRYPTO_PowBatchCallback cb,
+                                  void *cb_cls)
+{
+  pthread_attr_t attr;
+  long ncpu;
+  unsigned int num_threads;
+  unsigned int started = 0;
+
+  GNUNET_assert (0 == b->active);
+  b->cb = cb;
+  b->cb_cls = cb_cls;
+  b->notify = GNUNET_DISK_pipe (GNUNET_DISK_PF_NONE);
+  GNUNET_assert (NULL != b->notify);
+  b->notify_task = GNUNET_SCHEDULER_add_read_file (
+    GNUNET_TIME_UNIT_FOREVER_REL,
+    GNUNET_DISK_pipe_handle (b->notify,
+                             GNUNET_DISK_PIPE_END_READ),
+    &batch_done,
+    b);
+  ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+  num_threads = GNUNET_MIN (b->jobs_length,
+                            (ncpu > 0) ? (unsigned int) ncpu : 1);
+  /* our own reference keeps the batch alive while starting threads */
+  b->active = 1;
+  GNUNET_assert (0 == pthread_attr_init (&attr));
+  GNUNET_assert (0 ==
+                 pthread_attr_setdetachstate (&attr,
+                                              PTHREAD_CREATE_DETACHED));
+  for (unsigned int i = 0; i<num_threads; i++)
+  {
+    pthread_t thread;
+    int ret;
+
+    GNUNET_assert (0 == pthread_mutex_lock (&b->lock));
+    b->active++;
+    GNUNET_assert (0 == pthread_mutex_unlock (&b->lock));
+    ret = pthread_create (&thread,
+                          &attr,
+                          &batch_thread,
+                          b);
+    if (0 != ret)
+    {
+      errno = ret;
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "pthread_create");
+      GNUNET_assert (0 == pthread_mutex_lock (&b->lock));
+      b->active--;
+      GNUNET_assert (0 == pthread_mutex_unlock (&b->lock));
+      break;
+    }
+    started++;
+  }
+  GNUNET_assert (0 == pthread_attr_destroy (&attr));
+  if (0 == started)
+    run_jobs (b); /* no threads, compute on our own */
+  release_batch (b);
+}
+
+
+void
+ANASTASIS_CRYPTO_pow_batch_cancel (struct ANASTASIS_CRYPTO_PowBatch *b)
+{
+  bool idle;
+
+  if (NULL != b->notify_task)
+  {
+    GNUNET_SCHEDULER_cancel (b->notify_task);
+    b->notify_task = NULL;
+  }
+  GNUNET_assert (0 == pthread_mutex_lock (&b->lock));
+  b->cancelled = true;
+  idle = (0 == b->active);
+  GNUNET_assert (0 == pthread_mutex_unlock (&b->lock));
+  /* otherwise the last thread frees the batch */
+  if (idle)
+    free_batch (b);
+}
+
+
+/* end of anastasis_crypto_batch.c */
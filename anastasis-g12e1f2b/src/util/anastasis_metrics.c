@@ -0,0 +1,373 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file util/anastasis_metrics.c
+ * @brief latency histograms in the Prometheus text format
+ * @author Christian Grothoff
+ *
+ * Each power of two between 2^#MIN_SHIFT and 2^#MAX_SHIFT microseconds
+ * is split into two buckets, so recorded latencies are accurate to
+ * within 25%.  Buckets are updated with atomic increments, so database
+ * threads may record observations without taking a lock; only the
+ * registry of histograms is protected by a mutex.
+ */
+#include "platform.h"
+#include "anastasis_util_lib.h"
+#include <pthread.h>
+
+/**
+ * Upper bound of the first bucket is 2^MIN_SHIFT microseconds.
+ */
+#define MIN_SHIFT 6
+
+/**
+ * Observations beyond 2^MAX_SHIFT microseconds are only counted
+ * in the "+Inf" bucket.
+ */
+#define MAX_SHIFT 26
+
+/**
+ * Number of buckets with a finite upper bound.
+ */
+#define NUM_BUCKETS (1 + 2 * (MAX_SHIFT - MIN_SHIFT))
+
+
+/**
+ * Histograms sharing the same name.
+ */
+struct Family;
+
+
+/**
+ * Latency histogram.
+ */
+struct ANASTASIS_METRICS_Histogram
+{
+  /**
+   * Kept in DLL of the family.
+   */
+  struct ANASTASIS_METRICS_Histogram *next;
+
+  /**
+   * Kept in DLL of the family.
+   */
+  struct ANASTASIS_METRICS_Histogram *prev;
+
+  /**
+   * Labels of the series, "" for none.
+   */
+  char *labels;
+
+  /**
+   * Number of observations per bucket (not cumulative), the
+   * last entry counts observations beyond all finite bounds.
+   */
+  uint64_t counts[NUM_BUCKETS + 1];
+
+  /**
+   * Sum of all observations in microseconds.
+   */
+  uint64_t sum_us;
+};
+
+
+/**
+ * Histograms sharing the same name.
+ */
+struct Family
+{
+  /**
+   * Kept in DLL.
+   */
+  struct Family *next;
+
+  /**
+   * Kept in DLL.
+   */
+  struct Family *prev;
+
+  /**
+   * Head of histograms of this family.
+   */
+  struct ANASTASIS_METRICS_Histogram *h_head;
+
+  /**
+   * Tail of histograms of this family.
+   */
+  struct ANASTASIS_METRICS_Histogram *h_tail;
+
+  /**
+   * Name of the metric.
+   */
+  char *name;
+
+  /**
+   * Description of the metric.
+   */
+  char *help;
+};
+
+
+/**
+ * Protects #f_head, #f_tail and #registry.
+ */
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Head of all families.
+ */
+static struct Family *f_head;
+
+/**
+ * Tail of all families.
+ */
+static struct Family *f_tail;
+
+/**
+ * Map from hash of name and labels to histograms.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *registry;
+
+
+/**
+ * Compute the upper bound of bucket @a i.
+ *
+ * @param i bucket index, smaller than #NUM_BUCKETS
+ * @return upper bound in microseconds
+ */
+static uint64_t
+bucket_bound (unsigned int i)
+{
+  unsigned int shift;
+
+  if (0 == i)
+    return 1LLU << MIN_SHIFT;
+  shift = MIN_SHIFT + (i - 1) / 2;
+  if (0 == (i - 1) % 2)
+    return 3LLU << (shift - 1);
+  return 1LLU << (shift + 1);
+}
+
+
+/**
+ * Compute the bucket of an observation of @a us microseconds.
+ *
+ * @param us value to find the bucket for
+ * @return bucket index, #NUM_BUCKETS if beyond all finite bounds
+ */
+static unsigned int
+bucket_index (uint64_t us)
+{
+  uint64_t w;
+  unsigned int shift;
+
+  if (us <= (1LLU << MIN_SHIFT))
+    return 0;
+  /* bucket bounds are inclusive, so classify us - 1 */
+  w = us - 1;
+  shift = 63 - __builtin_clzll (w);
+  if (shift >= MAX_SHIFT)
+    return NUM_BUCKETS;
+  return 1 + 2 * (shift - MIN_SHIFT) + ((w >> (shift - 1)) & 1);
+}
+
+
+struct ANASTASIS_METRICS_Histogram *
+ANASTASIS_METRICS_histogram (const char *name,
+                             const char *help,
+                             const char *labels)
+{
+  struct GNUNET_HashContext *hctx;
+  struct GNUNET_HashCode key;
+  struct ANASTASIS_METRICS_Histogram *h;
+  struct Family *f;
+
+  if (NULL == labels)
+    labels = "";
+  hctx = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hctx,
+                                   name,
+                                   strlen (name) + 1);
+  GNUNET_CRYPTO_hash_context_read (hctx,
+                                   labels,
+                                   strlen (labels) + 1);
+  GNUNET_CRYPTO_hash_context_finish (hctx,
+                                     &key);
+  GNUNET_assert (0 == pthread_mutex_lock (&registry_lock));
+  if (NULL == registry)
+    registry = GNUNET_CONTAINER_multihashmap_create (64,
+                                                     GNUNET_NO);
+  h = GNUNET_CONTAINER_multihashmap_get (registry,
+                                         &key);
+  if (NULL != h)
+  {
+    GNUNET_assert (0 == pthread_mutex_unlock (&registry_lock));
+    return h;
+  }
+  for (f = f_head; NULL != f; f = f->next)
+    if (0 == strcmp (f->name,
+                     name))
+      break;
+  if (NULL == f)
+  {
+    f = GNUNET_new (struct Family);
+    f->name = GNUNET_strdup (name);
+    f->help = GNUNET_strdup (help);
+    GNUNET_CONTAINER_DLL_insert_tail (f_head,
+                                      f_tail,
+                                      f);
+  }
+  h = GNUNET_new (struct ANASTASIS_METRICS_Histogram);
+  h->labels = GNUNET_strdup (labels);
+  GNUNET_CONTAINER_DLL_insert_tail (f->h_head,
+                                    f->h_tail,
+                                    h);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (
+                   registry,
+                   &key,
+                   h,
+                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  GNUNET_assert (0 == pthread_mutex_unlock (&registry_lock));
+  return h;
+}
+
+
+void
+ANASTASIS_METRICS_observe (struct ANASTASIS_METRICS_Histogram *h,
+                           struct GNUNET_TIME_Relative duration)
+{
+  uint64_t us = duration.rel_value_us;
+
+  __atomic_fetch_add (&h->counts[bucket_index (us)],
+                      1,
+                      __ATOMIC_RELAXED);
+  __atomic_fetch_add (&h->sum_us,
+                      us,
+                      __ATOMIC_RELAXED);
+}
+
+
+/**
+ * Dump histogram @a h of family @a f to @a buf.
+ *
+ * @param[in,out] buf buffer to write to
+ * @param f family of @a h
+ * @param h histogram to dump
+ */
+static void
+dump_histogram (struct GNUNET_Buffer *buf,
+                const struct Family *f,
+                struct ANASTASIS_METRICS_Histogram *h)
+{
+  const char *sep = ('\0' == h->labels[0]) ? "" : ",";
+  uint64_t total = 0;
+
+  for (unsigned int i = 0; i<NUM_BUCKETS; i++)
+  {
+    total += __atomic_load_n (&h->counts[i],
+                              __ATOMIC_RELAXED);
+    GNUNET_buffer_write_fstr (buf,
+                              "%s_bucket{%s%sle=\"%.6f\"} %llu\n",
+                              f->name,
+                              h->labels,
+                              sep,
+                              bucket_bound (i) / 1000000.0,
+                              (unsigned long long) total);
+  }
+  total += __atomic_load_n (&h->counts[NUM_BUCKETS],
+                            __ATOMIC_RELAXED);
+  GNUNET_buffer_write_fstr (buf,
+                            "%s_bucket{%s%sle=\"+Inf\"} %llu\n",
+                            f->name,
+                            h->labels,
+                            sep,
+                            (unsigned long long) total);
+  GNUNET_buffer_write_fstr (buf,
+                            "%s_sum{%s} %.6f\n",
+                            f->name,
+                            h->labels,
+                            __atomic_load_n (&h->sum_us,
+                                             __ATOMIC_RELAXED) / 1000000.0);
+  GNUNET_buffer_write_fstr (buf,
+                            "%s_count{%s} %llu\n",
+                            f->name,
+                            h->labels,
+                            (unsigned long long) total);
+}
+
+
+char *
+ANASTASIS_METRICS_dump (void)
+{
+  struct GNUNET_Buffer buf = { 0 };
+
+  GNUNET_buffer_prealloc (&buf,
+                          4096);
+  GNUNET_assert (0 == pthread_mutex_lock (&registry_lock));
+  for (struct Family *f = f_head; NULL != f; f = f->next)
+  {
+    GNUNET_buffer_write_fstr (&buf,
+                              "# HELP %s %s\n"
+                              "# TYPE %s histogram\n",
+                              f->name,
+                              f->help,
+                              f->name);
+    for (struct ANASTASIS_METRICS_Histogram *h = f->h_head;
+         NULL != h;
+         h = h->next)
+      dump_histogram (&buf,
+                      f,
+                      h);
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&registry_lock));
+  return GNUNET_buffer_reap_str (&buf);
+}
+
+
+void
+ANASTASIS_METRICS_fini (void)
+{
+  struct Family *f;
+
+  while (NULL != (f = f_head))
+  {
+    struct ANASTASIS_METRICS_Histogram *h;
+
+    while (NULL != (h = f->h_head))
+    {
+      GNUNET_CONTAINER_DLL_remove (f->h_head,
+                                   f->h_tail,
+                                   h);
+      GNUNET_free (h->labels);
+      GNUNET_free (h);
+    }
+    GNUNET_CONTAINER_DLL_remove (f_head,
+                                 f_tail,
+                                 f);
+    GNUNET_free (f->name);
+    GNUNET_free (f->help);
+    GNUNET_free (f);
+  }
+  if (NULL != registry)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (registry);
+    registry = NULL;
+  }
+}
+
+
+/* end of anastasis_metrics.c */
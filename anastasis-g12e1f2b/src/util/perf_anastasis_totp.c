@@ -0,0 +1,152 @@
+/*
+  This file is part of Anastasis
+  Copyright (C) 2021 Anastasis SARL
+
+  Anastasis is free software; you can redistribute it and/or modify it under the
+  terms of the GNU Affero General Public License as published by the Free Software
+  Foundation; either version 3, or (at your option) any later version.
+
+  Anastasis is distributed in the hope that it will be useful, but WITHOUT ANY
+  WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR
+  A PARTICULAR PURPOSE.  See the GNU Affero General Public License for more details.
+
+  You should have received a copy of the GNU Affero General Public License along with
+  Anastasis; see the file COPYING.  If not, see <http://www.gnu.org/licenses/>
+*/
+/**
+ * @file util/perf_anastasis_totp.c
+ * @brief measure the cost of computing the TOTP codes of a window
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <gnunet/gnunet_util_lib.h>
+#include <gcrypt.h>
+#include "anastasis_crypto_lib.h"
+
+/**
+ * Number of windows to compute.
+ */
+#define ROUNDS (1024 * 16)
+
+/**
+ * Number of codes per window, as used by the TOTP plugin.
+ */
+#define WINDOW 5
+
+
+/**
+ * Compute the TOTP code of @a key for time step @a t the way the
+ * TOTP plugin used to, with a fresh HMAC handle per code.
+ *
+ * @param key input key material
+ * @param key_size number of bytes in @a key
+ * @param t time step to compute the code for
+ * @return TOTP code
+ */
+static uint64_t
+compute_totp (const void *key,
+              size_t key_size,
+              uint64_t t)
+{
+  uint64_t ctr = GNUNET_htonll (t);
+  gcry_md_hd_t md;
+  const unsigned char *mc;
+  uint32_t code = 0;
+  int offset;
+
+  GNUNET_assert (GPG_ERR_NO_ERROR ==
+                 gcry_md_open (&md,
+                               GCRY_MD_SHA1,
+                               GCRY_MD_FLAG_HMAC));
+  gcry_md_setkey (md,
+                  key,
+                  key_size);
+  gcry_md_write (md,
+                 &ctr,
+                 sizeof (ctr));
+  mc = gcry_md_read (md,
+                     GCRY_MD_SHA1);
+  GNUNET_assert (NULL != mc);
+  offset = mc[19] & 0x0f;
+  for (int count = 0; count < 4; count++)
+    code |= ((uint32_t) mc[offset + 3 - count]) << (8 * count);
+  gcry_md_close (md);
+  code &= 0x7fffffff;
+  return code % 100000000;
+}
+
+
+int
+main (int argc,
+      char *argv[])
+{
+  struct GNUNET_TIME_Relative step = GNUNET_TIME_relative_multiply (
+    GNUNET_TIME_UNIT_SECONDS,
+    30);
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative single;
+  struct GNUNET_TIME_Relative window;
+  char key[32];
+  uint64_t codes[WINDOW];
+  uint64_t t;
+
+  (void) argc;
+  GNUNET_log_setup (argv[0],
+                    "WARNING",
+                    NULL);
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              key,
+                              sizeof (key));
+  start = GNUNET_TIME_absolute_get ();
+  t = start.abs_value_us / step.rel_value_us;
+  ANASTASIS_CRYPTO_totp_window (key,
+                                sizeof (key),
+                                start,
+                                step,
+                                WINDOW,
+                                codes);
+  for (unsigned int i = 0; i<WINDOW; i++)
+    if (codes[i] !=
+        compute_totp (key,
+                      sizeof (key),
+                      t + i))
+    {
+      GNUNET_break (0);
+      return 1;
+    }
+
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int r = 0; r<ROUNDS; r++)
+    for (unsigned int i = 0; i<WINDOW; i++)
+      codes[i] = compute_totp (key,
+                               sizeof (key),
+                               t + i);
+  single = GNUNET_TIME_absolute_get_duration (start);
+
+  start = GNUNET_TIME_absolute_get ();
+  for (unsigned int r = 0; r<ROUNDS; r++)
+    ANASTASIS_CRYPTO_totp_window (key,
+                                  sizeof (key),
+                                  GNUNET_TIME_absolute_get (),
+                                  step,
+                                  WINDOW,
+                                  codes);
+  window = GNUNET_TIME_absolute_get_duration (start);
+
+  fprintf (stderr,
+           "%u windows of %u codes, one HMAC per code: %s\n",
+           ROUNDS,
+           WINDOW,
+           GNUNET_STRINGS_relative_time_to_string (single,
+                                                   GNUNET_YES));
+  fprintf (stderr,
+           "%u windows of %u codes, shared key schedule: %s\n",
+           ROUNDS,
+           WINDOW,
+           GNUNET_STRINGS_relative_time_to_string (window,
+                                                   GNUNET_YES));
+  return 0;
+}
+
+
+/* end of perf_anastasis_totp.c */
@@ -317,6 +317,242 @@ test_public_key_derive (void)
 }
 
 
+/**
+ * Testing TOTP codes against the test vectors of RFC 6238.
+ */
+static int
+test_totp_window (void)
+{
+  const char *key = "12345678901234567890";
+  struct GNUNET_TIME_Absolute start = {
+    .abs_value_us = 1111111109LLU * GNUNET_TIME_UNIT_SECONDS.rel_value_us
+  };
+  uint64_t codes[2];
+
+  ANASTASIS_CRYPTO_totp_window (key,
+                                strlen (key),
+                                start,
+                                GNUNET_TIME_relative_multiply (
+                                  GNUNET_TIME_UNIT_SECONDS,
+                                  30),
+                                2,
+                                codes);
+  if ( (7081804 != codes[0]) ||
+       (14050471 != codes[1]) )
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * Number of derivations of each kind in the batches we test.
+ */
+#define BATCH_SIZE 3
+
+/**
+ * Identity attributes for the batches.
+ */
+static json_t *batch_id_data[BATCH_SIZE];
+
+/**
+ * User identifiers computed by the batch that is completed.
+ */
+static struct ANASTASIS_CRYPTO_UserIdentifierP batch_ids[BATCH_SIZE];
+
+/**
+ * Answer hashes computed by the batch that is completed.
+ */
+static struct GNUNET_HashCode batch_hashes[BATCH_SIZE];
+
+/**
+ * Results of the batch that is cancelled, must never be written.
+ */
+static struct ANASTASIS_CRYPTO_UserIdentifierP cancelled_ids[BATCH_SIZE];
+
+/**
+ * Answer hashes of the batch that is cancelled, must never be written.
+ */
+static struct GNUNET_HashCode cancelled_hashes[BATCH_SIZE];
+
+/**
+ * Result of #test_pow_batch(), 0 on success.
+ */
+static int batch_ret = 1;
+
+
+/**
+ * Add the derivations of our test data to @a b.
+ *
+ * @param[in,out] b batch to add to
+ * @param[out] ids where to write the user identifiers
+ * @param[out] hashes where to write the answer hashes
+ */
+static void
+add_batch_jobs (struct ANASTASIS_CRYPTO_PowBatch *b,
+                struct ANASTASIS_CRYPTO_UserIdentifierP *ids,
+                struct GNUNET_HashCode *hashes)
+{
+  struct ANASTASIS_CRYPTO_ProviderSaltP server_salt;
+  struct ANASTASIS_CRYPTO_TruthUUIDP uuid;
+  struct ANASTASIS_CRYPTO_QuestionSaltP salt;
+
+  memset (&server_salt,
+          42,
+          sizeof (server_salt));
+  memset (&uuid,
+          43,
+          sizeof (uuid));
+  memset (&salt,
+          44,
+          sizeof (salt));
+  for (unsigned int i = 0; i<BATCH_SIZE; i++)
+  {
+    char answer[16];
+
+    GNUNET_snprintf (answer,
+                     sizeof (answer),
+                     "answer-%u",
+                     i);
+    ANASTASIS_CRYPTO_pow_batch_add_user_identifier (b,
+                                                    batch_id_data[i],
+                                                    &server_salt,
+                                                    &ids[i]);
+    ANASTASIS_CRYPTO_pow_batch_add_answer_hash (b,
+                                                answer,
+                                                &uuid,
+                                                &salt,
+                                                &hashes[i]);
+  }
+}
+
+
+/**
+ * The batch completed, check its results against the sequential
+ * derivations, and that the cancelled batch wrote nothing.
+ *
+ * @param cls NULL
+ */
+static void
+batch_done_cb (void *cls)
+{
+  struct ANASTASIS_CRYPTO_ProviderSaltP server_salt;
+  struct ANASTASIS_CRYPTO_TruthUUIDP uuid;
+  struct ANASTASIS_CRYPTO_QuestionSaltP salt;
+  struct ANASTASIS_CRYPTO_UserIdentifierP zero_id;
+  struct GNUNET_HashCode zero_hash;
+
+  (void) cls;
+  memset (&server_salt,
+          42,
+          sizeof (server_salt));
+  memset (&uuid,
+          43,
+          sizeof (uuid));
+  memset (&salt,
+          44,
+          sizeof (salt));
+  memset (&zero_id,
+          0,
+          sizeof (zero_id));
+  memset (&zero_hash,
+          0,
+          sizeof (zero_hash));
+  batch_ret = 0;
+  for (unsigned int i = 0; i<BATCH_SIZE; i++)
+  {
+    struct ANASTASIS_CRYPTO_UserIdentifierP id;
+    struct GNUNET_HashCode hash;
+    char answer[16];
+
+    GNUNET_snprintf (answer,
+                     sizeof (answer),
+                     "answer-%u",
+                     i);
+    ANASTASIS_CRYPTO_user_identifier_derive (batch_id_data[i],
+                                             &server_salt,
+                                             &id);
+    ANASTASIS_CRYPTO_secure_answer_hash (answer,
+                                         &uuid,
+                                         &salt,
+                                         &hash);
+    if ( (0 != GNUNET_memcmp (&id,
+                              &batch_ids[i])) ||
+         (0 != GNUNET_memcmp (&hash,
+                              &batch_hashes[i])) ||
+         (0 != GNUNET_memcmp (&zero_id,
+                              &cancelled_ids[i])) ||
+         (0 != GNUNET_memcmp (&zero_hash,
+                              &cancelled_hashes[i])) )
+    {
+      GNUNET_break (0);
+      batch_ret = 1;
+    }
+  }
+}
+
+
+/**
+ * Start a batch and cancel it while its threads are running, then
+ * run a batch to completion.
+ *
+ * @param cls NULL
+ */
+static void
+run_batches (void *cls)
+{
+  struct ANASTASIS_CRYPTO_PowBatch *b;
+
+  (void) cls;
+  b = ANASTASIS_CRYPTO_pow_batch_create ();
+  add_batch_jobs (b,
+                  cancelled_ids,
+                  cancelled_hashes);
+  ANASTASIS_CRYPTO_pow_batch_start (b,
+                                    &batch_done_cb,
+                                    NULL);
+  ANASTASIS_CRYPTO_pow_batch_cancel (b);
+  /* the identity attributes were copied, so the caller may
+     change them while the cancelled threads still run */
+  json_object_set_new (batch_id_data[0],
+                       "changed",
+                       json_true ());
+  b = ANASTASIS_CRYPTO_pow_batch_create ();
+  add_batch_jobs (b,
+                  batch_ids,
+                  batch_hashes);
+  ANASTASIS_CRYPTO_pow_batch_start (b,
+                                    &batch_done_cb,
+                                    NULL);
+}
+
+
+/**
+ * Testing batches of derivations computed on threads, including
+ * cancelling a batch while its threads run.
+ */
+static int
+test_pow_batch (void)
+{
+  for (unsigned int i = 0; i<BATCH_SIZE; i++)
+  {
+    batch_id_data[i] = json_object ();
+    GNUNET_assert (NULL != batch_id_data[i]);
+    GNUNET_assert (0 ==
+                   json_object_set_new (batch_id_data[i],
+                                        "index",
+                                        json_integer (i)));
+  }
+  GNUNET_SCHEDULER_run (&run_batches,
+                        NULL);
+  for (unsigned int i = 0; i<BATCH_SIZE; i++)
+    json_decref (batch_id_data[i]);
+  return batch_ret;
+}
+
+
 int
 main (int argc,
       const char *const argv[])
@@ -334,6 +570,10 @@ main (int argc,
     return 1;
   if (0 != test_public_key_derive ())
     return 1;
+  if (0 != test_totp_window ())
+    return 1;
+  if (0 != test_pow_batch ())
+    return 1;
   return 0;
 }
 